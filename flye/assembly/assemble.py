@@ -51,6 +51,11 @@ def assemble(args, run_params, out_file, log_file, config_path):
     cmdline.extend(["--kmer", str(run_params["kmer_size"])])
     if run_params["min_read_length"] > 0:
         cmdline.extend(["--min-read", str(run_params["min_read_length"])])
+    if args.trace:
+        cmdline.extend(["--trace", os.path.join(os.path.dirname(out_file),
+                                                "trace.json")])
+    if args.memory_limit:
+        cmdline.extend(["--memory-limit", str(args.memory_limit)])
     #if args.min_kmer_count is not None:
     #    cmdline.extend(["-m", str(args.min_kmer_count)])
     #if args.max_kmer_count is not None:
@@ -51,6 +51,10 @@ def analyse_repeats(args, run_params, input_assembly, out_folder,
         cmdline.append("--keep-haplotypes")
     cmdline.extend(["--min-ovlp", str(run_params["min_overlap"])])
     cmdline.extend(["--kmer", str(run_params["kmer_size"])])
+    if args.trace:
+        cmdline.extend(["--trace", os.path.join(out_folder, "trace.json")])
+    if args.memory_limit:
+        cmdline.extend(["--memory-limit", str(args.memory_limit)])
 
     try:
         logger.debug("Running: " + " ".join(cmdline))
@@ -64,20 +68,29 @@ def analyse_repeats(args, run_params, input_assembly, out_folder,
 
 
 def generate_contigs(args, run_params, graph_edges, out_folder,
-                    log_file, config_file, repeat_graph, reads_alignment):
+                    log_file, config_file, repeat_graph, reads_alignment,
+                    graph_snapshot=None):
     logger.debug("-----Begin contigger analyser log------")
 
-    cmdline = [CONTIGGER_BIN, "--graph-edges", graph_edges,
-               "--reads", ",".join(args.reads), "--out-dir", out_folder,
-               "--config", config_file, "--repeat-graph", repeat_graph,
-               "--graph-aln", reads_alignment, "--log", log_file,
-               "--threads", str(args.threads)]
+    cmdline = [CONTIGGER_BIN, "--reads", ",".join(args.reads),
+               "--out-dir", out_folder, "--config", config_file,
+               "--log", log_file, "--threads", str(args.threads)]
+    if graph_snapshot:
+        cmdline.extend(["--graph-snapshot", graph_snapshot])
+    else:
+        cmdline.extend(["--graph-edges", graph_edges,
+                        "--repeat-graph", repeat_graph,
+                        "--graph-aln", reads_alignment])
     if args.debug:
         cmdline.append("--debug")
     if args.keep_haplotypes:
         cmdline.append("--no-scaffold")
     cmdline.extend(["--min-ovlp", str(run_params["min_overlap"])])
     cmdline.extend(["--kmer", str(run_params["kmer_size"])])
+    if args.trace:
+        cmdline.extend(["--trace", os.path.join(out_folder, "trace.json")])
+    if args.memory_limit:
+        cmdline.extend(["--memory-limit", str(args.memory_limit)])
 
     try:
         logger.debug("Running: " + " ".join(cmdline))
@@ -41,6 +41,9 @@ vals = {
         "max_bubble_branches" : 50,
         "max_read_coverage" : 1000,
         "min_polish_aln_len" : 500,
+        #map reads and construct bubbles inside flye-polish
+        #(no intermediate SAM / bubbles files)
+        "native_polishing" : False,
 
         #final coverage filtering
         "relative_minimum_coverage" : 5,
@@ -52,14 +55,17 @@ vals = {
                 "hopo_matrix" : "config/bin_cfg/pacbio_homopolymers.mat",
                 "solid_missmatch" : 0.2,
                 "solid_indel" : 0.2,
-                "max_aln_error" : 0.25
+                "max_aln_error" : 0.25,
+                "hopo_correction" : False
             },
             "nano" : {
                 "subs_matrix" : "config/bin_cfg/nano_r94_substitutions.mat",
                 "hopo_matrix" : "config/bin_cfg/nano_r94_homopolymers.mat",
                 "solid_missmatch" : 0.3,
                 "solid_indel" : 0.3,
-                "max_aln_error" : 0.25
+                "max_aln_error" : 0.25,
+                #homopolymer length correction of the consensus
+                "hopo_correction" : True
             },
         },
 
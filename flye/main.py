@@ -177,6 +177,8 @@ class JobRepeat(Job):
                                                         "repeat_graph_edges.fasta")
         self.out_files["reads_alignment"] = os.path.join(self.work_dir,
                                                          "read_alignment_dump")
+        self.out_files["graph_snapshot"] = os.path.join(self.work_dir,
+                                                        "repeat_graph_snapshot")
         #self.out_files["repeats_dump"] = os.path.join(self.work_dir,
         #                                              "repeats_dump")
 
@@ -192,13 +194,14 @@ class JobRepeat(Job):
 
 class JobContigger(Job):
     def __init__(self, args, work_dir, log_file, repeat_graph_edges,
-                 repeat_graph, reads_alignment):
+                 repeat_graph, reads_alignment, graph_snapshot=None):
         super(JobContigger, self).__init__()
 
         self.args = args
         self.repeat_graph_edges = repeat_graph_edges
         self.repeat_graph = repeat_graph
         self.reads_alignment = reads_alignment
+        self.graph_snapshot = graph_snapshot
         self.log_file = log_file
         self.name = "contigger"
 
@@ -222,7 +225,8 @@ class JobContigger(Job):
         logger.info("Generating contigs")
         repeat.generate_contigs(self.args, Job.run_params, self.repeat_graph_edges,
                                 self.work_dir, self.log_file, self.args.asm_config,
-                                self.repeat_graph, self.reads_alignment)
+                                self.repeat_graph, self.reads_alignment,
+                                self.graph_snapshot)
 
 
 def _list_files(startpath, maxlevel=1):
@@ -360,7 +364,9 @@ class JobPolishing(Job):
         contigs, stats = \
             pol.polish(self.in_contigs, self.args.reads, self.polishing_dir,
                        self.args.num_iters, self.args.threads, self.args.platform,
-                       output_progress=True)
+                       output_progress=True, trace=self.args.trace,
+                       memory_limit=self.args.memory_limit,
+                       fast=self.args.fast_polish)
         #contigs = os.path.join(self.polishing_dir, "polished_1.fasta")
         #stats = os.path.join(self.polishing_dir, "contigs_stats.txt")
         pol.filter_by_coverage(self.args, stats, contigs,
@@ -450,6 +456,8 @@ def _create_job_list(args, work_dir, log_file):
     repeat_graph_edges = jobs[-1].out_files["repeat_graph_edges"]
     repeat_graph = jobs[-1].out_files["repeat_graph"]
     reads_alignment = jobs[-1].out_files["reads_alignment"]
+    #binary snapshot of the same graph, only valid until the graph is modified
+    graph_snapshot = jobs[-1].out_files["graph_snapshot"]
 
     #Trestle: Resolve Unbridged Repeats
     if not args.no_trestle and not args.meta and args.read_type == "raw":
@@ -458,6 +466,7 @@ def _create_job_list(args, work_dir, log_file):
                     reads_alignment))
         repeat_graph_edges = jobs[-1].out_files["repeat_graph_edges"]
         repeat_graph = jobs[-1].out_files["repeat_graph"]
+        graph_snapshot = None
 
     #Short plasmids
     if args.plasmids:
@@ -465,10 +474,11 @@ def _create_job_list(args, work_dir, log_file):
                                              repeat_graph, repeat_graph_edges))
         repeat_graph_edges = jobs[-1].out_files["repeat_graph_edges"]
         repeat_graph = jobs[-1].out_files["repeat_graph"]
+        graph_snapshot = None
 
     #Contigger
     jobs.append(JobContigger(args, work_dir, log_file, repeat_graph_edges,
-                             repeat_graph, reads_alignment))
+                             repeat_graph, reads_alignment, graph_snapshot))
     raw_contigs = jobs[-1].out_files["contigs"]
     scaffold_links = jobs[-1].out_files["scaffold_links"]
     graph_file = jobs[-1].out_files["assembly_graph"]
@@ -514,7 +524,8 @@ def _run_polisher_only(args):
 
     pol.polish(args.polish_target, args.reads, args.out_dir,
                args.num_iters, args.threads, args.platform,
-               output_progress=True)
+               output_progress=True, trace=args.trace,
+               memory_limit=args.memory_limit, fast=args.fast_polish)
 
 
 def _run(args):
@@ -601,7 +612,9 @@ def _usage():
             "\t     --genome-size SIZE --out-dir PATH\n\n"
             "\t     [--threads int] [--iterations int] [--min-overlap int]\n"
             "\t     [--meta] [--plasmids] [--no-trestle] [--polish-target]\n"
-            "\t     [--keep-haplotypes] [--debug] [--version] [--help] \n"
+            "\t     [--fast-polish]\n"
+            "\t     [--keep-haplotypes] [--debug] [--trace] [--memory-limit float]\n"
+            "\t     [--version] [--help] \n"
             "\t     [--resume] [--resume-from] [--stop-after]")
 
 
@@ -708,6 +721,11 @@ def main():
     parser.add_argument("--polish-target", dest="polish_target",
                         metavar="path", required=False,
                         help="run polisher on the target sequence")
+    parser.add_argument("--fast-polish", action="store_true",
+                        dest="fast_polish", default=False,
+                        help="subsample deep bubbles and stop consensus "
+                        "optimization early during polishing (faster, "
+                        "slightly less accurate)")
     parser.add_argument("--resume", action="store_true",
                         dest="resume", default=False,
                         help="resume from the last completed stage")
@@ -721,6 +739,14 @@ def main():
     parser.add_argument("--debug", action="store_true",
                         dest="debug", default=False,
                         help="enable debug output")
+    parser.add_argument("--trace", action="store_true",
+                        dest="trace", default=False,
+                        help="write performance traces (trace*.json) "
+                        "into the stage directories")
+    parser.add_argument("--memory-limit", dest="memory_limit", metavar="float",
+                        default=None, type=float,
+                        help="memory budget in Gb for the index, table and "
+                        "cache sizes [not set]")
     parser.add_argument("-v", "--version", action="version", version=_version())
     args = parser.parse_args()
 
@@ -49,7 +49,7 @@ def check_binaries():
 
 
 def polish(contig_seqs, read_seqs, work_dir, num_iters, num_threads, error_mode,
-           output_progress):
+           output_progress, trace=False, memory_limit=None, fast=False):
     """
     High-level polisher interface
     """
@@ -77,27 +77,46 @@ def polish(contig_seqs, read_seqs, work_dir, num_iters, num_threads, error_mode,
                                        CHUNK_SIZE)
         fp.write_fasta_dict(chunks, chunks_file)
 
-        ####
-        logger.info("Running minimap2")
-        alignment_file = os.path.join(work_dir, "minimap_{0}.sam".format(i + 1))
-        make_alignment(chunks_file, read_seqs, num_threads,
-                       work_dir, error_mode, alignment_file,
-                       reference_mode=True, sam_output=True)
-
-        #####
-        logger.info("Separating alignment into bubbles")
-        contigs_info = get_contigs_info(chunks_file)
-        bubbles_file = os.path.join(work_dir,
-                                    "bubbles_{0}.fasta".format(i + 1))
-        coverage_stats, mean_aln_error = \
-            make_bubbles(alignment_file, contigs_info, chunks_file,
-                         error_mode, num_threads,
-                         bubbles_file)
-
-        logger.info("Alignment error rate: %f", mean_aln_error)
         consensus_out = os.path.join(work_dir, "consensus_{0}.fasta".format(i + 1))
         polished_file = os.path.join(work_dir, "polished_{0}.fasta".format(i + 1))
-        if os.path.getsize(bubbles_file) == 0:
+        trace_file = (os.path.join(work_dir, "trace_{0}.json".format(i + 1))
+                      if trace else None)
+        if cfg.vals["native_polishing"]:
+            logger.info("Aligning reads and correcting bubbles")
+            aln_stats = os.path.join(work_dir, "aln_stats_{0}.txt".format(i + 1))
+            _run_polish_bin_native(chunks_file, read_seqs, error_mode, fast,
+                                   subs_matrix, hopo_matrix, consensus_out,
+                                   aln_stats, num_threads, output_progress,
+                                   trace_file, memory_limit)
+            coverage_stats, mean_aln_error = _read_aln_stats(aln_stats)
+            logger.info("Alignment error rate: %f", mean_aln_error)
+            os.remove(aln_stats)
+            intermediate_files = [chunks_file, consensus_out]
+            no_alignments = os.path.getsize(consensus_out) == 0
+        else:
+            ####
+            logger.info("Running minimap2")
+            alignment_file = os.path.join(work_dir, "minimap_{0}.sam".format(i + 1))
+            make_alignment(chunks_file, read_seqs, num_threads,
+                           work_dir, error_mode, alignment_file,
+                           reference_mode=True, sam_output=True)
+
+            #####
+            logger.info("Separating alignment into bubbles")
+            contigs_info = get_contigs_info(chunks_file)
+            bubbles_file = os.path.join(work_dir,
+                                        "bubbles_{0}.fasta".format(i + 1))
+            coverage_stats, mean_aln_error = \
+                make_bubbles(alignment_file, contigs_info, chunks_file,
+                             error_mode, num_threads,
+                             bubbles_file)
+
+            logger.info("Alignment error rate: %f", mean_aln_error)
+            intermediate_files = [chunks_file, bubbles_file,
+                                  consensus_out, alignment_file]
+            no_alignments = os.path.getsize(bubbles_file) == 0
+
+        if no_alignments:
             logger.info("No reads were aligned during polishing")
             if not output_progress:
                 logger.disabled = logger_state
@@ -105,19 +124,19 @@ def polish(contig_seqs, read_seqs, work_dir, num_iters, num_threads, error_mode,
             open(polished_file, "w")
             return polished_file, stats_file
 
-        #####
-        logger.info("Correcting bubbles")
-        _run_polish_bin(bubbles_file, subs_matrix, hopo_matrix,
-                        consensus_out, num_threads, output_progress)
+        if not cfg.vals["native_polishing"]:
+            #####
+            logger.info("Correcting bubbles")
+            _run_polish_bin(bubbles_file, error_mode, fast, subs_matrix,
+                            hopo_matrix, consensus_out, num_threads,
+                            output_progress, trace_file, memory_limit)
         polished_fasta, polished_lengths = _compose_sequence(consensus_out)
         merged_chunks = merge_chunks(polished_fasta)
         fp.write_fasta_dict(merged_chunks, polished_file)
 
         #Cleanup
-        os.remove(chunks_file)
-        os.remove(bubbles_file)
-        os.remove(consensus_out)
-        os.remove(alignment_file)
+        for filename in intermediate_files:
+            os.remove(filename)
 
         contig_lengths = polished_lengths
         prev_assembly = polished_file
@@ -262,16 +281,64 @@ def filter_by_coverage(args, stats_in, contigs_in, stats_out, contigs_out):
                     ctg_stats[ctg_id][0], ctg_stats[ctg_id][1]))
 
 
-def _run_polish_bin(bubbles_in, subs_matrix, hopo_matrix,
-                    consensus_out, num_threads, output_progress):
+def _polish_mode_options(error_mode, fast):
+    """
+    Optional consensus correction modes of the polishing binary
+    """
+    options = []
+    if fast:
+        options.append("--fast")
+    if cfg.vals["err_modes"][error_mode]["hopo_correction"]:
+        options.append("--hopo")
+    return options
+
+
+def _run_polish_bin(bubbles_in, error_mode, fast, subs_matrix, hopo_matrix,
+                    consensus_out, num_threads, output_progress,
+                    trace_file=None, memory_limit=None):
     """
     Invokes polishing binary
     """
     cmdline = [POLISH_BIN, "--bubbles", bubbles_in, "--subs-mat", subs_matrix,
                "--hopo-mat", hopo_matrix, "--out", consensus_out,
                "--threads", str(num_threads)]
+    cmdline.extend(_polish_mode_options(error_mode, fast))
+    if not output_progress:
+        cmdline.append("--quiet")
+    if trace_file:
+        cmdline.extend(["--trace", trace_file])
+    if memory_limit:
+        cmdline.extend(["--memory-limit", str(memory_limit)])
+
+    try:
+        subprocess.check_call(cmdline)
+    except subprocess.CalledProcessError as e:
+        if e.returncode == -9:
+            logger.error("Looks like the system ran out of memory")
+        raise PolishException(str(e))
+    except OSError as e:
+        raise PolishException(str(e))
+
+
+def _run_polish_bin_native(chunks_file, reads_files, error_mode, fast,
+                           subs_matrix, hopo_matrix, consensus_out, stats_out,
+                           num_threads, output_progress, trace_file=None,
+                           memory_limit=None):
+    """
+    Invokes polishing binary in the in-process alignment mode
+    """
+    cmdline = [POLISH_BIN, "--contigs", chunks_file,
+               "--reads", ",".join(reads_files), "--platform", error_mode,
+               "--subs-mat", subs_matrix, "--hopo-mat", hopo_matrix,
+               "--out", consensus_out, "--out-stats", stats_out,
+               "--threads", str(num_threads)]
+    cmdline.extend(_polish_mode_options(error_mode, fast))
     if not output_progress:
         cmdline.append("--quiet")
+    if trace_file:
+        cmdline.extend(["--trace", trace_file])
+    if memory_limit:
+        cmdline.extend(["--memory-limit", str(memory_limit)])
 
     try:
         subprocess.check_call(cmdline)
@@ -283,6 +350,25 @@ def _run_polish_bin(bubbles_in, subs_matrix, hopo_matrix,
         raise PolishException(str(e))
 
 
+def _read_aln_stats(stats_file):
+    """
+    Reads per-chunk coverage and alignment error rate,
+    produced by the polishing binary
+    """
+    coverage_stats = {}
+    sum_errors = 0
+    num_alignments = 0
+    with open(stats_file, "r") as f:
+        for line in f:
+            if line.startswith("#"): continue
+            tokens = line.strip().split("\t")
+            coverage_stats[tokens[0]] = int(tokens[1])
+            num_alignments += int(tokens[2])
+            sum_errors += int(tokens[2]) * float(tokens[3])
+
+    return coverage_stats, sum_errors / (num_alignments + 1)
+
+
 def _compose_sequence(consensus_file):
     """
     Concatenates bubbles consensuses into genome
@@ -0,0 +1,118 @@
+#!/usr/bin/env python
+
+#(c) 2019 by Authors
+#This file is a part of the Flye package.
+#Released under the BSD license (see LICENSE file)
+
+"""
+Runs the contigger on a tiny graph with read alignments that
+reference an edge which is no longer in the graph (as it happens
+after trestle removes edges, and the alignment dump is reloaded)
+"""
+
+
+from __future__ import print_function
+
+import os
+import sys
+import random
+import subprocess
+import shutil
+import tempfile
+from distutils.spawn import find_executable
+
+
+EDGE_LEN = 20000
+READ_LEN = 8000
+
+
+def _find_contigger():
+    script_dir = os.path.dirname(os.path.realpath(__file__))
+    local_bin = os.path.join(script_dir, "..", "..", "bin", "flye-contigger")
+    if os.path.isfile(local_bin):
+        return local_bin
+    return find_executable("flye-contigger")
+
+
+def _write_fasta(filename, records):
+    with open(filename, "w") as f:
+        for name, seq in records:
+            f.write(">{0}\n{1}\n".format(name, seq))
+
+
+def _aln_line(edge_id, read_name, read_begin, read_end, edge_name,
+              edge_begin, edge_end):
+    return ("\tAln\t{0}\t{1} {2} {3} {4} {5} {6} {7} {8} {9} {10} "
+            "{11} 0.05\n".format(edge_id, read_name, read_begin, read_end,
+                                 READ_LEN, edge_name, edge_begin, edge_end,
+                                 EDGE_LEN, -edge_begin,
+                                 EDGE_LEN - edge_end, read_end - read_begin))
+
+
+def test_missing_edge():
+    contigger = _find_contigger()
+    if not contigger:
+        sys.exit("flye-contigger is not installed!")
+
+    print("Running alignment loading test:\n")
+    script_dir = os.path.dirname(os.path.realpath(__file__))
+    config = os.path.join(script_dir, "..", "config", "bin_cfg",
+                          "asm_raw_reads.cfg")
+    work_dir = tempfile.mkdtemp()
+
+    random.seed(1)
+    edge_one = "".join(random.choice("ACGT") for _ in range(EDGE_LEN))
+    edge_two = "".join(random.choice("ACGT") for _ in range(EDGE_LEN))
+    read = edge_one[-READ_LEN // 2:] + edge_two[:READ_LEN // 2]
+
+    #edges 0 / 1 are in the graph, edges 4 / 5 were removed
+    _write_fasta(os.path.join(work_dir, "edges.fasta"),
+                 [("edge_1", edge_one), ("edge_3", edge_two)])
+    _write_fasta(os.path.join(work_dir, "reads.fasta"),
+                 [("read_0", read)])
+    with open(os.path.join(work_dir, "graph_dump"), "w") as f:
+        f.write("Edge\t0\t0\t1\t0\t0\t0\t10\t-1\n"
+                "\tSequence\t+edge_1 {0} 1 {0} 0 {0}\n".format(EDGE_LEN))
+        f.write("Edge\t1\t2\t3\t0\t0\t0\t10\t-1\n"
+                "\tSequence\t-edge_1 {0} -1 {0} 0 {0}\n".format(EDGE_LEN))
+
+    half = READ_LEN // 2
+    with open(os.path.join(work_dir, "aln_dump"), "w") as f:
+        f.write("Chain\n")
+        f.write(_aln_line(0, "+read_0", 0, half, "+edge_1",
+                          EDGE_LEN - half, EDGE_LEN))
+        f.write(_aln_line(4, "+read_0", half, READ_LEN, "+edge_3",
+                          0, half))
+        f.write("Chain\n")
+        f.write(_aln_line(5, "-read_0", 0, half, "-edge_3",
+                          EDGE_LEN - half, EDGE_LEN))
+        f.write(_aln_line(1, "-read_0", half, READ_LEN, "-edge_1",
+                          0, half))
+
+    try:
+        out_dir = os.path.join(work_dir, "out")
+        os.mkdir(out_dir)
+        subprocess.check_call([contigger, "--reads",
+                               os.path.join(work_dir, "reads.fasta"),
+                               "--graph-edges",
+                               os.path.join(work_dir, "edges.fasta"),
+                               "--repeat-graph",
+                               os.path.join(work_dir, "graph_dump"),
+                               "--graph-aln", os.path.join(work_dir, "aln_dump"),
+                               "--out-dir", out_dir, "--config", config,
+                               "--log", os.path.join(work_dir, "contigger.log"),
+                               "--threads", "1"])
+        if not os.path.getsize(os.path.join(out_dir, "contigs.fasta")):
+            sys.exit("No contigs were generated!")
+    finally:
+        shutil.rmtree(work_dir)
+    print("\nTEST SUCCESSFUL")
+
+
+def main():
+    test_missing_edge()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
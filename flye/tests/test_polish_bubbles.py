@@ -0,0 +1,150 @@
+#!/usr/bin/env python
+
+#(c) 2019 by Authors
+#This file is a part of the Flye package.
+#Released under the BSD license (see LICENSE file)
+
+"""
+Compares the bubbles constructed by flye-polish in the in-process
+alignment mode (in one batch and in many small batches) with
+the bubbles from the minimap2 SAM output and bubbles.py
+"""
+
+
+from __future__ import print_function
+
+import os
+import sys
+import random
+import subprocess
+import shutil
+import tempfile
+
+FLYE_ROOT = os.path.dirname(os.path.dirname(os.path.dirname(
+                            os.path.realpath(__file__))))
+sys.path.insert(0, FLYE_ROOT)
+os.environ["PATH"] = (os.path.join(FLYE_ROOT, "bin") + os.pathsep +
+                      os.environ["PATH"])
+
+import flye.utils.fasta_parser as fp
+from flye.polishing.alignment import (make_alignment, get_contigs_info,
+                                      split_into_chunks)
+from flye.polishing.bubbles import make_bubbles
+
+
+GENOME_LEN = 100000
+CHUNK_LEN = 25000
+READ_COVERAGE = 20
+ERROR_RATE = 0.1
+
+
+def _simulate_reads(genome, out_file):
+    total_len = 0
+    read_id = 0
+    with open(out_file, "w") as f:
+        while total_len < READ_COVERAGE * len(genome):
+            length = random.randint(2000, 10000)
+            start = random.randint(0, len(genome) - length)
+            read = genome[start : start + length]
+            if random.random() < 0.5:
+                read = fp.reverse_complement(read)
+
+            noisy = []
+            for nucl in read:
+                rnd = random.random()
+                if rnd < ERROR_RATE / 2:
+                    noisy.append(nucl + random.choice("ACGT"))
+                elif rnd < ERROR_RATE * 0.8:
+                    continue
+                elif rnd < ERROR_RATE:
+                    noisy.append(random.choice("ACGT"))
+                else:
+                    noisy.append(nucl)
+            f.write(">read_{0}\n{1}\n".format(read_id, "".join(noisy)))
+            total_len += length
+            read_id += 1
+
+
+def _read_bubbles(filename):
+    """
+    Bubbles indexed by (contig, position), the order of
+    branches within a bubble does not matter
+    """
+    bubbles = {}
+    with open(filename, "r") as f:
+        lines = f.read().splitlines()
+    pos = 0
+    while pos < len(lines):
+        header = lines[pos][1:].split()
+        num_branches = int(header[2])
+        branches = [lines[pos + 3 + 2 * i] for i in range(num_branches)]
+        bubbles[(header[0], int(header[1]))] = (lines[pos + 1],
+                                                sorted(branches))
+        pos += 2 + 2 * num_branches
+    return bubbles
+
+
+def _native_bubbles(chunks_file, reads_file, work_dir, out_bubbles,
+                    extra_args):
+    mat_dir = os.path.join(FLYE_ROOT, "flye", "config", "bin_cfg")
+    subprocess.check_call(["flye-polish", "--contigs", chunks_file,
+                           "--reads", reads_file, "--platform", "pacbio",
+                           "--subs-mat",
+                           os.path.join(mat_dir, "pacbio_substitutions.mat"),
+                           "--hopo-mat",
+                           os.path.join(mat_dir, "pacbio_homopolymers.mat"),
+                           "--out", os.path.join(work_dir, "consensus.fasta"),
+                           "--out-bubbles", out_bubbles, "--quiet"] +
+                          extra_args)
+    return _read_bubbles(out_bubbles)
+
+
+def test_native_bubbles():
+    print("Running bubbles comparison test:\n")
+    script_dir = os.path.dirname(os.path.realpath(__file__))
+    reference = fp.read_sequence_dict(os.path.join(script_dir, "data",
+                                                   "ecoli_500kb.fasta"))
+    genome = fp.to_acgt(list(reference.values())[0][:GENOME_LEN])
+    work_dir = tempfile.mkdtemp()
+
+    try:
+        random.seed(1)
+        reads_file = os.path.join(work_dir, "reads.fasta")
+        _simulate_reads(genome, reads_file)
+        chunks_file = os.path.join(work_dir, "chunks.fasta")
+        fp.write_fasta_dict(split_into_chunks({"contig_1": genome},
+                                              CHUNK_LEN), chunks_file)
+
+        sam_file = os.path.join(work_dir, "minimap.sam")
+        make_alignment(chunks_file, [reads_file], 1, work_dir, "pacbio",
+                       sam_file, reference_mode=True, sam_output=True)
+        sam_bubbles_file = os.path.join(work_dir, "bubbles_sam.fasta")
+        make_bubbles(sam_file, get_contigs_info(chunks_file), chunks_file,
+                     "pacbio", 1, sam_bubbles_file)
+        sam_bubbles = _read_bubbles(sam_bubbles_file)
+        if not sam_bubbles:
+            sys.exit("No bubbles were constructed!")
+
+        #default buffer: all chunks are in one batch; tiny buffer:
+        #one chunk per batch
+        for extra_args in [[], ["--aln-buffer", "0.00001"]]:
+            native_bubbles = \
+                _native_bubbles(chunks_file, reads_file, work_dir,
+                                os.path.join(work_dir, "bubbles_native.fasta"),
+                                extra_args)
+            if native_bubbles != sam_bubbles:
+                sys.exit("Bubbles are different from the SAM path ({0})"
+                         .format(" ".join(extra_args) or "single batch"))
+    finally:
+        shutil.rmtree(work_dir)
+
+    print("\nTEST SUCCESSFUL")
+
+
+def main():
+    test_native_bubbles()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
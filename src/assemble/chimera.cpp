@@ -11,6 +11,7 @@
 
 #include "../common/config.h"
 #include "../common/logger.h"
+#include "../common/quantile_sketch.h"
 #include "chimera.h"
 
 
@@ -19,11 +20,13 @@ bool ChimeraDetector::isChimeric(FastaRecord::Id readId)
 {
 	if (!_chimeras.contains(readId))
 	{
-		const auto& ovlps = _ovlpContainer.lazySeqOverlaps(readId);
-		bool result = this->testReadByCoverage(readId, ovlps) ||
+		auto coverage = _covProfiles.readCoverage(readId);
+		bool result = this->testReadByCoverage(*coverage) ||
 					  _ovlpContainer.hasSelfOverlaps(readId);
 		_chimeras.insert(readId, result);
 		_chimeras.insert(readId.rc(), result);
+		//the verdict is stored, so the profile is no longer needed
+		_covProfiles.release(readId);
 	}
 	return _chimeras.find(readId);
 }
@@ -34,7 +37,8 @@ bool ChimeraDetector::isChimeric(FastaRecord::Id readId,
 	const int JUMP = Config::get("maximum_jump");
 	if (!_chimeras.contains(readId))
 	{
-		bool result = this->testReadByCoverage(readId, readOvlps);
+		bool result = this->testReadByCoverage(_covProfiles
+												.readCoverage(readId, readOvlps));
 		for (const auto& ovlp : readOvlps)
 		{
 			if (ovlp.curId == ovlp.extId.rc()) 
@@ -64,8 +68,7 @@ void ChimeraDetector::estimateGlobalCoverage()
 	//				(int)Config::get("max_coverage_drop_rate");
 	int flankSize = 0;
 
-	std::unordered_map<int32_t, int32_t> readHist;
-	std::vector<int32_t> covList;
+	QuantileSketch covSketch;
 	
 	//std::ofstream fout("../cov_hist.txt");
 
@@ -74,8 +77,8 @@ void ChimeraDetector::estimateGlobalCoverage()
 	for (const auto& seq : _seqContainer.iterSeqs())
 	{
 		if (rand() % sampleRate) continue;
-		const auto& overlaps = _ovlpContainer.lazySeqOverlaps(seq.id);
-		auto coverage = this->getReadCoverage(seq.id, overlaps);
+		//the profiles are stored, and then reused by isChimeric()
+		const auto& coverage = *_covProfiles.readCoverage(seq.id);
 		bool nonZero = false;
 		for (auto c : coverage) nonZero |= (c != 0);
 		if (!nonZero) continue;
@@ -83,69 +86,30 @@ void ChimeraDetector::estimateGlobalCoverage()
 		for (size_t i = flankSize; i < coverage.size() - flankSize; ++i)
 		{
 			{
-				++readHist[coverage[i]];
+				covSketch.add(coverage[i]);
 				sum += coverage[i];
 				++num;
-				covList.push_back(coverage[i]);
 			}
 		}
 	}
 
-	if (readHist.empty())
+	if (covSketch.empty())
 	{
 		Logger::get().warning() << "No overlaps found!";
 		_overlapCoverage = 0;
 	}
 	else
 	{
-		_overlapCoverage = median(covList);
+		_overlapCoverage = std::lround(covSketch.median());
 	}
 
 	Logger::get().info() << "Overlap-based coverage: " << _overlapCoverage;
 }
 
-std::vector<int32_t> 
-	ChimeraDetector::getReadCoverage(FastaRecord::Id readId,
-									 const std::vector<OverlapRange>& readOverlaps)
-{
-	static const int WINDOW = Config::get("chimera_window");
-	//const int FLANK = (int)Config::get("maximum_overhang") / WINDOW;
-	const int FLANK = 1;
-
-	std::vector<int> coverage;
-	int numWindows = std::ceil((float)_seqContainer.seqLen(readId) / WINDOW) + 1;
-	if (numWindows - 2 * FLANK <= 0) return {0};
-
-	coverage.assign(numWindows - 2 * FLANK, 0);
-	for (const auto& ovlp : readOverlaps)
-	{
-		if (ovlp.curId == ovlp.extId.rc() ||
-			ovlp.curId == ovlp.extId) continue;
-
-		//skip 2 first/last windows of overlap to be more robust to
-		//possible coorinate shifts
-		for (int pos = ovlp.curBegin / WINDOW + FLANK; 		
-			 pos <= ovlp.curEnd / WINDOW - FLANK; ++pos)
-		{
-			if (pos - FLANK >= 0 && 					//shouldn't happen, but just in case..
-				pos - FLANK < (int)coverage.size())
-			{
-				//assert(pos - FLANK >= 0 && pos - FLANK < (int)coverage.size());
-				++coverage[pos - FLANK];
-			}
-		}
-	}
-
-	return coverage;
-}
-
-
-bool ChimeraDetector::testReadByCoverage(FastaRecord::Id readId,
-										 const std::vector<OverlapRange>& readOvlps)
+bool ChimeraDetector::testReadByCoverage(const std::vector<int32_t>& coverage)
 {
 	const float MAX_DROP_RATE = Config::get("max_coverage_drop_rate");
 
-	auto coverage = this->getReadCoverage(readId, readOvlps);
 	if (coverage.empty()) return false;
 
 	int32_t maxCov = 0;
@@ -156,7 +120,6 @@ bool ChimeraDetector::testReadByCoverage(FastaRecord::Id readId,
 		sumCov += cov;
 	}
 	//int32_t meanCoverage = sumCov / coverage.size();
-	int32_t medianCoverage = median(coverage);
 	if (sumCov == 0) return false;	//no overlaps found, but it's not chimeric either
 
 	int threshold = 0;	
@@ -170,6 +133,7 @@ bool ChimeraDetector::testReadByCoverage(FastaRecord::Id readId,
 		/*threshold = std::round((float)std::min(_overlapCoverage, maxCov) /
 							   MAX_DROP_RATE);*/
 		/*threshold = 1;*/
+		int32_t medianCoverage = median(coverage);
 		threshold = std::max(1L, std::lround(medianCoverage / MAX_DROP_RATE));
 	}
 
@@ -6,15 +6,18 @@
 
 #include "../sequence/overlap.h"
 #include "../sequence/sequence_container.h"
+#include "coverage_profile.h"
 #include <unordered_map>
 
 class ChimeraDetector
 {
 public:
 	ChimeraDetector(const SequenceContainer& readContainer,
-					OverlapContainer& ovlpContainer):
+					OverlapContainer& ovlpContainer,
+					CoverageProfiles& covProfiles):
 		_seqContainer(readContainer),
 		_ovlpContainer(ovlpContainer), 
+		_covProfiles(covProfiles),
 		_overlapCoverage(0)
 	{}
 
@@ -26,14 +29,11 @@ public:
 	int  getRightTrim(FastaRecord::Id readId);
 
 private:
-	std::vector<int32_t> 
-		getReadCoverage(FastaRecord::Id readId,
-						const std::vector<OverlapRange>& readOvlps);
-	bool testReadByCoverage(FastaRecord::Id readId,
-							const std::vector<OverlapRange>& readOvlps);
+	bool testReadByCoverage(const std::vector<int32_t>& coverage);
 
 	const SequenceContainer& _seqContainer;
 	OverlapContainer& _ovlpContainer;
+	CoverageProfiles& _covProfiles;
 
 	cuckoohash_map<FastaRecord::Id, bool> _chimeras;
 	int _overlapCoverage;
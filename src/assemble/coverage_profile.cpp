@@ -0,0 +1,80 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+#include <cmath>
+
+#include "coverage_profile.h"
+#include "../common/config.h"
+#include "../common/logger.h"
+
+
+CoverageProfiles::ProfilePtr
+	CoverageProfiles::readCoverage(FastaRecord::Id readId)
+{
+	ProfilePtr profile;
+	if (_profiles.find(readId, profile)) return profile;
+
+	auto overlaps = _ovlpContainer.sharedSeqOverlaps(readId);
+	profile = std::make_shared<const std::vector<int32_t>>
+		(this->readCoverage(readId, *overlaps));
+	_profiles.insert(readId, profile);
+	return profile;
+}
+
+std::vector<int32_t>
+	CoverageProfiles::readCoverage(FastaRecord::Id readId,
+								   const std::vector<OverlapRange>& readOvlps) const
+{
+	static const int WINDOW = Config::get("chimera_window");
+	//const int FLANK = (int)Config::get("maximum_overhang") / WINDOW;
+	const int FLANK = 1;
+
+	int numWindows = std::ceil((float)_seqContainer.seqLen(readId) / WINDOW) + 1;
+	if (numWindows - 2 * FLANK <= 0) return {0};
+
+	WindowCoverage coverage(numWindows - 2 * FLANK);
+	for (const auto& ovlp : readOvlps)
+	{
+		if (ovlp.curId == ovlp.extId.rc() ||
+			ovlp.curId == ovlp.extId) continue;
+
+		//skip 2 first/last windows of overlap to be more robust to
+		//possible coorinate shifts (profile window i is read window i + FLANK)
+		coverage.addRange(ovlp.curBegin / WINDOW, 
+						  ovlp.curEnd / WINDOW - 2 * FLANK + 1);
+	}
+	return coverage.profile();
+}
+
+std::unordered_map<FastaRecord::Id, std::vector<int32_t>>
+	CoverageProfiles::extCoverage(const std::vector<OverlapRange>& ovlps) const
+{
+	static const int WINDOW = Config::get("chimera_window");
+
+	std::unordered_map<FastaRecord::Id, WindowCoverage> diffCoverage;
+	for (const auto& ovlp: ovlps)
+	{
+		auto itCoverage = diffCoverage.find(ovlp.extId);
+		if (itCoverage == diffCoverage.end())
+		{
+			int numWindows = _seqContainer.seqLen(ovlp.extId) / WINDOW;
+			if (numWindows < 1)
+			{
+				Logger::get().warning() << "Wrong read length: " << numWindows;
+				numWindows = 1;
+			}
+			itCoverage = diffCoverage.emplace(ovlp.extId,
+											  WindowCoverage(numWindows)).first;
+		}
+		itCoverage->second.addRange(ovlp.extBegin / WINDOW + 1,
+									ovlp.extEnd / WINDOW);
+	}
+
+	std::unordered_map<FastaRecord::Id, std::vector<int32_t>> coverage;
+	for (const auto& readCov : diffCoverage)
+	{
+		coverage[readCov.first] = readCov.second.profile();
+	}
+	return coverage;
+}
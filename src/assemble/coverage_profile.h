@@ -0,0 +1,84 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Per-window read coverage by overlaps, shared by the chimera and
+//inner read detection. Profiles are accumulated with difference arrays:
+//each overlap is an O(1) update (instead of a walk over its windows),
+//and the profile is restored with a single prefix sum pass
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+
+#include "../sequence/overlap.h"
+#include "../sequence/sequence_container.h"
+
+class WindowCoverage
+{
+public:
+	explicit WindowCoverage(int numWindows):
+		_diff(std::max(numWindows, 0) + 1, 0) {}
+
+	//increments windows [begin, end), clipped to the profile
+	void addRange(int begin, int end)
+	{
+		begin = std::max(begin, 0);
+		end = std::min(end, (int)_diff.size() - 1);
+		if (begin >= end) return;
+		++_diff[begin];
+		--_diff[end];
+	}
+
+	std::vector<int32_t> profile() const
+	{
+		std::vector<int32_t> coverage(_diff.size() - 1);
+		int32_t current = 0;
+		for (size_t i = 0; i < coverage.size(); ++i)
+		{
+			current += _diff[i];
+			coverage[i] = current;
+		}
+		return coverage;
+	}
+
+private:
+	std::vector<int32_t> _diff;
+};
+
+class CoverageProfiles
+{
+public:
+	typedef std::shared_ptr<const std::vector<int32_t>> ProfilePtr;
+
+	CoverageProfiles(const SequenceContainer& readContainer,
+					 OverlapContainer& ovlpContainer):
+		_seqContainer(readContainer),
+		_ovlpContainer(ovlpContainer)
+	{}
+
+	//Coverage of the read by all its overlaps. Computed once and
+	//stored until released (thread-safe)
+	ProfilePtr readCoverage(FastaRecord::Id readId);
+	void release(FastaRecord::Id readId) {_profiles.erase(readId);}
+	void clear() {_profiles.clear();}
+
+	//Coverage of the read by the given subset of its overlaps (not stored).
+	//The first and the last window of each overlap are not counted
+	std::vector<int32_t>
+		readCoverage(FastaRecord::Id readId,
+					 const std::vector<OverlapRange>& readOvlps) const;
+
+	//Coverage of the extension reads by the given overlaps
+	std::unordered_map<FastaRecord::Id, std::vector<int32_t>>
+		extCoverage(const std::vector<OverlapRange>& ovlps) const;
+
+private:
+	const SequenceContainer& _seqContainer;
+	OverlapContainer& _ovlpContainer;
+
+	cuckoohash_map<FastaRecord::Id, ProfilePtr> _profiles;
+};
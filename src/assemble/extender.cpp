@@ -5,16 +5,27 @@
 #include <limits>
 #include <algorithm>
 #include <iomanip>
+#include <sstream>
 #include <stack>
 
 #include "../common/config.h"
 #include "../common/logger.h"
 #include "../common/parallel.h"
 #include "extender.h"
-
-
-Extender::ExtensionInfo Extender::extendDisjointig(FastaRecord::Id startRead)
+#include "../common/profiler.h"
+#include "../common/memory_budget.h"
+
+
+//Extensions are numbered by tickets in the order they are started.
+//Reads are claimed optimistically as the extension goes: if the
+//extension runs into too many reads claimed by the older extensions
+//(that are likely to be accepted first and make these reads inner),
+//it is aborted early. Older extensions are never aborted because of
+//the younger ones, so at least one of the conflicting ones proceeds
+Extender::ExtensionInfo Extender::extendDisjointig(FastaRecord::Id startRead,
+												   size_t ticket)
 {
+	static const int MAX_CONFLICTS = Config::get("max_inner_reads");
 
 	std::unordered_set<FastaRecord::Id> currentReads;
 	currentReads.insert(startRead);
@@ -26,11 +37,14 @@ Extender::ExtensionInfo Extender::extendDisjointig(FastaRecord::Id startRead)
 	std::vector<int> overlapSizes;
 	ExtensionInfo exInfo;
 	exInfo.reads.push_back(startRead);
+	this->setActive(startRead, true);
+	int numConflicts = this->claimRead(startRead, ticket) ? 1 : 0;
 	exInfo.assembledLength = _readsContainer.seqLen(startRead);
 
 	auto leftExtendsStart = [startRead, this](const FastaRecord::Id readId)
 	{
-		for (const auto& ovlp : _ovlpContainer.lazySeqOverlaps(startRead))
+		auto startOverlaps = _ovlpContainer.sharedSeqOverlaps(startRead);
+		for (const auto& ovlp : *startOverlaps)
 		{
 			if (ovlp.extId == readId &&
 				ovlp.leftShift < -(int)Config::get("maximum_jump")) 
@@ -43,7 +57,8 @@ Extender::ExtensionInfo Extender::extendDisjointig(FastaRecord::Id startRead)
 
 	while(true)
 	{
-		const auto& overlaps = _ovlpContainer.lazySeqOverlaps(currentRead);
+		auto overlapsPtr = _ovlpContainer.sharedSeqOverlaps(currentRead);
+		const auto& overlaps = *overlapsPtr;
 		std::vector<OverlapRange> extensions;
 		//int innerOverlaps = 0;
 		for (const auto& ovlp : overlaps)
@@ -118,8 +133,16 @@ Extender::ExtensionInfo Extender::extendDisjointig(FastaRecord::Id startRead)
 		if (foundExtension) 
 		{
 			exInfo.reads.push_back(currentRead);
+			this->setActive(currentRead, true);
 			overlapSizes.push_back(maxExtension->curRange());
 			//overlapsVisited |= currentReads.count(currentRead);
+
+			if (this->claimRead(currentRead, ticket) && 
+				++numConflicts > MAX_CONFLICTS)
+			{
+				exInfo.aborted = true;
+				break;
+			}
 		}
 		else
 		{
@@ -181,6 +204,7 @@ Extender::ExtensionInfo Extender::extendDisjointig(FastaRecord::Id startRead)
 
 void Extender::assembleDisjointigs()
 {
+	ScopedTimer timer("extension");
 	//static const int MAX_JUMP = Config::get("maximum_jump");
 	Logger::get().info() << "Extending reads";
 	_chimDetector.estimateGlobalCoverage();
@@ -195,8 +219,17 @@ void Extender::assembleDisjointigs()
 			Parameters::get().minimumOverlap) ++totalReads;
 	}
 	
+	//statistics of the wasted work (in extended reads)
+	std::atomic<size_t> nextTicket(0);
+	std::atomic<size_t> extendedReads(0);
+	std::atomic<size_t> abortedReads(0);
+	std::atomic<size_t> shortReads(0);
+	std::atomic<size_t> innerDiscardedReads(0);
+
 	std::mutex indexMutex;
-	auto processRead = [this, &indexMutex, &coveredReads, totalReads] 
+	auto processRead = [this, &indexMutex, &coveredReads, totalReads,
+						&nextTicket, &extendedReads, &abortedReads,
+						&shortReads, &innerDiscardedReads] 
 		(FastaRecord::Id startRead)
 	{
 		//most of the reads will fall into the inner categoty -
@@ -235,10 +268,41 @@ void Extender::assembleDisjointigs()
 			numInnerOvlp > totalOverlaps / 2) return;
 		
 		//Good to go!
-		ExtensionInfo exInfo = this->extendDisjointig(startRead);
+		size_t ticket = nextTicket++;
+		ExtensionInfo exInfo = this->extendDisjointig(startRead, ticket);
+
+		//the extension reads stay on the frontier (and claimed)
+		//until the disjointig is either accepted or discarded
+		struct FrontierGuard
+		{
+			FrontierGuard(Extender* extender, size_t ticket,
+						  const std::vector<FastaRecord::Id>& reads):
+				extender(extender), ticket(ticket), reads(reads) {}
+			~FrontierGuard()
+			{
+				for (const auto& readId : reads) 
+				{
+					extender->setActive(readId, false);
+					extender->releaseClaim(readId, ticket);
+				}
+			}
+			Extender* extender;
+			size_t ticket;
+			const std::vector<FastaRecord::Id> reads;
+		} frontierGuard(this, ticket, exInfo.reads);
 
+		extendedReads += exInfo.reads.size();
+		if (exInfo.aborted)
+		{
+			abortedReads += exInfo.reads.size();
+			return;
+		}
 		if (exInfo.reads.size() - exInfo.numSuspicious < 
-			(size_t)Config::get("min_reads_in_disjointig")) return;
+			(size_t)Config::get("min_reads_in_disjointig"))
+		{
+			shortReads += exInfo.reads.size();
+			return;
+		}
 
 		/*if (exInfo.leftAsmOverlap + exInfo.rightAsmOverlap > 
 			exInfo.assembledLength + 2 * Parameters::get().minimumOverlap)
@@ -265,6 +329,7 @@ void Extender::assembleDisjointigs()
 			Logger::get().debug() << "Discarded disjointig with "
 				<< exInfo.reads.size() << " reads and "
 				<< innerCount << " inner overlaps";
+			innerDiscardedReads += exInfo.reads.size();
 			return;
 		}
 
@@ -301,7 +366,8 @@ void Extender::assembleDisjointigs()
 			//	this->countRightExtensions(readId.rc()) > maxExtensions) continue;
 
 			//so each read is covered from the left and right
-			for (const auto& ovlp : _ovlpContainer.lazySeqOverlaps(readId))
+			auto readOverlaps = _ovlpContainer.sharedSeqOverlaps(readId);
+			for (const auto& ovlp : *readOverlaps)
 			{
 				allOverlaps.push_back(ovlp);
 				coveredReads.insert(ovlp.extId, true);
@@ -317,6 +383,18 @@ void Extender::assembleDisjointigs()
 		Logger::get().debug() << "Inner: " << 
 			_innerReads.size() << " covered: " << coveredReads.size()
 			<< " total: "<< totalReads;
+
+		//overlaps of the inner reads that are not on any active
+		//extension are unlikely to be needed again
+		if (_ovlpContainer.cacheOverflow() || 
+			MemoryBudget::get().underPressure())
+		{
+			size_t evicted = _ovlpContainer.evictOverlaps(
+				[this](FastaRecord::Id readId) 
+					{return this->canEvictOverlaps(readId);});
+			Logger::get().debug() << "Evicted overlaps of " << evicted
+				<< " reads, ovlp index size: " << _ovlpContainer.indexSize();
+		}
 		
 		_readLists.push_back(std::move(exInfo));
 	};
@@ -338,6 +416,18 @@ void Extender::assembleDisjointigs()
 	std::random_shuffle(allReads.begin(), allReads.end());
 	processInParallel(allReads, threadWorker,
 					  Parameters::get().numThreads, true);
+	//profiles of the reads that were never tested for chimerism
+	_covProfiles.clear();
+
+	size_t discardedReads = abortedReads + shortReads + innerDiscardedReads;
+	std::stringstream discardedStr;
+	discardedStr << std::fixed << std::setprecision(1) << 100.0f * 
+		discardedReads / std::max<size_t>(1, extendedReads);
+	Logger::get().debug() << "Extension work: " << extendedReads 
+		<< " reads in " << nextTicket << " extensions, discarded " 
+		<< discardedReads << " (" << discardedStr.str()
+		<< "%): aborted on conflict " << abortedReads << ", too short "
+		<< shortReads << ", too many inner reads " << innerDiscardedReads;
 	//_ovlpContainer.ensureTransitivity(/*only max*/ true);
 
 	bool addSingletons = (bool)Config::get("add_unassembled_reads");
@@ -363,7 +453,8 @@ void Extender::assembleDisjointigs()
 		{
 			if (!coveredLocal.count(readId))
 			{
-				for (const auto& ovlp : _ovlpContainer.lazySeqOverlaps(readId))
+				auto readOverlaps = _ovlpContainer.sharedSeqOverlaps(readId);
+				for (const auto& ovlp : *readOverlaps)
 				{
 					if (ovlp.leftShift >= 0 && ovlp.rightShift <= 0)
 					{
@@ -393,28 +484,7 @@ std::vector<FastaRecord::Id>
 	static const int WINDOW = Config::get("chimera_window");
 	static const int OVERHANG = Config::get("maximum_overhang");
 
-	std::unordered_map<FastaRecord::Id, 
-					   std::vector<int32_t>> readsCoverage;
-	for (const auto& ovlp: ovlps)
-	{
-		auto& coverage = readsCoverage[ovlp.extId];
-		if (coverage.empty())
-		{
-			int numWindows = _readsContainer.seqLen(ovlp.extId) / WINDOW;
-			if (numWindows < 1)
-			{
-				Logger::get().warning() << "Wrong read length: " << numWindows;
-				numWindows = 1;
-			}
-			coverage.assign(numWindows, 0);
-		}
-
-		for (int pos = ovlp.extBegin / WINDOW + 1; 
-			 pos < ovlp.extEnd / WINDOW; ++pos)
-		{
-			++coverage[pos];
-		}
-	}
+	auto readsCoverage = _covProfiles.extCoverage(ovlps);
 
 	std::vector<FastaRecord::Id> innerReads;
 	for (auto rc : readsCoverage)
@@ -477,7 +547,8 @@ void Extender::convertToDisjointigs()
 			bool found = false;
 			OverlapRange readsOvlp;
 
-			for (const auto& ovlp : _ovlpContainer.lazySeqOverlaps(exInfo.reads[i]))
+			auto curOverlaps = _ovlpContainer.sharedSeqOverlaps(exInfo.reads[i]);
+			for (const auto& ovlp : *curOverlaps)
 			{
 				if (ovlp.extId == exInfo.reads[i + 1]) 
 				{
@@ -488,7 +559,9 @@ void Extender::convertToDisjointigs()
 			}
 			if (!found)
 			{
-				for (const auto& ovlp : _ovlpContainer.lazySeqOverlaps(exInfo.reads[i + 1]))
+				auto nextOverlaps = 
+					_ovlpContainer.sharedSeqOverlaps(exInfo.reads[i + 1]);
+				for (const auto& ovlp : *nextOverlaps)
 				{
 					if (ovlp.extId == exInfo.reads[i]) 
 					{
@@ -520,7 +593,41 @@ int Extender::countRightExtensions(const std::vector<OverlapRange>& ovlps) const
 
 int Extender::countRightExtensions(FastaRecord::Id readId) const
 {
-	return this->countRightExtensions(_ovlpContainer.lazySeqOverlaps(readId));
+	return this->countRightExtensions(*_ovlpContainer.sharedSeqOverlaps(readId));
+}
+
+void Extender::setActive(FastaRecord::Id readId, bool active)
+{
+	if (!readId.strand()) readId = readId.rc();
+	if (active)
+	{
+		_activeReads.upsert(readId, [](size_t& num){++num;}, 1);
+	}
+	else
+	{
+		_activeReads.erase_fn(readId, [](size_t& num){return --num == 0;});
+	}
+}
+
+bool Extender::canEvictOverlaps(FastaRecord::Id readId) const
+{
+	return _innerReads.contains(readId) && !_activeReads.contains(readId);
+}
+
+//claims the read for the extension, returns true if it was
+//already claimed by an older extension
+bool Extender::claimRead(FastaRecord::Id readId, size_t ticket)
+{
+	if (!readId.strand()) readId = readId.rc();
+	size_t owner = ticket;
+	_claimedReads.upsert(readId, [&owner](size_t& val){owner = val;}, ticket);
+	return owner < ticket;
+}
+
+void Extender::releaseClaim(FastaRecord::Id readId, size_t ticket)
+{
+	if (!readId.strand()) readId = readId.rc();
+	_claimedReads.erase_fn(readId, [ticket](size_t& val){return val == ticket;});
 }
 
 bool Extender::extendsRight(const OverlapRange& ovlp) const
@@ -10,6 +10,7 @@
 #include "../sequence/overlap.h"
 #include "../sequence/consensus_generator.h"
 #include "chimera.h"
+#include "coverage_profile.h"
 
 class Extender
 {
@@ -18,7 +19,8 @@ public:
 			 OverlapContainer& ovlpContainer):
 		_readsContainer(readsContainer), 
 		_ovlpContainer(ovlpContainer),
-		_chimDetector(readsContainer, ovlpContainer)
+		_covProfiles(readsContainer, ovlpContainer),
+		_chimDetector(readsContainer, ovlpContainer, _covProfiles)
 	{}
 
 	void assembleDisjointigs();
@@ -32,7 +34,7 @@ private:
 			numSuspicious(0), meanOverlaps(0), stepsToTurn(0),
 			assembledLength(0), singleton(false),
 			avgOverlapSize(0), minOverlapSize(0),
-			leftAsmOverlap(0), rightAsmOverlap(0) {}
+			leftAsmOverlap(0), rightAsmOverlap(0), aborted(false) {}
 
 		std::vector<FastaRecord::Id> reads;
 		bool leftTip;
@@ -46,21 +48,34 @@ private:
 		int  minOverlapSize;
 		int  leftAsmOverlap;
 		int  rightAsmOverlap;
+		bool aborted;
 	};
 
-	ExtensionInfo extendDisjointig(FastaRecord::Id startingRead);
+	ExtensionInfo extendDisjointig(FastaRecord::Id startingRead, 
+								   size_t ticket);
 	int   countRightExtensions(FastaRecord::Id readId) const;
 	int   countRightExtensions(const std::vector<OverlapRange>&) const;
 	bool  extendsRight(const OverlapRange& ovlp) const;
 	void  convertToDisjointigs();
 	std::vector<FastaRecord::Id> 
 		getInnerReads(const std::vector<OverlapRange>& ovlps);
+	void  setActive(FastaRecord::Id readId, bool active);
+	bool  canEvictOverlaps(FastaRecord::Id readId) const;
+	bool  claimRead(FastaRecord::Id readId, size_t ticket);
+	void  releaseClaim(FastaRecord::Id readId, size_t ticket);
 
 	const SequenceContainer& _readsContainer;
 	OverlapContainer& _ovlpContainer;
+	CoverageProfiles  _covProfiles;
 	ChimeraDetector   _chimDetector;
 
 	std::vector<ExtensionInfo> 	_readLists;
 	std::vector<ContigPath> 	_disjointigPaths;
 	cuckoohash_map<FastaRecord::Id, size_t>  	_innerReads;
+	//reads of the extensions in progress (forward strand), with
+	//the number of extensions that include each read
+	cuckoohash_map<FastaRecord::Id, size_t>  	_activeReads;
+	//reads claimed by the extensions in progress (forward strand),
+	//with the ticket of the extension that claimed it first
+	cuckoohash_map<FastaRecord::Id, size_t>  	_claimedReads;
 };
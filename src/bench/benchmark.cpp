@@ -0,0 +1,218 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "benchmark.h"
+#include "../common/memory_info.h"
+
+
+namespace
+{
+	double percentile(const std::vector<double>& sorted, double fraction)
+	{
+		if (sorted.empty()) return 0;
+		size_t index = std::min(sorted.size() - 1,
+								(size_t)std::ceil(fraction * sorted.size()) - 1);
+		return sorted[index];
+	}
+
+	//extracts a numeric or string field from a flat JSON line
+	std::string jsonField(const std::string& line, const std::string& key)
+	{
+		std::string pattern = "\"" + key + "\": ";
+		size_t pos = line.find(pattern);
+		if (pos == std::string::npos) return "";
+		pos += pattern.size();
+		if (line[pos] == '"')
+		{
+			size_t end = line.find('"', pos + 1);
+			return line.substr(pos + 1, end - pos - 1);
+		}
+		size_t end = line.find_first_of(",}", pos);
+		return line.substr(pos, end - pos);
+	}
+}
+
+std::string BenchState::toJson(const std::string& name, double setupTime) const
+{
+	std::vector<double> sorted(_latencies);
+	std::sort(sorted.begin(), sorted.end());
+	const double MB = 1024 * 1024;
+
+	std::stringstream ss;
+	ss << std::setprecision(6);
+	ss << "{\"benchmark\": \"" << name << "\", \"input\": \"" << _input
+		<< "\", \"item\": \"" << _itemName
+		<< "\", \"iterations\": " << _latencies.size()
+		<< ", \"items_per_sec\": " << (_totalTime > 0 ? _items / _totalTime : 0)
+		<< ", \"mb_per_sec\": " << (_totalTime > 0 ? _bytes / MB / _totalTime : 0)
+		<< ", \"latency_p50_ms\": " << percentile(sorted, 0.50) * 1000
+		<< ", \"latency_p90_ms\": " << percentile(sorted, 0.90) * 1000
+		<< ", \"latency_p99_ms\": " << percentile(sorted, 0.99) * 1000
+		<< ", \"latency_max_ms\": " << (sorted.empty() ? 0 : sorted.back()) * 1000
+		<< ", \"total_sec\": " << _totalTime
+		<< ", \"setup_sec\": " << setupTime
+		<< ", \"peak_rss_mb\": " << getPeakRSS() / MB << "}";
+	return ss.str();
+}
+
+void BenchmarkRunner::add(const std::string& name, size_t minIterations,
+						  size_t maxIterations, BenchFunction function)
+{
+	_benchmarks.push_back({name, minIterations, maxIterations, function});
+}
+
+std::vector<std::string> BenchmarkRunner::names() const
+{
+	std::vector<std::string> names;
+	for (auto& bench : _benchmarks) names.push_back(bench.name);
+	return names;
+}
+
+std::vector<std::string> BenchmarkRunner::run(const std::string& filter,
+											  std::ostream& out, bool verbose)
+{
+	std::vector<std::string> results;
+	for (auto& bench : _benchmarks)
+	{
+		if (bench.name.find(filter) == std::string::npos) continue;
+
+		std::cerr << "Running " << bench.name << "..." << std::endl;
+		std::string result = this->runChild(bench, verbose);
+		out << result << std::endl;
+		results.push_back(result);
+	}
+	return results;
+}
+
+//runs the benchmark in a child process, which sends the JSON
+//result back through a pipe
+std::string BenchmarkRunner::runChild(const Benchmark& bench, bool verbose)
+{
+	int fds[2];
+	if (pipe(fds) != 0)
+	{
+		throw std::runtime_error("Can't create pipe");
+	}
+
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		throw std::runtime_error("Can't fork");
+	}
+	if (pid == 0)
+	{
+		close(fds[0]);
+		//the kernels might log their progress
+		if (!verbose)
+		{
+			int devNull = open("/dev/null", O_WRONLY);
+			dup2(devNull, STDERR_FILENO);
+			close(devNull);
+		}
+
+		std::string result;
+		try
+		{
+			BenchState state(_options, bench.minIterations,
+							 bench.maxIterations);
+			auto setupStart = std::chrono::steady_clock::now();
+			bench.function(state);
+			double totalTime =
+				std::chrono::duration_cast<std::chrono::duration<double>>
+					(std::chrono::steady_clock::now() - setupStart).count();
+			result = state.toJson(bench.name, std::max(0.0, totalTime -
+												   state.measuredTime()));
+		}
+		catch (std::exception& e)
+		{
+			result = "{\"benchmark\": \"" + bench.name +
+					 "\", \"error\": \"" + e.what() + "\"}";
+		}
+		size_t written = 0;
+		while (written < result.size())
+		{
+			ssize_t ret = write(fds[1], result.data() + written,
+								result.size() - written);
+			if (ret <= 0) break;
+			written += ret;
+		}
+		close(fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	std::string result;
+	char buffer[4096];
+	ssize_t bytesRead = 0;
+	while ((bytesRead = read(fds[0], buffer, sizeof(buffer))) > 0)
+	{
+		result.append(buffer, bytesRead);
+	}
+	close(fds[0]);
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	if (result.empty())
+	{
+		result = "{\"benchmark\": \"" + bench.name +
+				 "\", \"error\": \"terminated with status " +
+				 std::to_string(status) + "\"}";
+	}
+	return result;
+}
+
+int compareWithBaseline(const std::vector<std::string>& results,
+						const std::string& baselineFile, double tolerance)
+{
+	std::ifstream fin(baselineFile);
+	if (!fin)
+	{
+		throw std::runtime_error("Can't open " + baselineFile);
+	}
+	std::unordered_map<std::string, double> baseline;
+	std::string line;
+	while (std::getline(fin, line))
+	{
+		std::string throughput = jsonField(line, "items_per_sec");
+		if (!throughput.empty())
+		{
+			baseline[jsonField(line, "benchmark")] = std::stod(throughput);
+		}
+	}
+
+	int regressions = 0;
+	for (auto& result : results)
+	{
+		std::string name = jsonField(result, "benchmark");
+		std::string throughput = jsonField(result, "items_per_sec");
+		if (throughput.empty())
+		{
+			std::cerr << "FAILED " << name << ": "
+				<< jsonField(result, "error") << std::endl;
+			++regressions;
+			continue;
+		}
+		auto itBase = baseline.find(name);
+		if (itBase == baseline.end() || itBase->second <= 0) continue;
+
+		double change = std::stod(throughput) / itBase->second - 1;
+		bool regressed = change < -tolerance;
+		std::cerr << (regressed ? "REGRESSION " : "ok ") << name << ": "
+			<< std::fixed << std::setprecision(1) << change * 100
+			<< "% throughput vs baseline" << std::endl;
+		if (regressed) ++regressions;
+	}
+	return regressions;
+}
@@ -0,0 +1,130 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Minimal benchmark harness. Each benchmark prepares its input
+//(not timed), and then repeatedly times the kernel with
+//BenchState::startIteration() / finishIteration(). Every benchmark is
+//run in a separate child process, so its peak RSS is measured
+//independently from the others. Results are printed as JSON lines
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <cstdint>
+
+struct BenchOptions
+{
+	BenchOptions(): seed(1), scale(1.0), minTime(1.0), numThreads(1) {}
+
+	uint64_t 	seed;
+	double 		scale;		//multiplier for the input sizes
+	double 		minTime;	//minimum measured time per benchmark, seconds
+	size_t 		numThreads;
+	std::string subsMatrix;
+};
+
+class BenchState
+{
+public:
+	BenchState(const BenchOptions& options, size_t minIterations,
+			   size_t maxIterations):
+		options(options), _minIterations(minIterations),
+		_maxIterations(maxIterations), _totalTime(0),
+		_items(0), _bytes(0)
+	{}
+
+	const BenchOptions& options;
+
+	//whether another iteration should be run
+	bool keepRunning() const
+	{
+		if (_latencies.size() < _minIterations) return true;
+		return _latencies.size() < _maxIterations &&
+			   _totalTime < options.minTime;
+	}
+
+	void startIteration()
+	{
+		_iterStart = std::chrono::steady_clock::now();
+	}
+
+	//records the iteration time and the amount of processed work
+	void finishIteration(double items, double bytes)
+	{
+		double elapsed = std::chrono::duration_cast<std::chrono::duration<double>>
+			(std::chrono::steady_clock::now() - _iterStart).count();
+		_latencies.push_back(elapsed);
+		_totalTime += elapsed;
+		_items += items;
+		_bytes += bytes;
+	}
+
+	//human-readable description of the input and the processed item
+	void setInfo(const std::string& itemName, const std::string& input)
+	{
+		_itemName = itemName;
+		_input = input;
+	}
+
+	double measuredTime() const {return _totalTime;}
+
+	std::string toJson(const std::string& name, double setupTime) const;
+
+private:
+	size_t _minIterations;
+	size_t _maxIterations;
+	std::chrono::steady_clock::time_point _iterStart;
+
+	std::vector<double> _latencies;
+	double _totalTime;
+	double _items;
+	double _bytes;
+	std::string _itemName;
+	std::string _input;
+};
+
+class BenchmarkRunner
+{
+public:
+	typedef std::function<void(BenchState&)> BenchFunction;
+
+	explicit BenchmarkRunner(const BenchOptions& options):
+		_options(options) {}
+
+	//the function is called once: it prepares the input and then runs
+	//iterations while state.keepRunning() is true
+	void add(const std::string& name, size_t minIterations,
+			 size_t maxIterations, BenchFunction function);
+
+	std::vector<std::string> names() const;
+
+	//runs the benchmarks whose names contain the filter and
+	//prints the JSON results to the stream. Returns the results
+	std::vector<std::string> run(const std::string& filter,
+								 std::ostream& out, bool verbose);
+
+private:
+	struct Benchmark
+	{
+		std::string   name;
+		size_t 		  minIterations;
+		size_t 		  maxIterations;
+		BenchFunction function;
+	};
+	std::string runChild(const Benchmark& bench, bool verbose);
+
+	const BenchOptions& 	_options;
+	std::vector<Benchmark> 	_benchmarks;
+};
+
+//compares the results with the baseline (both as JSON lines) and
+//reports the benchmarks whose throughput dropped by more than the
+//tolerance. Returns the number of regressions
+int compareWithBaseline(const std::vector<std::string>& results,
+						const std::string& baselineFile, double tolerance);
+
+void registerCoreBenchmarks(BenchmarkRunner& runner);
@@ -0,0 +1,386 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Benchmarks of the core kernels on synthetic data. Input sizes are
+//multiplied by BenchOptions::scale; the data only depends on the seed
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "benchmark.h"
+#include "synthetic_data.h"
+#include "../sequence/sequence_container.h"
+#include "../sequence/vertex_index.h"
+#include "../sequence/overlap.h"
+#include "../sequence/wfa_align.h"
+#include "../sequence/consensus_generator.h"
+#include "../repeat_graph/repeat_graph.h"
+#include "../polishing/alignment.h"
+#include "../common/bfcontainer.h"
+#include "../common/config.h"
+
+
+namespace
+{
+	//raw reads: ~8% error rate, 30x coverage
+	const size_t GENOME_SIZE = 300000;
+	const double READ_COVERAGE = 30;
+	const size_t READ_LENGTH = 8000;
+	const double READ_ERROR = 0.08;
+	const int 	 REPEAT_COPIES = 4;
+	const size_t REPEAT_LENGTH = 5000;
+	const double REPEAT_DIVERGENCE = 0.01;
+	const int 	 MIN_KMER_COVERAGE = 3;
+
+	size_t scaled(size_t size, const BenchOptions& options)
+	{
+		return std::max<size_t>(1, size * options.scale);
+	}
+
+	std::string describeReads(const BenchOptions& options)
+	{
+		return std::to_string(scaled(GENOME_SIZE, options)) + "bp genome, " +
+			std::to_string((int)READ_COVERAGE) + "x reads of " +
+			std::to_string(READ_LENGTH) + "bp";
+	}
+
+	//fills the container with synthetic reads, returns the genome size
+	size_t makeReads(const BenchOptions& options, SequenceContainer& reads)
+	{
+		SyntheticData data(options.seed);
+		std::string genome = data.genome(scaled(GENOME_SIZE, options),
+										 REPEAT_COPIES, REPEAT_LENGTH,
+										 REPEAT_DIVERGENCE);
+		auto readSeqs = data.reads(genome, READ_COVERAGE, READ_LENGTH,
+								   READ_ERROR);
+		for (size_t i = 0; i < readSeqs.size(); ++i)
+		{
+			reads.addSequence(DnaSequence(readSeqs[i]),
+							  "read_" + std::to_string(i));
+		}
+		reads.buildPositionIndex();
+		return genome.size();
+	}
+
+	size_t totalLength(const SequenceContainer& seqs)
+	{
+		size_t total = 0;
+		for (auto& seq : seqs.iterSeqs())
+		{
+			if (seq.id.strand()) total += seq.sequence.length();
+		}
+		return total;
+	}
+
+	//pairs of sequences that are independently mutated copies of
+	//the same random sequence
+	std::vector<std::pair<std::string, std::string>>
+		makeSequencePairs(const BenchOptions& options, size_t numPairs,
+						  size_t length, double errorRate)
+	{
+		SyntheticData data(options.seed);
+		std::vector<std::pair<std::string, std::string>> pairs;
+		for (size_t i = 0; i < numPairs; ++i)
+		{
+			std::string base = data.randomSequence(length);
+			pairs.emplace_back(data.mutate(base, errorRate),
+							   data.mutate(base, errorRate));
+		}
+		return pairs;
+	}
+
+	void benchCountKmers(BenchState& state)
+	{
+		SequenceContainer reads;
+		size_t genomeSize = makeReads(state.options, reads);
+		size_t bases = totalLength(reads);
+		state.setInfo("k-mer", describeReads(state.options));
+
+		while (state.keepRunning())
+		{
+			VertexIndex index(reads, /*sample rate*/ 1);
+			state.startIteration();
+			index.countKmers(/*hard threshold*/ 2, genomeSize);
+			state.finishIteration(bases, bases);
+		}
+	}
+
+	void benchBuildIndex(BenchState& state)
+	{
+		SequenceContainer reads;
+		size_t genomeSize = makeReads(state.options, reads);
+		size_t bases = totalLength(reads);
+		state.setInfo("k-mer", describeReads(state.options));
+
+		while (state.keepRunning())
+		{
+			VertexIndex index(reads, /*sample rate*/ 1);
+			index.countKmers(/*hard threshold*/ 2, genomeSize);
+			index.setRepeatCutoff(MIN_KMER_COVERAGE);
+			state.startIteration();
+			index.buildIndex(MIN_KMER_COVERAGE);
+			state.finishIteration(bases, bases);
+		}
+	}
+
+	void benchSeqOverlaps(BenchState& state)
+	{
+		SequenceContainer reads;
+		size_t genomeSize = makeReads(state.options, reads);
+		VertexIndex index(reads, /*sample rate*/ 1);
+		index.countKmers(/*hard threshold*/ 2, genomeSize);
+		index.setRepeatCutoff(MIN_KMER_COVERAGE);
+		index.buildIndex(MIN_KMER_COVERAGE);
+		state.setInfo("read", describeReads(state.options));
+
+		OverlapDetector ovlp(reads, index,
+							 (int)Config::get("maximum_jump"),
+							 Parameters::get().minimumOverlap,
+							 (int)Config::get("maximum_overhang"),
+							 /*no max overlaps*/ 0,
+							 /*store alignment*/ false,
+							 /*only max*/ true,
+							 /*no div threshold*/ 1.0f,
+							 /* bad end adjustment*/ 0.0f,
+							 /* nucl alignent*/ false);
+		OverlapContainer overlaps(ovlp, reads);
+
+		size_t nextRead = 0;
+		while (state.keepRunning())
+		{
+			const FastaRecord& read = reads.iterSeqs()[nextRead];
+			nextRead = (nextRead + 2) % reads.iterSeqs().size();
+
+			state.startIteration();
+			auto readOverlaps = overlaps.quickSeqOverlaps(read.id);
+			state.finishIteration(1, read.sequence.length());
+		}
+	}
+
+	//pairs of 5kb sequences, each mutated from the common base
+	std::vector<std::pair<DnaSequence, DnaSequence>>
+		makeAlignmentPairs(BenchState& state, double errorRate)
+	{
+		const size_t LENGTH = 5000;
+		auto pairs = makeSequencePairs(state.options, 16, LENGTH, errorRate);
+		std::vector<std::pair<DnaSequence, DnaSequence>> sequences;
+		for (auto& seqPair : pairs)
+		{
+			sequences.emplace_back(DnaSequence(seqPair.first),
+								   DnaSequence(seqPair.second));
+		}
+		state.setInfo("alignment", "5kb sequences with " + 
+					  std::to_string((int)(errorRate * 200 + 0.5)) + 
+					  "% divergence");
+		return sequences;
+	}
+
+	void runKswAlign(BenchState& state, double errorRate)
+	{
+		auto sequences = makeAlignmentPairs(state, errorRate);
+		std::vector<CigOp> cigar;
+		size_t nextPair = 0;
+		while (state.keepRunning())
+		{
+			auto& seqPair = sequences[nextPair++ % sequences.size()];
+			size_t lenOne = seqPair.first.length();
+			size_t lenTwo = seqPair.second.length();
+
+			state.startIteration();
+			OverlapDetector::kswAlign(seqPair.first, 0, lenOne,
+									  seqPair.second, 0, lenTwo,
+									  /*match*/ 1, /*mm*/ -2, /*gap open*/ 2,
+									  /*gap ext*/ 1, cigar);
+			state.finishIteration(1, lenOne + lenTwo);
+		}
+	}
+
+	void runWfaAlign(BenchState& state, double errorRate)
+	{
+		auto sequences = makeAlignmentPairs(state, errorRate);
+		std::vector<CigOp> cigar;
+		size_t nextPair = 0;
+		while (state.keepRunning())
+		{
+			auto& seqPair = sequences[nextPair++ % sequences.size()];
+			size_t lenOne = seqPair.first.length();
+			size_t lenTwo = seqPair.second.length();
+
+			state.startIteration();
+			float errRate = 0;
+			if (!wfaAlign(seqPair.first, 0, lenOne, seqPair.second, 0, lenTwo,
+						  /*match*/ 1, /*mm*/ -2, /*gap open*/ 2,
+						  /*gap ext*/ 1, /*max div*/ 0.5f, cigar, errRate))
+			{
+				throw std::runtime_error("WFA alignment failed");
+			}
+			state.finishIteration(1, lenOne + lenTwo);
+		}
+	}
+
+	void benchKswAlign(BenchState& state) {runKswAlign(state, 0.075);}
+	void benchKswAlignHifi(BenchState& state) {runKswAlign(state, 0.005);}
+	void benchWfaAlignHifi(BenchState& state) {runWfaAlign(state, 0.005);}
+
+	void benchConsensusAlignment(BenchState& state)
+	{
+		const size_t LENGTH = 5000;
+		auto pairs = makeSequencePairs(state.options, 16, LENGTH, 0.075);
+		std::vector<std::pair<std::vector<uint8_t>,
+							  std::vector<uint8_t>>> sequences;
+		for (auto& seqPair : pairs)
+		{
+			std::vector<uint8_t> seqOne(seqPair.first.size());
+			DnaSequence(seqPair.first).copyRaw(0, seqOne.size(), seqOne.data());
+			std::vector<uint8_t> seqTwo(seqPair.second.size());
+			DnaSequence(seqPair.second).copyRaw(0, seqTwo.size(), seqTwo.data());
+			sequences.emplace_back(std::move(seqOne), std::move(seqTwo));
+		}
+		state.setInfo("alignment", "5kb sequences with 15% divergence");
+
+		std::string alnOne;
+		std::string alnTwo;
+		size_t nextPair = 0;
+		while (state.keepRunning())
+		{
+			auto& seqPair = sequences[nextPair++ % sequences.size()];
+			int lenOne = seqPair.first.size();
+			int lenTwo = seqPair.second.size();
+			int bandWidth = abs(lenOne - lenTwo) +
+							(int)Config::get("maximum_jump");
+
+			state.startIteration();
+			alnOne.clear();
+			alnTwo.clear();
+			ConsensusGenerator::pairwiseAlignment(seqPair.first, seqPair.second,
+												  alnOne, alnTwo, bandWidth);
+			state.finishIteration(1, lenOne + lenTwo);
+		}
+	}
+
+	void benchPolishAlignment(BenchState& state)
+	{
+		if (state.options.subsMatrix.empty())
+		{
+			throw std::runtime_error("substitution matrix is not set "
+									 "(--subs-mat)");
+		}
+		SubstitutionMatrix subsMatrix(state.options.subsMatrix);
+
+		//bubbles: short consensus and a set of diverged read segments
+		const size_t NUM_BUBBLES = 16;
+		const size_t BUBBLE_LENGTH = 150;
+		const size_t BUBBLE_DEPTH = 30;
+		SyntheticData data(state.options.seed);
+		std::vector<std::pair<std::string, std::vector<std::string>>> bubbles;
+		for (size_t i = 0; i < NUM_BUBBLES; ++i)
+		{
+			std::string candidate = data.randomSequence(BUBBLE_LENGTH);
+			std::vector<std::string> branches;
+			for (size_t j = 0; j < BUBBLE_DEPTH; ++j)
+			{
+				branches.push_back(data.mutate(candidate, READ_ERROR));
+			}
+			bubbles.emplace_back(candidate, branches);
+		}
+		state.setInfo("bubble", "150bp bubbles with 30 branches");
+
+		Alignment aligner(subsMatrix);
+		size_t nextBubble = 0;
+		while (state.keepRunning())
+		{
+			auto& bubble = bubbles[nextBubble++ % bubbles.size()];
+			size_t bases = 0;
+			for (auto& branch : bubble.second) bases += branch.size();
+
+			state.startIteration();
+			aligner.globalAlignment(bubble.first, bubble.second);
+			state.finishIteration(1, bases);
+		}
+	}
+
+	void benchBFContainerSort(BenchState& state)
+	{
+		struct Match
+		{
+			int32_t curPos;
+			int32_t extPos;
+			FastaRecord::Id extId;
+		};
+		const size_t NUM_MATCHES = scaled(2000000, state.options);
+
+		SyntheticData data(state.options.seed);
+		std::vector<Match> matches;
+		matches.reserve(NUM_MATCHES);
+		for (size_t i = 0; i < NUM_MATCHES; ++i)
+		{
+			matches.push_back({(int32_t)data.uniform(READ_LENGTH),
+							   (int32_t)data.uniform(READ_LENGTH),
+							   FastaRecord::Id(data.uniform(1000))});
+		}
+		state.setInfo("element", std::to_string(NUM_MATCHES) +
+					  " k-mer matches");
+
+		ChunkPool<Match> pool;
+		while (state.keepRunning())
+		{
+			BFContainer<Match> container(pool);
+			for (auto& match : matches) container.emplace_back(match);
+
+			state.startIteration();
+			std::sort(container.begin(), container.end(),
+					  [](const Match& k1, const Match& k2)
+					  {return k1.extId != k2.extId ? k1.extId < k2.extId :
+													 k1.curPos < k2.curPos;});
+			state.finishIteration(NUM_MATCHES, NUM_MATCHES * sizeof(Match));
+		}
+	}
+
+	void benchRepeatGraphBuild(BenchState& state)
+	{
+		//two disjointigs that overlap by 20% of their length and
+		//share the repeat copies
+		SyntheticData data(state.options.seed);
+		std::string genome = data.genome(scaled(GENOME_SIZE, state.options),
+										 REPEAT_COPIES, REPEAT_LENGTH,
+										 REPEAT_DIVERGENCE);
+		size_t pieceLength = genome.size() * 6 / 10;
+		SequenceContainer disjointigs;
+		disjointigs.addSequence(DnaSequence(genome.substr(0, pieceLength)),
+								"disjointig_1");
+		disjointigs.addSequence(DnaSequence(genome.substr(genome.size() -
+															pieceLength)),
+								"disjointig_2");
+		disjointigs.buildPositionIndex();
+		state.setInfo("graph", std::to_string(genome.size()) +
+					  "bp genome, " + std::to_string(REPEAT_COPIES) +
+					  " repeat copies");
+
+		size_t bases = totalLength(disjointigs);
+		while (state.keepRunning())
+		{
+			SequenceContainer edgeSequences;
+			RepeatGraph graph(disjointigs, &edgeSequences);
+			state.startIteration();
+			graph.build();
+			state.finishIteration(1, bases);
+		}
+	}
+}
+
+void registerCoreBenchmarks(BenchmarkRunner& runner)
+{
+	runner.add("vertex_index/count_kmers", 2, 10, benchCountKmers);
+	runner.add("vertex_index/build_index", 2, 10, benchBuildIndex);
+	runner.add("overlap/get_seq_overlaps", 20, 100000, benchSeqOverlaps);
+	runner.add("overlap/ksw_align", 20, 100000, benchKswAlign);
+	runner.add("overlap/ksw_align_hifi", 20, 100000, benchKswAlignHifi);
+	runner.add("overlap/wfa_align_hifi", 20, 100000, benchWfaAlignHifi);
+	runner.add("consensus/pairwise_alignment", 20, 100000,
+			   benchConsensusAlignment);
+	runner.add("polishing/global_alignment", 20, 100000,
+			   benchPolishAlignment);
+	runner.add("common/bfcontainer_sort", 3, 100, benchBFContainerSort);
+	runner.add("repeat_graph/build", 2, 10, benchRepeatGraphBuild);
+}
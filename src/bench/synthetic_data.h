@@ -0,0 +1,135 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Reproducible synthetic genomes and long reads for the benchmarks.
+//Uses its own generator (splitmix64) instead of the std distributions,
+//so the data is the same on every platform / standard library
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+class SyntheticData
+{
+public:
+	explicit SyntheticData(uint64_t seed): _state(seed) {}
+
+	uint64_t next()
+	{
+		uint64_t z = (_state += 0x9e3779b97f4a7c15ULL);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+		return z ^ (z >> 31);
+	}
+
+	//uniform in [0, bound)
+	uint64_t uniform(uint64_t bound) {return next() % bound;}
+
+	//uniform in [0, 1)
+	double uniformReal() {return (next() >> 11) * (1.0 / (1ULL << 53));}
+
+	std::string randomSequence(size_t length)
+	{
+		std::string seq(length, 'A');
+		for (size_t i = 0; i < length; ++i) seq[i] = "ACGT"[this->uniform(4)];
+		return seq;
+	}
+
+	//introduces substitutions, insertions and deletions in equal
+	//proportions, with the given total rate
+	std::string mutate(const std::string& seq, double errorRate)
+	{
+		std::string result;
+		result.reserve(seq.size() + seq.size() / 10);
+		for (size_t i = 0; i < seq.size(); ++i)
+		{
+			if (this->uniformReal() >= errorRate)
+			{
+				result += seq[i];
+				continue;
+			}
+			switch (this->uniform(3))
+			{
+			case 0:		//substitution
+				result += "ACGT"[(nucleotideId(seq[i]) + 1 +
+								  this->uniform(3)) % 4];
+				break;
+			case 1:		//insertion
+				result += "ACGT"[this->uniform(4)];
+				result += seq[i];
+				break;
+			default:	//deletion
+				break;
+			}
+		}
+		return result;
+	}
+
+	static std::string reverseComplement(const std::string& seq)
+	{
+		std::string result(seq.rbegin(), seq.rend());
+		for (auto& c : result)
+		{
+			c = "TGCA"[nucleotideId(c)];
+		}
+		return result;
+	}
+
+	//random genome with several diverged copies of the same repeat
+	std::string genome(size_t length, int numRepeatCopies,
+					   size_t repeatLength, double repeatDivergence)
+	{
+		std::string genome = this->randomSequence(length);
+		if (numRepeatCopies == 0 || repeatLength >= length) return genome;
+
+		std::string repeat = this->randomSequence(repeatLength);
+		for (int i = 0; i < numRepeatCopies; ++i)
+		{
+			//copies are evenly spaced
+			size_t pos = (length - repeatLength) * i / numRepeatCopies;
+			std::string copy = this->mutate(repeat, repeatDivergence)
+									.substr(0, repeatLength);
+			genome.replace(pos, copy.size(), copy);
+		}
+		return genome;
+	}
+
+	//reads from random positions and strands with the given
+	//mean coverage. Read lengths are uniform in [meanLen / 2, meanLen * 3 / 2)
+	std::vector<std::string> reads(const std::string& genome, double coverage,
+								   size_t meanLength, double errorRate)
+	{
+		std::vector<std::string> reads;
+		size_t totalLength = 0;
+		while (totalLength < coverage * genome.size())
+		{
+			size_t length = std::min(genome.size(), meanLength / 2 +
+									 this->uniform(meanLength));
+			size_t start = this->uniform(genome.size() - length + 1);
+			std::string read = this->mutate(genome.substr(start, length),
+											errorRate);
+			if (this->uniform(2)) read = reverseComplement(read);
+			totalLength += read.size();
+			reads.push_back(std::move(read));
+		}
+		return reads;
+	}
+
+private:
+	static size_t nucleotideId(char c)
+	{
+		switch (c)
+		{
+			case 'A': return 0;
+			case 'C': return 1;
+			case 'G': return 2;
+			default: return 3;
+		}
+	}
+
+	uint64_t _state;
+};
@@ -19,20 +19,24 @@
 #include "../common/logger.h"
 #include "../common/utils.h"
 #include "../common/memory_info.h"
+#include "../common/profiler.h"
+#include "../common/memory_budget.h"
 
 #include <getopt.h>
 
 bool parseArgs(int argc, char** argv, std::string& readsFasta, 
 			   std::string& outAssembly, std::string& logFile, size_t& genomeSize,
 			   int& kmerSize, bool& debug, size_t& numThreads, int& minOverlap, 
-			   std::string& configPath, int& minReadLength, bool& unevenCov)
+			   std::string& configPath, int& minReadLength, bool& unevenCov,
+			   std::string& traceFile, double& memoryLimit)
 {
 	auto printUsage = [argv]()
 	{
 		std::cerr << "Usage: flye-assemble "
 				  << " --reads path --out-asm path --genome-size size --config path\n"
 				  << "\t\t[--min-read length] [--log path] [--treads num]\n"
-				  << "\t\t[--kmer size] [--meta] [--min-ovlp size] [--debug] [-h]\n\n"
+				  << "\t\t[--kmer size] [--meta] [--min-ovlp size] [--debug] [--trace path]\n"
+				  << "\t\t[--memory-limit size] [-h]\n\n"
 				  << "Required arguments:\n"
 				  << "  --reads path\tcomma-separated list of read files\n"
 				  << "  --out-asm path\tpath to output file\n"
@@ -48,6 +52,10 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 				  << "[default = false] \n"
 				  << "  --log log_file\toutput log to file "
 				  << "[default = not set] \n"
+				  << "  --trace path\twrite Chrome trace of the run phases "
+				  << "and log profiling summary [default = not set] \n"
+				  << "  --memory-limit size\tmemory budget in Gb that limits "
+				  << "the table and cache sizes [default = not set] \n"
 				  << "  --threads num_threads\tnumber of parallel threads "
 				  << "[default = 1] \n";
 	};
@@ -66,6 +74,8 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 		{"min-ovlp", required_argument, 0, 0},
 		{"meta", no_argument, 0, 0},
 		{"debug", no_argument, 0, 0},
+		{"trace", required_argument, 0, 0},
+		{"memory-limit", required_argument, 0, 0},
 		{0, 0, 0, 0}
 	};
 
@@ -87,6 +97,10 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 				logFile = optarg;
 			else if (!strcmp(longOptions[optionIndex].name, "debug"))
 				debug = true;
+			else if (!strcmp(longOptions[optionIndex].name, "trace"))
+				traceFile = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "memory-limit"))
+				memoryLimit = atof(optarg);
 			else if (!strcmp(longOptions[optionIndex].name, "meta"))
 				unevenCov = true;
 			else if (!strcmp(longOptions[optionIndex].name, "reads"))
@@ -131,14 +145,22 @@ int main(int argc, char** argv)
 	std::string readsFasta;
 	std::string outAssembly;
 	std::string logFile;
+	std::string traceFile;
+	double memoryLimit = 0;
 	std::string configPath;
 
 	if (!parseArgs(argc, argv, readsFasta, outAssembly, logFile, genomeSize,
 				   kmerSize, debugging, numThreads, minOverlap, configPath, 
-				   minReadLength, unevenCov)) return 1;
+				   minReadLength, unevenCov, traceFile, memoryLimit)) return 1;
 
 	Logger::get().setDebugging(debugging);
 	if (!logFile.empty()) Logger::get().setOutputFile(logFile);
+	if (!traceFile.empty()) Profiler::get().enableTrace(traceFile);
+	if (memoryLimit > 0)
+	{
+		MemoryBudget::get().setLimit(memoryLimit * 1024 * 1024 * 1024);
+		Logger::get().debug() << "Memory limit: " << memoryLimit << " Gb";
+	}
 	Logger::get().debug() << "Build date: " << __DATE__ << " " << __TIME__;
 	std::ios::sync_with_stdio(false);
 
@@ -231,6 +253,18 @@ int main(int argc, char** argv)
 	readOverlaps.estimateOverlaperParameters();
 	readOverlaps.setRelativeDivergenceThreshold(
 		(float)Config::get("assemble_ovlp_relative_divergence"));
+	//under the memory limit, overlaps of the assembled reads
+	//are evicted from the cache during extension
+	if (MemoryBudget::get().limited())
+	{
+		size_t cacheBytes = MemoryBudget::get()
+			.share(std::numeric_limits<size_t>::max(), /*fraction*/ 0.5);
+		//forward and reverse copies of each overlap are stored
+		readOverlaps.setCacheCapacity(std::max<size_t>(1, cacheBytes / 
+													 (2 * sizeof(OverlapRange))));
+		Logger::get().debug() << "Overlap cache capacity: " 
+			<< cacheBytes / 1024 / 1024 << " Mb";
+	}
 
 	Extender extender(readsContainer, readOverlaps);
 	extender.assembleDisjointigs();
@@ -244,5 +278,6 @@ int main(int argc, char** argv)
 	Logger::get().debug() << "Peak RAM usage: " 
 		<< getPeakRSS() / 1024 / 1024 / 1024 << " Gb";
 
+	Profiler::get().finish();
 	return 0;
 }
@@ -0,0 +1,178 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+#include <iostream>
+#include <fstream>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/config.h"
+#include "../common/logger.h"
+#include "../bench/benchmark.h"
+
+#include <getopt.h>
+
+bool parseArgs(int argc, char** argv, std::string& configPath,
+			   BenchOptions& options, int& kmerSize, std::string& filter,
+			   std::string& outFile, std::string& baselineFile,
+			   double& tolerance, bool& listOnly, bool& verbose)
+{
+	auto printUsage = [argv]()
+	{
+		std::cerr << "Usage: flye-bench "
+				  << " --config path [--subs-mat path] [--seed num]\n"
+				  << "\t\t[--scale float] [--min-time sec] [--threads num]\n"
+				  << "\t\t[--kmer size] [--filter str] [--out path]\n"
+				  << "\t\t[--baseline path] [--tolerance float] [--list]\n"
+				  << "\t\t[--verbose] [-h]\n\n"
+				  << "Required arguments:\n"
+				  << "  --config path\tpath to the config file\n\n"
+				  << "Optional arguments:\n"
+				  << "  --subs-mat path\tsubstitution matrix for the "
+				  << "polishing benchmarks [default = not set] \n"
+				  << "  --seed num\tseed for the synthetic data "
+				  << "[default = 1] \n"
+				  << "  --scale float\tmultiplier for the input sizes "
+				  << "[default = 1.0] \n"
+				  << "  --min-time sec\tminimum measured time per benchmark "
+				  << "[default = 1.0] \n"
+				  << "  --kmer size\tk-mer size [default = 15] \n"
+				  << "  --filter str\tonly run benchmarks whose names "
+				  << "contain the string [default = not set] \n"
+				  << "  --out path\toutput JSON lines to file "
+				  << "[default = stdout] \n"
+				  << "  --baseline path\tcompare throughput with the "
+				  << "previous results [default = not set] \n"
+				  << "  --tolerance float\tallowed relative throughput drop "
+				  << "[default = 0.1] \n"
+				  << "  --list \t\tlist the benchmarks and exit \n"
+				  << "  --verbose \t\tshow the kernels output "
+				  << "[default = false] \n"
+				  << "  --threads num_threads\tnumber of parallel threads "
+				  << "[default = 1] \n";
+	};
+
+	int optionIndex = 0;
+	static option longOptions[] =
+	{
+		{"config", required_argument, 0, 0},
+		{"subs-mat", required_argument, 0, 0},
+		{"seed", required_argument, 0, 0},
+		{"scale", required_argument, 0, 0},
+		{"min-time", required_argument, 0, 0},
+		{"threads", required_argument, 0, 0},
+		{"kmer", required_argument, 0, 0},
+		{"filter", required_argument, 0, 0},
+		{"out", required_argument, 0, 0},
+		{"baseline", required_argument, 0, 0},
+		{"tolerance", required_argument, 0, 0},
+		{"list", no_argument, 0, 0},
+		{"verbose", no_argument, 0, 0},
+		{0, 0, 0, 0}
+	};
+
+	int opt = 0;
+	while ((opt = getopt_long(argc, argv, "h", longOptions, &optionIndex)) != -1)
+	{
+		switch(opt)
+		{
+		case 0:
+			if (!strcmp(longOptions[optionIndex].name, "config"))
+				configPath = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "subs-mat"))
+				options.subsMatrix = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "seed"))
+				options.seed = strtoull(optarg, nullptr, 10);
+			else if (!strcmp(longOptions[optionIndex].name, "scale"))
+				options.scale = atof(optarg);
+			else if (!strcmp(longOptions[optionIndex].name, "min-time"))
+				options.minTime = atof(optarg);
+			else if (!strcmp(longOptions[optionIndex].name, "threads"))
+				options.numThreads = atoi(optarg);
+			else if (!strcmp(longOptions[optionIndex].name, "kmer"))
+				kmerSize = atoi(optarg);
+			else if (!strcmp(longOptions[optionIndex].name, "filter"))
+				filter = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "out"))
+				outFile = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "baseline"))
+				baselineFile = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "tolerance"))
+				tolerance = atof(optarg);
+			else if (!strcmp(longOptions[optionIndex].name, "list"))
+				listOnly = true;
+			else if (!strcmp(longOptions[optionIndex].name, "verbose"))
+				verbose = true;
+			break;
+
+		case 'h':
+			printUsage();
+			exit(0);
+		}
+	}
+	if (configPath.empty() || options.scale <= 0)
+	{
+		printUsage();
+		return false;
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	BenchOptions options;
+	int kmerSize = 15;
+	double tolerance = 0.1;
+	bool listOnly = false;
+	bool verbose = false;
+	std::string configPath;
+	std::string filter;
+	std::string outFile;
+	std::string baselineFile;
+	if (!parseArgs(argc, argv, configPath, options, kmerSize, filter,
+				   outFile, baselineFile, tolerance, listOnly, verbose)) return 1;
+
+	Config::load(configPath);
+	Parameters::get().numThreads = options.numThreads;
+	Parameters::get().kmerSize = kmerSize;
+	Parameters::get().minimumOverlap = 5000;
+	Parameters::get().unevenCoverage = false;
+	Logger::get().setDebugging(verbose);
+
+	BenchmarkRunner runner(options);
+	registerCoreBenchmarks(runner);
+	if (listOnly)
+	{
+		for (auto& name : runner.names()) std::cout << name << std::endl;
+		return 0;
+	}
+
+	std::vector<std::string> results;
+	if (!outFile.empty())
+	{
+		std::ofstream fout(outFile);
+		if (!fout)
+		{
+			std::cerr << "Can't open " << outFile << std::endl;
+			return 1;
+		}
+		results = runner.run(filter, fout, verbose);
+	}
+	else
+	{
+		results = runner.run(filter, std::cout, verbose);
+	}
+
+	if (!baselineFile.empty())
+	{
+		int regressions = compareWithBaseline(results, baselineFile, tolerance);
+		if (regressions > 0)
+		{
+			std::cerr << regressions << " benchmark(s) regressed" << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
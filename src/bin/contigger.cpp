@@ -14,10 +14,13 @@
 #include "../common/logger.h"
 #include "../common/utils.h"
 #include "../common/memory_info.h"
+#include "../common/profiler.h"
+#include "../common/memory_budget.h"
 
 #include "../repeat_graph/repeat_graph.h"
 #include "../repeat_graph/read_aligner.h"
 #include "../repeat_graph/output_generator.h"
+#include "../repeat_graph/graph_snapshot.h"
 #include "../contigger/contig_extender.h"
 
 #include <getopt.h>
@@ -27,19 +30,24 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 			   std::string& inGraphEdges, int& kmerSize,
 			   int& minOverlap, bool& debug, size_t& numThreads, 
 			   std::string& configPath, std::string& inRepeatGraph,
-			   std::string& inReadsAlignment, bool& noScaffold)
+			   std::string& inReadsAlignment, std::string& inSnapshot,
+			   bool& noScaffold,
+			   std::string& traceFile, double& memoryLimit)
 {
 	auto printUsage = [argv]()
 	{
 		std::cerr << "Usage: flye-contigger "
 				  << " --graph-edges path --reads path --out-dir path --config path\n"
-				  << "\t\t--repeat-graph path --graph-aln path\n"
+				  << "\t\t(--repeat-graph path --graph-aln path | --graph-snapshot path)\n"
 				  << "\t\t[--log path] [--treads num] [--kmer size] [--no-scaffold]\n"
-				  << "\t\t[--min-ovlp size] [--debug] [-h]\n\n"
+				  << "\t\t[--min-ovlp size] [--debug] [--trace path]\n"
+				  << "\t\t[--memory-limit size] [-h]\n\n"
 				  << "Required arguments:\n"
 				  << "  --graph-edges path\tpath to fasta with graph edges\n"
 				  << "  --repeat-graph path\tpath to serialized repeat graph\n"
 				  << "  --graph-aln path\tpath to read-graph alignment\n"
+				  << "  --graph-snapshot path\tpath to binary graph snapshot, "
+				  << "replaces the three options above\n"
 				  << "  --reads path\tcomma-separated list of read files\n"
 				  << "  --out-dir path\tpath to output directory\n"
 				  << "  --config path\tpath to the config file\n\n"
@@ -53,6 +61,10 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 				  << "[default = false] \n"
 				  << "  --log log_file\toutput log to file "
 				  << "[default = not set] \n"
+				  << "  --trace path\twrite Chrome trace of the run phases "
+				  << "and log profiling summary [default = not set] \n"
+				  << "  --memory-limit size\tmemory budget in Gb that limits "
+				  << "the table and cache sizes [default = not set] \n"
 				  << "  --threads num_threads\tnumber of parallel threads "
 				  << "[default = 1] \n";
 	};
@@ -66,11 +78,14 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 		{"config", required_argument, 0, 0},
 		{"repeat-graph", required_argument, 0, 0},
 		{"graph-aln", required_argument, 0, 0},
+		{"graph-snapshot", required_argument, 0, 0},
 		{"log", required_argument, 0, 0},
 		{"threads", required_argument, 0, 0},
 		{"kmer", required_argument, 0, 0},
 		{"min-ovlp", required_argument, 0, 0},
 		{"debug", no_argument, 0, 0},
+		{"trace", required_argument, 0, 0},
+		{"memory-limit", required_argument, 0, 0},
 		{"no-scaffold", no_argument, 0, 0},
 		{0, 0, 0, 0}
 	};
@@ -91,6 +106,10 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 				logFile = optarg;
 			else if (!strcmp(longOptions[optionIndex].name, "debug"))
 				debug = true;
+			else if (!strcmp(longOptions[optionIndex].name, "trace"))
+				traceFile = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "memory-limit"))
+				memoryLimit = atof(optarg);
 			else if (!strcmp(longOptions[optionIndex].name, "no-scaffold"))
 				noScaffold = true;
 			else if (!strcmp(longOptions[optionIndex].name, "reads"))
@@ -103,6 +122,8 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 				inRepeatGraph = optarg;
 			else if (!strcmp(longOptions[optionIndex].name, "graph-aln"))
 				inReadsAlignment = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "graph-snapshot"))
+				inSnapshot = optarg;
 			else if (!strcmp(longOptions[optionIndex].name, "config"))
 				configPath = optarg;
 			break;
@@ -112,9 +133,10 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 			exit(0);
 		}
 	}
-	if (readsFasta.empty() || outFolder.empty() || 
-		inGraphEdges.empty() || configPath.empty() ||
-		inRepeatGraph.empty() || inReadsAlignment.empty())
+	bool textGraph = !inGraphEdges.empty() && !inRepeatGraph.empty() &&
+					 !inReadsAlignment.empty();
+	if (readsFasta.empty() || outFolder.empty() || configPath.empty() ||
+		(!textGraph && inSnapshot.empty()))
 	{
 		printUsage();
 		return false;
@@ -139,16 +161,25 @@ int main(int argc, char** argv)
 	std::string inGraphEdges;
 	std::string inRepeatGraph;
 	std::string inReadsAlignment;
+	std::string inSnapshot;
 	std::string outFolder;
 	std::string logFile;
+	std::string traceFile;
+	double memoryLimit = 0;
 	std::string configPath;
 	if (!parseArgs(argc, argv, readsFasta, outFolder, logFile, inGraphEdges,
 				   kmerSize, minOverlap, debugging, 
 				   numThreads, configPath, inRepeatGraph, 
-				   inReadsAlignment, noScaffold))  return 1;
+				   inReadsAlignment, inSnapshot, noScaffold, traceFile, memoryLimit))  return 1;
 	
 	Logger::get().setDebugging(debugging);
 	if (!logFile.empty()) Logger::get().setOutputFile(logFile);
+	if (!traceFile.empty()) Profiler::get().enableTrace(traceFile);
+	if (memoryLimit > 0)
+	{
+		MemoryBudget::get().setLimit(memoryLimit * 1024 * 1024 * 1024);
+		Logger::get().debug() << "Memory limit: " << memoryLimit << " Gb";
+	}
 	Logger::get().debug() << "Build date: " << __DATE__ << " " << __TIME__;
 	std::ios::sync_with_stdio(false);
 	
@@ -173,7 +204,7 @@ int main(int argc, char** argv)
 	std::vector<std::string> readsList = splitString(readsFasta, ',');
 	try
 	{
-		seqGraphEdges.loadFromFile(inGraphEdges);
+		if (inSnapshot.empty()) seqGraphEdges.loadFromFile(inGraphEdges);
 		for (auto& readsFile : readsList)
 		{
 			seqReads.loadFromFile(readsFile);
@@ -189,10 +220,18 @@ int main(int argc, char** argv)
 
 	SequenceContainer emptyContainer;
 	RepeatGraph rg(emptyContainer, &seqGraphEdges);
-	rg.loadGraph(inRepeatGraph);
-	rg.validateGraph();
 	ReadAligner aln(rg, seqReads);
-	aln.loadAlignments(inReadsAlignment);
+	if (!inSnapshot.empty())
+	{
+		GraphSnapshot::load(inSnapshot, rg, aln, seqGraphEdges, seqReads);
+		rg.validateGraph();
+	}
+	else
+	{
+		rg.loadGraph(inRepeatGraph);
+		rg.validateGraph();
+		aln.loadAlignments(inReadsAlignment);
+	}
 	OutputGenerator outGen(rg, aln, seqReads);
 
 	//Logger::get().info() << "Generating contigs";
@@ -225,5 +264,6 @@ int main(int argc, char** argv)
 	Logger::get().debug() << "Peak RAM usage: " 
 		<< getPeakRSS() / 1024 / 1024 / 1024 << " Gb";
 
+	Profiler::get().finish();
 	return 0;
 }
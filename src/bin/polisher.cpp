@@ -8,42 +8,90 @@
 #include <cstring>
 
 #include "../polishing/bubble_processor.h"
+#include "../polishing/bubble_generator.h"
+#include "../common/profiler.h"
+#include "../common/memory_budget.h"
 
 
-bool parseArgs(int argc, char** argv, std::string& bubblesFile, 
+bool parseArgs(int argc, char** argv, std::string& bubblesFile,
+			   std::string& contigsFile, std::string& readsFiles,
+			   std::string& platform, std::string& outStats,
+			   std::string& outBubbles, double& alnBuffer,
 			   std::string& scoringMatrix, std::string& hopoMatrix,
 			   std::string& outConsensus, std::string& outVerbose,
-			   int& numThreads, bool& quiet)
+			   std::string& outBubbleStats, int& numThreads, bool& quiet,
+			   bool& fastMode, bool& hopoCorrection,
+			   std::string& traceFile, double& memoryLimit)
 {
 	auto printUsage = [argv]()
 	{
 		std::cerr << "Usage: flye-polish "
 				  << " --bubbles path --subs-mat path --hopo-mat size --out path\n"
-				  << "\t\t[--treads num] [--quiet] [--debug] [-h]\n\n"
+				  << "\t\t[--treads num] [--fast] [--hopo] [--bubble-stats path]\n"
+				  << "\t\t[--quiet] [--debug] [--trace path]\n"
+				  << "\t\t[--memory-limit size] [-h]\n"
+				  << "       flye-polish "
+				  << " --contigs path --reads path --platform name\n"
+				  << "\t\t--subs-mat path --hopo-mat size --out path\n"
+				  << "\t\t[--out-stats path] [--out-bubbles path] [--aln-buffer size]\n"
+				  << "\t\t[--treads num] [--fast] [--hopo] [--bubble-stats path]\n"
+				  << "\t\t[--quiet] [--debug] [--trace path]\n"
+				  << "\t\t[--memory-limit size] [-h]\n\n"
 				  << "Required arguments:\n"
 				  << "  --bubbles path\tpath to bubbles file\n"
 				  << "  --subs-mat path\tpath to substitution matrix\n"
 				  << "  --hopo-mat size\tpath to homopolymer matrix\n"
 				  << "  --out path\tpath to output file\n\n"
+				  << "In-process alignment mode (instead of --bubbles):\n"
+				  << "  --contigs path\tpath to contigs (chunks) file\n"
+				  << "  --reads path\tcomma-separated list of read files\n"
+				  << "  --platform name\tsequencing platform (pacbio / nano)\n"
+				  << "  --out-stats path\tpath to alignment statistics output\n"
+				  << "  --out-bubbles path\toutput constructed bubbles "
+				  << "(same format as --bubbles)\n"
+				  << "  --aln-buffer size\tmaximum size (in Gb) of the buffered "
+				  << "alignments, contigs are processed in batches "
+				  << "[default = 4]\n\n"
 				  << "Optional arguments:\n"
 				  << "  --quiet \t\tno terminal output "
 				  << "[default = false] \n"
 				  << "  --debug \t\textra debug output "
 				  << "[default = false] \n"
+				  << "  --fast \t\tsubsample deep bubbles and stop optimization "
+				  << "early [default = false] \n"
+				  << "  --hopo \t\thomopolymer length correction "
+				  << "[default = false] \n"
+				  << "  --bubble-stats path\toutput per-bubble iteration counts "
+				  << "and timings [default = not set] \n"
+				  << "  --trace path\twrite Chrome trace of the run phases "
+				  << "and log profiling summary [default = not set] \n"
+				  << "  --memory-limit size\tmemory budget in Gb that limits "
+				  << "the table and cache sizes [default = not set] \n"
 				  << "  --threads num_threads\tnumber of parallel threads "
 				  << "[default = 1] \n";
 	};
-	
+
 	int optionIndex = 0;
 	static option longOptions[] =
 	{
 		{"bubbles", required_argument, 0, 0},
+		{"contigs", required_argument, 0, 0},
+		{"reads", required_argument, 0, 0},
+		{"platform", required_argument, 0, 0},
+		{"out-stats", required_argument, 0, 0},
+		{"out-bubbles", required_argument, 0, 0},
+		{"aln-buffer", required_argument, 0, 0},
 		{"subs-mat", required_argument, 0, 0},
 		{"hopo-mat", required_argument, 0, 0},
 		{"out", required_argument, 0, 0},
 		{"threads", required_argument, 0, 0},
+		{"bubble-stats", required_argument, 0, 0},
 		{"debug", no_argument, 0, 0},
+		{"trace", required_argument, 0, 0},
+		{"memory-limit", required_argument, 0, 0},
 		{"quiet", no_argument, 0, 0},
+		{"fast", no_argument, 0, 0},
+		{"hopo", no_argument, 0, 0},
 		{0, 0, 0, 0}
 	};
 
@@ -57,10 +105,32 @@ bool parseArgs(int argc, char** argv, std::string& bubblesFile,
 				numThreads = atoi(optarg);
 			else if (!strcmp(longOptions[optionIndex].name, "debug"))
 				outVerbose = true;
+			else if (!strcmp(longOptions[optionIndex].name, "trace"))
+				traceFile = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "memory-limit"))
+				memoryLimit = atof(optarg);
 			else if (!strcmp(longOptions[optionIndex].name, "quiet"))
 				quiet = true;
+			else if (!strcmp(longOptions[optionIndex].name, "fast"))
+				fastMode = true;
+			else if (!strcmp(longOptions[optionIndex].name, "hopo"))
+				hopoCorrection = true;
+			else if (!strcmp(longOptions[optionIndex].name, "bubble-stats"))
+				outBubbleStats = optarg;
 			else if (!strcmp(longOptions[optionIndex].name, "bubbles"))
 				bubblesFile = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "contigs"))
+				contigsFile = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "reads"))
+				readsFiles = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "platform"))
+				platform = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "out-stats"))
+				outStats = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "out-bubbles"))
+				outBubbles = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "aln-buffer"))
+				alnBuffer = atof(optarg);
 			else if (!strcmp(longOptions[optionIndex].name, "subs-mat"))
 				scoringMatrix = optarg;
 			else if (!strcmp(longOptions[optionIndex].name, "hopo-mat"))
@@ -74,7 +144,10 @@ bool parseArgs(int argc, char** argv, std::string& bubblesFile,
 			exit(0);
 		}
 	}
-	if (bubblesFile.empty() || scoringMatrix.empty() || 
+	bool bubblesInput = !bubblesFile.empty();
+	bool alignmentInput = !contigsFile.empty() && !readsFiles.empty() &&
+						  !platform.empty();
+	if (bubblesInput == alignmentInput || scoringMatrix.empty() ||
 		hopoMatrix.empty() || outConsensus.empty())
 	{
 		printUsage();
@@ -84,24 +157,65 @@ bool parseArgs(int argc, char** argv, std::string& bubblesFile,
 	return true;
 }
 
-int main(int argc, char* argv[]) 
+int main(int argc, char* argv[])
 {
 	std::string bubblesFile;
+	std::string contigsFile;
+	std::string readsFiles;
+	std::string platform;
+	std::string outStats;
+	std::string outBubbles;
+	double alnBuffer = 0;
 	std::string scoringMatrix;
 	std::string hopoMatrix;
 	std::string outConsensus;
 	std::string outVerbose;
+	std::string outBubbleStats;
+	std::string traceFile;
+	double memoryLimit = 0;
 	int  numThreads = 1;
 	bool quiet = false;
-	if (!parseArgs(argc, argv, bubblesFile, scoringMatrix, 
-				   hopoMatrix, outConsensus, outVerbose, numThreads,
-				   quiet))
+	bool fastMode = false;
+	bool hopoCorrection = false;
+	if (!parseArgs(argc, argv, bubblesFile, contigsFile, readsFiles, platform,
+				   outStats, outBubbles, alnBuffer, scoringMatrix, hopoMatrix, outConsensus,
+				   outVerbose, outBubbleStats, numThreads, quiet, fastMode,
+				   hopoCorrection, traceFile, memoryLimit))
 		return 1;
 
+	if (!traceFile.empty()) Profiler::get().enableTrace(traceFile);
+	if (memoryLimit > 0)
+	{
+		MemoryBudget::get().setLimit(memoryLimit * 1024 * 1024 * 1024);
+		Logger::get().debug() << "Memory limit: " << memoryLimit << " Gb";
+	}
+
 	BubbleProcessor bp(scoringMatrix, hopoMatrix, !quiet);
 	if (!outVerbose.empty())
 		bp.enableVerboseOutput(outVerbose);
-	bp.polishAll(bubblesFile, outConsensus, numThreads); 
+	if (!outBubbleStats.empty())
+		bp.enableStatsOutput(outBubbleStats);
+	if (fastMode)
+		bp.enableFastMode();
+	if (hopoCorrection)
+		bp.enableHopoCorrection();
+
+	if (!bubblesFile.empty())
+	{
+		bp.polishAll(bubblesFile, outConsensus, numThreads);
+	}
+	else
+	{
+		if (!outBubbles.empty())
+			bp.enableBubblesOutput(outBubbles);
+		BubbleGenerator generator(contigsFile, splitString(readsFiles, ','),
+								  platform);
+		if (alnBuffer > 0)
+			generator.setBufferLimit(alnBuffer * 1024 * 1024 * 1024);
+		bp.polishAll(generator, outConsensus, numThreads);
+		if (!outStats.empty()) generator.writeStats(outStats);
+	}
 
+	Profiler::get().finish();
 	return 0;
 }
@@ -13,6 +13,8 @@
 #include "../common/logger.h"
 #include "../common/utils.h"
 #include "../common/memory_info.h"
+#include "../common/profiler.h"
+#include "../common/memory_budget.h"
 
 #include "../repeat_graph/repeat_graph.h"
 #include "../repeat_graph/multiplicity_inferer.h"
@@ -20,6 +22,7 @@
 #include "../repeat_graph/graph_processing.h"
 #include "../repeat_graph/repeat_resolver.h"
 #include "../repeat_graph/output_generator.h"
+#include "../repeat_graph/graph_snapshot.h"
 
 #include <getopt.h>
 
@@ -28,14 +31,16 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 			   std::string& inAssembly, int& kmerSize,
 			   int& minOverlap, bool& debug, size_t& numThreads, 
 			   std::string& configPath, bool& unevenCov,
-			   bool& keepHaplotypes)
+			   bool& keepHaplotypes,
+			   std::string& traceFile, double& memoryLimit)
 {
 	auto printUsage = [argv]()
 	{
 		std::cerr << "Usage: flye-repeat "
 				  << " --disjointigs path --reads path --out-dir path --config path\n"
 				  << "\t\t[--log path] [--treads num] [--kmer size] [--meta] [--keep-haplotypes]\n"
-				  << "\t\t[--min-ovlp size] [--debug] [-h]\n\n"
+				  << "\t\t[--min-ovlp size] [--debug] [--trace path]\n"
+				  << "\t\t[--memory-limit size] [-h]\n\n"
 				  << "Required arguments:\n"
 				  << "  --disjointigs path\tpath to disjointigs file\n"
 				  << "  --reads path\tcomma-separated list of read files\n"
@@ -53,6 +58,10 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 				  << "[default = false] \n"
 				  << "  --log log_file\toutput log to file "
 				  << "[default = not set] \n"
+				  << "  --trace path\twrite Chrome trace of the run phases "
+				  << "and log profiling summary [default = not set] \n"
+				  << "  --memory-limit size\tmemory budget in Gb that limits "
+				  << "the table and cache sizes [default = not set] \n"
 				  << "  --threads num_threads\tnumber of parallel threads "
 				  << "[default = 1] \n";
 	};
@@ -71,6 +80,8 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 		{"meta", no_argument, 0, 0},
 		{"keep-haplotypes", no_argument, 0, 0},
 		{"debug", no_argument, 0, 0},
+		{"trace", required_argument, 0, 0},
+		{"memory-limit", required_argument, 0, 0},
 		{0, 0, 0, 0}
 	};
 
@@ -90,6 +101,10 @@ bool parseArgs(int argc, char** argv, std::string& readsFasta,
 				logFile = optarg;
 			else if (!strcmp(longOptions[optionIndex].name, "debug"))
 				debug = true;
+			else if (!strcmp(longOptions[optionIndex].name, "trace"))
+				traceFile = optarg;
+			else if (!strcmp(longOptions[optionIndex].name, "memory-limit"))
+				memoryLimit = atof(optarg);
 			else if (!strcmp(longOptions[optionIndex].name, "meta"))
 				unevenCov = true;
 			else if (!strcmp(longOptions[optionIndex].name, "keep-haplotypes"))
@@ -136,13 +151,21 @@ int main(int argc, char** argv)
 	std::string inAssembly;
 	std::string outFolder;
 	std::string logFile;
+	std::string traceFile;
+	double memoryLimit = 0;
 	std::string configPath;
 	if (!parseArgs(argc, argv, readsFasta, outFolder, logFile, inAssembly,
 				   kmerSize, minOverlap, debugging, 
-				   numThreads, configPath, isMeta, keepHaplotypes))  return 1;
+				   numThreads, configPath, isMeta, keepHaplotypes, traceFile, memoryLimit))  return 1;
 	
 	Logger::get().setDebugging(debugging);
 	if (!logFile.empty()) Logger::get().setOutputFile(logFile);
+	if (!traceFile.empty()) Profiler::get().enableTrace(traceFile);
+	if (memoryLimit > 0)
+	{
+		MemoryBudget::get().setLimit(memoryLimit * 1024 * 1024 * 1024);
+		Logger::get().debug() << "Memory limit: " << memoryLimit << " Gb";
+	}
 	Logger::get().debug() << "Build date: " << __DATE__ << " " << __TIME__;
 	std::ios::sync_with_stdio(false);
 	
@@ -280,9 +303,12 @@ int main(int argc, char** argv)
 	SequenceContainer::writeFasta(edgeSequences.iterSeqs(), 
 								  outFolder + "/repeat_graph_edges.fasta",
 								  /*only pos strand*/ true);
+	GraphSnapshot::store(outFolder + "/repeat_graph_snapshot", rg, 
+						 aligner, seqReads);
 
 	Logger::get().debug() << "Peak RAM usage: " 
 		<< getPeakRSS() / 1024 / 1024 / 1024 << " Gb";
 
+	Profiler::get().finish();
 	return 0;
 }
@@ -15,6 +15,8 @@
 #include <vector>
 #include <mutex>
 
+#include "memory_budget.h"
+
 template <class T, int ChunkSize = 1024 * 1024>
 class ChunkPool
 {
@@ -28,6 +30,7 @@ public:
 
 	{
 		for (T* chunk : _freeChunks) delete[] chunk;
+		MemoryBudget::get().release(_freeChunks.size() * CHUNK_BYTES);
 		_freeChunks.clear();
 	}
 
@@ -42,12 +45,20 @@ public:
 		}
 		else
 		{
+			MemoryBudget::get().reserve(CHUNK_BYTES);
 			return new T[ChunkSize];
 		}
 	}
 
+	//free chunks are not kept when close to the memory limit
 	void returnChunk(T* chunk)
 	{
+		if (MemoryBudget::get().underPressure())
+		{
+			delete[] chunk;
+			MemoryBudget::get().release(CHUNK_BYTES);
+			return;
+		}
 		std::lock_guard<std::mutex> lock(_chunkMutex);
 		_freeChunks.push_back(chunk);
 	}
@@ -55,6 +66,8 @@ public:
 	size_t numberChunks() {return _freeChunks.size();}
 	
 private:
+	static const size_t CHUNK_BYTES = ChunkSize * sizeof(T);
+
 	std::mutex 		_chunkMutex;
 	std::vector<T*> _freeChunks;
 };
@@ -2,6 +2,8 @@
 //This file is a part of Ragout program.
 //Released under the BSD license (see LICENSE file)
 
+#pragma once
+
 #include <vector>
 #include <unordered_map>
 
@@ -50,14 +52,24 @@ void unionSet(SetNode<T>* node1, SetNode<T>* node2)
 	}
 }
 
+//Groups are listed in the order of their first elements,
+//so the result does not depend on the addresses of the nodes
 template <typename T>
-std::unordered_map<SetNode<T>*, std::vector<T>> 
+std::vector<std::pair<SetNode<T>*, std::vector<T>>>
 	groupBySet(const std::vector<SetNode<T>*>& sets)
 {
-	std::unordered_map<SetNode<T>*, std::vector<T>> groups;
+	std::unordered_map<SetNode<T>*, size_t> groupIds;
+	std::vector<std::pair<SetNode<T>*, std::vector<T>>> groups;
 	for (auto& setNode : sets)
 	{
-		groups[findSet(setNode)].push_back(setNode->data);
+		SetNode<T>* root = findSet(setNode);
+		auto itGroup = groupIds.find(root);
+		if (itGroup == groupIds.end())
+		{
+			itGroup = groupIds.emplace(root, groups.size()).first;
+			groups.emplace_back(root, std::vector<T>());
+		}
+		groups[itGroup->second].second.push_back(setNode->data);
 	}
 	return groups;
 }
@@ -76,3 +88,78 @@ public:
 	}
 };
 
+//Disjoint set over the indices [0, size), stored in flat arrays.
+//Useful when the elements themselves are kept in a vector, so
+//no per-element nodes need to be allocated
+class IndexSet
+{
+public:
+	explicit IndexSet(size_t size = 0): _parent(size), _rank(size, 0)
+	{
+		for (size_t i = 0; i < size; ++i) _parent[i] = i;
+	}
+
+	size_t add()
+	{
+		_parent.push_back(_parent.size());
+		_rank.push_back(0);
+		return _parent.size() - 1;
+	}
+
+	size_t size() const {return _parent.size();}
+
+	size_t findSet(size_t elem)
+	{
+		//path halving
+		while (_parent[elem] != elem)
+		{
+			_parent[elem] = _parent[_parent[elem]];
+			elem = _parent[elem];
+		}
+		return elem;
+	}
+
+	void unionSet(size_t elemOne, size_t elemTwo)
+	{
+		size_t root1 = this->findSet(elemOne);
+		size_t root2 = this->findSet(elemTwo);
+		if (root1 == root2) return;
+
+		if (_rank[root1] > _rank[root2])
+		{
+			_parent[root2] = root1;
+		}
+		else
+		{
+			_parent[root1] = root2;
+			if (_rank[root1] == _rank[root2])
+			{
+				++_rank[root2];
+			}
+		}
+	}
+
+	//groups the elements by their sets. Groups are ordered by 
+	//their smallest element, and each group is sorted
+	std::vector<std::vector<size_t>> groups()
+	{
+		const size_t NO_GROUP = -1;
+		std::vector<size_t> rootGroup(_parent.size(), NO_GROUP);
+		std::vector<std::vector<size_t>> result;
+		for (size_t i = 0; i < _parent.size(); ++i)
+		{
+			size_t root = this->findSet(i);
+			if (rootGroup[root] == NO_GROUP)
+			{
+				rootGroup[root] = result.size();
+				result.emplace_back();
+			}
+			result[rootGroup[root]].push_back(i);
+		}
+		return result;
+	}
+
+private:
+	std::vector<size_t> _parent;
+	std::vector<int> 	_rank;
+};
@@ -11,7 +11,7 @@ template <class T>
 class Matrix
 {
 public:
-	Matrix(): _rows(0), _cols(0), _data(nullptr) {}
+	Matrix(): _rows(0), _cols(0), _capacity(0), _data(nullptr) {}
 	Matrix(const Matrix& other):
 		Matrix(other._rows, other._cols)
 	{
@@ -24,12 +24,14 @@ public:
 	{
 		std::swap(_cols, other._cols);
 		std::swap(_rows, other._rows);
+		std::swap(_capacity, other._capacity);
 		std::swap(_data, other._data);
 	}
 	Matrix& operator=(Matrix && other)
 	{
 		std::swap(_cols, other._cols);
 		std::swap(_rows, other._rows);
+		std::swap(_capacity, other._capacity);
 		std::swap(_data, other._data);
 		return *this;
 	}
@@ -38,12 +40,13 @@ public:
 		Matrix temp(other);
 		std::swap(_cols, temp._cols);
 		std::swap(_rows, temp._rows);
+		std::swap(_capacity, temp._capacity);
 		std::swap(_data, temp._data);
 		return *this;
 	}
 
 	Matrix(size_t rows, size_t cols, T val = 0):
-		_rows(rows), _cols(cols)
+		_rows(rows), _cols(cols), _capacity(rows * cols)
 	{
 		if (!rows || !cols)
 			throw std::runtime_error("Zero matrix dimension");
@@ -55,6 +58,22 @@ public:
 		if (_data) delete[] _data;
 	}
 
+	//changes the dimensions, reusing the allocated memory if
+	//it is large enough. The content is left uninitialized
+	void resize(size_t rows, size_t cols)
+	{
+		if (!rows || !cols)
+			throw std::runtime_error("Zero matrix dimension");
+		if (rows * cols > _capacity)
+		{
+			if (_data) delete[] _data;
+			_data = new T[rows * cols];
+			_capacity = rows * cols;
+		}
+		_rows = rows;
+		_cols = cols;
+	}
+
 	T& at(size_t row, size_t col) {return _data[row * _cols + col];}
 	const T& at(size_t row, size_t col) const {return _data[row * _cols + col];}
 	size_t nrows() const {return _rows;}
@@ -63,5 +82,6 @@ public:
 private:
 	size_t _rows;
 	size_t _cols;
+	size_t _capacity;
 	T* _data;
 };
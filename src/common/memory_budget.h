@@ -0,0 +1,109 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Process-wide memory budget. Large allocations (k-mer counting tables,
+//index and container chunks) are registered here, and the subsystems
+//query the budget to choose their table sizes and cache capacities,
+//and to evict caches / throttle new work when the usage approaches
+//the limit. The memory that is not registered (hash tables, sequences)
+//is taken into account through the current RSS.
+//Without a limit (default) the budget only does the accounting,
+//and all the sizes stay at their defaults
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+#include "memory_info.h"
+
+class MemoryBudget
+{
+public:
+	static MemoryBudget& get()
+	{
+		static MemoryBudget instance;
+		return instance;
+	}
+
+	//should be called before any parallel work is started
+	void setLimit(size_t bytes) {_limit = bytes;}
+	size_t limit() const {return _limit;}
+	bool limited() const {return _limit > 0;}
+
+	//registers / unregisters a large allocation
+	void reserve(size_t bytes)
+	{
+		size_t newReserved = (_reserved += bytes);
+		size_t curPeak = _peakReserved;
+		while (newReserved > curPeak &&
+			   !_peakReserved.compare_exchange_weak(curPeak, newReserved)) {}
+	}
+	void release(size_t bytes) {_reserved -= bytes;}
+
+	size_t reserved() const {return _reserved;}
+	size_t peakReserved() const {return _peakReserved;}
+
+	//usage estimate: registered allocations or RSS, whichever is larger
+	size_t used() const {return std::max((size_t)_reserved, this->currentRss());}
+
+	//memory left within the limit
+	size_t available() const
+	{
+		if (!this->limited()) return std::numeric_limits<size_t>::max();
+		size_t curUsed = this->used();
+		return curUsed < _limit ? _limit - curUsed : 0;
+	}
+
+	//size of a new table / cache: the default size, unless it does not
+	//fit into the given fraction of the available memory
+	size_t share(size_t defaultSize, double fraction, size_t minSize = 0) const
+	{
+		if (!this->limited()) return defaultSize;
+		size_t fitSize = this->available() * fraction;
+		return std::max(minSize, std::min(defaultSize, fitSize));
+	}
+
+	//the usage is close to the limit: caches should be evicted,
+	//and no new memory-heavy work should be started
+	bool underPressure() const
+	{
+		if (!this->limited()) return false;
+		return this->used() > _limit * PRESSURE_RATE;
+	}
+
+private:
+	MemoryBudget():
+		_limit(0), _reserved(0), _peakReserved(0),
+		_rss(0), _rssTimestamp(0)
+	{}
+	MemoryBudget(const MemoryBudget&) = delete;
+	void operator=(const MemoryBudget&) = delete;
+
+	//reading RSS requires a syscall, so the value is updated
+	//at most once per RSS_INTERVAL
+	size_t currentRss() const
+	{
+		int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>
+			(std::chrono::steady_clock::now().time_since_epoch()).count();
+		int64_t prevTimestamp = _rssTimestamp;
+		if (now - prevTimestamp >= RSS_INTERVAL_MS &&
+			_rssTimestamp.compare_exchange_strong(prevTimestamp, now))
+		{
+			_rss = getCurrentRSS();
+		}
+		return _rss;
+	}
+
+	const double  PRESSURE_RATE = 0.9;
+	const int64_t RSS_INTERVAL_MS = 50;
+
+	size_t 				_limit;
+	std::atomic<size_t> _reserved;
+	std::atomic<size_t> _peakReserved;
+	mutable std::atomic<size_t>  _rss;
+	mutable std::atomic<int64_t> _rssTimestamp;
+};
@@ -0,0 +1,384 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Lightweight built-in profiling: scoped phase timers, per-thread
+//counters and periodic RSS sampling. Everything is disabled unless
+//a trace file is set. The trace is written in the Chrome trace
+//format (can be opened with chrome://tracing or ui.perfetto.dev),
+//and the per-phase summary table goes to the log
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <condition_variable>
+#include <unordered_map>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include "logger.h"
+#include "memory_info.h"
+
+class Profiler
+{
+public:
+	static Profiler& get()
+	{
+		static Profiler instance;
+		return instance;
+	}
+
+	//should be called before any parallel work is started
+	void enableTrace(const std::string& filename)
+	{
+		_traceFile = filename;
+		_enabled = true;
+		this->sampleRss();
+		_sampler = std::thread([this]()
+		{
+			std::unique_lock<std::mutex> lock(_samplerMutex);
+			while (!_stopSampler)
+			{
+				_samplerCv.wait_for(lock, SAMPLE_INTERVAL);
+				if (!_stopSampler) this->sampleRss();
+			}
+		});
+	}
+
+	bool enabled() const {return _enabled;}
+
+	//microseconds since the profiler start
+	int64_t timestamp() const
+	{
+		return std::chrono::duration_cast<std::chrono::microseconds>
+			(std::chrono::steady_clock::now() - _startTime).count();
+	}
+
+	//counters are registered once (typically into a static variable)
+	//and then accumulated separately by each thread
+	size_t registerCounter(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(_registryMutex);
+		auto itCounter = std::find(_counterNames.begin(),
+								   _counterNames.end(), name);
+		if (itCounter != _counterNames.end())
+		{
+			return itCounter - _counterNames.begin();
+		}
+		_counterNames.push_back(name);
+		return _counterNames.size() - 1;
+	}
+
+	void addCounter(size_t counterId, double value)
+	{
+		if (!_enabled) return;
+		ThreadData& data = this->threadData();
+		if (data.counters.size() <= counterId)
+		{
+			data.counters.resize(counterId + 1, 0);
+		}
+		data.counters[counterId] += value;
+	}
+
+	void addEvent(const char* name, int64_t start)
+	{
+		int64_t end = this->timestamp();
+		size_t rss = getCurrentRSS();
+		this->threadData().events.push_back({name, start, end - start, rss});
+	}
+
+	//stops the sampling and writes the trace and summary.
+	//Should be called once, after all worker threads are joined
+	void finish()
+	{
+		if (!_enabled) return;
+		{
+			std::lock_guard<std::mutex> lock(_samplerMutex);
+			_stopSampler = true;
+		}
+		_samplerCv.notify_all();
+		_sampler.join();
+		this->sampleRss();
+
+		this->writeTrace();
+		this->logSummary();
+		_enabled = false;
+	}
+
+private:
+	const std::chrono::milliseconds SAMPLE_INTERVAL =
+		std::chrono::milliseconds(500);
+
+	struct TraceEvent
+	{
+		const char* name;
+		int64_t 	start;
+		int64_t 	duration;
+		size_t 		rssAfter;
+	};
+	struct ThreadData
+	{
+		size_t 					threadId;
+		std::vector<TraceEvent> events;
+		std::vector<double> 	counters;
+	};
+	struct RssSample
+	{
+		int64_t time;
+		size_t 	rss;
+	};
+
+	Profiler():
+		_enabled(false), _stopSampler(false),
+		_startTime(std::chrono::steady_clock::now())
+	{}
+	~Profiler()
+	{
+		if (_sampler.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(_samplerMutex);
+				_stopSampler = true;
+			}
+			_samplerCv.notify_all();
+			_sampler.join();
+		}
+	}
+
+	ThreadData& threadData()
+	{
+		//thread data is owned by the profiler, so it stays
+		//available after the thread exits
+		thread_local ThreadData* data = nullptr;
+		if (!data)
+		{
+			std::lock_guard<std::mutex> lock(_registryMutex);
+			_threads.emplace_back(new ThreadData);
+			data = _threads.back().get();
+			data->threadId = _threads.size() - 1;
+		}
+		return *data;
+	}
+
+	void sampleRss()
+	{
+		RssSample sample {this->timestamp(), getCurrentRSS()};
+		std::lock_guard<std::mutex> lock(_registryMutex);
+		_rssSamples.push_back(sample);
+	}
+
+	static double toMb(size_t bytes)
+	{
+		return (double)bytes / 1024 / 1024;
+	}
+
+	void writeTrace()
+	{
+		std::ofstream fout(_traceFile);
+		if (!fout)
+		{
+			throw std::runtime_error("Can't open " + _traceFile);
+		}
+		fout << std::fixed << std::setprecision(1);
+
+		fout << "{\"traceEvents\": [\n";
+		bool first = true;
+		auto separator = [&first, &fout]()
+		{
+			if (!first) fout << ",\n";
+			first = false;
+		};
+		for (auto& thread : _threads)
+		{
+			separator();
+			fout << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, "
+				 << "\"tid\": " << thread->threadId << ", \"args\": {\"name\": "
+				 << "\"thread " << thread->threadId << "\"}}";
+			for (auto& event : thread->events)
+			{
+				separator();
+				fout << "{\"name\": \"" << event.name << "\", \"ph\": \"X\", "
+					 << "\"pid\": 0, \"tid\": " << thread->threadId
+					 << ", \"ts\": " << event.start << ", \"dur\": "
+					 << event.duration << ", \"args\": {\"rss_mb\": "
+					 << toMb(event.rssAfter) << "}}";
+			}
+		}
+		for (auto& sample : _rssSamples)
+		{
+			separator();
+			fout << "{\"name\": \"RSS\", \"ph\": \"C\", \"pid\": 0, \"ts\": "
+				 << sample.time << ", \"args\": {\"Mb\": "
+				 << toMb(sample.rss) << "}}";
+		}
+		fout << "\n],\n\"displayTimeUnit\": \"ms\",\n\"otherData\": {";
+
+		//counters, summed over all threads
+		auto totals = this->counterTotals();
+		for (size_t i = 0; i < _counterNames.size(); ++i)
+		{
+			if (i > 0) fout << ", ";
+			fout << "\"" << _counterNames[i] << "\": " << totals[i];
+		}
+		fout << "}}\n";
+	}
+
+	std::vector<double> counterTotals() const
+	{
+		std::vector<double> totals(_counterNames.size(), 0);
+		for (auto& thread : _threads)
+		{
+			for (size_t i = 0; i < thread->counters.size(); ++i)
+			{
+				totals[i] += thread->counters[i];
+			}
+		}
+		return totals;
+	}
+
+	void logSummary()
+	{
+		//phases in the order of their first invocation
+		struct PhaseStats
+		{
+			int64_t firstStart;
+			size_t 	calls;
+			int64_t totalTime;
+			size_t 	peakRss;
+		};
+		std::unordered_map<std::string, PhaseStats> phases;
+		for (auto& thread : _threads)
+		{
+			for (auto& event : thread->events)
+			{
+				auto itPhase = phases.find(event.name);
+				if (itPhase == phases.end())
+				{
+					itPhase = phases.insert({event.name,
+						{event.start, 0, 0, 0}}).first;
+				}
+				PhaseStats& stats = itPhase->second;
+				stats.firstStart = std::min(stats.firstStart, event.start);
+				++stats.calls;
+				stats.totalTime += event.duration;
+
+				//peak of the RSS samples taken during the event
+				stats.peakRss = std::max(stats.peakRss, event.rssAfter);
+				auto itSample = std::lower_bound(_rssSamples.begin(),
+					_rssSamples.end(), event.start,
+					[](const RssSample& s, int64_t t) {return s.time < t;});
+				for (; itSample != _rssSamples.end() &&
+					   itSample->time <= event.start + event.duration;
+					   ++itSample)
+				{
+					stats.peakRss = std::max(stats.peakRss, itSample->rss);
+				}
+			}
+		}
+		std::vector<std::pair<std::string, PhaseStats>>
+			sortedPhases(phases.begin(), phases.end());
+		std::sort(sortedPhases.begin(), sortedPhases.end(),
+				  [](const std::pair<std::string, PhaseStats>& p1,
+					 const std::pair<std::string, PhaseStats>& p2)
+				  {return p1.second.firstStart < p2.second.firstStart;});
+
+		auto formatRow = [](const std::string& name, const std::string& col1,
+							const std::string& col2, const std::string& col3)
+		{
+			std::stringstream ss;
+			ss << std::left << std::setw(32) << name << std::right
+				<< std::setw(10) << col1 << std::setw(14) << col2
+				<< std::setw(16) << col3;
+			return ss.str();
+		};
+		auto formatNum = [](double value, int precision)
+		{
+			std::stringstream ss;
+			ss << std::fixed << std::setprecision(precision) << value;
+			return ss.str();
+		};
+
+		//phase times are inclusive of the nested phases
+		Logger::get().info() << "Profiling summary (trace written to "
+			<< _traceFile << "):";
+		Logger::get().info() << formatRow("Phase", "Calls", "Time, s",
+										  "Peak RSS, Mb");
+		for (auto& phase : sortedPhases)
+		{
+			Logger::get().info() << formatRow(phase.first,
+				std::to_string(phase.second.calls),
+				formatNum((double)phase.second.totalTime / 1000000, 2),
+				formatNum(toMb(phase.second.peakRss), 0));
+		}
+
+		//counters: total over all threads and maximum per thread
+		if (!_counterNames.empty())
+		{
+			Logger::get().info() << formatRow("Counter", "Threads", "Total",
+											  "Max per thread");
+			auto totals = this->counterTotals();
+			for (size_t i = 0; i < _counterNames.size(); ++i)
+			{
+				size_t numThreads = 0;
+				double maxValue = 0;
+				for (auto& thread : _threads)
+				{
+					if (i < thread->counters.size() && thread->counters[i] != 0)
+					{
+						++numThreads;
+						maxValue = std::max(maxValue, thread->counters[i]);
+					}
+				}
+				Logger::get().info() << formatRow(_counterNames[i],
+					std::to_string(numThreads), formatNum(totals[i], 2),
+					formatNum(maxValue, 2));
+			}
+		}
+		Logger::get().info() << "Peak RSS: " << formatNum(toMb(getPeakRSS()), 0)
+			<< " Mb";
+	}
+
+	bool 		_enabled;
+	std::string _traceFile;
+
+	std::mutex 								 _registryMutex;
+	std::vector<std::unique_ptr<ThreadData>> _threads;
+	std::vector<std::string> 				 _counterNames;
+	std::vector<RssSample> 					 _rssSamples;
+
+	std::thread 			_sampler;
+	std::mutex 				_samplerMutex;
+	std::condition_variable _samplerCv;
+	bool 					_stopSampler;
+
+	std::chrono::steady_clock::time_point _startTime;
+};
+
+//Records the lifetime of the object as a named phase.
+//The name should be a string literal
+class ScopedTimer
+{
+public:
+	explicit ScopedTimer(const char* name):
+		_name(name),
+		_start(Profiler::get().enabled() ? Profiler::get().timestamp() : -1)
+	{}
+	~ScopedTimer()
+	{
+		if (_start >= 0) Profiler::get().addEvent(_name, _start);
+	}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+	const char* _name;
+	int64_t 	_start;
+};
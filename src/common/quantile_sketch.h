@@ -0,0 +1,226 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Streaming quantile estimation with a log-binned histogram: a value
+//v > 0 is counted in the bin ceil(log_gamma(v)), so any quantile is
+//reported with a relative error below SKETCH_ACCURACY. The memory
+//only depends on the range of the values (not on their number),
+//and two sketches are merged by adding up their bins.
+//With the chosen accuracy, integers up to ~250 (e.g. coverage values)
+//are restored exactly after rounding
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <memory>
+
+class QuantileSketch
+{
+public:
+	static constexpr double SKETCH_ACCURACY = 0.002;
+	static constexpr double SKETCH_MIN_VALUE = 1e-9;	//smaller values are zeros
+
+	QuantileSketch(): _zeroCount(0), _count(0) {}
+
+	void add(double value, uint64_t count = 1)
+	{
+		if (std::fabs(value) < SKETCH_MIN_VALUE)
+		{
+			_zeroCount += count;
+		}
+		else if (value > 0)
+		{
+			_positive.add(binIndex(value), count);
+		}
+		else
+		{
+			_negative.add(binIndex(-value), count);
+		}
+		_count += count;
+	}
+
+	void merge(const QuantileSketch& other)
+	{
+		_positive.merge(other._positive);
+		_negative.merge(other._negative);
+		_zeroCount += other._zeroCount;
+		_count += other._count;
+	}
+
+	void clear()
+	{
+		_positive = BinStore();
+		_negative = BinStore();
+		_zeroCount = 0;
+		_count = 0;
+	}
+
+	uint64_t count() const {return _count;}
+	bool empty() const {return _count == 0;}
+
+	//same semantics as quantile() from utils.h: the value with
+	//rank min(n * percent / 100, n - 1) in the sorted order
+	double quantile(int percent) const
+	{
+		if (_count == 0) return 0;
+		uint64_t rank = std::min(_count * percent / 100, _count - 1);
+
+		double result = 0;
+		uint64_t passed = 0;
+		this->forEachBin([rank, &result, &passed]
+						 (double value, uint64_t binCount)
+		{
+			if (passed <= rank && rank < passed + binCount) result = value;
+			passed += binCount;
+		});
+		return result;
+	}
+
+	double median() const {return this->quantile(50);}
+
+	//calls fun(value, count) for each non-empty bin,
+	//in the increasing order of values
+	void forEachBin(const std::function<void(double, uint64_t)>& fun) const
+	{
+		for (int i = (int)_negative.bins.size() - 1; i >= 0; --i)
+		{
+			if (_negative.bins[i] == 0) continue;
+			fun(-binValue(_negative.offset + i), _negative.bins[i]);
+		}
+		if (_zeroCount > 0) fun(0, _zeroCount);
+		for (size_t i = 0; i < _positive.bins.size(); ++i)
+		{
+			if (_positive.bins[i] == 0) continue;
+			fun(binValue(_positive.offset + i), _positive.bins[i]);
+		}
+	}
+
+private:
+	static double logGamma()
+	{
+		static const double LOG_GAMMA =
+			std::log((1 + SKETCH_ACCURACY) / (1 - SKETCH_ACCURACY));
+		return LOG_GAMMA;
+	}
+
+	static int32_t binIndex(double value)
+	{
+		return std::ceil(std::log(value) / logGamma());
+	}
+
+	//the value within SKETCH_ACCURACY from all the values in the bin
+	static double binValue(int32_t index)
+	{
+		return 2 * std::exp(index * logGamma()) /
+			(1 + std::exp(logGamma()));
+	}
+
+	//dense bins [offset, offset + bins.size())
+	struct BinStore
+	{
+		BinStore(): offset(0) {}
+
+		void add(int32_t index, uint64_t count)
+		{
+			if (bins.empty())
+			{
+				offset = index;
+			}
+			if (index < offset)
+			{
+				bins.insert(bins.begin(), offset - index, 0);
+				offset = index;
+			}
+			if (index >= offset + (int32_t)bins.size())
+			{
+				bins.resize(index - offset + 1, 0);
+			}
+			bins[index - offset] += count;
+		}
+
+		void merge(const BinStore& other)
+		{
+			for (size_t i = 0; i < other.bins.size(); ++i)
+			{
+				if (other.bins[i] > 0) this->add(other.offset + i, other.bins[i]);
+			}
+		}
+
+		int32_t offset;
+		std::vector<uint64_t> bins;
+	};
+
+	BinStore _positive;
+	BinStore _negative;
+	uint64_t _zeroCount;
+	uint64_t _count;
+};
+
+//A sketch that is updated from multiple threads. Each thread adds values
+//to its own sketch without locking: the per-thread sketches are
+//registered in the shared one on the first update and merged on request.
+//merged() and clear() should not run concurrently with add() (e.g. they
+//are called after the parallel loop is joined)
+class ConcurrentQuantileSketch
+{
+public:
+	ConcurrentQuantileSketch(): _sketchId(nextSketchId()) {}
+
+	ConcurrentQuantileSketch(const ConcurrentQuantileSketch&) = delete;
+	ConcurrentQuantileSketch&
+		operator=(const ConcurrentQuantileSketch&) = delete;
+
+	void add(double value)
+	{
+		this->threadSketch().add(value);
+	}
+
+	QuantileSketch merged() const
+	{
+		std::lock_guard<std::mutex> lock(_registryMutex);
+		QuantileSketch result;
+		for (auto& sketch : _threadSketches) result.merge(*sketch);
+		return result;
+	}
+
+	void clear()
+	{
+		std::lock_guard<std::mutex> lock(_registryMutex);
+		for (auto& sketch : _threadSketches) sketch->clear();
+	}
+
+private:
+	//ids are never reused, so the thread caches do not
+	//confuse a new sketch with a destroyed one
+	static uint64_t nextSketchId()
+	{
+		static std::atomic<uint64_t> counter(0);
+		return counter++;
+	}
+
+	QuantileSketch& threadSketch()
+	{
+		//a thread usually updates one or two sketches at a time
+		thread_local std::vector<std::pair<uint64_t, QuantileSketch*>> cache;
+		for (auto& entry : cache)
+		{
+			if (entry.first == _sketchId) return *entry.second;
+		}
+
+		std::lock_guard<std::mutex> lock(_registryMutex);
+		_threadSketches.emplace_back(new QuantileSketch());
+		cache.emplace_back(_sketchId, _threadSketches.back().get());
+		return *_threadSketches.back();
+	}
+
+	const uint64_t _sketchId;
+	mutable std::mutex _registryMutex;
+	std::vector<std::unique_ptr<QuantileSketch>> _threadSketches;
+};
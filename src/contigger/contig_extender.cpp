@@ -4,10 +4,12 @@
 
 #include "contig_extender.h"
 #include "../repeat_graph/output_generator.h"
+#include "../common/profiler.h"
 #include <cmath>
 
 void ContigExtender::generateUnbranchingPaths()
 {
+	ScopedTimer timer("unbranching_paths");
 	GraphProcessor proc(_graph, _asmSeqs);
 	_unbranchingPaths = proc.getUnbranchingPaths();
 
@@ -60,6 +62,7 @@ void ContigExtender::generateUnbranchingPaths()
 
 void ContigExtender::generateContigs()
 {
+	ScopedTimer timer("contig_extension");
 	Logger::get().debug() << "Extending contigs into repeats";
 
 	bool graphContinue = (bool)Config::get("extend_contigs_with_repeats");
@@ -72,19 +75,6 @@ void ContigExtender::generateContigs()
 		upathsSeqs[&_unbranchingPaths[i]] = &coreSeqs[i];
 	}
 
-	std::unordered_map<GraphEdge*, 
-					   std::vector<const GraphAlignment*>> alnIndex;
-	for (auto& aln : _aligner.getAlignments())
-	{
-		if (aln.size() > 1)
-		{
-			for (auto edge : aln)
-			{
-				alnIndex[edge.edge].push_back(&aln);
-			}
-		}
-	}
-
 	std::unordered_set<GraphEdge*> coveredRepeats;
 	std::unordered_map<const GraphEdge*, bool> repeatDirections;
 	auto canTraverse = [&repeatDirections] (const GraphEdge* edge)
@@ -97,7 +87,7 @@ void ContigExtender::generateContigs()
 	typedef std::pair<GraphPath, std::string> PathAndSeq;
 	auto extendPathRight =
 		[this, &coveredRepeats, &repeatDirections, &upathsSeqs, 
-		 &canTraverse, &alnIndex, graphContinue] 
+		 &canTraverse, graphContinue] 
 	(UnbranchingPath& upath)
 	{
 
@@ -107,9 +97,9 @@ void ContigExtender::generateContigs()
 		//first, choose the longest aligned read from this edge
 		int32_t maxExtension = 0;
 		GraphAlignment bestAlignment;
-		for (auto pathPtr : alnIndex[upath.path.back()])
+		for (size_t alnId : _aligner.getEdgeAlignments(upath.path.back()))
 		{
-			const GraphAlignment& path = *pathPtr;
+			const GraphAlignment& path = _aligner.getAlignments()[alnId];
 			for (size_t i = 0; i < path.size(); ++i)
 			{
 				if (path[i].edge == upath.path.back() &&
@@ -6,9 +6,8 @@
 #include <chrono>
 
 
-Alignment::Alignment(size_t size, const SubstitutionMatrix& sm):
-	_forwardScores(size),
-	_reverseScores(size),
+Alignment::Alignment(const SubstitutionMatrix& sm):
+	_numReads(0),
 	_subsMatrix(sm)
 { 
 }
@@ -17,25 +16,31 @@ Alignment::Alignment(size_t size, const SubstitutionMatrix& sm):
 AlnScoreType Alignment::globalAlignment(const std::string& consensus,
 							 			const std::vector<std::string>& reads)
 {
+	//matrices are only added, never removed, so their
+	//memory could be reused by the subsequent calls
+	_numReads = reads.size();
+	if (_forwardScores.size() < _numReads)
+	{
+		_forwardScores.resize(_numReads);
+		_reverseScores.resize(_numReads);
+	}
+
 	AlnScoreType finalScore = 0;
-	for (size_t readId = 0; readId < _forwardScores.size(); ++readId)
+	_revConsensus.assign(consensus.rbegin(), consensus.rend());
+	for (size_t readId = 0; readId < _numReads; ++readId)
 	{
 		unsigned int x = consensus.size() + 1;
 		unsigned int y = reads[readId].size() + 1;
-		ScoreMatrix scoreMat(x, y, 0);
-			
+		_forwardScores[readId].resize(x, y);
 		AlnScoreType score = this->getScoringMatrix(consensus, reads[readId], 
-													  scoreMat);
-		_forwardScores[readId] = std::move(scoreMat);
+													_forwardScores[readId]);
 
 		//The reverse alignment is similar, but we need
 		//the scoring matrix with of the reverse alignment (I guess)
-		std::string revConsensus(consensus.rbegin(), consensus.rend());
-		std::string revRead(reads[readId].rbegin(), reads[readId].rend());
-
-		ScoreMatrix scoreMatRev(x, y, 0);
-		this->getScoringMatrix(revConsensus, revRead, scoreMatRev);
-		_reverseScores[readId] = std::move(scoreMatRev);
+		_revRead.assign(reads[readId].rbegin(), reads[readId].rend());
+		_reverseScores[readId].resize(x, y);
+		this->getScoringMatrix(_revConsensus, _revRead, 
+							   _reverseScores[readId]);
 
 		finalScore += score;
 	}
@@ -45,7 +50,7 @@ AlnScoreType Alignment::globalAlignment(const std::string& consensus,
 AlnScoreType Alignment::addDeletion(unsigned int letterIndex) const
 {
 	AlnScoreType finalScore = 0;
-	for (size_t readId = 0; readId < _forwardScores.size(); ++readId)
+	for (size_t readId = 0; readId < _numReads; ++readId)
 	{
 		const ScoreMatrix& forwardScore = _forwardScores[readId];
 		const ScoreMatrix& reverseScore = _reverseScores[readId];
@@ -86,7 +91,8 @@ AlnScoreType Alignment::addSubstitution(unsigned int letterIndex, char base,
 		size_t frontRow = letterIndex - 1;
 		size_t revRow = reverseScore.nrows() - 1 - letterIndex;
 
-		std::vector<AlnScoreType> sub(reads[readId].size() + 1);
+		std::vector<AlnScoreType>& sub = _extensionScores;
+		sub.resize(reads[readId].size() + 1);
 		sub[0] = forwardScore.at(frontRow, 0) + _subsMatrix.getScore(base, '-');
 		for (size_t i = 0; i < reads[readId].size(); ++i)
 		{
@@ -123,7 +129,8 @@ AlnScoreType Alignment::addInsertion(unsigned int pos, char base,
 		size_t frontRow = pos - 1;
 		size_t revRow = reverseScore.nrows() - pos;
 
-		std::vector<AlnScoreType> sub(reads[readId].size() + 1);
+		std::vector<AlnScoreType>& sub = _extensionScores;
+		sub.resize(reads[readId].size() + 1);
 		sub[0] = forwardScore.at(frontRow, 0) + _subsMatrix.getScore(base, '-');
 		for (size_t i = 0; i < reads[readId].size(); ++i)
 		{
@@ -152,6 +159,7 @@ AlnScoreType Alignment::getScoringMatrix(const std::string& v,
 								  		 ScoreMatrix& scoreMat) 
 {
 	AlnScoreType score = 0;
+	scoreMat.at(0, 0) = 0;
 	
 	for (size_t i = 0; i < v.size(); i++) 
 	{
@@ -18,7 +18,9 @@ class Alignment
 {
 
 public:
-	Alignment(size_t size, const SubstitutionMatrix& sm);
+	//the object keeps its dynamic programming matrices between
+	//globalAlignment() calls, so it is cheaper to reuse it
+	Alignment(const SubstitutionMatrix& sm);
 
 	typedef Matrix<AlnScoreType> ScoreMatrix;
 
@@ -32,10 +34,15 @@ public:
 						   	  char base, const std::vector<std::string>& reads) const;
 
 private:
+	size_t _numReads;
 	std::vector<ScoreMatrix> _forwardScores;
 	std::vector<ScoreMatrix> _reverseScores;
 	const SubstitutionMatrix& _subsMatrix;
 
+	std::string _revConsensus;
+	std::string _revRead;
+	mutable std::vector<AlnScoreType> _extensionScores;
+
 	AlnScoreType getScoringMatrix(const std::string& v, const std::string& w,
 							      ScoreMatrix& scoreMat);
 };
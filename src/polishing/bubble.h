@@ -19,10 +19,22 @@ struct StepInfo
 
 struct Bubble
 {
+	//bubbles carry all the branch sequences, so they are
+	//only moved between the cache and the polishing threads
+	Bubble(): position(0), numIterations(0), polishTime(0) {}
+	Bubble(const Bubble&) = delete;
+	Bubble& operator=(const Bubble&) = delete;
+	Bubble(Bubble&&) = default;
+	Bubble& operator=(Bubble&&) = default;
+
 	std::string header;
 	int position;
 
 	std::string candidate;
 	std::vector<std::string> branches;
 	std::vector<StepInfo> polishSteps;
+
+	//polishing statistics
+	int   numIterations;
+	float polishTime;		//seconds
 };
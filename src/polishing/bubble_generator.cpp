@@ -0,0 +1,819 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <cstdlib>
+
+#include "bubble_generator.h"
+
+#include "minimap.h"
+#include "bseq.h"
+#include "../common/profiler.h"
+#include "../common/logger.h"
+#include "../common/memory_budget.h"
+
+namespace
+{
+	const char ACGT[] = "ACGT";
+
+	//buffered alignments size limit (default), and a rough estimate
+	//of the memory taken by the alignments per aligned read base
+	//(read sequence, CIGAR and the secondary alignments)
+	const size_t DEFAULT_BUFFER_LIMIT = 4ULL * 1024 * 1024 * 1024;
+	const double ALN_BYTES_PER_BASE = 2.0;
+
+	//non-ACGT symbols are converted to 'A', similar to fp.to_acgt
+	std::string toAcgt(const char* seq, size_t length)
+	{
+		std::string result(length, 'A');
+		for (size_t i = 0; i < length; ++i)
+		{
+			uint8_t code = seq_nt4_table[(uint8_t)seq[i]];
+			if (code < 4) result[i] = ACGT[code];
+		}
+		return result;
+	}
+
+	std::string reverseComplement(const std::string& seq)
+	{
+		std::string result(seq.rbegin(), seq.rend());
+		for (auto& c : result)
+		{
+			switch (c)
+			{
+				case 'A': c = 'T'; break;
+				case 'C': c = 'G'; break;
+				case 'G': c = 'C'; break;
+				case 'T': c = 'A'; break;
+			}
+		}
+		return result;
+	}
+
+	//Shifts all ambigious query gaps to the right
+	//(see shift_gaps in flye/polishing/alignment.py)
+	std::string shiftGaps(const std::string& trgSeq, const std::string& qrySeq)
+	{
+		std::string trg = "$" + trgSeq + "$";
+		std::string qry = "$" + qrySeq + "$";
+		bool isGap = false;
+		int64_t gapStart = 0;
+		for (int64_t i = 0; i < (int64_t)trg.size(); ++i)
+		{
+			if (isGap && qry[i] != '-')
+			{
+				isGap = false;
+				int64_t swapLeft = gapStart - 1;
+				int64_t swapRight = i - 1;
+				while (swapLeft > 0 && swapRight >= gapStart &&
+					   qry[swapLeft] == trg[swapRight])
+				{
+					std::swap(qry[swapLeft], qry[swapRight]);
+					--swapLeft;
+					--swapRight;
+				}
+			}
+			if (!isGap && qry[i] == '-')
+			{
+				isGap = true;
+				gapStart = i;
+			}
+		}
+		return qry.substr(1, qry.size() - 2);
+	}
+
+	std::string removeGaps(const std::string& seq, size_t start, size_t end)
+	{
+		std::string result;
+		result.reserve(end - start);
+		for (size_t i = start; i < end; ++i)
+		{
+			if (seq[i] != '-') result.push_back(seq[i]);
+		}
+		return result;
+	}
+}
+
+BubbleParameters::BubbleParameters(const std::string& platform):
+	simpleKmerLength(4),
+	solidKmerLength(10),
+	maxBubbleLength(500),
+	maxBubbleBranches(50),
+	maxReadCoverage(1000),
+	minAlnLength(500),
+	maxAlnError(0.25f)
+{
+	if (platform == "pacbio")
+	{
+		solidMissmatch = 0.2f;
+		solidIndel = 0.2f;
+		minimapPreset = "map-pb";
+	}
+	else if (platform == "nano")
+	{
+		solidMissmatch = 0.3f;
+		solidIndel = 0.3f;
+		minimapPreset = "map-ont";
+	}
+	else
+	{
+		throw std::runtime_error("Unknown platform: " + platform);
+	}
+}
+
+BubbleGenerator::BubbleGenerator(const std::string& contigsFile,
+								 const std::vector<std::string>& readFiles,
+								 const std::string& platform):
+	_params(platform),
+	_readFiles(readFiles),
+	_bufferLimit(MemoryBudget::get().share(DEFAULT_BUFFER_LIMIT,
+										   /*fraction*/ 0.5)),
+	_batchBegin(0),
+	_batchEnd(0),
+	_bytesPerBase(0)
+{
+	mm_bseq_file_t* fastaFile = mm_bseq_open(contigsFile.c_str());
+	if (!fastaFile)
+	{
+		throw std::runtime_error("Error opening contigs file");
+	}
+	const int CHUNK = 100000000;
+	while (true)
+	{
+		int numSeqs = 0;
+		mm_bseq1_t* seqs = mm_bseq_read(fastaFile, CHUNK, 0, &numSeqs);
+		if (!seqs) break;
+		for (int i = 0; i < numSeqs; ++i)
+		{
+			ContigRecord rec;
+			rec.name = seqs[i].name;
+			rec.sequence = toAcgt(seqs[i].seq, seqs[i].l_seq);
+			rec.circular = rec.name.substr(0, rec.name.find('_')) ==
+						   "circular";
+			rec.alignedSequence = 0;
+			rec.alignedBytes = 0;
+			rec.meanCoverage = 0;
+			rec.numFilteredAln = 0;
+			rec.sumAlnError = 0;
+			_contigs.push_back(std::move(rec));
+
+			free(seqs[i].name);
+			free(seqs[i].seq);
+		}
+		free(seqs);
+	}
+	mm_bseq_close(fastaFile);
+}
+
+//Worst-case estimate is used if all contigs fit into the buffer
+//with the maximum coverage. Otherwise, the coverage is estimated
+//from the total length of the reads
+double BubbleGenerator::estimateBytesPerBase() const
+{
+	size_t contigBases = 0;
+	for (auto& contig : _contigs) contigBases += contig.sequence.size();
+	double worstCase = _params.maxReadCoverage * ALN_BYTES_PER_BASE;
+	if (contigBases * worstCase <= _bufferLimit) return worstCase;
+
+	size_t readBases = 0;
+	const int BATCH_SIZE = 100000000;
+	for (auto& readsFile : _readFiles)
+	{
+		mm_bseq_file_t* fastaFile = mm_bseq_open(readsFile.c_str());
+		if (!fastaFile)
+		{
+			throw std::runtime_error("Error opening reads file: " + readsFile);
+		}
+		while (true)
+		{
+			int numReads = 0;
+			mm_bseq1_t* reads = mm_bseq_read(fastaFile, BATCH_SIZE,
+											 0, &numReads);
+			if (!reads) break;
+			for (int i = 0; i < numReads; ++i)
+			{
+				readBases += reads[i].l_seq;
+				free(reads[i].name);
+				free(reads[i].seq);
+			}
+			free(reads);
+		}
+		mm_bseq_close(fastaFile);
+	}
+	double coverage = std::min((double)_params.maxReadCoverage,
+							   (double)readBases / contigBases);
+	return std::max(coverage, 1.0) * ALN_BYTES_PER_BASE;
+}
+
+//Takes the next contigs while their expected alignments fit into
+//the buffer (at least one contig), and maps the reads to them.
+//The estimate is then refined using the actual alignments
+bool BubbleGenerator::mapNextBatch(int numThreads)
+{
+	if (_batchEnd == _contigs.size()) return false;
+	if (_bytesPerBase == 0) _bytesPerBase = this->estimateBytesPerBase();
+
+	_batchBegin = _batchEnd;
+	size_t batchBases = 0;
+	while (_batchEnd < _contigs.size())
+	{
+		size_t contigLen = _contigs[_batchEnd].sequence.size();
+		if (_batchEnd > _batchBegin &&
+			(batchBases + contigLen) * _bytesPerBase > _bufferLimit) break;
+		batchBases += contigLen;
+		++_batchEnd;
+	}
+
+	this->mapReads(numThreads);
+
+	size_t batchBytes = 0;
+	for (size_t i = _batchBegin; i < _batchEnd; ++i)
+	{
+		batchBytes += _contigs[i].alignedBytes;
+	}
+	if (batchBases > 0 && batchBytes > 0)
+	{
+		_bytesPerBase = (double)batchBytes / batchBases;
+	}
+	Logger::get().debug() << "Mapped reads to contigs " << _batchBegin
+		<< " - " << _batchEnd << " of " << _contigs.size() << ", alignments: "
+		<< batchBytes / 1024 / 1024 << " Mb";
+	return true;
+}
+
+void BubbleGenerator::mapReads(int numThreads)
+{
+	ScopedTimer timer("polish_read_mapping");
+	if (_batchBegin == _batchEnd) return;
+
+	mm_verbose = 1;
+	mm_idxopt_t idxOpt;
+	mm_mapopt_t mapOpt;
+	mm_set_opt(0, &idxOpt, &mapOpt);
+	mm_set_opt(_params.minimapPreset.c_str(), &idxOpt, &mapOpt);
+	//same as "-a -p 0.5 -N 10" in the command-line mode
+	mapOpt.flag |= MM_F_CIGAR;
+	mapOpt.pri_ratio = 0.5f;
+	mapOpt.best_n = 10;
+
+	std::vector<const char*> seqPtrs;
+	std::vector<const char*> namePtrs;
+	for (size_t i = _batchBegin; i < _batchEnd; ++i)
+	{
+		seqPtrs.push_back(_contigs[i].sequence.c_str());
+		namePtrs.push_back(_contigs[i].name.c_str());
+	}
+	mm_idx_t* index = mm_idx_str(idxOpt.w, idxOpt.k, idxOpt.flag & MM_I_HPC,
+								 idxOpt.bucket_bits, seqPtrs.size(),
+								 &seqPtrs[0], &namePtrs[0]);
+	mm_mapopt_update(&mapOpt, index);
+
+	typedef std::pair<int32_t, ContigAlignment> MappedRead;
+	auto mapRead = [this, index, &mapOpt](const mm_bseq1_t& read,
+										  mm_tbuf_t* buffer,
+										  std::vector<MappedRead>& out)
+	{
+		int numRegs = 0;
+		mm_reg1_t* regs = mm_map(index, read.l_seq, read.seq, &numRegs,
+								 buffer, &mapOpt, read.name);
+		for (int i = 0; i < numRegs; ++i)
+		{
+			mm_reg1_t& reg = regs[i];
+			if (!reg.p) continue;
+
+			ContigAlignment aln;
+			aln.trgStart = reg.rs;
+			aln.trgEnd = reg.re;
+			aln.qryLength = read.l_seq;
+			aln.secondary = reg.id != reg.parent;
+			aln.qrySeq = toAcgt(read.seq + reg.qs, reg.qe - reg.qs);
+			if (reg.rev) aln.qrySeq = reverseComplement(aln.qrySeq);
+			aln.cigar.assign(reg.p->cigar, reg.p->cigar + reg.p->n_cigar);
+
+			size_t contigId = _batchBegin + reg.rid;
+			const std::string& trgSeq = _contigs[contigId].sequence;
+			size_t trgPos = reg.rs;
+			size_t qryPos = 0;
+			size_t matches = 0;
+			size_t columns = 0;
+			for (uint32_t op : aln.cigar)
+			{
+				uint32_t opLen = op >> 4;
+				switch (op & 0xf)
+				{
+					case 0:
+						for (size_t j = 0; j < opLen; ++j)
+						{
+							if (trgSeq[trgPos + j] == aln.qrySeq[qryPos + j])
+								++matches;
+						}
+						trgPos += opLen;
+						qryPos += opLen;
+						break;
+					case 1:
+						qryPos += opLen;
+						break;
+					case 2:
+						trgPos += opLen;
+						break;
+					default:
+						throw std::runtime_error("Unsupported CIGAR operation");
+				}
+				columns += opLen;
+			}
+			aln.errRate = 1.0f - (float)matches / columns;
+
+			out.emplace_back(contigId, std::move(aln));
+			free(reg.p);
+		}
+		free(regs);
+	};
+
+	const int BATCH_SIZE = 100000000;
+	std::vector<mm_tbuf_t*> buffers(numThreads);
+	for (auto& buf : buffers) buf = mm_tbuf_init();
+
+	for (auto& readsFile : _readFiles)
+	{
+		mm_bseq_file_t* fastaFile = mm_bseq_open(readsFile.c_str());
+		if (!fastaFile)
+		{
+			throw std::runtime_error("Error opening reads file: " + readsFile);
+		}
+		while (true)
+		{
+			int numReads = 0;
+			mm_bseq1_t* reads = mm_bseq_read(fastaFile, BATCH_SIZE,
+											 0, &numReads);
+			if (!reads) break;
+
+			//per-read output slots keep the result independent
+			//from the thread scheduling
+			std::vector<std::vector<MappedRead>> mapped(numReads);
+			std::atomic<int> nextRead(0);
+			auto threadWorker = [&](int threadId)
+			{
+				while (true)
+				{
+					int readId = nextRead++;
+					if (readId >= numReads) return;
+					mapRead(reads[readId], buffers[threadId], mapped[readId]);
+				}
+			};
+			std::vector<std::thread> threads(numThreads);
+			for (size_t i = 0; i < threads.size(); ++i)
+			{
+				threads[i] = std::thread(threadWorker, i);
+			}
+			for (size_t i = 0; i < threads.size(); ++i)
+			{
+				threads[i].join();
+			}
+
+			for (auto& readAlignments : mapped)
+			{
+				for (auto& idAln : readAlignments)
+				{
+					ContigRecord& contig = _contigs[idAln.first];
+					if (contig.alignedSequence / contig.sequence.size() >
+						_params.maxReadCoverage) continue;
+
+					size_t alnBytes = sizeof(ContigAlignment) +
+						idAln.second.qrySeq.capacity() +
+						idAln.second.cigar.capacity() * sizeof(uint32_t);
+					contig.alignedSequence += idAln.second.qrySeq.size();
+					contig.alignedBytes += alnBytes;
+					MemoryBudget::get().reserve(alnBytes);
+					contig.alignments.push_back(std::move(idAln.second));
+				}
+			}
+
+			for (int i = 0; i < numReads; ++i)
+			{
+				free(reads[i].name);
+				free(reads[i].seq);
+			}
+			free(reads);
+		}
+		mm_bseq_close(fastaFile);
+	}
+
+	for (auto& buf : buffers) mm_tbuf_destroy(buf);
+	mm_idx_destroy(index);
+}
+
+void BubbleGenerator::makeBubbles(size_t contigId,
+								  std::vector<Bubble>& bubbles)
+{
+	ContigRecord& contig = _contigs[contigId];
+	auto alignments = this->getUniformAlignments(contig);
+	Profile profile = this->computeProfile(contig, alignments);
+	auto partition = this->getPartition(profile);
+	this->getBubbleSeqs(contig, alignments, profile, partition, bubbles);
+
+	size_t numBranches = 0;
+	for (auto& bubble : bubbles) numBranches += bubble.branches.size();
+	contig.meanCoverage = numBranches / (bubbles.size() + 1);
+
+	this->postprocessBubbles(bubbles);
+
+	//alignments are not needed anymore
+	contig.alignments.clear();
+	contig.alignments.shrink_to_fit();
+	MemoryBudget::get().release(contig.alignedBytes);
+	contig.alignedBytes = 0;
+}
+
+void BubbleGenerator::writeStats(const std::string& filename) const
+{
+	std::ofstream fout(filename);
+	if (!fout.is_open())
+	{
+		throw std::runtime_error("Error opening stats file");
+	}
+	fout << "#seq_name\tcoverage\tnum_alignments\tmean_aln_error\n";
+	for (auto& contig : _contigs)
+	{
+		fout << contig.name << "\t" << contig.meanCoverage << "\t"
+			<< contig.numFilteredAln << "\t"
+			<< (contig.numFilteredAln ?
+				contig.sumAlnError / contig.numFilteredAln : 0) << "\n";
+	}
+}
+
+void BubbleGenerator::getAlignedStrings(const ContigRecord& contig,
+										const ContigAlignment& aln,
+										std::string& trgAln,
+										std::string& qryAln) const
+{
+	trgAln.clear();
+	qryAln.clear();
+	size_t trgPos = aln.trgStart;
+	size_t qryPos = 0;
+	for (uint32_t op : aln.cigar)
+	{
+		uint32_t opLen = op >> 4;
+		switch (op & 0xf)
+		{
+			case 0:
+				trgAln.append(contig.sequence, trgPos, opLen);
+				qryAln.append(aln.qrySeq, qryPos, opLen);
+				trgPos += opLen;
+				qryPos += opLen;
+				break;
+			case 1:
+				trgAln.append(opLen, '-');
+				qryAln.append(aln.qrySeq, qryPos, opLen);
+				qryPos += opLen;
+				break;
+			case 2:
+				trgAln.append(contig.sequence, trgPos, opLen);
+				qryAln.append(opLen, '-');
+				trgPos += opLen;
+				break;
+		}
+	}
+}
+
+//Leaves top alignments for each position within contig
+//assuming uniform coverage distribution
+std::vector<const BubbleGenerator::ContigAlignment*>
+	BubbleGenerator::getUniformAlignments(const ContigRecord& contig) const
+{
+	const size_t WINDOW = 100;
+	const size_t MIN_COV = 10;
+	const float COV_RATE = 1.25f;
+
+	size_t numWindows = contig.sequence.size() / WINDOW + 1;
+	std::vector<int> wndPrimaryCov(numWindows, 0);
+	std::vector<std::vector<float>> wndAlnQuality(numWindows);
+	std::vector<float> wndQualThresholds(numWindows, 1.0f);
+	for (auto& aln : contig.alignments)
+	{
+		for (size_t i = aln.trgStart / WINDOW; i < aln.trgEnd / WINDOW; ++i)
+		{
+			if (!aln.secondary) ++wndPrimaryCov[i];
+			wndAlnQuality[i].push_back(aln.errRate);
+		}
+	}
+
+	std::vector<int> sortedCov(wndPrimaryCov);
+	std::sort(sortedCov.begin(), sortedCov.end());
+	float medianCov = (sortedCov.size() % 2) ?
+		sortedCov[sortedCov.size() / 2] :
+		(sortedCov[sortedCov.size() / 2 - 1] +
+		 sortedCov[sortedCov.size() / 2]) / 2.0f;
+	size_t covThreshold = std::max((size_t)(COV_RATE * medianCov), MIN_COV);
+	for (size_t i = 0; i < numWindows; ++i)
+	{
+		if (wndAlnQuality[i].size() > covThreshold)
+		{
+			std::nth_element(wndAlnQuality[i].begin(),
+							 wndAlnQuality[i].begin() + covThreshold,
+							 wndAlnQuality[i].end());
+			wndQualThresholds[i] = wndAlnQuality[i][covThreshold];
+		}
+	}
+
+	std::vector<const ContigAlignment*> filtered;
+	for (auto& aln : contig.alignments)
+	{
+		size_t goodWindows = 0;
+		size_t totalWindows = aln.trgEnd / WINDOW - aln.trgStart / WINDOW;
+		for (size_t i = aln.trgStart / WINDOW; i < aln.trgEnd / WINDOW; ++i)
+		{
+			if (aln.errRate <= wndQualThresholds[i]) ++goodWindows;
+		}
+		if (goodWindows > totalWindows / 2) filtered.push_back(&aln);
+	}
+	return filtered;
+}
+
+BubbleGenerator::Profile
+	BubbleGenerator::computeProfile(ContigRecord& contig,
+									const std::vector<const ContigAlignment*>&
+										alignments) const
+{
+	const int64_t genomeLen = contig.sequence.size();
+	Profile profile(genomeLen);
+	std::string trgAln;
+	std::string qryAln;
+	for (auto& aln : alignments)
+	{
+		this->getAlignedStrings(contig, *aln, trgAln, qryAln);
+		if (aln->errRate > _params.maxAlnError ||
+			qryAln.size() < _params.minAlnLength) continue;
+
+		++contig.numFilteredAln;
+		contig.sumAlnError += aln->errRate;
+
+		std::string qrySeq = shiftGaps(trgAln, qryAln);
+		std::string trgSeq = shiftGaps(qrySeq, trgAln);
+
+		int64_t trgPos = aln->trgStart;
+		for (size_t i = 0; i < trgSeq.size(); ++i)
+		{
+			if (trgSeq[i] == '-') trgPos -= 1;
+			if (trgPos >= genomeLen) trgPos -= genomeLen;
+
+			ProfileInfo& profElem = profile[trgPos];
+			if (trgSeq[i] == '-')
+			{
+				++profElem.numInserts;
+			}
+			else
+			{
+				profElem.nucl = trgSeq[i];
+				++profElem.coverage;
+				if (qrySeq[i] == '-')
+				{
+					++profElem.numDeletions;
+				}
+				else if (trgSeq[i] != qrySeq[i])
+				{
+					++profElem.numMissmatch;
+				}
+			}
+			++trgPos;
+		}
+	}
+	return profile;
+}
+
+bool BubbleGenerator::isSolidKmer(const Profile& profile,
+								  size_t position) const
+{
+	for (size_t i = position; i < position + _params.solidKmerLength; ++i)
+	{
+		if (profile[i].coverage == 0) return false;
+		float localMissmatch = float(profile[i].numMissmatch +
+									 profile[i].numDeletions) /
+							   profile[i].coverage;
+		float localIns = float(profile[i].numInserts) / profile[i].coverage;
+		if (localMissmatch > _params.solidMissmatch ||
+			localIns > _params.solidIndel) return false;
+	}
+	return true;
+}
+
+bool BubbleGenerator::isSimpleKmer(const Profile& profile,
+								   size_t position) const
+{
+	const int simpleLen = _params.simpleKmerLength;
+	const int extendedLen = simpleLen * 2;
+	std::string nucl;
+	for (int i = -extendedLen / 2; i < extendedLen / 2; ++i)
+	{
+		nucl.push_back(profile[position + i].nucl);
+	}
+
+	//single nucleotide homopolymers
+	for (int i = extendedLen / 2 - simpleLen / 2;
+		 i < extendedLen / 2 + simpleLen / 2 - 1; ++i)
+	{
+		if (nucl[i] == nucl[i + 1]) return false;
+	}
+
+	//dinucleotide homopolymers
+	for (int shift = 0; shift < 2; ++shift)
+	{
+		for (int i = 0; i < simpleLen - shift - 1; ++i)
+		{
+			int pos = extendedLen / 2 - simpleLen + shift + i * 2;
+			if (pos + 4 <= extendedLen &&
+				nucl.compare(pos, 2, nucl, pos + 2, 2) == 0) return false;
+		}
+	}
+
+	return true;
+}
+
+//Partitions genome into sub-alignments at solid regions / simple kmers
+std::vector<int32_t> BubbleGenerator::getPartition(const Profile& profile) const
+{
+	const int64_t SOLID_LEN = _params.solidKmerLength;
+	const int64_t SIMPLE_LEN = _params.simpleKmerLength;
+	const int64_t MAX_BUBBLE = _params.maxBubbleLength;
+	const int64_t profLen = profile.size();
+
+	std::vector<bool> solidFlags(profLen, false);
+	int64_t profPos = 0;
+	while (profPos < profLen - SOLID_LEN)
+	{
+		if (this->isSolidKmer(profile, profPos))
+		{
+			for (int64_t i = profPos; i < profPos + SOLID_LEN; ++i)
+			{
+				solidFlags[i] = true;
+			}
+			profPos += SOLID_LEN;
+		}
+		else
+		{
+			profPos += 1;
+		}
+	}
+
+	std::vector<int32_t> partition;
+	int64_t prevPartition = SOLID_LEN;
+	profPos = SOLID_LEN;
+	while (profPos < profLen - SOLID_LEN)
+	{
+		int64_t curPartition = profPos + SIMPLE_LEN / 2;
+		bool landmark = std::all_of(solidFlags.begin() + profPos,
+									solidFlags.begin() + profPos + SIMPLE_LEN,
+									[](bool b) {return b;}) &&
+						this->isSimpleKmer(profile, curPartition);
+
+		if (landmark || profPos - prevPartition > MAX_BUBBLE)
+		{
+			partition.push_back(curPartition);
+			prevPartition = curPartition;
+			profPos += SOLID_LEN;
+		}
+		else
+		{
+			profPos += 1;
+		}
+	}
+
+	return partition;
+}
+
+//Given genome landmarks, forms bubble sequences
+void BubbleGenerator::getBubbleSeqs(const ContigRecord& contig,
+									const std::vector<const ContigAlignment*>&
+										alignments,
+									const Profile& profile,
+									const std::vector<int32_t>& partition,
+									std::vector<Bubble>& bubbles) const
+{
+	if (partition.empty()) return;
+
+	const int64_t contigLen = contig.sequence.size();
+	std::vector<int32_t> extPartition;
+	extPartition.push_back(0);
+	extPartition.insert(extPartition.end(), partition.begin(),
+						partition.end());
+	extPartition.push_back(contigLen);
+
+	for (size_t i = 0; i < extPartition.size() - 1; ++i)
+	{
+		bubbles.emplace_back();
+		bubbles.back().header = contig.name;
+		bubbles.back().position = extPartition[i];
+		for (int32_t pos = extPartition[i]; pos < extPartition[i + 1]; ++pos)
+		{
+			if (profile[pos].nucl)
+			{
+				bubbles.back().candidate.push_back(profile[pos].nucl);
+			}
+		}
+	}
+
+	auto bisect = [&partition](int64_t pos)
+	{
+		return std::upper_bound(partition.begin(), partition.end(), pos) -
+			   partition.begin();
+	};
+
+	std::string trgAln;
+	std::string qryAln;
+	for (auto& aln : alignments)
+	{
+		this->getAlignedStrings(contig, *aln, trgAln, qryAln);
+
+		size_t bubbleId = bisect(aln->trgStart % contigLen);
+		int64_t nextBubbleStart = extPartition[bubbleId + 1];
+		bool chromosomeStart = bubbleId == 0 && !contig.circular;
+		bool chromosomeEnd = aln->trgEnd > partition.back() &&
+							 !contig.circular;
+
+		size_t branchStart = 0;
+		bool firstSegment = true;
+		int64_t trgPos = aln->trgStart;
+		for (size_t i = 0; i < trgAln.size(); ++i)
+		{
+			if (trgAln[i] == '-') continue;
+			if (trgPos >= contigLen) trgPos -= contigLen;
+
+			if (trgPos >= nextBubbleStart || trgPos == 0)
+			{
+				if (!firstSegment || chromosomeStart)
+				{
+					bubbles[bubbleId].branches
+						.push_back(removeGaps(qryAln, branchStart, i));
+				}
+				firstSegment = false;
+				bubbleId = bisect(trgPos);
+				nextBubbleStart = extPartition[bubbleId + 1];
+				branchStart = i;
+			}
+			++trgPos;
+		}
+
+		if (chromosomeEnd)
+		{
+			bubbles.back().branches
+				.push_back(removeGaps(qryAln, branchStart, qryAln.size()));
+		}
+	}
+}
+
+void BubbleGenerator::postprocessBubbles(std::vector<Bubble>& bubbles) const
+{
+	std::vector<Bubble> newBubbles;
+	for (auto& bubble : bubbles)
+	{
+		if (bubble.branches.empty()) continue;
+
+		std::vector<std::string> sortedBranches(bubble.branches);
+		std::stable_sort(sortedBranches.begin(), sortedBranches.end(),
+						 [](const std::string& s1, const std::string& s2)
+						 	{return s1.length() < s2.length();});
+		std::string medianBranch = sortedBranches[sortedBranches.size() / 2];
+		if (medianBranch.empty()) continue;
+
+		std::vector<std::string> newBranches;
+		//Bubble is TOO BIIG, will not correct it (maybe at the next iteration)
+		if (medianBranch.size() > _params.maxBubbleLength * 1.5)
+		{
+			newBranches.push_back(medianBranch);
+		}
+		else
+		{
+			for (auto& branch : bubble.branches)
+			{
+				float inconsRate = std::abs((float)branch.size() -
+											(float)medianBranch.size()) /
+								   medianBranch.size();
+				if (inconsRate < 0.5f)
+				{
+					newBranches.push_back(branch.empty() ?
+										  std::string("A") :
+										  std::move(branch));
+				}
+			}
+		}
+
+		if (std::abs((int64_t)medianBranch.size() -
+					 (int64_t)bubble.candidate.size()) >
+			(int64_t)medianBranch.size() / 2)
+		{
+			bubble.candidate = medianBranch;
+		}
+		if (newBranches.size() > _params.maxBubbleBranches)
+		{
+			newBranches.resize(_params.maxBubbleBranches);
+		}
+
+		bubble.branches = std::move(newBranches);
+		newBubbles.push_back(std::move(bubble));
+	}
+	bubbles = std::move(newBubbles);
+}
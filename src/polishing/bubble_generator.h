@@ -0,0 +1,129 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//In-process replacement of the "minimap2 -> sort SAM -> bubbles.py"
+//part of the polishing pipeline. Reads are mapped to the contig chunks
+//using the minimap2 library API, alignments are kept in memory
+//grouped by contig, and bubbles are constructed on demand for
+//each contig (the logic mirrors flye/polishing/bubbles.py).
+//Contigs are processed in batches, so that the buffered alignments
+//of a batch fit into the given limit: the reads are mapped to the
+//index of the current batch only, and the alignments of a contig are
+//released as soon as its bubbles are constructed
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include "bubble.h"
+
+//Same values as in flye/config/py_cfg.py
+struct BubbleParameters
+{
+	BubbleParameters(const std::string& platform);
+
+	int    simpleKmerLength;
+	int    solidKmerLength;
+	int    maxBubbleLength;
+	size_t maxBubbleBranches;
+	size_t maxReadCoverage;
+	size_t minAlnLength;
+	float  solidMissmatch;
+	float  solidIndel;
+	float  maxAlnError;
+	std::string minimapPreset;
+};
+
+class BubbleGenerator
+{
+public:
+	BubbleGenerator(const std::string& contigsFile,
+					const std::vector<std::string>& readFiles,
+					const std::string& platform);
+
+	//maximum size of the buffered alignments (in bytes)
+	void   setBufferLimit(size_t bytes) {_bufferLimit = bytes;}
+	//maps the reads to the next batch of contigs,
+	//returns false if all contigs were already processed
+	bool   mapNextBatch(int numThreads);
+	size_t batchBegin() const {return _batchBegin;}
+	size_t batchEnd() const {return _batchEnd;}
+	size_t numContigs() const {return _contigs.size();}
+	//thread-safe as long as different threads process different contigs
+	void   makeBubbles(size_t contigId, std::vector<Bubble>& bubbles);
+	void   writeStats(const std::string& filename) const;
+
+private:
+	struct ContigAlignment
+	{
+		int32_t  trgStart;
+		int32_t  trgEnd;
+		int32_t  qryLength;
+		float    errRate;
+		bool	 secondary;
+		std::string qrySeq;			//aligned part of the read, in the
+									//contig orientation, without gaps
+		std::vector<uint32_t> cigar;	//minimap2-encoded CIGAR
+	};
+
+	struct ContigRecord
+	{
+		std::string name;
+		std::string sequence;
+		bool 		circular;
+
+		std::vector<ContigAlignment> alignments;
+		size_t 		alignedSequence;
+		size_t 		alignedBytes;
+
+		int 	meanCoverage;
+		size_t  numFilteredAln;
+		double  sumAlnError;
+	};
+
+	struct ProfileInfo
+	{
+		ProfileInfo(): nucl(0), numInserts(0), numDeletions(0),
+			numMissmatch(0), coverage(0) {}
+
+		char 	nucl;
+		int32_t numInserts;
+		int32_t numDeletions;
+		int32_t numMissmatch;
+		int32_t coverage;
+	};
+	typedef std::vector<ProfileInfo> Profile;
+
+	void mapReads(int numThreads);
+	double estimateBytesPerBase() const;
+	void getAlignedStrings(const ContigRecord& contig,
+						   const ContigAlignment& aln,
+						   std::string& trgAln, std::string& qryAln) const;
+	std::vector<const ContigAlignment*>
+		getUniformAlignments(const ContigRecord& contig) const;
+	Profile computeProfile(ContigRecord& contig,
+						   const std::vector<const ContigAlignment*>& alns) const;
+	std::vector<int32_t> getPartition(const Profile& profile) const;
+	bool isSolidKmer(const Profile& profile, size_t position) const;
+	bool isSimpleKmer(const Profile& profile, size_t position) const;
+	void getBubbleSeqs(const ContigRecord& contig,
+					   const std::vector<const ContigAlignment*>& alns,
+					   const Profile& profile,
+					   const std::vector<int32_t>& partition,
+					   std::vector<Bubble>& bubbles) const;
+	void postprocessBubbles(std::vector<Bubble>& bubbles) const;
+
+	const BubbleParameters 		_params;
+	const std::vector<std::string> _readFiles;
+	std::vector<ContigRecord> 	_contigs;
+	std::mutex 					_contigsMutex;
+
+	size_t 	_bufferLimit;
+	size_t 	_batchBegin;
+	size_t 	_batchEnd;
+	double 	_bytesPerBase;
+};
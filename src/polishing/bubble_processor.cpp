@@ -7,6 +7,8 @@
 #include <sys/stat.h>
 
 #include "bubble_processor.h"
+#include "../common/profiler.h"
+#include "../common/memory_budget.h"
 
 namespace
 {
@@ -16,6 +18,25 @@ namespace
 		if (stat(filename.c_str(), &st) != 0) return 0;
 		return st.st_size;
 	}
+
+	//very long or single-branch bubbles are not polished
+	bool needsPolishing(const Bubble& bubble)
+	{
+		const size_t MAX_BUBBLE = 5000;
+		return bubble.candidate.size() < MAX_BUBBLE &&
+			   bubble.branches.size() > 1;
+	}
+
+	//roughly proportional to the number of cells in the
+	//dynamic programming matrices computed during polishing
+	size_t polishingCost(const Bubble& bubble)
+	{
+		if (!needsPolishing(bubble)) return 1;
+
+		size_t branchesLength = 0;
+		for (auto& branch : bubble.branches) branchesLength += branch.size();
+		return (bubble.candidate.size() + 1) * branchesLength;
+	}
 }
 
 BubbleProcessor::BubbleProcessor(const std::string& subsMatPath,
@@ -26,7 +47,13 @@ BubbleProcessor::BubbleProcessor(const std::string& subsMatPath,
 	_generalPolisher(_subsMatrix),
 	_homoPolisher(_subsMatrix, _hopoMatrix),
 	_dinucFixer(_subsMatrix),
+	_generator(nullptr),
+	_nextContig(0),
+	_activeGenerators(0),
 	_verbose(false),
+	_outputStats(false),
+	_outputBubbles(false),
+	_hopoCorrection(false),
 	_showProgress(showProgress)
 {
 }
@@ -36,7 +63,9 @@ void BubbleProcessor::polishAll(const std::string& inBubbles,
 								const std::string& outConsensus,
 			   					int numThreads)
 {
+	ScopedTimer timer("polishing");
 	_cachedBubbles.clear();
+	_cachedCosts.clear();
 	_cachedBubbles.reserve(BUBBLES_CACHE);
 
 	size_t fileLength = fileSize(inBubbles);
@@ -51,13 +80,47 @@ void BubbleProcessor::polishAll(const std::string& inBubbles,
 	}
 
 	_progress.setFinalCount(fileLength);
+	this->openConsensus(outConsensus);
+	this->runThreads(numThreads);
+	if (_showProgress) _progress.setDone();
+}
+
+
+void BubbleProcessor::polishAll(BubbleGenerator& generator,
+								const std::string& outConsensus,
+			   					int numThreads)
+{
+	ScopedTimer timer("polishing");
+	_cachedBubbles.clear();
+	_cachedCosts.clear();
+	_generator = &generator;
+	_progress.setFinalCount(std::max<size_t>(generator.numContigs(), 1));
+	this->openConsensus(outConsensus);
 
+	//the alignments of a batch are released while its
+	//bubbles are constructed, before the next batch is mapped
+	while (generator.mapNextBatch(numThreads))
+	{
+		_nextContig = generator.batchBegin();
+		this->runThreads(numThreads);
+	}
+	if (_showProgress) _progress.setDone();
+	_generator = nullptr;
+}
+
+
+void BubbleProcessor::openConsensus(const std::string& outConsensus)
+{
 	_consensusFile.open(outConsensus);
 	if (!_consensusFile.is_open())
 	{
 		throw std::runtime_error("Error opening consensus file");
 	}
+}
+
 
+void BubbleProcessor::runThreads(int numThreads)
+{
 	std::vector<std::thread> threads(numThreads);
 	for (size_t i = 0; i < threads.size(); ++i)
 	{
@@ -67,20 +130,31 @@ void BubbleProcessor::polishAll(const std::string& inBubbles,
 	{
 		threads[i].join();
 	}
-	if (_showProgress) _progress.setDone();
 }
 
 
+//Bubbles are taken from the back of the cache, which is sorted
+//by the estimated polishing cost, so the most expensive bubbles
+//within the cached window are started first. Cheap bubbles
+//(including the ones that are not polished at all) are grouped
+//into batches, so they go through the mutex together.
 void BubbleProcessor::parallelWorker()
 {
-	const int MAX_BUBBLE = 5000;
-
+	std::vector<Bubble> batch;
+	Alignment alignBuffer(_subsMatrix);
 	_stateMutex.lock();
 	while (true)
 	{
 		if (_cachedBubbles.empty())
 		{
-			this->cacheBubbles(BUBBLES_CACHE);
+			if (_generator)
+			{
+				this->generateBubbles();
+			}
+			else
+			{
+				this->cacheBubbles(BUBBLES_CACHE);
+			}
 			if(_cachedBubbles.empty())
 			{
 				_stateMutex.unlock();
@@ -88,22 +162,61 @@ void BubbleProcessor::parallelWorker()
 			}
 		}
 
-		Bubble bubble = _cachedBubbles.back();
-		_cachedBubbles.pop_back();
+		batch.clear();
+		size_t batchCost = 0;
+		while (!_cachedBubbles.empty() &&
+			   (batch.empty() || batchCost + _cachedCosts.back() <=
+			   					 MAX_BATCH_COST))
+		{
+			batchCost += _cachedCosts.back();
+			batch.push_back(std::move(_cachedBubbles.back()));
+			_cachedBubbles.pop_back();
+			_cachedCosts.pop_back();
+		}
 
-		if (bubble.candidate.size() < MAX_BUBBLE &&
-			bubble.branches.size() > 1)
+		_stateMutex.unlock();
+		for (auto& bubble : batch)
 		{
-			_stateMutex.unlock();
-			_generalPolisher.polishBubble(bubble);
-			//_homoPolisher.polishBubble(bubble);
-			_dinucFixer.fixBubble(bubble);
-			_stateMutex.lock();
+			if (needsPolishing(bubble))
+			{
+				auto startTime = std::chrono::steady_clock::now();
+				_generalPolisher.polishBubble(bubble, alignBuffer);
+				if (_hopoCorrection) _homoPolisher.polishBubble(bubble);
+				_dinucFixer.fixBubble(bubble, alignBuffer);
+				bubble.polishTime = std::chrono::duration<float>
+					(std::chrono::steady_clock::now() - startTime).count();
+			}
 		}
+		_stateMutex.lock();
 		
-		this->writeBubbles({bubble});
-		if (_verbose) this->writeLog({bubble});
+		this->writeBubbles(batch);
+		if (_verbose) this->writeLog(batch);
+		if (_outputStats) this->writeStats(batch);
+	}
+}
+
+
+//Should be called with _stateMutex locked, after new
+//bubbles are added to the cache
+void BubbleProcessor::scheduleBubbles()
+{
+	std::vector<std::pair<size_t, size_t>> costIds;
+	costIds.reserve(_cachedBubbles.size());
+	for (size_t i = 0; i < _cachedBubbles.size(); ++i)
+	{
+		costIds.emplace_back(polishingCost(_cachedBubbles[i]), i);
+	}
+	std::sort(costIds.begin(), costIds.end());
+
+	std::vector<Bubble> sortedBubbles;
+	sortedBubbles.reserve(_cachedBubbles.size());
+	_cachedCosts.clear();
+	for (auto& costId : costIds)
+	{
+		sortedBubbles.push_back(std::move(_cachedBubbles[costId.second]));
+		_cachedCosts.push_back(costId.first);
 	}
+	_cachedBubbles = std::move(sortedBubbles);
 }
 
 
@@ -120,6 +233,7 @@ void BubbleProcessor::writeBubbles(const std::vector<Bubble>& bubbles)
 void BubbleProcessor::enableVerboseOutput(const std::string& filename)
 {
 	_verbose = true;
+	_generalPolisher.setLogSteps(true);
 	_logFile.open(filename);
 	if (!_logFile.is_open())
 	{
@@ -127,6 +241,56 @@ void BubbleProcessor::enableVerboseOutput(const std::string& filename)
 	}
 }
 
+void BubbleProcessor::enableBubblesOutput(const std::string& filename)
+{
+	_outputBubbles = true;
+	_rawBubblesFile.open(filename);
+	if (!_rawBubblesFile.is_open())
+	{
+		throw std::runtime_error("Error opening bubbles file");
+	}
+}
+
+//same format as the bubbles file produced by bubbles.py
+void BubbleProcessor::writeRawBubbles(const std::vector<Bubble>& bubbles)
+{
+	for (auto& bubble : bubbles)
+	{
+		_rawBubblesFile << ">" << bubble.header << " " << bubble.position
+						<< " " << bubble.branches.size() << "\n"
+						<< bubble.candidate << "\n";
+		for (size_t i = 0; i < bubble.branches.size(); ++i)
+		{
+			_rawBubblesFile << ">" << i << "\n" << bubble.branches[i] << "\n";
+		}
+	}
+}
+
+void BubbleProcessor::enableStatsOutput(const std::string& filename)
+{
+	_outputStats = true;
+	_statsFile.open(filename);
+	if (!_statsFile.is_open())
+	{
+		throw std::runtime_error("Error opening stats file");
+	}
+	_statsFile << "#seq_name\tposition\tcandidate_len\tnum_branches"
+			   << "\titerations\ttime_ms\n";
+}
+
+void BubbleProcessor::writeStats(const std::vector<Bubble>& bubbles)
+{
+	for (auto& bubble : bubbles)
+	{
+		_statsFile << bubble.header << "\t" << bubble.position << "\t"
+				   << bubble.candidate.size() << "\t" 
+				   << bubble.branches.size() << "\t"
+				   << bubble.numIterations << "\t"
+				   << std::fixed << std::setprecision(3) 
+				   << bubble.polishTime * 1000 << "\n";
+	}
+}
+
 void BubbleProcessor::writeLog(const std::vector<Bubble>& bubbles)
 {
 	std::vector<std::string> methods = {"None", "Insertion", "Substitution",
@@ -149,10 +313,51 @@ void BubbleProcessor::writeLog(const std::vector<Bubble>& bubbles)
 }
 
 
+//Called with _stateMutex locked. The lock is released while bubbles
+//for the next contig are being constructed, so that other threads could
+//keep polishing or start constructing bubbles for the other contigs.
+//Returns when some bubbles are cached, or when there is nothing left.
+void BubbleProcessor::generateBubbles()
+{
+	while (_cachedBubbles.empty())
+	{
+		if (_nextContig == _generator->batchEnd())
+		{
+			if (!_activeGenerators) return;
+			_generatorDone.wait(_stateMutex);
+			continue;
+		}
+		//close to the memory limit, chunks are aligned one at a time
+		if (_activeGenerators && MemoryBudget::get().underPressure())
+		{
+			_generatorDone.wait(_stateMutex);
+			continue;
+		}
+
+		size_t contigId = _nextContig++;
+		++_activeGenerators;
+		_stateMutex.unlock();
+
+		std::vector<Bubble> bubbles;
+		_generator->makeBubbles(contigId, bubbles);
+
+		_stateMutex.lock();
+		--_activeGenerators;
+		if (_outputBubbles) this->writeRawBubbles(bubbles);
+		for (auto& bubble : bubbles)
+		{
+			_cachedBubbles.push_back(std::move(bubble));
+		}
+		this->scheduleBubbles();
+		_generatorDone.notify_all();
+		if (_showProgress) _progress.advance();
+	}
+}
+
+
 void BubbleProcessor::cacheBubbles(int maxRead)
 {
 	std::string buffer;
-	std::string candidate;
 
 	int readBubbles = 0;
 	while (!_bubblesFile.eof() && readBubbles < maxRead)
@@ -165,12 +370,11 @@ void BubbleProcessor::cacheBubbles(int maxRead)
 		{
 			throw std::runtime_error("Error parsing bubbles file");
 		}
-		std::getline(_bubblesFile, candidate);
-		std::transform(candidate.begin(), candidate.end(), 
-				       candidate.begin(), ::toupper);
-		
 		Bubble bubble;
-		bubble.candidate = candidate;
+		std::getline(_bubblesFile, bubble.candidate);
+		std::transform(bubble.candidate.begin(), bubble.candidate.end(), 
+				       bubble.candidate.begin(), ::toupper);
+
 		bubble.header = elems[0].substr(1, std::string::npos);
 		bubble.position = std::stoi(elems[1]);
 		int numOfReads = std::stoi(elems[2]);
@@ -181,10 +385,11 @@ void BubbleProcessor::cacheBubbles(int maxRead)
 			if (buffer.empty()) break;
 
 			std::getline(_bubblesFile, buffer);
-			std::getline(_bubblesFile, buffer);
-			std::transform(buffer.begin(), buffer.end(), 
-				       	   buffer.begin(), ::toupper);
-			bubble.branches.push_back(buffer);
+			bubble.branches.emplace_back();
+			std::string& branch = bubble.branches.back();
+			std::getline(_bubblesFile, branch);
+			std::transform(branch.begin(), branch.end(), 
+				       	   branch.begin(), ::toupper);
 			count++;
 		}
 		if (count != numOfReads)
@@ -195,6 +400,7 @@ void BubbleProcessor::cacheBubbles(int maxRead)
 		_cachedBubbles.push_back(std::move(bubble));
 		++readBubbles;
 	}
+	this->scheduleBubbles();
 
 	int64_t filePos = _bubblesFile.tellg();
 	if (_showProgress && filePos > 0)
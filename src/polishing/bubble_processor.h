@@ -8,6 +8,7 @@
 #include <vector>
 #include <cmath>
 #include <mutex>
+#include <condition_variable>
 #include <fstream>
 
 #include "subs_matrix.h"
@@ -17,6 +18,7 @@
 #include "utility.h"
 #include "../common/progress_bar.h"
 #include "dinucleotide_fixer.h"
+#include "bubble_generator.h"
 
 
 class BubbleProcessor 
@@ -27,29 +29,53 @@ public:
 					bool  showProgress);
 	void polishAll(const std::string& inBubbles, const std::string& outConsensus,
 				   int numThreads);
+	void polishAll(BubbleGenerator& generator, const std::string& outConsensus,
+				   int numThreads);
 	void enableVerboseOutput(const std::string& filename);
+	void enableStatsOutput(const std::string& filename);
+	void enableBubblesOutput(const std::string& filename);
+	void enableFastMode() {_generalPolisher.setFastMode(true);}
+	void enableHopoCorrection() {_hopoCorrection = true;}
 
 private:
+	void openConsensus(const std::string& outConsensus);
+	void runThreads(int numThreads);
 	void parallelWorker();
 	void cacheBubbles(int numBubbles);
+	void generateBubbles();
+	void scheduleBubbles();
 	void writeBubbles(const std::vector<Bubble>& bubbles);
 	void writeLog(const std::vector<Bubble>& bubbles);
+	void writeStats(const std::vector<Bubble>& bubbles);
+	void writeRawBubbles(const std::vector<Bubble>& bubbles);
 
 	const int BUBBLES_CACHE = 100;
+	const size_t MAX_BATCH_COST = 100000;
 
 	const SubstitutionMatrix  _subsMatrix;
 	const HopoMatrix 		  _hopoMatrix;
-	const GeneralPolisher 	  _generalPolisher;
+	GeneralPolisher 	 	  _generalPolisher;
 	const HomoPolisher 		  _homoPolisher;
 	const DinucleotideFixer	  _dinucFixer;
 
 	ProgressPercent 		  _progress;
 	std::mutex				  _stateMutex;
 	std::vector<Bubble>		  _cachedBubbles;
+	std::vector<size_t>		  _cachedCosts;
+
+	BubbleGenerator*		  _generator;
+	size_t					  _nextContig;
+	int						  _activeGenerators;
+	std::condition_variable_any _generatorDone;
 
 	std::ifstream			  _bubblesFile;
 	std::ofstream			  _consensusFile;
 	std::ofstream			  _logFile;
+	std::ofstream			  _statsFile;
+	std::ofstream			  _rawBubblesFile;
 	bool					  _verbose;
+	bool					  _outputStats;
+	bool					  _outputBubbles;
+	bool					  _hopoCorrection;
 	bool 					  _showProgress;
 };
@@ -5,12 +5,11 @@
 #include "dinucleotide_fixer.h"
 #include "alignment.h"
 
-void DinucleotideFixer::fixBubble(Bubble& bubble) const
+void DinucleotideFixer::fixBubble(Bubble& bubble, Alignment& align) const
 {
-	auto likelihood = [this](const std::string& candidate, 
-						     const std::vector<std::string>& branches)
+	auto likelihood = [&align](const std::string& candidate, 
+							   const std::vector<std::string>& branches)
 	{
-		Alignment align(branches.size(), _subsMatrix);
 		AlnScoreType score = align.globalAlignment(candidate, branches);
 		return score;
 	};
@@ -6,6 +6,7 @@
 
 #include "subs_matrix.h"
 #include "bubble.h"
+#include "alignment.h"
 
 class DinucleotideFixer
 {
@@ -13,7 +14,7 @@ public:
 	DinucleotideFixer(const SubstitutionMatrix& subsMatrix):
 		_subsMatrix(subsMatrix)
 	{}
-	void fixBubble(Bubble& bubble) const;
+	void fixBubble(Bubble& bubble, Alignment& align) const;
 
 private:
 	std::pair<int, int> getDinucleotideRuns(const std::string& sequence) const;
@@ -5,19 +5,26 @@
 #include "general_polisher.h"
 #include "alignment.h"
 
-void GeneralPolisher::polishBubble(Bubble& bubble) const
+void GeneralPolisher::polishBubble(Bubble& bubble, Alignment& align) const
 {
-	auto optimize = [this] (const std::string& candidate,
-							const std::vector<std::string>& branches,
-							std::vector<StepInfo>& polishSteps)
+	//in the fast mode, deep bubbles are polished with at most
+	//FAST_MAX_BRANCHES branches, and edits that improve the score
+	//by less than MIN_SCORE_GAIN (in the log-likelihood units) are ignored
+	const size_t FAST_MAX_BRANCHES = 20;
+	const AlnScoreType MIN_SCORE_GAIN = _fastMode ? SCORE_MULT : 0;
+
+	StepInfo rec;
+	auto optimize = [this, &align, &rec, &bubble, MIN_SCORE_GAIN]
+		(const std::string& candidate, const std::vector<std::string>& branches)
 	{
 		std::string prevCandidate = candidate;
-		Alignment align(branches.size(), _subsMatrix);
 		size_t iterNum = 0;
 		while(true)
 		{
-			StepInfo rec = this->makeStep(prevCandidate, branches, align);
-			polishSteps.push_back(rec);
+			this->makeStep(prevCandidate, branches, align, 
+						   MIN_SCORE_GAIN, rec);
+			if (_logSteps) bubble.polishSteps.push_back(rec);
+			++bubble.numIterations;
 			if (prevCandidate == rec.sequence) break;
 			if (rec.score > 0)
 			{
@@ -29,11 +36,29 @@ void GeneralPolisher::polishBubble(Bubble& bubble) const
 				std::cerr << "Too many iters!\n";
 				break;
 			}
-			prevCandidate = rec.sequence;
+			prevCandidate.swap(rec.sequence);
 		}
 		return prevCandidate;
 	};
 
+	//polishing with a subset of branches: the selected branches are
+	//temporarily moved out of the bubble, so they are not copied
+	auto optimizeSubset = [&bubble, &optimize]
+		(const std::string& candidate, const std::vector<size_t>& branchIds)
+	{
+		std::vector<std::string> subset(branchIds.size());
+		for (size_t i = 0; i < branchIds.size(); ++i)
+		{
+			subset[i].swap(bubble.branches[branchIds[i]]);
+		}
+		std::string result = optimize(candidate, subset);
+		for (size_t i = 0; i < branchIds.size(); ++i)
+		{
+			subset[i].swap(bubble.branches[branchIds[i]]);
+		}
+		return result;
+	};
+
 	//first, select closest X branches (by length) and polish with them
 	const int PRE_POLISH = 5;
 	std::string prePolished = bubble.candidate;
@@ -43,29 +68,42 @@ void GeneralPolisher::polishBubble(Bubble& bubble) const
 				  [](const std::string& s1, const std::string& s2)
 				     {return s1.length() < s2.length();});
 		size_t left = bubble.branches.size() / 2 - PRE_POLISH / 2;
-		size_t right = left + PRE_POLISH;
-		std::vector<std::string> reducedSet(bubble.branches.begin() + left,
-											bubble.branches.begin() + right);
-		prePolished = optimize(prePolished, reducedSet, 
-							   bubble.polishSteps);
+		std::vector<size_t> reducedSet;
+		for (size_t i = left; i < left + PRE_POLISH; ++i)
+		{
+			reducedSet.push_back(i);
+		}
+		prePolished = optimizeSubset(prePolished, reducedSet);
 	}
 	
-	//then, polish with all branches
-	bubble.candidate = optimize(prePolished, bubble.branches, 
-								bubble.polishSteps);
-	
+	//then, polish with all branches (or with the sampled subset
+	//of branches, which are already sorted by length)
+	if (_fastMode && bubble.branches.size() > FAST_MAX_BRANCHES)
+	{
+		std::vector<size_t> sampledSet;
+		for (size_t i = 0; i < FAST_MAX_BRANCHES; ++i)
+		{
+			sampledSet.push_back((2 * i + 1) * bubble.branches.size() / 
+								 (2 * FAST_MAX_BRANCHES));
+		}
+		bubble.candidate = optimizeSubset(prePolished, sampledSet);
+	}
+	else
+	{
+		bubble.candidate = optimize(prePolished, bubble.branches);
+	}
 }
 
-StepInfo GeneralPolisher::makeStep(const std::string& candidate, 
-				   				   const std::vector<std::string>& branches,
-								   Alignment& align) const
+void GeneralPolisher::makeStep(const std::string& candidate, 
+				   			   const std::vector<std::string>& branches,
+							   Alignment& align, AlnScoreType minGain,
+							   StepInfo& stepResult) const
 {
 	static char alphabet[] = {'A', 'C', 'G', 'T'};
-	StepInfo stepResult;
 	
-	//Alignment
+	//Alignment. Edits should improve the score by more than minGain
 	AlnScoreType score = align.globalAlignment(candidate, branches);
-	stepResult.score = score;
+	stepResult.score = score + minGain;
 	stepResult.sequence = candidate;
 
 	//Deletion
@@ -82,7 +120,7 @@ StepInfo GeneralPolisher::makeStep(const std::string& candidate,
 			improvement = true;
 		}
 	}
-	if (improvement) return stepResult;
+	if (improvement) return;
 
 	//Insertion
 	for (size_t pos = 0; pos < candidate.size() + 1; ++pos) 
@@ -99,7 +137,7 @@ StepInfo GeneralPolisher::makeStep(const std::string& candidate,
 			}
 		}
 	}	
-	if (improvement) return stepResult;
+	if (improvement) return;
 
 	//Substitution
 	for (size_t pos = 0; pos < candidate.size(); ++pos) 
@@ -115,9 +153,9 @@ StepInfo GeneralPolisher::makeStep(const std::string& candidate,
 				stepResult.score = score;
 				stepResult.sequence = candidate;
 				stepResult.sequence[pos] = letter;
+				improvement = true;
 			}
 		}
 	}
-
-	return stepResult;
+	if (!improvement) stepResult.score = score;
 }
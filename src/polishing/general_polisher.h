@@ -12,14 +12,24 @@ class GeneralPolisher
 {
 public:
 	GeneralPolisher(const SubstitutionMatrix& subsMatrix):
-		_subsMatrix(subsMatrix)
+		_subsMatrix(subsMatrix), _fastMode(false), _logSteps(false)
 	{}
-	void polishBubble(Bubble& bubble) const;
+	//fast mode: deep bubbles are polished with a bounded subset
+	//of branches, and the optimization stops once the score gain
+	//of the best edit is below a threshold
+	void setFastMode(bool fastMode) {_fastMode = fastMode;}
+	//intermediate candidates are only stored for the polishing log
+	void setLogSteps(bool logSteps) {_logSteps = logSteps;}
+	//align is a per-thread buffer, reused between bubbles
+	void polishBubble(Bubble& bubble, Alignment& align) const;
 
 private:
-	StepInfo makeStep(const std::string& candidate, 
-					  const std::vector<std::string>& branches,
-					  Alignment& align) const;
+	void makeStep(const std::string& candidate, 
+				  const std::vector<std::string>& branches,
+				  Alignment& align, AlnScoreType minGain,
+				  StepInfo& stepResult) const;
 
 	const SubstitutionMatrix& _subsMatrix;
+	bool _fastMode;
+	bool _logSteps;
 };
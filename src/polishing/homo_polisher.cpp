@@ -4,6 +4,8 @@
 
 #include <algorithm>
 #include <unordered_set>
+#include <limits>
+#include <stdexcept>
 
 #include "homo_polisher.h"
 #include "../common/matrix.h"
@@ -11,73 +13,123 @@
 
 namespace
 {
-	//Computes global pairwise alignment with custom substitution matrix
+	//Computes global pairwise alignment with custom substitution matrix.
+	//Only the cells within the band around the diagonal (scaled by
+	//the sequences lengths) are computed, and the matrices store
+	//the band only. Candidate and branches have similar lengths
+	//(the others are filtered out when bubbles are constructed),
+	//so the band is narrow compared to the full matrix.
 	void pairwiseAlignment(const std::string& seqOne, const std::string& seqTwo,
 						   const SubstitutionMatrix& subsMat,
 						   std::string& outOne, std::string& outTwo)
 	{
-		Matrix<AlnScoreType> scoreMat(seqOne.length() + 1, seqTwo.length() + 1);
-		Matrix<char> backtrackMat(seqOne.length() + 1, seqTwo.length() + 1);
+		const int64_t MIN_BAND = 16;
+		const int64_t BAND_RATE = 10;
+		const AlnScoreType NEG_INF = std::numeric_limits<AlnScoreType>::min() / 2;
 
-		scoreMat.at(0, 0) = 0;
-		backtrackMat.at(0, 0) = 0;
-		for (size_t i = 0; i < seqOne.length(); ++i) 
+		const int64_t lenOne = seqOne.length();
+		const int64_t lenTwo = seqTwo.length();
+
+		//trivial alignment, if one of the sequences is empty
+		if (lenOne == 0 || lenTwo == 0)
 		{
-			scoreMat.at(i + 1, 0) = scoreMat.at(i, 0) + 
-									subsMat.getScore(seqOne[i], '-');
-			backtrackMat.at(i + 1, 0) = 1;
+			outOne = seqOne + std::string(lenTwo, '-') + "$";
+			outTwo = std::string(lenOne, '-') + seqTwo + "$";
+			return;
 		}
-		for (size_t i = 0; i < seqTwo.length(); ++i) 
+
+		//the band moves by up to lenTwo / lenOne + 1 columns per row,
+		//so the bands of the consecutive rows always overlap, and
+		//the path to the last cell stays within the band. For the very
+		//different lengths, the band covers the whole row (full DP)
+		const int64_t band = std::max(std::max(MIN_BAND, lenTwo / lenOne + 1),
+									  std::max(lenOne, lenTwo) / BAND_RATE);
+		const int64_t bandWidth = 2 * band + 1;
+
+		//matrices are reused between calls in the same thread
+		thread_local Matrix<AlnScoreType> scoreMat;
+		thread_local Matrix<char> backtrackMat;
+		scoreMat.resize(lenOne + 1, bandWidth);
+		backtrackMat.resize(lenOne + 1, bandWidth);
+
+		//first column of the band for the given row
+		auto bandStart = [lenOne, lenTwo, band](int64_t row)
 		{
-			scoreMat.at(0, i + 1) = scoreMat.at(0, i) + 
-									subsMat.getScore('-', seqTwo[i]);
-			backtrackMat.at(0, i + 1) = 0;
-		}
+			return row * lenTwo / lenOne - band;
+		};
 
-		//filling DP matrices
-		for (size_t i = 1; i < seqOne.length() + 1; ++i)
+		int64_t prevStart = 0;
+		for (int64_t i = 0; i < lenOne + 1; ++i)
 		{
-			for (size_t j = 1; j < seqTwo.length() + 1; ++j) 
+			int64_t start = bandStart(i);
+			//band shift relative to the previous row
+			int64_t shift = start - prevStart;
+			for (int64_t k = 0; k < bandWidth; ++k)
 			{
-				AlnScoreType left = scoreMat.at(i, j - 1) + 
-							 		subsMat.getScore('-', seqTwo[j - 1]);
-				AlnScoreType up = scoreMat.at(i - 1, j) + 
-								  subsMat.getScore(seqOne[i - 1], '-');
-				AlnScoreType cross = scoreMat.at(i - 1, j - 1) + 
-							  		 subsMat.getScore(seqOne[i - 1], seqTwo[j - 1]);
+				int64_t j = start + k;
+				if (j < 0 || j > lenTwo)
+				{
+					scoreMat.at(i, k) = NEG_INF;
+					continue;
+				}
+				if (i == 0 && j == 0)
+				{
+					scoreMat.at(i, k) = 0;
+					backtrackMat.at(i, k) = 0;
+					continue;
+				}
+
+				//cells above are at (i - 1, k + shift) and (i - 1, k + shift - 1)
+				int64_t upK = k + shift;
+				AlnScoreType left = k > 0 && j > 0 ? scoreMat.at(i, k - 1) + 
+							 		subsMat.getScore('-', seqTwo[j - 1]) : NEG_INF;
+				AlnScoreType up = i > 0 && upK < bandWidth ? 
+								  scoreMat.at(i - 1, upK) + 
+								  subsMat.getScore(seqOne[i - 1], '-') : NEG_INF;
+				AlnScoreType cross = i > 0 && j > 0 && upK > 0 && upK <= bandWidth ? 
+									 scoreMat.at(i - 1, upK - 1) + 
+							  		 subsMat.getScore(seqOne[i - 1], 
+									 				  seqTwo[j - 1]) : NEG_INF;
 
 				int prev = 2;
-				AlnScoreType score = cross;
-				if (up > score)
+				AlnScoreType maxScore = cross;
+				if (up > maxScore)
 				{
 					prev = 1;
-					score = up;
+					maxScore = up;
 				}
-				if (left > score)
+				if (left > maxScore)
 				{
 					prev = 0;
-					score = left;
+					maxScore = left;
 				}
-				scoreMat.at(i, j) = score;
-				backtrackMat.at(i, j) = prev;
+				scoreMat.at(i, k) = maxScore;
+				backtrackMat.at(i, k) = prev;
 			}
+			prevStart = start;
 		}
 
 		//backtrack
-		int i = seqOne.length();
-		int j = seqTwo.length();
+		int64_t i = lenOne;
+		int64_t j = lenTwo;
 		outOne.clear();
 		outTwo.clear();
 
 		while (i != 0 || j != 0) 
 		{
-			if(backtrackMat.at(i, j) == 1) 
+			int64_t k = j - bandStart(i);
+			if (k < 0 || k >= bandWidth)
+			{
+				throw std::runtime_error("Backtrack left the alignment band");
+			}
+			char prev = backtrackMat.at(i, k);
+			if(prev == 1) 
 			{
 				outOne += seqOne[i - 1];
 				outTwo += '-';
 				i -= 1;
 			}
-			else if (backtrackMat.at(i, j) == 0) 
+			else if (prev == 0) 
 			{
 				outOne += '-';
 				outTwo += seqTwo[j - 1];
@@ -171,6 +223,8 @@ namespace
 //processes a single bubble
 void HomoPolisher::polishBubble(Bubble& bubble) const
 {
+	if (bubble.candidate.empty() || bubble.branches.empty()) return;
+
 	std::string prevCandidate;
 	std::string curCandidate = bubble.candidate;
 
@@ -276,19 +330,19 @@ size_t HomoPolisher::compareTopTwo(char nucleotide, size_t firstChoice,
 								   observations) const
 {
 	size_t choices[] = {firstChoice, secondChoice};
-	HopoMatrix::ObsVector knownObs[2];
+	const HopoMatrix::ObsVector* knownObs[2];
 
 	for (size_t i = 0; i < 2; ++i)
 	{
 		auto state = HopoMatrix::State(nucleotide, choices[i]);
-		knownObs[i] = _hopoMatrix.knownObservations(state);
+		knownObs[i] = &_hopoMatrix.knownObservations(state);
 	}
 	
 	//getting common known observations
 	std::unordered_set<uint32_t> fstSet;
-	for (auto obs : knownObs[0]) fstSet.insert(obs.id);
+	for (auto obs : *knownObs[0]) fstSet.insert(obs.id);
 	std::unordered_set<uint32_t> commonSet;
-	for (auto obs : knownObs[1])
+	for (auto obs : *knownObs[1])
 	{
 		if (fstSet.count(obs.id)) commonSet.insert(obs.id);
 	}
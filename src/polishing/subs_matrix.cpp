@@ -49,7 +49,6 @@ namespace
 	static const double MIN_HOPO_PROB = 0.001f;
 	static const double ZERO_HOPO_PROB = 0.0000000001f;
 
-	static const int32_t SCORE_MULT = 2 << 16;
 	AlnScoreType probToScore(double prob)
 	{
 		//std::cout << prob << " " << (int32_t)std::round(std::log(prob) * (double)SCORE_MULT) << "\n";
@@ -217,23 +216,24 @@ HopoMatrix::HopoMatrix(const std::string& fileName)
 	}
 	_genomeProbs.assign(NUM_HOPO_STATES, probToScore(MIN_HOPO_PROB));
 	this->loadMatrix(fileName);
-}
-
 
-//returns all observations from the training set for a given state
-HopoMatrix::ObsVector HopoMatrix::knownObservations(State state) const
-{
-	ObsVector obsVector;
-	for (uint32_t obsId = 0; obsId < NUM_HOPO_OBS; ++obsId)
+	//observations from the training set for each state. The list
+	//is precomputed, since scanning all possible observations
+	//for every homopolymer dominates the polishing time
+	_knownObservations.assign(NUM_HOPO_STATES, ObsVector());
+	for (size_t stateId = 0; stateId < NUM_HOPO_STATES; ++stateId)
 	{
-		if (_observationProbs[state.id][obsId] > probToScore(MIN_HOPO_PROB))
+		for (uint32_t obsId = 0; obsId < NUM_HOPO_OBS; ++obsId)
 		{
-			obsVector.emplace_back(obsId);
+			if (_observationProbs[stateId][obsId] > probToScore(MIN_HOPO_PROB))
+			{
+				_knownObservations[stateId].emplace_back(obsId);
+			}
 		}
 	}
-	return obsVector;
 }
 
+
 //loads homopolymer matrix from .mat file
 void HopoMatrix::loadMatrix(const std::string& fileName)
 {
@@ -13,6 +13,9 @@
 
 typedef int64_t AlnScoreType;
 
+//scores are natural log-probabilities multiplied by this factor
+const AlnScoreType SCORE_MULT = 2 << 16;
+
 class SubstitutionMatrix 
 {
 public:
@@ -72,7 +75,8 @@ public:
 		{return _observationProbs[state.id][observ.id];}
 	AlnScoreType getGenomeProb(State state) const
 		{return _genomeProbs[state.id];}
-	ObsVector knownObservations(State state) const;
+	const ObsVector& knownObservations(State state) const
+		{return _knownObservations[state.id];}
 	static Observation strToObs(char mainNucl, const std::string& dnaStr, 
 								size_t start = 0, 
 								size_t end = std::string::npos);
@@ -83,4 +87,5 @@ private:
 
 	std::vector<std::vector<AlnScoreType>> _observationProbs;
 	std::vector<AlnScoreType> 			   _genomeProbs;
+	std::vector<ObsVector>				   _knownObservations;
 };
@@ -44,11 +44,7 @@ void GraphProcessor::fixChimericJunctions()
 	}
 	for (auto& node : simpleCases)
 	{
-		GraphNode* newNode = _graph.addNode();
-		GraphEdge* cutEdge = node->outEdges.front();
-		newNode->outEdges.push_back(cutEdge);
-		cutEdge->nodeLeft = newNode;
-		node->outEdges.clear();
+		_graph.disconnectLeft(node->outEdges.front());
 	}
 
 	//more common case: 2 in - 2 out
@@ -74,13 +70,8 @@ void GraphProcessor::fixChimericJunctions()
 	for(auto& node : complexCases)
 	{
 		GraphNode* newNode = _graph.addNode();
-		node->inEdges[1]->nodeRight = newNode;
-		node->outEdges[0]->nodeLeft = newNode;
-		newNode->inEdges.push_back(node->inEdges[1]);
-		newNode->outEdges.push_back(node->outEdges[0]);
-
-		node->inEdges.pop_back();
-		node->outEdges.erase(node->outEdges.begin());
+		_graph.reattachRight(node->inEdges[1], newNode);
+		_graph.reattachLeft(node->outEdges[0], newNode);
 	}
 
 	Logger::get().debug() << "Removed " 
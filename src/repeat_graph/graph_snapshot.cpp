@@ -0,0 +1,338 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "graph_snapshot.h"
+#include "../common/logger.h"
+#include "../common/profiler.h"
+
+
+namespace
+{
+	const uint32_t SNAPSHOT_MAGIC = 0x47594c46;	//"FLYG"
+	const uint32_t SNAPSHOT_VERSION = 1;
+
+	class SnapshotWriter
+	{
+	public:
+		SnapshotWriter(const std::string& filename):
+			_fout(filename, std::ios::binary)
+		{
+			if (!_fout)
+			{
+				throw std::runtime_error("Can't open " + filename);
+			}
+		}
+
+		template <class T>
+		void write(const T& value)
+		{
+			_fout.write((const char*)&value, sizeof(T));
+		}
+
+		void writeBytes(const void* data, size_t size)
+		{
+			_fout.write((const char*)data, size);
+		}
+
+		void writeString(const std::string& str)
+		{
+			this->write<uint32_t>(str.size());
+			this->writeBytes(str.data(), str.size());
+		}
+
+	private:
+		std::ofstream _fout;
+	};
+
+	class SnapshotReader
+	{
+	public:
+		SnapshotReader(const std::string& filename):
+			_filename(filename), _data(nullptr), _size(0), _pos(0)
+		{
+			int fd = open(filename.c_str(), O_RDONLY);
+			if (fd < 0)
+			{
+				throw std::runtime_error("Can't open " + filename);
+			}
+			struct stat fileStat;
+			if (fstat(fd, &fileStat) != 0)
+			{
+				close(fd);
+				throw std::runtime_error("Can't open " + filename);
+			}
+			_size = fileStat.st_size;
+			if (_size > 0)
+			{
+				void* mapped = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (mapped == MAP_FAILED)
+				{
+					close(fd);
+					throw std::runtime_error("Can't map " + filename);
+				}
+				_data = (const uint8_t*)mapped;
+				madvise(mapped, _size, MADV_SEQUENTIAL);
+			}
+			close(fd);
+		}
+
+		~SnapshotReader()
+		{
+			if (_data) munmap((void*)_data, _size);
+		}
+
+		SnapshotReader(const SnapshotReader&) = delete;
+		SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+		//the mapped data might be unaligned, so values are copied
+		template <class T>
+		T read()
+		{
+			T value;
+			memcpy(&value, this->readBytes(sizeof(T)), sizeof(T));
+			return value;
+		}
+
+		const uint8_t* readBytes(size_t size)
+		{
+			if (_pos + size > _size)
+			{
+				throw std::runtime_error("Error parsing: " + _filename);
+			}
+			const uint8_t* ptr = _data + _pos;
+			_pos += size;
+			return ptr;
+		}
+
+		std::string readString()
+		{
+			uint32_t length = this->read<uint32_t>();
+			return std::string((const char*)this->readBytes(length), length);
+		}
+
+	private:
+		std::string    _filename;
+		const uint8_t* _data;
+		size_t 		   _size;
+		size_t 		   _pos;
+	};
+
+	//sequence ids are global for all containers, so they are
+	//stored relative to the first sequence of the container
+	uint32_t relativeId(FastaRecord::Id seqId, const SequenceContainer& seqs)
+	{
+		return seqId.index() - seqs.iterSeqs().front().id.index();
+	}
+}
+
+void GraphSnapshot::store(const std::string& filename, RepeatGraph& graph,
+						  const ReadAligner& aligner,
+						  const SequenceContainer& readSeqs)
+{
+	ScopedTimer timer("snapshot_store");
+	SnapshotWriter writer(filename);
+	writer.write(SNAPSHOT_MAGIC);
+	writer.write(SNAPSHOT_VERSION);
+
+	//edge sequences, only the positive strands (the negative
+	//strand records are created by the container)
+	const SequenceContainer& edgeSeqs = graph.edgeSequences();
+	writer.write<uint64_t>(edgeSeqs.iterSeqs().size() / 2);
+	std::vector<uint8_t> packedSeq;
+	for (auto& seqRec : edgeSeqs.iterSeqs())
+	{
+		if (!seqRec.id.strand()) continue;
+
+		writer.writeString(seqRec.description.substr(1));
+		writer.write<uint64_t>(seqRec.sequence.length());
+		packedSeq.assign((seqRec.sequence.length() + 3) / 4, 0);
+		seqRec.sequence.copyPacked(packedSeq.data());
+		writer.writeBytes(packedSeq.data(), packedSeq.size());
+	}
+
+	//graph topology and the edge properties
+	uint64_t nextNodeId = 0;
+	std::unordered_map<GraphNode*, uint64_t> nodeIds;
+	for (auto& node : graph.iterNodes())
+	{
+		nodeIds[node] = nextNodeId++;
+	}
+	writer.write<uint64_t>(std::distance(graph.iterEdges().begin(), 
+										 graph.iterEdges().end()));
+	for (auto& edge : graph.iterEdges())
+	{
+		writer.write<uint32_t>(edge->edgeId.index());
+		writer.write<uint64_t>(nodeIds[edge->nodeLeft]);
+		writer.write<uint64_t>(nodeIds[edge->nodeRight]);
+		writer.write<uint8_t>(edge->repetitive);
+		writer.write<uint8_t>(edge->selfComplement);
+		writer.write<uint8_t>(edge->resolved);
+		writer.write<int32_t>(edge->meanCoverage);
+		writer.write<int32_t>(edge->altGroupId);
+
+		writer.write<uint32_t>(edge->seqSegments.size());
+		for (auto& seg : edge->seqSegments)
+		{
+			writer.write<uint32_t>(relativeId(seg.edgeSeqId, edgeSeqs));
+			writer.write<int32_t>(seg.seqLen);
+			writer.write<uint32_t>(seg.origSeqId.index());
+			writer.write<int32_t>(seg.origSeqLen);
+			writer.write<int32_t>(seg.origSeqStart);
+			writer.write<int32_t>(seg.origSeqEnd);
+		}
+	}
+
+	//read alignment chains
+	writer.write<uint64_t>(readSeqs.iterSeqs().size());
+	writer.write<uint64_t>(aligner.getAlignments().size());
+	for (auto& chain : aligner.getAlignments())
+	{
+		writer.write<uint32_t>(chain.size());
+		for (auto& aln : chain)
+		{
+			const OverlapRange& ovlp = aln.overlap;
+			writer.write<uint32_t>(aln.edge->edgeId.index());
+			writer.write<uint32_t>(relativeId(ovlp.curId, readSeqs));
+			writer.write<int32_t>(ovlp.curBegin);
+			writer.write<int32_t>(ovlp.curEnd);
+			writer.write<int32_t>(ovlp.curLen);
+			writer.write<uint32_t>(relativeId(ovlp.extId, edgeSeqs));
+			writer.write<int32_t>(ovlp.extBegin);
+			writer.write<int32_t>(ovlp.extEnd);
+			writer.write<int32_t>(ovlp.extLen);
+			writer.write<int32_t>(ovlp.leftShift);
+			writer.write<int32_t>(ovlp.rightShift);
+			writer.write<int32_t>(ovlp.score);
+			writer.write<float>(ovlp.seqDivergence);
+		}
+	}
+}
+
+void GraphSnapshot::load(const std::string& filename, RepeatGraph& graph,
+						 ReadAligner& aligner, SequenceContainer& edgeSeqs,
+						 const SequenceContainer& readSeqs)
+{
+	ScopedTimer timer("snapshot_load");
+	SnapshotReader reader(filename);
+	if (reader.read<uint32_t>() != SNAPSHOT_MAGIC ||
+		reader.read<uint32_t>() != SNAPSHOT_VERSION)
+	{
+		throw std::runtime_error("Unsupported graph snapshot: " + filename);
+	}
+
+	//edge sequences
+	uint64_t numSeqs = reader.read<uint64_t>();
+	for (size_t i = 0; i < numSeqs; ++i)
+	{
+		std::string name = reader.readString();
+		uint64_t length = reader.read<uint64_t>();
+		const uint8_t* packedSeq = reader.readBytes((length + 3) / 4);
+		edgeSeqs.addSequence(DnaSequence::fromPacked(packedSeq, length), name);
+	}
+	auto edgeSeqId = [&edgeSeqs, &filename](uint32_t relId)
+	{
+		if (relId >= edgeSeqs.iterSeqs().size())
+		{
+			throw std::runtime_error("Error parsing: " + filename);
+		}
+		return FastaRecord::Id(edgeSeqs.iterSeqs().front().id.index() + relId);
+	};
+
+	//graph, nodes are created in the same order as by loadGraph()
+	std::unordered_map<uint64_t, GraphNode*> idToNode;
+	auto getNode = [&idToNode, &graph](uint64_t nodeId)
+	{
+		auto itNode = idToNode.find(nodeId);
+		if (itNode != idToNode.end()) return itNode->second;
+		return idToNode[nodeId] = graph.addNode();
+	};
+	uint64_t numEdges = reader.read<uint64_t>();
+	for (size_t i = 0; i < numEdges; ++i)
+	{
+		FastaRecord::Id edgeId(reader.read<uint32_t>());
+		GraphNode* leftNode = getNode(reader.read<uint64_t>());
+		GraphNode* rightNode = getNode(reader.read<uint64_t>());
+		GraphEdge edge(leftNode, rightNode, edgeId);
+		edge.repetitive = reader.read<uint8_t>();
+		edge.selfComplement = reader.read<uint8_t>();
+		edge.resolved = reader.read<uint8_t>();
+		edge.meanCoverage = reader.read<int32_t>();
+		edge.altGroupId = reader.read<int32_t>();
+		if (edge.altGroupId != -1) edge.altHaplotype = true;
+
+		uint32_t numSegments = reader.read<uint32_t>();
+		for (size_t j = 0; j < numSegments; ++j)
+		{
+			EdgeSequence seg;
+			seg.edgeSeqId = edgeSeqId(reader.read<uint32_t>());
+			seg.seqLen = reader.read<int32_t>();
+			seg.origSeqId = FastaRecord::Id(reader.read<uint32_t>());
+			seg.origSeqLen = reader.read<int32_t>();
+			seg.origSeqStart = reader.read<int32_t>();
+			seg.origSeqEnd = reader.read<int32_t>();
+			edge.seqSegments.push_back(seg);
+		}
+		graph.addEdge(std::move(edge));
+	}
+
+	//alignments
+	if (reader.read<uint64_t>() != readSeqs.iterSeqs().size())
+	{
+		throw std::runtime_error("Reads do not match the graph snapshot: "
+								 + filename);
+	}
+	uint64_t numChains = reader.read<uint64_t>();
+	std::vector<GraphAlignment> alignments;
+	alignments.reserve(numChains);
+	for (size_t i = 0; i < numChains; ++i)
+	{
+		uint32_t chainLen = reader.read<uint32_t>();
+		GraphAlignment chain;
+		chain.reserve(chainLen);
+		for (size_t j = 0; j < chainLen; ++j)
+		{
+			FastaRecord::Id edgeId(reader.read<uint32_t>());
+			GraphEdge* edge = graph.getEdge(edgeId);
+			if (!edge)
+			{
+				throw std::runtime_error("Error parsing graph snapshot: " + 
+										 filename);
+			}
+
+			OverlapRange ovlp;
+			uint32_t readId = reader.read<uint32_t>();
+			ovlp.curBegin = reader.read<int32_t>();
+			ovlp.curEnd = reader.read<int32_t>();
+			ovlp.curLen = reader.read<int32_t>();
+			if (readId >= readSeqs.iterSeqs().size() ||
+				readSeqs.iterSeqs()[readId].sequence.length() !=
+					(size_t)ovlp.curLen)
+			{
+				throw std::runtime_error("Reads do not match the graph snapshot: "
+										 + filename);
+			}
+			ovlp.curId = readSeqs.iterSeqs()[readId].id;
+			ovlp.extId = edgeSeqId(reader.read<uint32_t>());
+			ovlp.extBegin = reader.read<int32_t>();
+			ovlp.extEnd = reader.read<int32_t>();
+			ovlp.extLen = reader.read<int32_t>();
+			ovlp.leftShift = reader.read<int32_t>();
+			ovlp.rightShift = reader.read<int32_t>();
+			ovlp.score = reader.read<int32_t>();
+			ovlp.seqDivergence = reader.read<float>();
+			chain.push_back({ovlp, edge, edgeId});
+		}
+		alignments.push_back(std::move(chain));
+	}
+	aligner.setAlignments(std::move(alignments));
+
+	Logger::get().debug() << "Loaded graph snapshot with " << numEdges
+		<< " edges and " << numChains << " alignments";
+}
@@ -0,0 +1,31 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Binary snapshot of the resolved repeat graph: topology, edge sequences
+//(2-bit packed), per-edge coverage and the read alignment chains.
+//It is written by flye-repeat and lets flye-contigger start without
+//parsing the text graph / alignment dumps and the edges fasta.
+//The file consists of fixed-width records, and is memory-mapped
+//when loaded
+
+#pragma once
+
+#include "repeat_graph.h"
+#include "read_aligner.h"
+
+class GraphSnapshot
+{
+public:
+	static void store(const std::string& filename, RepeatGraph& graph,
+					  const ReadAligner& aligner,
+					  const SequenceContainer& readSeqs);
+
+	//loads the snapshot into an empty graph and aligner. The edge
+	//sequences are added to edgeSeqs, which should be empty and be the
+	//graph's edge sequences container. Reads should be the same
+	//as when the snapshot was stored
+	static void load(const std::string& filename, RepeatGraph& graph,
+					 ReadAligner& aligner, SequenceContainer& edgeSeqs,
+					 const SequenceContainer& readSeqs);
+};
@@ -1,5 +1,6 @@
 #include "haplotype_resolver.h"
 #include "graph_processing.h"
+#include "../common/profiler.h"
 #include <queue>
 #include <set>
 
@@ -12,6 +13,7 @@
 //Note that we are not using any global coverage assumptions here.
 int HaplotypeResolver::findHeterozygousBulges()
 {
+	ScopedTimer timer("haplotype_detection");
 	//const float MAX_COV_VAR = 1.5;
 	const int MAX_BUBBLE_LEN = Config::get("max_bubble_length");
 
@@ -137,6 +139,7 @@ int HaplotypeResolver::findHeterozygousBulges()
 //3. Loop coverage is roughly equal or less than coverage of entrance/exit
 int HaplotypeResolver::findHeterozygousLoops()
 {
+	ScopedTimer timer("haplotype_detection");
 	const float COV_MULT = 1.5;
 	const int MAX_LOOP_LEN = Config::get("max_bubble_length");
 
@@ -228,14 +231,15 @@ int HaplotypeResolver::findHeterozygousLoops()
 
 HaplotypeResolver::VariantPaths 
 	HaplotypeResolver::findVariantSegment(GraphEdge* startEdge,
-										  const std::vector<GraphAlignment>& alingnments,
+										  const std::vector<size_t>& alignmentIds,
 										  const std::unordered_set<GraphEdge*>& loopedEdges)
 {
 	//first, extract alnignment paths starting from
 	//the current edge and sort them from longest to shortest
 	std::vector<GraphAlignment> outPaths;
-	for (auto& aln : alingnments)
+	for (size_t alnId : alignmentIds)
 	{
+		const auto& aln = _aligner.getAlignments()[alnId];
 		for (size_t i = 0; i < aln.size(); ++i)
 		{
 			//if (aln[i].edge == startEdge)
@@ -442,8 +446,9 @@ HaplotypeResolver::VariantPaths
 
 	//get the bridgin read sequence
 	std::vector<GraphAlignment> bridgingReads;
-	for (auto& aln : alingnments)
+	for (size_t alnId : alignmentIds)
 	{
+		const auto& aln = _aligner.getAlignments()[alnId];
 		int startPos = -1;
 		int endPos = -1;
 		for (size_t i = 0; i < aln.size(); ++i)
@@ -483,8 +488,7 @@ HaplotypeResolver::VariantPaths
 //(more than just two alternative branches) using read-paths
 int HaplotypeResolver::findComplexHaplotypes()
 {
-	auto alnIndex = _aligner.makeAlignmentIndex();
-
+	ScopedTimer timer("haplotype_detection");
 	GraphProcessor proc(_graph, _asmSeqs);
 	auto unbranchingPaths = proc.getUnbranchingPaths();
 	std::unordered_set<GraphEdge*> loopedEdges;
@@ -505,14 +509,15 @@ int HaplotypeResolver::findComplexHaplotypes()
 		if (loopedEdges.count(startEdge)) continue;
 		if (usedEdges.count(startEdge)) continue;
 		
-		auto varSeg = this->findVariantSegment(startEdge, alnIndex[startEdge], 
+		auto varSeg = this->findVariantSegment(startEdge, 
+									_aligner.getEdgeAlignments(startEdge), 
 											   loopedEdges);
 		if (varSeg.startEdge && varSeg.endEdge &&
 			varSeg.startEdge != _graph.complementEdge(varSeg.endEdge))
 		{
 			auto revSeg = 
 				this->findVariantSegment(_graph.complementEdge(varSeg.endEdge), 
-										 alnIndex[_graph.complementEdge(varSeg.endEdge)], 
+				_aligner.getEdgeAlignments(_graph.complementEdge(varSeg.endEdge)), 
 										 loopedEdges);
 			if (revSeg.endEdge == _graph.complementEdge(varSeg.startEdge))
 			{
@@ -574,6 +579,7 @@ int HaplotypeResolver::findComplexHaplotypes()
 
 void HaplotypeResolver::collapseHaplotypes()
 {
+	ScopedTimer timer("haplotype_detection");
 	int numBridged = 0;
 	std::unordered_set<GraphEdge*> separatedEdges;
 	for (auto& inEdge : _graph.iterEdges())
@@ -644,23 +650,15 @@ DnaSequence HaplotypeResolver::pathSequence(GraphPath& path)
 void HaplotypeResolver::separeteAdjacentEdges(GraphEdge* inEdge, GraphEdge* outEdge)
 {
 	GraphNode* newNode = _graph.addNode();
-
-	vecRemove(inEdge->nodeRight->inEdges, inEdge);
-	inEdge->nodeRight = newNode;
-	newNode->inEdges.push_back(inEdge);
-
-	vecRemove(outEdge->nodeLeft->outEdges, outEdge);
-	outEdge->nodeLeft = newNode;
-	newNode->outEdges.push_back(outEdge);
+	_graph.reattachRight(inEdge, newNode);
+	_graph.reattachLeft(outEdge, newNode);
 }
 
 void HaplotypeResolver::separateDistantEdges(GraphEdge* inEdge, GraphEdge* outEdge,
 						  					 EdgeSequence insertSeq, FastaRecord::Id newId)
 {
 	GraphNode* leftNode = _graph.addNode();
-	vecRemove(inEdge->nodeRight->inEdges, inEdge);
-	inEdge->nodeRight = leftNode;
-	leftNode->inEdges.push_back(inEdge);
+	_graph.reattachRight(inEdge, leftNode);
 
 	GraphNode* rightNode = _graph.addNode();
 	GraphEdge* newEdge = _graph.addEdge(GraphEdge(leftNode, rightNode,
@@ -670,9 +668,7 @@ void HaplotypeResolver::separateDistantEdges(GraphEdge* inEdge, GraphEdge* outEd
 							outEdge->meanCoverage) / 2;
 	newEdge->meanCoverage = pathCoverage;
 
-	vecRemove(outEdge->nodeLeft->outEdges, outEdge);
-	outEdge->nodeLeft = rightNode;
-	rightNode->outEdges.push_back(outEdge);
+	_graph.reattachLeft(outEdge, rightNode);
 }
 
 void HaplotypeResolver::resetEdges()
@@ -995,6 +991,7 @@ namespace
 
 int HaplotypeResolver::findSuperbubbles()
 {
+	ScopedTimer timer("haplotype_detection");
 	const int MAX_BUBBLE_LEN = Config::get("max_bubble_length");	//50k
 	
 	GraphProcessor proc(_graph, _asmSeqs);
@@ -6,49 +6,76 @@
 #include "graph_processing.h"
 #include "../common/disjoint_set.h"
 #include "../common/utils.h"
+#include "../common/parallel.h"
+#include "../common/profiler.h"
+#include "../common/quantile_sketch.h"
 #include <cmath>
+#include <set>
 
 
 
 //Estimates the mean coverage and assingns edges multiplicity accordingly
 void MultiplicityInferer::estimateCoverage()
 {
+	ScopedTimer timer("coverage_estimation");
 	const int WINDOW = Config::get("coverage_estimate_window");
+	const size_t CHUNK_SIZE = 1000;
 
-	//alternative coverage
-	std::unordered_map<GraphEdge*, std::vector<int32_t>> wndCoverage;
-
+	//per-window coverage of each edge, indexed by edge id. 
+	//Alignments are processed in parallel (by chunks),
+	//so the counters are atomic
+	size_t numIds = 0;
+	for (auto& edge : _graph.iterEdges())
+	{
+		numIds = std::max(numIds, edge->edgeId.index() + 1);
+	}
+	std::vector<std::vector<std::atomic<int32_t>>> atomicCoverage(numIds);
 	for (auto& edge : _graph.iterEdges())
 	{
 		size_t numWindows = edge->length() / WINDOW;
-		wndCoverage[edge].assign(numWindows, 0);
+		atomicCoverage[edge->edgeId.index()] = 
+			std::vector<std::atomic<int32_t>>(numWindows);
 	}
 
-	for (auto& path : _aligner.getAlignments())
+	const auto& alignments = _aligner.getAlignments();
+	std::vector<size_t> chunkStarts;
+	for (size_t i = 0; i < alignments.size(); i += CHUNK_SIZE)
+	{
+		chunkStarts.push_back(i);
+	}
+	std::function<void(const size_t&)> countChunk = 
+	[&alignments, &atomicCoverage, WINDOW, CHUNK_SIZE] (const size_t& start)
 	{
-		for (size_t i = 0; i < path.size(); ++i)
+		size_t end = std::min(start + CHUNK_SIZE, alignments.size());
+		for (size_t alnId = start; alnId < end; ++alnId)
 		{
-			auto& ovlp = path[i].overlap;
-			auto& coverage = wndCoverage[path[i].edge];
-			for (int pos = ovlp.extBegin / WINDOW + 1; 
-			 	 pos < ovlp.extEnd / WINDOW; ++pos)
+			for (auto& edgeAln : alignments[alnId])
 			{
-				if (pos >= 0 && 
-					pos < (int)coverage.size())
+				auto& ovlp = edgeAln.overlap;
+				auto& coverage = atomicCoverage[edgeAln.edge->edgeId.index()];
+				for (int pos = ovlp.extBegin / WINDOW + 1; 
+					 pos < ovlp.extEnd / WINDOW; ++pos)
 				{
-					++coverage[pos];
+					if (pos >= 0 && 
+						pos < (int)coverage.size())
+					{
+						coverage[pos].fetch_add(1, std::memory_order_relaxed);
+					}
 				}
 			}
 		}
-	}
+	};
+	processInParallel(chunkStarts, countChunk, 
+					  Parameters::get().numThreads, /*progress*/ false);
 
+	//the counters are read directly, without copying
 	int64_t sumCov = 0;
 	int64_t sumLength = 0;
-	for (auto& edgeCoverage : wndCoverage)
+	for (auto& edgeCoverage : atomicCoverage)
 	{
-		for (auto& cov : edgeCoverage.second)
+		for (auto& cov : edgeCoverage)
 		{
-			sumCov += (int64_t)cov;
+			sumCov += (int64_t)cov.load(std::memory_order_relaxed);
 			++sumLength;
 		}
 	}
@@ -56,19 +83,39 @@ void MultiplicityInferer::estimateCoverage()
 
 	Logger::get().info() << "Mean edge coverage: " << _meanCoverage;
 
-	std::vector<int32_t> edgesCoverage;
+	//medians are also computed in parallel, with the quantile sketches
+	std::vector<int32_t> medianCoverage(numIds, 0);
+	std::vector<size_t> edgeIds;
+	for (size_t i = 0; i < numIds; ++i)
+	{
+		if (!atomicCoverage[i].empty()) edgeIds.push_back(i);
+	}
+	std::function<void(const size_t&)> computeMedian = 
+	[&atomicCoverage, &medianCoverage] (const size_t& edgeId)
+	{
+		QuantileSketch covSketch;
+		for (auto& cov : atomicCoverage[edgeId])
+		{
+			covSketch.add(cov.load(std::memory_order_relaxed));
+		}
+		medianCoverage[edgeId] = std::lround(covSketch.median());
+	};
+	processInParallel(edgeIds, computeMedian, 
+					  Parameters::get().numThreads, /*progress*/ false);
+
+	QuantileSketch edgesCoverage;
 	for (auto edge : _graph.iterEdges())
 	{
-		if (wndCoverage[edge].empty()) continue;
+		if (atomicCoverage[edge->edgeId.index()].empty()) continue;
 
 		GraphEdge* complEdge = _graph.complementEdge(edge);
-		int32_t medianCov = (median(wndCoverage[edge]) + 
-						 	 median(wndCoverage[complEdge])) / 2;
+		int32_t medianCov = (medianCoverage[edge->edgeId.index()] + 
+						 	 medianCoverage[complEdge->edgeId.index()]) / 2;
 
 		int estMult = std::round((float)medianCov / _meanCoverage);
 		if (estMult == 1)
 		{
-			edgesCoverage.push_back(medianCov);
+			edgesCoverage.add(medianCov);
 		}
 
 		//std::string match = estMult != edge->multiplicity ? "*" : " ";
@@ -86,13 +133,14 @@ void MultiplicityInferer::estimateCoverage()
 	if (!edgesCoverage.empty())
 	{
 		const float MULT = 1.75f;	//at least 1.75x of mean coverage
-		_uniqueCovThreshold = MULT * quantile(edgesCoverage, 75);
+		_uniqueCovThreshold = MULT * std::lround(edgesCoverage.quantile(75));
 	}
 	Logger::get().debug() << "Unique coverage threshold " << _uniqueCovThreshold;
 }
 
 int MultiplicityInferer::resolveForks()
 {
+	ScopedTimer timer("graph_simplification");
 	//const int UNIQUE_LEN = (int)Config::get("unique_edge_length");
 	const int MAJOR_TO_MINOR = 5;
 
@@ -189,6 +237,7 @@ int MultiplicityInferer::resolveForks()
 //only remove tips
 int MultiplicityInferer::removeUnsupportedEdges(bool onlyTips)
 {
+	ScopedTimer timer("graph_simplification");
 	GraphProcessor proc(_graph, _asmSeqs);
 	auto unbranchingPaths = proc.getUnbranchingPaths();
 
@@ -236,6 +285,7 @@ int MultiplicityInferer::removeUnsupportedEdges(bool onlyTips)
 
 int MultiplicityInferer::disconnectMinorPaths()
 {
+	ScopedTimer timer("graph_simplification");
 	const int DETACH_RATE = 5;
 
 	auto nodeDegree = [](GraphNode* node)
@@ -312,32 +362,35 @@ int MultiplicityInferer::disconnectMinorPaths()
 //addresses chimeric connections
 int MultiplicityInferer::splitNodes()
 {
+	ScopedTimer timer("graph_simplification");
 	static const int MIN_JCT_SUPPORT = 2;
 
 	Logger::get().debug() << "Splitting nodes";
 	int numSplit = 0;
 
-	//storing connectivity information
-	std::unordered_map<GraphEdge*, 
-					   std::unordered_map<GraphEdge*, int>> readSupport;
-	for (auto& readPath : _aligner.getAlignments())
+	//the split only depends on the node's edges and their
+	//connection support, so after the first run only the nodes 
+	//touched since the previous run need to be checked. Splits do not
+	//change the other nodes (or the support), and the nodes are visited
+	//in the order of their ids, so the result is the same as if all
+	//nodes were checked
+	std::vector<GraphNode*> originalNodes;
+	if (_splitCheckpoint == RepeatGraph::NO_CHECKPOINT)
 	{
-		if (readPath.size() < 2) continue;
-		
-		for (size_t i = 0; i < readPath.size() - 1; ++i)
-		{
-			//if (readPath[i].edge == readPath[i + 1].edge &&
-			//	readPath[i].edge->isLooped()) continue;
-			if (readPath[i].edge->edgeId == 
-				readPath[i + 1].edge->edgeId.rc()) continue;
-
-			++readSupport[readPath[i].edge][readPath[i + 1].edge];
-		}
+		originalNodes.assign(_graph.iterNodes().begin(), 
+							 _graph.iterNodes().end());
+	}
+	else
+	{
+		auto touched = _graph.getTouchedNodes(_splitCheckpoint);
+		originalNodes.assign(touched.begin(), touched.end());
 	}
+	_splitCheckpoint = _graph.touchCheckpoint(_splitCheckpoint);
+	std::sort(originalNodes.begin(), originalNodes.end(),
+			  [](const GraphNode* n1, const GraphNode* n2)
+			  {return n1->nodeId < n2->nodeId;});
 
 	std::unordered_set<GraphNode*> usedNodes;
-	std::vector<GraphNode*> originalNodes(_graph.iterNodes().begin(), 
-									      _graph.iterNodes().end());
 	for (auto& nodeToSplit : originalNodes)
 	{
 		if (nodeToSplit->inEdges.size() < 2 ||
@@ -355,7 +408,7 @@ int MultiplicityInferer::splitNodes()
 		typedef SetNode<EdgeDir> SetElement;
 		SetVec<EdgeDir> allElements;
 		std::unordered_map<GraphEdge*, SetElement*> inputElements;
-		std::unordered_map<GraphEdge*, SetElement*> outputElements;
+		std::unordered_map<FastaRecord::Id, SetElement*> outputElements;
 		for (GraphEdge* edge : nodeToSplit->inEdges) 
 		{
 			allElements.push_back(new SetElement({edge, true}));
@@ -364,13 +417,14 @@ int MultiplicityInferer::splitNodes()
 		for (GraphEdge* edge : nodeToSplit->outEdges) 
 		{
 			allElements.push_back(new SetElement({edge, false}));
-			outputElements[edge] = allElements.back();
+			outputElements[edge->edgeId] = allElements.back();
 		}
 
 		//grouping edges if they are connected by reads
 		for (GraphEdge* inEdge : nodeToSplit->inEdges)
 		{
-			for (auto outEdge : readSupport[inEdge])
+			//connectivity information is maintained by the aligner
+			for (auto outEdge : _aligner.getOutConnections(inEdge))
 			{
 				if (outEdge.second >= MIN_JCT_SUPPORT)
 				{
@@ -401,23 +455,17 @@ int MultiplicityInferer::splitNodes()
 
 			for (auto& cl : clusters)
 			{
-				auto switchNode = [&nodeToSplit](GraphEdge* edge, 
-												 GraphNode* newNode,
-												 bool isInput)
+				auto switchNode = [this](GraphEdge* edge, GraphNode* newNode,
+										 bool isInput)
 				{
 					if (!isInput)
 					{
-						vecRemove(edge->nodeLeft->outEdges, edge);
-						edge->nodeLeft = newNode;
-						newNode->outEdges.push_back(edge);
+						_graph.reattachLeft(edge, newNode);
 					}
 					else
 					{
-						vecRemove(edge->nodeRight->inEdges, edge);
-						edge->nodeRight = newNode;
-						newNode->inEdges.push_back(edge);
+						_graph.reattachRight(edge, newNode);
 					}
-
 				};
 
 				GraphNode* newNode = _graph.addNode();
@@ -450,72 +498,105 @@ int MultiplicityInferer::splitNodes()
 //edge coverage
 int MultiplicityInferer::removeUnsupportedConnections()
 {
+	ScopedTimer timer("graph_simplification");
 	static const int MIN_JCT_SUPPORT = 2;
 
-	std::unordered_map<GraphEdge*, int32_t> rightConnections;
-	std::unordered_map<GraphEdge*, int32_t> leftConnections;
-
-	for (auto& readPath : _aligner.getAlignments())
+	//Only the edges next to the nodes touched since the previous run
+	//could change their status (the support is only updated together
+	//with the graph, when the alignments are updated). Edges are checked
+	//in the order of their ids, and if a disconnection changes a node, 
+	//its edges that come later in this order are checked in the same run.
+	//This way, the result is the same as if all edges were checked
+	auto idLess = [](const GraphEdge* e1, const GraphEdge* e2)
+		{return e1->edgeId < e2->edgeId;};
+	std::set<GraphEdge*, decltype(idLess)> edgesToCheck(idLess);
+	auto addNodeEdges = [this, &edgesToCheck](GraphNode* node, 
+											  const GraphEdge* after)
 	{
-		if (readPath.size() < 2) continue;
-		//int overhang = std::max(readPath.front().overlap.curBegin,
-		//						readPath.back().overlap.curLen - 
-		//							readPath.back().overlap.curEnd);
-		//if (overhang > (int)Config::get("maximum_overhang")) continue;
-
-		for (size_t i = 0; i < readPath.size() - 1; ++i)
+		for (auto edges : {&node->inEdges, &node->outEdges})
 		{
-			//if (readPath[i].edge == readPath[i + 1].edge &&
-			//	readPath[i].edge->isLooped()) continue;
-			if (readPath[i].edge->edgeId == 
-				readPath[i + 1].edge->edgeId.rc()) continue;
-
-			++rightConnections[readPath[i].edge];
-			++leftConnections[readPath[i + 1].edge];
-			GraphEdge* complLeft = _graph.complementEdge(readPath[i].edge);
-			GraphEdge* complRight = _graph.complementEdge(readPath[i + 1].edge);
-			++rightConnections[complRight];
-			++leftConnections[complLeft];
+			for (GraphEdge* edge : *edges)
+			{
+				//the forward strand edge is checked along with its complement
+				if (!edge->edgeId.strand()) edge = _graph.complementEdge(edge);
+				if (!after || after->edgeId < edge->edgeId) 
+				{
+					edgesToCheck.insert(edge);
+				}
+			}
+		}
+	};
+	if (_connectionsCheckpoint == RepeatGraph::NO_CHECKPOINT)
+	{
+		for (GraphEdge* edge : _graph.iterEdges())
+		{
+			if (edge->edgeId.strand()) edgesToCheck.insert(edge);
+		}
+	}
+	else
+	{
+		for (GraphNode* node : _graph.getTouchedNodes(_connectionsCheckpoint))
+		{
+			addNodeEdges(node, nullptr);
 		}
 	}
+	_connectionsCheckpoint = _graph.touchCheckpoint(_connectionsCheckpoint);
 
 	int numDisconnected = 0;
-	for (auto& edge : _graph.iterEdges())
+	while (!edgesToCheck.empty())
 	{
+		GraphEdge* edge = *edgesToCheck.begin();
+		edgesToCheck.erase(edgesToCheck.begin());
 		if (!edge->edgeId.strand() || edge->isLooped()) continue;
 		GraphEdge* complEdge = _graph.complementEdge(edge);
 
+		//Connections are counted for both the alignment and its complement.
+		//The aligner keeps the support counters up to date, so there is 
+		//no need to scan all alignments here
+		int32_t rightConnections = _aligner.getOutSupport(edge) + 
+								   _aligner.getInSupport(complEdge);
+		int32_t leftConnections = _aligner.getInSupport(edge) + 
+								  _aligner.getOutSupport(complEdge);
+
 		//int32_t coverageThreshold = edge->meanCoverage / 
 		//						Config::get("graph_cov_drop_rate");
 		//coverageThreshold = std::max(MIN_JCT_SUPPORT, coverageThreshold);
 		int32_t coverageThreshold = MIN_JCT_SUPPORT;
 
 		//Logger::get().debug() << "Adjacencies: " << edge->edgeId.signedId() << " "
-		//	<< leftConnections[edge] / 2 << " " << rightConnections[edge] / 2;
+		//	<< leftConnections / 2 << " " << rightConnections / 2;
 
 		if (!edge->nodeRight->isEnd() &&
 			edge->nodeRight->isBifurcation() &&
-			rightConnections[edge] / 2 < coverageThreshold)
+			rightConnections / 2 < coverageThreshold)
 		{
 			++numDisconnected;
 			Logger::get().debug() << "Chimeric right: " <<
-				edge->edgeId.signedId() << " " << rightConnections[edge] / 2;
+				edge->edgeId.signedId() << " " << rightConnections / 2;
 
+			GraphNode* prevRight = edge->nodeRight;
+			GraphNode* prevComplLeft = complEdge->nodeLeft;
 			_graph.disconnectRight(edge);
 			_graph.disconnectLeft(complEdge);
+			addNodeEdges(prevRight, edge);
+			addNodeEdges(prevComplLeft, edge);
 
 			if (edge->selfComplement) continue;	//already discinnected
 		}
 		if (!edge->nodeLeft->isEnd() &&
 			edge->nodeLeft->isBifurcation() &&
-			leftConnections[edge] / 2 < coverageThreshold)
+			leftConnections / 2 < coverageThreshold)
 		{
 			++numDisconnected;
 			Logger::get().debug() << "Chimeric left: " <<
-				edge->edgeId.signedId() << " " << leftConnections[edge] / 2;
+				edge->edgeId.signedId() << " " << leftConnections / 2;
 
+			GraphNode* prevLeft = edge->nodeLeft;
+			GraphNode* prevComplRight = complEdge->nodeRight;
 			_graph.disconnectLeft(edge);
 			_graph.disconnectRight(complEdge);
+			addNodeEdges(prevLeft, edge);
+			addNodeEdges(prevComplRight, edge);
 		}
 	}
 
@@ -527,6 +608,7 @@ int MultiplicityInferer::removeUnsupportedConnections()
 
 void MultiplicityInferer::trimTipsIteration(int& outShort, int& outLong)
 {
+	ScopedTimer timer("graph_simplification");
 	const int SHORT_TIP = Config::get("short_tip_length");
 	const int LONG_TIP = Config::get("long_tip_length");
 	const int COV_RATE = 2;
@@ -613,15 +695,9 @@ void MultiplicityInferer::trimTipsIteration(int& outShort, int& outLong)
 			GraphEdge* targetEdge = path.path.front();
 			GraphEdge* complEdge = _graph.complementEdge(targetEdge);
 
-			vecRemove(targetEdge->nodeLeft->outEdges, targetEdge);
-			targetEdge->nodeLeft = _graph.addNode();
-			targetEdge->nodeLeft->outEdges.push_back(targetEdge);
-
+			_graph.disconnectLeft(targetEdge);
 			//if (targetEdge->selfComplement) continue;
-
-			vecRemove(complEdge->nodeRight->inEdges, complEdge);
-			complEdge->nodeRight = _graph.addNode();
-			complEdge->nodeRight->inEdges.push_back(complEdge);
+			_graph.disconnectRight(complEdge);
 		}
 	}
 	_aligner.updateAlignments();
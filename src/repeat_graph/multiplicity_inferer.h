@@ -16,7 +16,17 @@ public:
 						const SequenceContainer& asmSeqs, 
 						const SequenceContainer& readSeqs):
 		_graph(graph), _aligner(aligner), _asmSeqs(asmSeqs), 
-		_readSeqs(readSeqs), _uniqueCovThreshold(0), _meanCoverage(0) {}
+		_readSeqs(readSeqs), _uniqueCovThreshold(0), _meanCoverage(0),
+		_splitCheckpoint(RepeatGraph::NO_CHECKPOINT), 
+		_connectionsCheckpoint(RepeatGraph::NO_CHECKPOINT) {}
+	~MultiplicityInferer()
+	{
+		_graph.releaseTouchCheckpoint(_splitCheckpoint);
+		_graph.releaseTouchCheckpoint(_connectionsCheckpoint);
+	}
+	//the checkpoints are owned by the object
+	MultiplicityInferer(const MultiplicityInferer&) = delete;
+	MultiplicityInferer& operator=(const MultiplicityInferer&) = delete;
 
 	//coverage-related
 	void estimateCoverage();
@@ -61,4 +71,9 @@ private:
 	const SequenceContainer& _readSeqs;
 	int _uniqueCovThreshold; 
 	int _meanCoverage;
+
+	//positions in the graph's touched nodes log at the previous
+	//runs of the incremental simplification passes
+	size_t _splitCheckpoint;
+	size_t _connectionsCheckpoint;
 };
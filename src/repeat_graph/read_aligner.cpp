@@ -4,6 +4,7 @@
 
 #include "read_aligner.h"
 #include "../common/parallel.h"
+#include "../common/profiler.h"
 #include <cmath>
 #include <iomanip>
 
@@ -107,7 +108,27 @@ std::vector<GraphAlignment>
 	return acceptedAlignments;
 }
 
-void ReadAligner::alignReads()
+const VertexIndex& ReadAligner::getEdgesIndex()
+{
+	size_t numSequences = _graph.edgeSequences().iterSeqs().size();
+	if (_edgesIndex && _indexedSequences == numSequences) return *_edgesIndex;
+
+	//the positional index might be missing or outdated
+	//(e.g. for the edge sequences loaded from a file)
+	_graph.updateEdgeSeqsPositions();
+	_edgesIndex.reset(new VertexIndex(_graph.edgeSequences(), 
+						   (int)Config::get("read_align_kmer_sample")));
+	_edgesIndex->countKmers(/*min freq*/ 1, /* genome size*/ 0);
+	_edgesIndex->setRepeatCutoff(/*min freq*/ 1);
+	_edgesIndex->buildIndex(/*min freq*/ 1);
+	_indexedSequences = numSequences;
+	return *_edgesIndex;
+}
+
+//Aligns the given reads (positive strands) to the current graph in parallel.
+//Returns the chains of each read, in the order of the input
+std::vector<std::vector<GraphAlignment>> 
+	ReadAligner::alignReadSet(const std::vector<FastaRecord::Id>& reads)
 {
 	static const int MIN_EDGE_OVLP = (int)Config::get("max_separation");
 	static const int EDGE_FLANK = 100;
@@ -126,11 +147,7 @@ void ReadAligner::alignReads()
 	}
 
 	//index it and align reads
-	VertexIndex pathsIndex(_graph.edgeSequences(), 
-						   (int)Config::get("read_align_kmer_sample"));
-	pathsIndex.countKmers(/*min freq*/ 1, /* genome size*/ 0);
-	pathsIndex.setRepeatCutoff(/*min freq*/ 1);
-	pathsIndex.buildIndex(/*min freq*/ 1);
+	const VertexIndex& pathsIndex = this->getEdgesIndex();
 	OverlapDetector readsOverlapper(_graph.edgeSequences(), pathsIndex, 
 									(int)Config::get("maximum_jump"),
 									MIN_EDGE_OVLP - EDGE_FLANK,
@@ -141,30 +158,20 @@ void ReadAligner::alignReads()
 									/*nucl alignment*/ false);
 	OverlapContainer readsOverlaps(readsOverlapper, _readSeqs);
 	static const float MAX_DIVERGENCE = Config::get("read_align_ovlp_divergence");
-
-	std::vector<FastaRecord::Id> allQueries;
-	int64_t totalLength = 0;
-	for (auto& read : _readSeqs.iterSeqs())
-	{
-		if (!read.id.strand()) continue;
-		if (read.sequence.length() > (size_t)Parameters::get().minimumOverlap)
-		{
-			totalLength += read.sequence.length();
-			allQueries.push_back(read.id);
-		}
-	}
-	std::mutex indexMutex;
-	int numAligned = 0;
-	int alignedInFull = 0;
-	int64_t alignedLength = 0;
 	OvlpDivStats divergenceStats;
 
-	std::function<void(const FastaRecord::Id&)> alignRead = 
-	[this, &indexMutex, &numAligned, &readsOverlaps,
-		&idToSegment, &alignedLength, &alignedInFull, &divergenceStats] 
-	(const FastaRecord::Id& seqId)
+	//each read writes its chains into its own slot, so there is no 
+	//synchronization, and the output order does not depend on threads
+	std::vector<std::vector<GraphAlignment>> readChains(reads.size());
+	std::vector<size_t> queryIds(reads.size());
+	for (size_t i = 0; i < queryIds.size(); ++i) queryIds[i] = i;
+
+	std::function<void(const size_t&)> alignRead = 
+	[this, &reads, &readChains, &readsOverlaps, &idToSegment, 
+		&divergenceStats] 
+	(const size_t& queryId)
 	{
-		auto overlaps = readsOverlaps.quickSeqOverlaps(seqId);
+		auto overlaps = readsOverlaps.quickSeqOverlaps(reads[queryId]);
 		std::vector<EdgeAlignment> alignments;
 		for (auto& ovlp : overlaps)
 		{
@@ -174,20 +181,22 @@ void ReadAligner::alignReads()
 			if (ovlp.extLen < MIN_EDGE_OVLP + EDGE_FLANK ||
 				std::min(ovlp.curRange(), ovlp.extRange()) > MIN_EDGE_OVLP)
 			{
-				//alignments.push_back({ovlp, idToSegment[ovlp.extId].first,
-				//					  idToSegment[ovlp.extId].second});
-				alignments.push_back({ovlp, idToSegment[ovlp.extId].first});
+				//sequences of the removed edges are still indexed
+				auto segIt = idToSegment.find(ovlp.extId);
+				if (segIt == idToSegment.end()) continue;
+				alignments.push_back({ovlp, segIt->second.first,
+									  segIt->second.first->edgeId});
 			}
 
 		}
 		std::sort(alignments.begin(), alignments.end(),
 		  [](const EdgeAlignment& e1, const EdgeAlignment& e2)
 			{return e1.overlap.curBegin < e2.overlap.curBegin;});
-		auto readChains = this->chainReadAlignments(alignments);
+		auto chains = this->chainReadAlignments(alignments);
 
 		//check divergence
-		std::vector<GraphAlignment> goodChains;
-		for (auto& chain : readChains)
+		auto& goodChains = readChains[queryId];
+		for (auto& chain : chains)
 		{
 			float sumMatched = 0;
 			int alnLen = chain.back().overlap.curEnd - 
@@ -200,44 +209,79 @@ void ReadAligner::alignReads()
 			divergenceStats.add(chainDivergence);
 			if (chainDivergence < MAX_DIVERGENCE)
 			{
-				goodChains.push_back(chain);
+				goodChains.push_back(std::move(chain));
 			}
 		}
+	};
+
+	processInParallel(queryIds, alignRead, 
+					  Parameters::get().numThreads, true);
 
-		std::vector<GraphAlignment> complChains(goodChains);
-		for (auto& chain : complChains)
+	readsOverlaps.overlapDivergenceStats(divergenceStats, MAX_DIVERGENCE);
+	return readChains;
+}
+
+//adds the read chains and their complements to the alignments
+void ReadAligner::addReadChains(std::vector<GraphAlignment>& chains)
+{
+	for (auto& chain : chains) 
+	{
+		_readAlignments.push_back(chain);
+	}
+	for (auto& chain : chains)
+	{
+		for (auto& aln : chain)
 		{
-			for (auto& aln : chain)
-			{
-				aln.edge = _graph.complementEdge(aln.edge);
-				//aln.segment = aln.segment.complement();
-				aln.overlap = aln.overlap.complement();
-			}
-			std::reverse(chain.begin(), chain.end());
+			aln.edge = _graph.complementEdge(aln.edge);
+			aln.edgeId = aln.edge->edgeId;
+			aln.overlap = aln.overlap.complement();
+		}
+		std::reverse(chain.begin(), chain.end());
+		_readAlignments.push_back(std::move(chain));
+	}
+	chains.clear();
+}
+
+void ReadAligner::alignReads()
+{
+	ScopedTimer timer("read_alignment");
+	std::vector<FastaRecord::Id> allQueries;
+	int64_t totalLength = 0;
+	for (auto& read : _readSeqs.iterSeqs())
+	{
+		if (!read.id.strand()) continue;
+		if (read.sequence.length() > (size_t)Parameters::get().minimumOverlap)
+		{
+			totalLength += read.sequence.length();
+			allQueries.push_back(read.id);
 		}
+	}
 
-		if (goodChains.empty()) return;
+	//the alignments will be consistent with the current graph
+	_graph.takeEditJournal();
+	auto readChains = this->alignReadSet(allQueries);
+
+	//merging in the order of reads: chains, then their complements
+	int numAligned = 0;
+	int alignedInFull = 0;
+	int64_t alignedLength = 0;
+	_readAlignments.clear();
+	_numEmpty = 0;
+	for (auto& goodChains : readChains)
+	{
+		if (goodChains.empty()) continue;
 
-		/////synchronized part
-		indexMutex.lock();
 		++numAligned;
 		if (goodChains.size() == 1) ++alignedInFull;
 		for (auto& chain : goodChains) 
 		{
-			_readAlignments.push_back(chain);
 			alignedLength += chain.back().overlap.curEnd - 
 							 chain.front().overlap.curBegin;
 		}
-		for (auto& chain : complChains)
-		{
-			_readAlignments.push_back(chain);
-		}
-		indexMutex.unlock();
-		/////
-	};
-
-	processInParallel(allQueries, alignRead, 
-					  Parameters::get().numThreads, true);
+		this->addReadChains(goodChains);
+		goodChains.shrink_to_fit();
+	}
+	this->indexAlignments();
 
 	/*for (auto& aln : _readAlignments)
 	{
@@ -289,34 +333,85 @@ void ReadAligner::alignReads()
 	Logger::get().debug() << "Aligned in one piece : " << alignedInFull;
 	Logger::get().info() << "Aligned read sequence: " << alignedLength << " / " 
 		<< totalLength << " (" << (float)alignedLength / totalLength << ")";
-	readsOverlaps.overlapDivergenceStats(divergenceStats, MAX_DIVERGENCE);
 }
 
-//updates alignments with respect to the new graph
+//updates alignments with respect to the new graph. Alignments to the
+//removed edges are dropped, and chains are split at the broken adjacencies.
+//The removed edges are taken from the graph edit journal. Only the
+//changed alignments are re-indexed: the first part of a split chain keeps
+//the id of the original alignment, the other parts are appended, and
+//the dropped alignments are left empty. The reads are not re-aligned
+//to the newly added edges.
 void ReadAligner::updateAlignments()
 {
-	std::vector<GraphAlignment> newAlignments;
-	for (auto& aln : _readAlignments)
+	ScopedTimer timer("alignment_update");
+
+	auto journal = _graph.takeEditJournal();
+	auto isRemoved = [&journal](const EdgeAlignment& edgeAln)
+	{
+		//null edges might come from the loaded alignments
+		return edgeAln.edge == nullptr || 
+			   (!journal.removedEdges.empty() && 
+				journal.removedEdges.count(edgeAln.edgeId));
+	};
+	auto isIntact = [&isRemoved](const GraphAlignment& aln)
+	{
+		for (size_t i = 0; i < aln.size(); ++i)
+		{
+			if (isRemoved(aln[i])) return false;
+			if (i + 1 < aln.size() &&
+				(isRemoved(aln[i + 1]) ||
+				 aln[i].edge->nodeRight != aln[i + 1].edge->nodeLeft)) return false;
+		}
+		return true;
+	};
+
+	//most of the alignments are usually unchanged
+	std::vector<size_t> changedIds;
+	for (size_t alnId = 0; alnId < _readAlignments.size(); ++alnId)
+	{
+		if (!isIntact(_readAlignments[alnId])) changedIds.push_back(alnId);
+	}
+	if (changedIds.empty()) return;
+
+	for (size_t alnId : changedIds)
 	{
+		this->unindexAlignment(alnId);
+		GraphAlignment aln;
+		aln.swap(_readAlignments[alnId]);
+
+		std::vector<GraphAlignment> parts;
 		GraphAlignment curAlignment;
 		for (size_t i = 0; i < aln.size() - 1; ++i)
 		{
-			if (!_graph.hasEdge(aln[i].edge)) continue;
+			if (isRemoved(aln[i])) continue;
 
 			curAlignment.push_back(aln[i]);
-			if (!_graph.hasEdge(aln[i + 1].edge) ||
+			if (isRemoved(aln[i + 1]) ||
 				aln[i].edge->nodeRight != aln[i + 1].edge->nodeLeft)
 			{
-				newAlignments.push_back(curAlignment);
+				parts.push_back(curAlignment);
 				curAlignment.clear();
 			}
 		}
+		if (!isRemoved(aln.back())) curAlignment.push_back(aln.back());
+		if (!curAlignment.empty()) parts.push_back(curAlignment);
 
-		if (_graph.hasEdge(aln.back().edge)) curAlignment.push_back(aln.back());
-		if (!curAlignment.empty()) newAlignments.push_back(curAlignment);
+		if (parts.empty())
+		{
+			++_numEmpty;
+			continue;
+		}
+		_readAlignments[alnId] = std::move(parts.front());
+		this->indexAlignment(alnId);
+		for (size_t i = 1; i < parts.size(); ++i)
+		{
+			_readAlignments.push_back(std::move(parts[i]));
+			this->indexAlignment(_readAlignments.size() - 1);
+		}
 	}
-
-	_readAlignments = newAlignments;
+	this->touchChangedNodes();
+	if (_numEmpty > _readAlignments.size() / 2) this->compactAlignments();
 }
 
 void ReadAligner::storeAlignments(const std::string& filename)
@@ -329,6 +424,7 @@ void ReadAligner::storeAlignments(const std::string& filename)
 
 	for (auto& chain : _readAlignments)
 	{
+		if (chain.empty()) continue;
 		fout << "Chain\n";
 		for (auto& aln : chain)
 		{
@@ -341,6 +437,7 @@ void ReadAligner::storeAlignments(const std::string& filename)
 
 void ReadAligner::loadAlignments(const std::string& filename)
 {
+	ScopedTimer timer("alignment_load");
 	std::ifstream fin(filename);
 	if (!fin)
 	{
@@ -369,7 +466,7 @@ void ReadAligner::loadAlignments(const std::string& filename)
 			fin >> edgeId;
 			ovlp.load(fin, _readSeqs, _graph.edgeSequences());
 			GraphEdge* edge = _graph.getEdge(FastaRecord::Id(edgeId));
-			curAlignment.push_back({ovlp, edge});
+			curAlignment.push_back({ovlp, edge, FastaRecord::Id(edgeId)});
 		}
 		else throw std::runtime_error("Error parsing: " + filename);
 	}
@@ -379,24 +476,159 @@ void ReadAligner::loadAlignments(const std::string& filename)
 		curAlignment.clear();
 	}
 
+	//the loaded graph is the reference point for the later edits,
+	//only the alignments to the missing edges are updated
+	_graph.takeEditJournal();
+	this->updateAlignments();
+	this->indexAlignments();
+}
+
+//replaces the current alignments with the given ones (for example,
+//loaded from a graph snapshot)
+void ReadAligner::setAlignments(std::vector<GraphAlignment> alignments)
+{
+	_readAlignments = std::move(alignments);
+	_readAlignments.erase(std::remove_if(_readAlignments.begin(),
+										 _readAlignments.end(),
+		[](const GraphAlignment& aln) {return aln.empty();}),
+		_readAlignments.end());
+	_numEmpty = 0;
+	_graph.takeEditJournal();
 	this->updateAlignments();
+	this->indexAlignments();
 }
 
-ReadAligner::AlnIndex ReadAligner::makeAlignmentIndex()
+//Builds the edge -> alignment ids index and the connection support
+//from scratch
+void ReadAligner::indexAlignments()
 {
-	std::unordered_map<GraphEdge*, 
-					   std::vector<GraphAlignment>> alnIndex;
-	for (auto& aln : this->getAlignments())
+	_outConnections.clear();
+	_outSupport.clear();
+	_inSupport.clear();
+	for (auto& aln : _readAlignments) this->countConnections(aln, 1);
+	_connectionDeltas.clear();
+	_graph.touchAllNodes();
+
+	this->indexEdges();
+}
+
+void ReadAligner::indexEdges()
+{
+	_edgeAlignments.clear();
+	for (size_t alnId = 0; alnId < _readAlignments.size(); ++alnId)
 	{
-		if (aln.size() > 1)
+		auto& aln = _readAlignments[alnId];
+		if (aln.size() < 2) continue;
+
+		for (auto& edgeAln : aln)
 		{
-			std::unordered_set<GraphEdge*> uniqueEdges;
-			for (auto& edgeAln : aln)
+			auto& alnIds = _edgeAlignments[edgeAln.edgeId];
+			if (alnIds.empty() || alnIds.back() != alnId) 
 			{
-				uniqueEdges.insert(edgeAln.edge);
+				alnIds.push_back(alnId);
 			}
-			for (GraphEdge* edge : uniqueEdges) alnIndex[edge].push_back(aln);
 		}
 	}
-	return alnIndex;
+}
+
+//Adds the (new) alignment with the given id to the index
+//and to the connection support
+void ReadAligner::indexAlignment(size_t alnId)
+{
+	auto& aln = _readAlignments[alnId];
+	this->countConnections(aln, 1);
+	if (aln.size() < 2) return;
+
+	for (auto& edgeAln : aln)
+	{
+		auto& alnIds = _edgeAlignments[edgeAln.edgeId];
+		auto itId = std::lower_bound(alnIds.begin(), alnIds.end(), alnId);
+		if (itId == alnIds.end() || *itId != alnId) alnIds.insert(itId, alnId);
+	}
+}
+
+//Removes the alignment from the index and from the connection support,
+//before it is changed. Some of its edges might be already deleted
+void ReadAligner::unindexAlignment(size_t alnId)
+{
+	auto& aln = _readAlignments[alnId];
+	this->countConnections(aln, -1);
+	if (aln.size() < 2) return;
+
+	for (auto& edgeAln : aln)
+	{
+		auto itAlns = _edgeAlignments.find(edgeAln.edgeId);
+		if (itAlns == _edgeAlignments.end()) continue;
+
+		auto& alnIds = itAlns->second;
+		auto itId = std::lower_bound(alnIds.begin(), alnIds.end(), alnId);
+		if (itId != alnIds.end() && *itId == alnId) alnIds.erase(itId);
+		if (alnIds.empty()) _edgeAlignments.erase(itAlns);
+	}
+}
+
+//reports the nodes where the support has changed since the last 
+//call, so the simplification passes could revisit them
+void ReadAligner::touchChangedNodes()
+{
+	for (auto& delta : _connectionDeltas)
+	{
+		if (delta.second == 0) continue;
+		GraphEdge* leftEdge = _graph.getEdge(delta.first.first);
+		if (leftEdge) _graph.touchNode(leftEdge->nodeRight);
+		GraphEdge* rightEdge = _graph.getEdge(delta.first.second);
+		if (rightEdge) _graph.touchNode(rightEdge->nodeLeft);
+	}
+	_connectionDeltas.clear();
+}
+
+//Removes the empty alignments. This changes the ids, so the edge index
+//is rebuilt (the connection support stays the same). Happens when
+//most of the alignments are empty, so the cost is amortized
+void ReadAligner::compactAlignments()
+{
+	_readAlignments.erase(std::remove_if(_readAlignments.begin(),
+										 _readAlignments.end(),
+		[](const GraphAlignment& aln) {return aln.empty();}),
+		_readAlignments.end());
+	_numEmpty = 0;
+	this->indexEdges();
+}
+
+//Adds (sign = 1) or subtracts (sign = -1) the connections of the
+//alignment to the support counters. When subtracting, some edges 
+//might be already deleted, so only the edge ids are used: 
+//a connection is subtracted only if it was counted before
+void ReadAligner::countConnections(const GraphAlignment& aln, int sign)
+{
+	auto updateCounter = [sign](std::unordered_map<FastaRecord::Id, int>& counters,
+								FastaRecord::Id edgeId)
+	{
+		auto& counter = counters[edgeId];
+		counter += sign;
+		if (counter == 0) counters.erase(edgeId);
+	};
+
+	for (size_t i = 0; i + 1 < aln.size(); ++i)
+	{
+		FastaRecord::Id leftEdge = aln[i].edgeId;
+		FastaRecord::Id rightEdge = aln[i + 1].edgeId;
+		if (sign > 0)
+		{
+			if (leftEdge == rightEdge.rc()) continue;
+		}
+		else
+		{
+			auto itConn = _outConnections.find(leftEdge);
+			if (itConn == _outConnections.end() ||
+				!itConn->second.count(rightEdge)) continue;
+		}
+
+		_connectionDeltas[std::make_pair(leftEdge, rightEdge)] += sign;
+		auto& outConnections = _outConnections[leftEdge];
+		updateCounter(outConnections, rightEdge);
+		if (outConnections.empty()) _outConnections.erase(leftEdge);
+		updateCounter(_outSupport, leftEdge);
+		updateCounter(_inSupport, rightEdge);
+	}
 }
@@ -8,12 +8,17 @@
 
 #pragma once
 
+#include <memory>
+
 #include "repeat_graph.h"
+#include "../sequence/vertex_index.h"
 
 struct EdgeAlignment
 {
 	OverlapRange overlap;
 	GraphEdge* edge;
+	//id of the edge, it is used once the edge might be deleted
+	FastaRecord::Id edgeId;
 	//EdgeSequence segment;
 };
 typedef std::vector<EdgeAlignment> GraphAlignment;
@@ -22,27 +27,90 @@ class ReadAligner
 {
 public:
 	ReadAligner(RepeatGraph& graph, const SequenceContainer& readSeqs): 
-		_graph(graph), _readSeqs(readSeqs) {}
+		_numEmpty(0), _graph(graph), _readSeqs(readSeqs), 
+		_indexedSequences(0) {}
 
 	void alignReads();
 	void updateAlignments();
+	//the alignments that were dropped during the updates
+	//are left empty (until the vector is compacted)
 	const std::vector<GraphAlignment>& getAlignments() const
 		{return _readAlignments;}
 
 	void storeAlignments(const std::string& filename);
 	void loadAlignments(const std::string& filename);
+	void setAlignments(std::vector<GraphAlignment> alignments);
+
+	//ids (positions in getAlignments()) of the alignments to 
+	//more than one edge that go through the given edge. Each alignment
+	//is listed once, in increasing order. The ids of the unchanged
+	//alignments stay the same after the updates, unless most of 
+	//the alignments were dropped and the vector is compacted
+	const std::vector<size_t>& getEdgeAlignments(GraphEdge* edge) const
+	{
+		static const std::vector<size_t> EMPTY;
+		auto itAlns = _edgeAlignments.find(edge->edgeId);
+		return itAlns != _edgeAlignments.end() ? itAlns->second : EMPTY;
+	}
 
-	typedef std::unordered_map<GraphEdge*, 
-					   		   std::vector<GraphAlignment>> AlnIndex;
-	AlnIndex makeAlignmentIndex();
+	//connection support: the number of alignments that go from 
+	//the given edge directly into each of the next edges, given by ids
+	//(connections of an edge with its own complement are not counted).
+	//Like the index above, it is updated together with the alignments
+	const std::unordered_map<FastaRecord::Id, int>& 
+		getOutConnections(GraphEdge* edge) const
+	{
+		static const std::unordered_map<FastaRecord::Id, int> EMPTY;
+		auto itConn = _outConnections.find(edge->edgeId);
+		return itConn != _outConnections.end() ? itConn->second : EMPTY;
+	}
+	//total support of all outgoing / incoming connections of the edge
+	int getOutSupport(GraphEdge* edge) const
+	{
+		auto itSupport = _outSupport.find(edge->edgeId);
+		return itSupport != _outSupport.end() ? itSupport->second : 0;
+	}
+	int getInSupport(GraphEdge* edge) const
+	{
+		auto itSupport = _inSupport.find(edge->edgeId);
+		return itSupport != _inSupport.end() ? itSupport->second : 0;
+	}
 
 private:
 	std::vector<GraphAlignment> 
 		chainReadAlignments(const std::vector<EdgeAlignment>& ovlps) const;
+	const VertexIndex& getEdgesIndex();
+	std::vector<std::vector<GraphAlignment>> 
+		alignReadSet(const std::vector<FastaRecord::Id>& reads);
+	void addReadChains(std::vector<GraphAlignment>& chains);
+	void indexAlignments();
+	void indexEdges();
+	void indexAlignment(size_t alnId);
+	void unindexAlignment(size_t alnId);
+	void touchChangedNodes();
+	void compactAlignments();
+	void countConnections(const GraphAlignment& aln, int sign);
 
 	std::vector<GraphAlignment> _readAlignments;
+	size_t						_numEmpty;
+	//the index and the support are keyed by edge ids, since
+	//the alignments are unindexed after their edges are deleted
+	std::unordered_map<FastaRecord::Id, std::vector<size_t>> _edgeAlignments;
+	std::unordered_map<FastaRecord::Id, 
+					   std::unordered_map<FastaRecord::Id, int>> _outConnections;
+	std::unordered_map<FastaRecord::Id, int> _outSupport;
+	std::unordered_map<FastaRecord::Id, int> _inSupport;
+	//net changes of the connection support since the last indexing
+	std::unordered_map<std::pair<FastaRecord::Id, FastaRecord::Id>, int, 
+					   pairhash> _connectionDeltas;
 
 	RepeatGraph& _graph;
 	//const SequenceContainer&   _asmSeqs;
 	const SequenceContainer&   _readSeqs;
+
+	//index of the edge sequences, reused between alignReads() calls.
+	//The edge sequence container only grows, so the index is
+	//up to date as long as the number of sequences is the same
+	std::unique_ptr<VertexIndex> _edgesIndex;
+	size_t						 _indexedSequences;
 };
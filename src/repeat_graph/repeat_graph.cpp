@@ -10,8 +10,10 @@
 #include "../sequence/vertex_index.h"
 #include "../common/config.h"
 #include "../common/disjoint_set.h"
+#include "../common/parallel.h"
 #include "repeat_graph.h"
 #include "graph_processing.h"
+#include "../common/profiler.h"
 
 
 namespace
@@ -39,6 +41,24 @@ namespace
 		int32_t pos;
 	};
 
+	//splits the sorted points into runs [begin, end) of 
+	//consecutive points, so that the neighbours are "close"
+	template <class T, class CloseFun>
+	std::vector<std::pair<size_t, size_t>> 
+		splitRuns(const std::vector<T>& points, CloseFun close)
+	{
+		std::vector<std::pair<size_t, size_t>> runs;
+		size_t begin = 0;
+		for (size_t i = 1; i <= points.size(); ++i)
+		{
+			if (i == points.size() || !close(points[i - 1], points[i]))
+			{
+				runs.emplace_back(begin, i);
+				begin = i;
+			}
+		}
+		return runs;
+	}
 }
 
 bool GraphEdge::isRightTerminal() const
@@ -63,6 +83,7 @@ std::unordered_set<GraphEdge*> GraphEdge::adjacentEdges()
 
 void RepeatGraph::build()
 {
+	ScopedTimer timer("graph_build");
 	//getting overlaps
 	VertexIndex asmIndex(_asmSeqs, 
 						 (int)Config::get("repeat_graph_kmer_sample"));
@@ -106,249 +127,230 @@ void RepeatGraph::getGluepoints(OverlapContainer& asmOverlaps)
 	//Each subcluster will thus have a different Y-coordinate,
 	//but they will share their X-coordinate and cluster ID
 	//(this means they will be glued during repeat graph cosntruction)
+	//Since points are clustered by the single linkage along one axis,
+	//each cluster is a run of consecutive points after sorting. 
+	//Clustering is independent for each contig and is done in parallel.
 	
 	Logger::get().debug() << "Computing gluepoints";
-	typedef SetNode<Point2d> SetPoint2d;
-	std::unordered_map<FastaRecord::Id, SetVec<Point2d>> endpoints;
 
-	//first, extract endpoints from all overlaps.
-	//each point has X and Y coordinates (curSeq and extSeq)
+	std::vector<FastaRecord::Id> fwdSeqs;
 	for (auto& seq : _asmSeqs.iterSeqs())
 	{
-		for (auto& ovlp : asmOverlaps.lazySeqOverlaps(seq.id))
-		{
-			endpoints[ovlp.curId]
-				.push_back(new SetPoint2d(Point2d(ovlp.curId, ovlp.curBegin,
-										  ovlp.extId, ovlp.extBegin)));
-			endpoints[ovlp.curId]
-				.push_back(new SetPoint2d(Point2d(ovlp.curId, ovlp.curEnd,
-										  ovlp.extId, ovlp.extEnd)));
-		}
+		if (seq.id.strand()) fwdSeqs.push_back(seq.id);
 	}
+	std::vector<size_t> seqTasks(fwdSeqs.size());
+	for (size_t i = 0; i < seqTasks.size(); ++i) seqTasks[i] = i;
 
-	//for each contig, cluster gluepoints that are close to each other
-	//only cosider X coordinates for now
-	for (auto& seqPoints : endpoints)
-	{
-		std::sort(seqPoints.second.begin(), seqPoints.second.end(),
-				  [](const SetPoint2d* p1, const SetPoint2d* p2)
-				  {return p1->data.curPos < p2->data.curPos;});
+	//for each contig, the list of clusters. Each cluster is given by
+	//its X projection, followed by the projections of Y subclusters
+	std::vector<std::vector<std::vector<Point1d>>> seqClusters(fwdSeqs.size());
 
-		for (size_t i = 0; i < seqPoints.second.size() - 1; ++i)
-		{
-			auto* p1 = seqPoints.second[i];
-			auto* p2 = seqPoints.second[i + 1];
-			if (abs(p1->data.curPos - p2->data.curPos) < _maxSeparation)
-			{
-				unionSet(p1, p2);
-			}
-
-		}
-	}
-	std::vector<SetPoint2d*> flatEndpoints;
-	for (auto& seqPoints : endpoints)
+	std::function<void(const size_t&)> clusterSeqPoints = 
+	[this, &fwdSeqs, &seqClusters, &asmOverlaps] (const size_t& seqIdx)
 	{
-		flatEndpoints.insert(flatEndpoints.end(), seqPoints.second.begin(), 
-							 seqPoints.second.end());
-	}
-	auto clusters = groupBySet(flatEndpoints);
-
-	typedef SetNode<Point1d> SetPoint1d;
-	std::unordered_map<FastaRecord::Id, SetVec<Point1d>> tempGluepoints;
-	std::unordered_map<SetPoint1d*, SetPoint1d*> complements;
+		FastaRecord::Id clustSeq = fwdSeqs[seqIdx];
 
-	//we will now split each cluster based on it's Y coordinates
-	//and project these subgroups to the corresponding sequences
-	for (auto& clustEndpoints : clusters)
-	{
-		//first, simply add projections for each point from the cluster
-		FastaRecord::Id clustSeq = clustEndpoints.second.front().curId;
-		if (!clustSeq.strand()) continue;	//only for forward strands
-
-		std::vector<int32_t> positions;
-		for (auto& ep : clustEndpoints.second) 
+		//first, extract endpoints from all overlaps.
+		//each point has X and Y coordinates (curSeq and extSeq)
+		std::vector<Point2d> endpoints;
+		for (auto& ovlp : asmOverlaps.lazySeqOverlaps(clustSeq))
 		{
-			positions.push_back(ep.curPos);
+			endpoints.emplace_back(ovlp.curId, ovlp.curBegin,
+								   ovlp.extId, ovlp.extBegin);
+			endpoints.emplace_back(ovlp.curId, ovlp.curEnd,
+								   ovlp.extId, ovlp.extEnd);
 		}
-		int32_t clusterXpos = median(positions);
-
-		std::vector<Point1d> clusterPoints;
-		clusterPoints.emplace_back(clustSeq, clusterXpos);
 
-		SetVec<Point2d> extCoords;
-		for (auto& ep : clustEndpoints.second)
-		{
-			extCoords.push_back(new SetPoint2d(ep));
-		}
-		
-		//Important part: extending set of gluing points
-		//We need also add extra projections
-		//for gluepoints that are inside overlaps
-		//(handles situations with 'repeat hierarchy', when some
-		//repeats are parts of the other bigger repeats)
-		for (auto& interval : asmOverlaps.getCoveringOverlaps(clustSeq, 
-											 clusterXpos - 1, clusterXpos + 1))
+		//cluster gluepoints that are close to each other
+		//only cosider X coordinates for now
+		std::sort(endpoints.begin(), endpoints.end(),
+				  [](const Point2d& p1, const Point2d& p2)
+				  {return p1.curPos < p2.curPos;});
+		auto xRuns = splitRuns(endpoints, 
+			[this](const Point2d& p1, const Point2d& p2)
+			{return p2.curPos - p1.curPos < _maxSeparation;});
+
+		//we will now split each cluster based on it's Y coordinates
+		//and project these subgroups to the corresponding sequences
+		for (auto& xRun : xRuns)
 		{
-			auto& ovlp = *interval.value;
-			if (ovlp.curEnd - clusterXpos > _maxSeparation &&
-				clusterXpos - ovlp.curBegin > _maxSeparation)
+			std::vector<int32_t> positions;
+			for (size_t i = xRun.first; i < xRun.second; ++i) 
 			{
-				int32_t projectedPos = ovlp.project(clusterXpos);
-				extCoords.push_back(new SetPoint2d(Point2d(clustSeq, clusterXpos,
-											   	   ovlp.extId, 
-											   	   projectedPos)));
+				positions.push_back(endpoints[i].curPos);
 			}
-		}
+			int32_t clusterXpos = median(positions);
 
-		//Finally, cluster the projected points based on Y coordinates
-		std::sort(extCoords.begin(), extCoords.end(),
-				  [](const SetPoint2d* p1, const SetPoint2d* p2)
-				  {return (p1->data.extId != p2->data.extId) ? 
-				  		   p1->data.extId < p2->data.extId :
-						   p1->data.extPos < p2->data.extPos;});
-		for (size_t i = 0; i < extCoords.size() - 1; ++i)
-		{
-			auto* p1 = extCoords[i];
-			auto* p2 = extCoords[i + 1];
-			if (p1->data.extId == p2->data.extId &&
-				abs(p1->data.extPos - p2->data.extPos) < _maxSeparation)
+			std::vector<Point1d> clusterPoints;
+			clusterPoints.emplace_back(clustSeq, clusterXpos);
+
+			std::vector<Point2d> extCoords(endpoints.begin() + xRun.first,
+										   endpoints.begin() + xRun.second);
+			
+			//Important part: extending set of gluing points
+			//We need also add extra projections
+			//for gluepoints that are inside overlaps
+			//(handles situations with 'repeat hierarchy', when some
+			//repeats are parts of the other bigger repeats)
+			for (auto& interval : asmOverlaps.getCoveringOverlaps(clustSeq, 
+											 clusterXpos - 1, clusterXpos + 1))
 			{
-				unionSet(p1, p2);
+				auto& ovlp = *interval.value;
+				if (ovlp.curEnd - clusterXpos > _maxSeparation &&
+					clusterXpos - ovlp.curBegin > _maxSeparation)
+				{
+					int32_t projectedPos = ovlp.project(clusterXpos);
+					extCoords.emplace_back(clustSeq, clusterXpos,
+										   ovlp.extId, projectedPos);
+				}
 			}
 
-		}
-		auto extClusters = groupBySet(extCoords);
-		//now, get coordinates for each cluster
-		for (auto& extClust : extClusters)
-		{
-			std::vector<int32_t> positions;
-			for (auto& ep : extClust.second) 
+			//Finally, cluster the projected points based on Y coordinates
+			std::sort(extCoords.begin(), extCoords.end(),
+					  [](const Point2d& p1, const Point2d& p2)
+					  {return (p1.extId != p2.extId) ? 
+							   p1.extId < p2.extId :
+							   p1.extPos < p2.extPos;});
+			auto yRuns = splitRuns(extCoords, 
+				[this](const Point2d& p1, const Point2d& p2)
+				{return p1.extId == p2.extId && 
+						p2.extPos - p1.extPos < _maxSeparation;});
+
+			//now, get coordinates for each cluster
+			for (auto& yRun : yRuns)
 			{
-				positions.push_back(ep.extPos);
+				std::vector<int32_t> positions;
+				for (size_t i = yRun.first; i < yRun.second; ++i) 
+				{
+					positions.push_back(extCoords[i].extPos);
+				}
+				int32_t clusterYpos = median(positions);
+				clusterPoints.emplace_back(extCoords[yRun.first].extId, 
+										   clusterYpos);
 			}
-			int32_t clusterYpos = median(positions);
-
-			FastaRecord::Id extSeq = extClust.second.front().extId;
-			clusterPoints.emplace_back(extSeq, clusterYpos);
+			seqClusters[seqIdx].push_back(std::move(clusterPoints));
 		}
-
-		//We should now consider how newly generaetd clusters
-		//are integrated with the existing ones, we might need to
-		//merge some of them together
-		std::vector<SetPoint1d*> toMerge;
-		for (auto& clustPt : clusterPoints)
+	};
+	processInParallel(seqTasks, clusterSeqPoints, 
+					  Parameters::get().numThreads, /*progress bar*/ false);
+
+	//We should now consider how newly generaetd clusters
+	//are integrated with each other. Points of the same cluster
+	//are glued, as well as the points that are close on the
+	//same sequence. Each point is stored together with its complement,
+	//(they have consecutive indices), and complements are glued in the same way.
+	std::vector<Point1d> gluePoints;
+	IndexSet pointSets;
+	std::unordered_map<FastaRecord::Id, std::vector<size_t>> seqPoints;
+	for (auto& clusters : seqClusters)
+	{
+		for (auto& cluster : clusters)
 		{
-			int32_t seqLen = _asmSeqs.seqLen(clustPt.seqId);
-			Point1d complPt(clustPt.seqId.rc(), seqLen - clustPt.pos - 1);
-
-			auto& seqGluepoints = tempGluepoints[clustPt.seqId];
-			auto& complGluepoints = tempGluepoints[clustPt.seqId.rc()];
-
-			//inserting into sorted vector
-			auto cmp = [] (const SetPoint1d* gp, int32_t pos)
-								{return gp->data.pos < pos;};
-			size_t i = std::lower_bound(seqGluepoints.begin(), 
-										seqGluepoints.end(),
-										clustPt.pos, cmp) - seqGluepoints.begin();
-			auto cmp2 = [] (int32_t pos, const SetPoint1d* gp)
-								{return pos < gp->data.pos;};
-			size_t ci = std::upper_bound(complGluepoints.begin(), 
-										 complGluepoints.end(),
-										 complPt.pos, cmp2) - complGluepoints.begin();
-			if (!seqGluepoints.empty())
+			for (size_t i = 0; i < cluster.size(); ++i)
 			{
-				if (i > 0 && 
-					clustPt.pos - seqGluepoints[i - 1]->data.pos < _maxSeparation)
-				{
-					toMerge.push_back(seqGluepoints[i - 1]);
-				}
-				if (i < seqGluepoints.size() && 
-					seqGluepoints[i]->data.pos - clustPt.pos < _maxSeparation)
+				const Point1d& clustPt = cluster[i];
+				int32_t seqLen = _asmSeqs.seqLen(clustPt.seqId);
+
+				size_t fwdId = pointSets.add();
+				gluePoints.push_back(clustPt);
+				size_t revId = pointSets.add();
+				gluePoints.emplace_back(clustPt.seqId.rc(), 
+										seqLen - clustPt.pos - 1);
+
+				seqPoints[clustPt.seqId].push_back(fwdId);
+				seqPoints[clustPt.seqId.rc()].push_back(revId);
+				if (i > 0)
 				{
-					toMerge.push_back(seqGluepoints[i]);
+					pointSets.unionSet(fwdId - 2, fwdId);
+					pointSets.unionSet(revId - 2, revId);
 				}
 			}
-
-			seqGluepoints.insert(seqGluepoints.begin() + i, 
-								 new SetPoint1d(clustPt));
-			auto fwdPtr = seqGluepoints[i];
-			complGluepoints.insert(complGluepoints.begin() + ci,
-								   new SetPoint1d(complPt));
-			auto revPtr = complGluepoints[ci];
-
-			complements[fwdPtr] = revPtr;
-			complements[revPtr] = fwdPtr;
-			toMerge.push_back(fwdPtr);
 		}
-		for (size_t i = 0; i < toMerge.size() - 1; ++i)
+	}
+	for (auto& seqIds : seqPoints)
+	{
+		auto& ids = seqIds.second;
+		std::sort(ids.begin(), ids.end(), 
+				  [&gluePoints](size_t p1, size_t p2)
+				  {return gluePoints[p1].pos != gluePoints[p2].pos ?
+				  		  gluePoints[p1].pos < gluePoints[p2].pos : p1 < p2;});
+		for (size_t i = 0; i + 1 < ids.size(); ++i)
 		{
-			unionSet(toMerge[i], toMerge[i + 1]);
-			unionSet(complements[toMerge[i]], 
-					 complements[toMerge[i + 1]]);
+			if (gluePoints[ids[i + 1]].pos - gluePoints[ids[i]].pos < 
+				_maxSeparation)
+			{
+				pointSets.unionSet(ids[i], ids[i + 1]);
+			}
 		}
 	}
 	
 	//Generating final gluepoints, we might need to additionally
-	//split long clusters into parts (tandem repeats)
+	//split long clusters into parts (tandem repeats).
+	//Ids are assigned in the order of sequences and positions,
+	//so they do not depend on the threads scheduling
 	size_t pointId = 0;
-	std::unordered_map<SetPoint1d*, size_t> setToId;
-	auto addConsensusPoint = [&setToId, this, &pointId]
-		(const std::vector<SetPoint1d*>& group)
+	const size_t NO_ID = -1;
+	std::vector<size_t> setToId(gluePoints.size(), NO_ID);
+	auto addConsensusPoint = [&setToId, &pointSets, &gluePoints, 
+							  this, &pointId, NO_ID]
+		(const std::vector<size_t>& group)
 	{
-		SetPoint1d* reprPoint = group.front();
-		if (!setToId.count(findSet(reprPoint)))
+		const Point1d& reprPoint = gluePoints[group.front()];
+		size_t reprSet = pointSets.findSet(group.front());
+		if (setToId[reprSet] == NO_ID)
 		{
-			setToId[findSet(reprPoint)] = pointId++;
+			setToId[reprSet] = pointId++;
 		}
-		int32_t clusterSize = group.back()->data.pos - 
-							  group.front()->data.pos;
+		size_t clusterId = setToId[reprSet];
+		int32_t clusterSize = gluePoints[group.back()].pos - reprPoint.pos;
 
 		//big cluster corresponding to a tandem repeat - 
 		//split it into multiple short edges
 		if (clusterSize > _maxSeparation)
 		{
-			_gluePoints[reprPoint->data.seqId]
-				.emplace_back(setToId[findSet(reprPoint)],
-							  reprPoint->data.seqId, group.front()->data.pos);
+			_gluePoints[reprPoint.seqId]
+				.emplace_back(clusterId, reprPoint.seqId, reprPoint.pos);
 
 			int32_t repeats = std::floor(clusterSize / _maxSeparation);
 			int32_t mode = clusterSize / repeats;
 			for (int32_t i = 1; i < repeats; ++i)
 			{
-				int32_t pos = group.front()->data.pos + mode * i;
-				_gluePoints[reprPoint->data.seqId]
-					.emplace_back(setToId[findSet(reprPoint)],
-								  reprPoint->data.seqId, pos);
+				int32_t pos = reprPoint.pos + mode * i;
+				_gluePoints[reprPoint.seqId]
+					.emplace_back(clusterId, reprPoint.seqId, pos);
 
 			}
 
-			_gluePoints[reprPoint->data.seqId]
-				.emplace_back(setToId[findSet(reprPoint)],
-							  reprPoint->data.seqId, group.back()->data.pos);
+			_gluePoints[reprPoint.seqId]
+				.emplace_back(clusterId, reprPoint.seqId, 
+							  gluePoints[group.back()].pos);
 		}
 		//"normal" endpoint - just take a consensus
 		else
 		{
 			std::vector<int32_t> positions;
-			for (auto& ep : group) 
+			for (size_t ep : group) 
 			{
-				positions.push_back(ep->data.pos);
+				positions.push_back(gluePoints[ep].pos);
 			}
 			int32_t clusterXpos = median(positions);
 
-			_gluePoints[reprPoint->data.seqId]
-				.emplace_back(setToId[findSet(reprPoint)],
-							  reprPoint->data.seqId, clusterXpos);
+			_gluePoints[reprPoint.seqId]
+				.emplace_back(clusterId, reprPoint.seqId, clusterXpos);
 		}
 
 	};
-	for (auto& seqGluepoints : tempGluepoints)
+	for (auto& seq : _asmSeqs.iterSeqs())
 	{
-		std::vector<SetPoint1d*> currentGroup;
-		for (auto& gp : seqGluepoints.second)
+		auto seqIds = seqPoints.find(seq.id);
+		if (seqIds == seqPoints.end()) continue;
+
+		std::vector<size_t> currentGroup;
+		for (size_t gp : seqIds->second)
 		{
 			if (currentGroup.empty() || 
-				gp->data.pos - currentGroup.back()->data.pos < _maxSeparation)
+				gluePoints[gp].pos - gluePoints[currentGroup.back()].pos < 
+					_maxSeparation)
 			{
 				currentGroup.push_back(gp);
 			}
@@ -669,10 +671,27 @@ void RepeatGraph::initializeEdges(const OverlapContainer& asmOverlaps)
 {
 	Logger::get().debug() << "Initializing edges";
 
+	//segments between the same pair of nodes. Node pairs are stored
+	//in the order of their first appearance, so edge ids are deterministic
 	typedef std::pair<GraphNode*, GraphNode*> NodePair;
-	std::unordered_map<NodePair, std::vector<EdgeSequence>, 
-					   pairhash> parallelSegments;
-	std::unordered_map<NodePair, NodePair, pairhash> complEdges;
+	struct ParallelSegments
+	{
+		NodePair nodes;
+		NodePair complNodes;
+		std::vector<EdgeSequence> segments;
+	};
+	std::vector<ParallelSegments> parallelSegments;
+	std::unordered_map<NodePair, size_t, pairhash> pairIndex;
+	auto nodePairId = [&parallelSegments, &pairIndex](NodePair nodes)
+	{
+		auto itPair = pairIndex.find(nodes);
+		if (itPair != pairIndex.end()) return itPair->second;
+
+		pairIndex[nodes] = parallelSegments.size();
+		parallelSegments.emplace_back();
+		parallelSegments.back().nodes = nodes;
+		return parallelSegments.size() - 1;
+	};
 
 	std::unordered_map<size_t, GraphNode*> nodeIndex;
 	auto idToNode = [&nodeIndex, this](size_t nodeId)
@@ -684,24 +703,25 @@ void RepeatGraph::initializeEdges(const OverlapContainer& asmOverlaps)
 		return nodeIndex[nodeId];
 	};
 
-	for (auto& seqEdgesPair : _gluePoints)
+	for (auto& seq : _asmSeqs.iterSeqs())
 	{
-		if (!seqEdgesPair.first.strand()) continue;
-		if (seqEdgesPair.second.size() < 2) continue;
+		if (!seq.id.strand()) continue;
+		auto& seqPoints = _gluePoints[seq.id];
+		if (seqPoints.size() < 2) continue;
 
-		FastaRecord::Id complId = seqEdgesPair.first.rc();
+		FastaRecord::Id complId = seq.id.rc();
 
-		if (seqEdgesPair.second.size() != _gluePoints[complId].size())
+		if (seqPoints.size() != _gluePoints[complId].size())
 		{
 			throw std::runtime_error("Graph is not symmetric");
 		}
 
-		for (size_t i = 0; i < seqEdgesPair.second.size() - 1; ++i)
+		for (size_t i = 0; i < seqPoints.size() - 1; ++i)
 		{
-			GluePoint gpLeft = seqEdgesPair.second[i];
-			GluePoint gpRight = seqEdgesPair.second[i + 1];
+			GluePoint gpLeft = seqPoints[i];
+			GluePoint gpRight = seqPoints[i + 1];
 
-			size_t complPos = seqEdgesPair.second.size() - i - 2;
+			size_t complPos = seqPoints.size() - i - 2;
 			GluePoint complLeft = _gluePoints[complId][complPos];
 			GluePoint complRight = _gluePoints[complId][complPos + 1];
 
@@ -713,18 +733,30 @@ void RepeatGraph::initializeEdges(const OverlapContainer& asmOverlaps)
 			GraphNode* complRightNode = idToNode(complRight.pointId);
 			NodePair revPair = std::make_pair(complLeftNode, complRightNode);
 
+			size_t fwdId = nodePairId(fwdPair);
+			size_t revId = nodePairId(revPair);
+
 			int32_t seqLen = _asmSeqs.seqLen(gpLeft.seqId);
-			parallelSegments[fwdPair].emplace_back(gpLeft.seqId, seqLen, 
-												   gpLeft.position, 
-							  					   gpRight.position);
-			parallelSegments[revPair]
-				.push_back(parallelSegments[fwdPair].back().complement());
-
-			complEdges[fwdPair] = revPair;
-			complEdges[revPair] = fwdPair;
+			EdgeSequence segment(gpLeft.seqId, seqLen, gpLeft.position, 
+								 gpRight.position);
+			parallelSegments[fwdId].segments.push_back(segment);
+			parallelSegments[revId].segments.push_back(segment.complement());
+
+			parallelSegments[fwdId].complNodes = revPair;
+			parallelSegments[revId].complNodes = fwdPair;
 		}
 	}
 
+	//only one of the complementary node pairs is processed
+	std::vector<size_t> pairTasks;
+	std::vector<bool> usedPairs(parallelSegments.size(), false);
+	for (size_t i = 0; i < parallelSegments.size(); ++i)
+	{
+		if (usedPairs[i]) continue;
+		usedPairs[pairIndex[parallelSegments[i].complNodes]] = true;
+		pairTasks.push_back(i);
+	}
+
 	auto segIntersect = [] (const EdgeSequence& s, int32_t intBegin, 
 							int32_t intEnd)
 	{
@@ -732,49 +764,54 @@ void RepeatGraph::initializeEdges(const OverlapContainer& asmOverlaps)
 						std::max(intBegin, s.origSeqStart), 0);
 	};
 
-	std::unordered_set<NodePair, pairhash> usedPairs;
-	size_t singletonsFiltered = 0;
-	for (auto& nodePairSeqs : parallelSegments)
+	//segments of each node pair are clustered independently,
+	//in parallel. Each cluster is a list of segment indices
+	std::vector<std::vector<std::vector<size_t>>> 
+		pairClusters(parallelSegments.size());
+	std::atomic<size_t> singletonsFiltered(0);
+	std::function<void(const size_t&)> clusterSegments = 
+	[&parallelSegments, &pairClusters, &asmOverlaps, 
+		&singletonsFiltered, &segIntersect] (const size_t& pairId)
 	{
-		if (usedPairs.count(nodePairSeqs.first)) continue;
-		usedPairs.insert(complEdges[nodePairSeqs.first]);
+		const auto& segments = parallelSegments[pairId].segments;
 
 		//creating set and building index
-		SetVec<EdgeSequence*> segmentSets;
-		typedef SetNode<EdgeSequence*> SetSegment;
+		IndexSet segmentSets(segments.size());
 		std::unordered_map<FastaRecord::Id, 
-						   std::vector<SetSegment*>> segmentIndex;
-		for (auto& seg : nodePairSeqs.second) 
+						   std::vector<size_t>> segmentIndex;
+		for (size_t i = 0; i < segments.size(); ++i) 
 		{
-			segmentSets.push_back(new SetNode<EdgeSequence*>(&seg));
-			segmentIndex[seg.origSeqId].push_back(segmentSets.back());
+			segmentIndex[segments[i].origSeqId].push_back(i);
 		}
 		for (auto& seqSegments : segmentIndex)
 		{
 			std::sort(seqSegments.second.begin(), seqSegments.second.end(),
-					  [](const SetSegment* s1, const SetSegment* s2)
-					  {return s1->data->origSeqStart < s2->data->origSeqStart;});
+					  [&segments](size_t s1, size_t s2)
+					  {return segments[s1].origSeqStart < 
+					  		  segments[s2].origSeqStart;});
 		}
 
-
 		//cluster segments based on their overlaps
-		for (auto& setOne : segmentSets)
+		for (size_t setOne = 0; setOne < segments.size(); ++setOne)
 		{
+			const EdgeSequence& segOne = segments[setOne];
 			for (auto& interval : asmOverlaps
-					.getCoveringOverlaps(setOne->data->origSeqId, 
-										 setOne->data->origSeqStart,
-										 setOne->data->origSeqEnd))
+					.getCoveringOverlaps(segOne.origSeqId, 
+										 segOne.origSeqStart,
+										 segOne.origSeqEnd))
 			{
 				auto& ovlp = *interval.value;
 				int32_t intersectOne = 
-					segIntersect(*setOne->data, ovlp.curBegin, ovlp.curEnd);
+					segIntersect(segOne, ovlp.curBegin, ovlp.curEnd);
 				if (intersectOne <= 0) continue;
 
-				auto& ss = segmentIndex[ovlp.extId];
-				auto cmpBegin = [] (const SetSegment* s, int32_t pos)
-								    {return s->data->origSeqStart < pos;};
-				auto cmpEnd = [] (const SetSegment* s, int32_t pos)
-								    {return s->data->origSeqEnd < pos;};
+				auto itSegments = segmentIndex.find(ovlp.extId);
+				if (itSegments == segmentIndex.end()) continue;
+				auto& ss = itSegments->second;
+				auto cmpBegin = [&segments] (size_t s, int32_t pos)
+								    {return segments[s].origSeqStart < pos;};
+				auto cmpEnd = [&segments] (size_t s, int32_t pos)
+								    {return segments[s].origSeqEnd < pos;};
 				auto startRange = std::lower_bound(ss.begin(), ss.end(),
 												   ovlp.extBegin, cmpEnd);
 				auto endRange = std::lower_bound(ss.begin(), ss.end(),
@@ -782,117 +819,41 @@ void RepeatGraph::initializeEdges(const OverlapContainer& asmOverlaps)
 				if (endRange != ss.end()) ++endRange;
 				for (;startRange != endRange; ++startRange)
 				{
-					auto* setTwo = *startRange;
-					if (findSet(setOne) == findSet(setTwo)) continue;
+					size_t setTwo = *startRange;
+					if (segmentSets.findSet(setOne) == 
+						segmentSets.findSet(setTwo)) continue;
 
-					int32_t projStart = ovlp.project(setOne->data->origSeqStart);
-					int32_t projEnd = ovlp.project(setOne->data->origSeqEnd);
+					const EdgeSequence& segTwo = segments[setTwo];
+					int32_t projStart = ovlp.project(segOne.origSeqStart);
+					int32_t projEnd = ovlp.project(segOne.origSeqEnd);
 					int32_t projIntersect =
-						segIntersect(*setTwo->data, projStart, projEnd);
+						segIntersect(segTwo, projStart, projEnd);
 
-					if (projIntersect > setOne->data->seqLen / 2 && 
-						projIntersect > setTwo->data->seqLen / 2)
+					if (projIntersect > segOne.seqLen / 2 && 
+						projIntersect > segTwo.seqLen / 2)
 					{
-						unionSet(setOne, setTwo);
+						segmentSets.unionSet(setOne, setTwo);
 					}
 				}
 			}
 		}
-		auto edgeClusters = groupBySet(segmentSets);
-		/*if (edgeClusters.size() > 0)
-		{
-			Logger::get().debug() << "Node with " << segmentSets.size() << " segments";
-			Logger::get().debug() << "clusters: " << edgeClusters.size();
-			for (auto& edgeClust : edgeClusters)
-			{
-				int sumLen = 0;
-				for (auto s : edgeClust.second) sumLen += s->seqLen;
-				Logger::get().debug() << "\tcl: " << edgeClust.second.size()
-					<< " " << sumLen / edgeClust.second.size() << " "
-					<< edgeClust.first;
-				
-				if (edgeClust.second.size() < 10)
-				{
-					for (auto s : edgeClust.second)
-					{
-						Logger::get().debug() << "\t\t" << _asmSeqs.seqName(s->origSeqId)
-							<< " " << s->origSeqStart << " " << s->seqLen;
+		auto edgeClusters = segmentSets.groups();
 
-						//////////
-						if (edgeClust.second.size() <= 3)
-						{
-							auto segOne = s;
-							for (auto& interval : asmOverlaps
-									.getCoveringOverlaps(segOne->origSeqId, segOne->origSeqStart,
-														 segOne->origSeqEnd))
-							{
-								auto& ovlp = *interval.value;
-								int32_t intersectOne = 
-									segIntersect(*segOne, ovlp.curBegin, ovlp.curEnd);
-								if (intersectOne < segOne->seqLen / 2) continue;
-
-								auto& ss = segmentIndex[ovlp.extId];
-								auto cmpBegin = [] (const SetSegment* s, int32_t pos)
-													{return s->data->origSeqStart < pos;};
-								auto cmpEnd = [] (const SetSegment* s, int32_t pos)
-													{return s->data->origSeqEnd < pos;};
-								auto startRange = std::lower_bound(ss.begin(), ss.end(),
-																   ovlp.extBegin, cmpEnd);
-								auto endRange = std::lower_bound(ss.begin(), ss.end(),
-																 ovlp.extEnd, cmpBegin);
-								if (endRange != ss.end()) ++endRange;
-								for (;startRange != endRange; ++startRange)
-								{
-									auto* setTwo = *startRange;
-									if (segOne->origSeqStart == setTwo->data->origSeqStart &&
-										segOne->origSeqEnd == setTwo->data->origSeqEnd) continue;
-
-									//projecting the interval endpoints
-									//(overlap might be covering the actual segment)
-									int32_t projStart = ovlp.project(segOne->origSeqStart);
-									int32_t projEnd = ovlp.project(segOne->origSeqEnd);
-									int32_t projIntersect =
-										segIntersect(*setTwo->data, projStart, projEnd);
-									
-									if (projIntersect > 0)
-									{
-										Logger::get().debug() << "\t\t\t" 
-											<< _asmSeqs.seqName(setTwo->data->origSeqId) << " "
-											<< setTwo->data->origSeqStart << " " 
-											<< setTwo->data->origSeqEnd << " "
-											<< intersectOne << " " 
-											<< projIntersect << " " << findSet(setTwo);
-									}
-								}
-							}
-						}
-					}
-					///////////
-				}
-				else
-				{
-					Logger::get().debug() << "\t\t\t...";
-				}
-			}
-		}*/
-
-		//add edge for each cluster
-		std::vector<EdgeSequence> usedSegments;
 		for (auto& edgeClust : edgeClusters)
 		{
 			//filtering segments that were not glued, but covered by overlaps
-			if (edgeClusters.size() > 1 && edgeClust.second.size() == 1)
+			if (edgeClusters.size() > 1 && edgeClust.size() == 1)
 			{
-				auto seg = edgeClust.second.front();
+				const EdgeSequence& seg = segments[edgeClust.front()];
 				bool covered = false;
 				for (auto& interval : asmOverlaps
-						.getCoveringOverlaps(seg->origSeqId, seg->origSeqStart,
-										 	 seg->origSeqEnd))
+						.getCoveringOverlaps(seg.origSeqId, seg.origSeqStart,
+										 	 seg.origSeqEnd))
 				{
 					auto& ovlp = *interval.value;
 					int32_t intersect = 
-						segIntersect(*seg, ovlp.curBegin, ovlp.curEnd);
-					if (intersect == seg->seqLen) covered = true;
+						segIntersect(seg, ovlp.curBegin, ovlp.curEnd);
+					if (intersect == seg.seqLen) covered = true;
 				}
 				if (covered)
 				{
@@ -900,19 +861,32 @@ void RepeatGraph::initializeEdges(const OverlapContainer& asmOverlaps)
 					continue;
 				}
 			}
+			pairClusters[pairId].push_back(std::move(edgeClust));
+		}
+	};
+	processInParallel(pairTasks, clusterSegments, 
+					  Parameters::get().numThreads, /*progress bar*/ false);
 
+	//add edge for each cluster
+	for (size_t pairId : pairTasks)
+	{
+		auto& nodePairSeqs = parallelSegments[pairId];
+		std::vector<EdgeSequence> usedSegments;
+		for (auto& edgeClust : pairClusters[pairId])
+		{
 			//in case we have complement edges within the node pair
-			auto& anySegment = *edgeClust.second.front();
+			auto& anySegment = nodePairSeqs.segments[edgeClust.front()];
 			if (std::find(usedSegments.begin(), usedSegments.end(), anySegment) 
 						  != usedSegments.end()) continue;
 
-			GraphNode* leftNode = nodePairSeqs.first.first;
-			GraphNode* rightNode = nodePairSeqs.first.second;
+			GraphNode* leftNode = nodePairSeqs.nodes.first;
+			GraphNode* rightNode = nodePairSeqs.nodes.second;
 			GraphEdge newEdge(leftNode, rightNode, FastaRecord::Id(_nextEdgeId));
-			for (auto& seg : edgeClust.second)
+			for (size_t segId : edgeClust)
 			{
-				newEdge.seqSegments.push_back(*seg);
-				usedSegments.push_back(seg->complement());
+				auto& seg = nodePairSeqs.segments[segId];
+				newEdge.seqSegments.push_back(seg);
+				usedSegments.push_back(seg.complement());
 			}
 
 			//check if it's self-complmenet
@@ -923,13 +897,14 @@ void RepeatGraph::initializeEdges(const OverlapContainer& asmOverlaps)
 			this->addEdge(std::move(newEdge));
 			if (!selfComplement)
 			{
-				leftNode = complEdges[nodePairSeqs.first].first;
-				rightNode = complEdges[nodePairSeqs.first].second;
+				leftNode = nodePairSeqs.complNodes.first;
+				rightNode = nodePairSeqs.complNodes.second;
 				GraphEdge* complEdge = this->addEdge(GraphEdge(leftNode, rightNode, 
 												FastaRecord::Id(_nextEdgeId + 1)));
-				for (auto& seg : edgeClust.second)
+				for (size_t segId : edgeClust)
 				{
-					complEdge->seqSegments.push_back(seg->complement());
+					complEdge->seqSegments
+						.push_back(nodePairSeqs.segments[segId].complement());
 				}
 			}
 
@@ -1181,6 +1156,7 @@ void RepeatGraph::validateGraph()
 
 void RepeatGraph::loadGraph(const std::string& filename)
 {
+	ScopedTimer timer("graph_load");
 	std::ifstream fin(filename);
 	if (!fin)
 	{
@@ -1243,7 +1219,7 @@ EdgeSequence RepeatGraph::addEdgeSequence(const DnaSequence& sequence,
 
 void RepeatGraph::updateEdgeSequences()
 {
-	for (auto& edge : _graphEdges)
+	for (auto& edge : this->iterEdges())
 	{
 		if (!edge->edgeId.strand()) continue;
 
@@ -1296,4 +1272,5 @@ RepeatGraph::~RepeatGraph()
 	for (auto edge : toRemove) this->removeEdge(edge);
 	for (auto node : _graphNodes) delete node;
 	_graphNodes.clear();
+	_nodesById.clear();
 }
@@ -5,6 +5,9 @@
 #pragma once
 
 #include <list>
+#include <set>
+#include <map>
+#include <iterator>
 
 #include "../sequence/sequence_container.h"
 #include "../sequence/overlap.h"
@@ -150,6 +153,8 @@ struct GraphEdge
 
 struct GraphNode
 {
+	GraphNode(size_t nodeId): nodeId(nodeId), touchStamp(0) {}
+
 	bool isBifurcation() const
 		{return outEdges.size() != 1 || inEdges.size() != 1;}
 
@@ -221,16 +226,57 @@ struct GraphNode
 
 	std::vector<GraphEdge*> inEdges;
 	std::vector<GraphEdge*> outEdges;
+	//sequential, in the order of creation
+	size_t nodeId;
+	//end of the touched nodes log after the last entry of this node
+	size_t touchStamp;
 };
 
 typedef std::vector<GraphEdge*> GraphPath;
 
+//Iterates over the values of an id -> object map. Nodes and edges are 
+//listed in the order of their ids, so the graph processing does not
+//depend on the memory layout (as it would with the pointer hashes)
+template <typename Key, typename T>
+class IdOrderIterator
+{
+public:
+	typedef std::forward_iterator_tag iterator_category;
+	typedef T* value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef T** pointer;
+	typedef T*& reference;
+
+	IdOrderIterator(typename std::map<Key, T*>::iterator it): _it(it) {}
+
+	T*& operator*() const {return _it->second;}
+	IdOrderIterator& operator++() {++_it; return *this;}
+	bool operator==(const IdOrderIterator& other) const 
+		{return _it == other._it;}
+	bool operator!=(const IdOrderIterator& other) const 
+		{return _it != other._it;}
+
+private:
+	typename std::map<Key, T*>::iterator _it;
+};
 
 class RepeatGraph
 {
 public:
+	//Edges that were removed since the journal was last taken.
+	//They are already deleted, so they are recorded by their ids
+	//(taken before the deletion). The ids are never reused.
+	struct EditJournal
+	{
+		std::unordered_set<FastaRecord::Id> removedEdges;
+
+		bool empty() const {return removedEdges.empty();}
+	};
+
 	RepeatGraph(const SequenceContainer& asmSeqs, SequenceContainer* graphSeqs):
-		 _nextEdgeId(0), _asmSeqs(asmSeqs), _edgeSeqsContainer(graphSeqs)
+		 _nextEdgeId(0), _nextNodeId(0), _asmSeqs(asmSeqs), 
+		 _edgeSeqsContainer(graphSeqs),
+		 _touchLogBegin(0), _touchedAllEnd(0), _lastTouchCheckpoint(0)
 	{}
 	~RepeatGraph();
 
@@ -247,8 +293,9 @@ public:
 	//nodes
 	GraphNode* addNode()
 	{
-		GraphNode* node = new GraphNode();
+		GraphNode* node = new GraphNode(_nextNodeId++);
 		_graphNodes.insert(node);
+		_nodesById[node->nodeId] = node;
 		return node;
 	}
 
@@ -257,10 +304,10 @@ public:
 	public:
 		IterNodes(RepeatGraph& graph): _graph(graph) {}
 
-		std::unordered_set<GraphNode*>::iterator begin() 
-			{return _graph._graphNodes.begin();}
-		std::unordered_set<GraphNode*>::iterator end() 
-			{return _graph._graphNodes.end();}
+		IdOrderIterator<size_t, GraphNode> begin() 
+			{return _graph._nodesById.begin();}
+		IdOrderIterator<size_t, GraphNode> end() 
+			{return _graph._nodesById.end();}
 	
 	private:
 		RepeatGraph& _graph;
@@ -273,6 +320,7 @@ public:
 	{
 		GraphEdge* newEdge = new GraphEdge(edge);
 		_graphEdges.insert(newEdge);
+		_edgesById[newEdge->edgeId] = newEdge;
 		newEdge->nodeLeft->outEdges.push_back(newEdge);
 		newEdge->nodeRight->inEdges.push_back(newEdge);
 		
@@ -281,6 +329,9 @@ public:
 		{
 			_idToEdge[newEdge->edgeId.rc()] = newEdge;
 		}
+
+		this->touchNode(newEdge->nodeLeft);
+		this->touchNode(newEdge->nodeRight);
 		return newEdge;
 	}
 	bool hasEdge(GraphEdge* edge)
@@ -297,10 +348,10 @@ public:
 	public:
 		IterEdges(RepeatGraph& graph): _graph(graph) {}
 
-		std::unordered_set<GraphEdge*>::iterator begin() 
-			{return _graph._graphEdges.begin();}
-		std::unordered_set<GraphEdge*>::iterator end() 
-			{return _graph._graphEdges.end();}
+		IdOrderIterator<FastaRecord::Id, GraphEdge> begin() 
+			{return _graph._edgesById.begin();}
+		IdOrderIterator<FastaRecord::Id, GraphEdge> end() 
+			{return _graph._edgesById.end();}
 	
 	private:
 		RepeatGraph& _graph;
@@ -310,10 +361,14 @@ public:
 
 	void removeEdge(GraphEdge* edge)
 	{
+		this->touchNode(edge->nodeLeft);
+		this->touchNode(edge->nodeRight);
 		vecRemove(edge->nodeRight->inEdges, edge);
 		vecRemove(edge->nodeLeft->outEdges, edge);
 		_graphEdges.erase(edge);
-		_idToEdge.erase(edge->edgeId);
+		_edgesById.erase(edge->edgeId);
+		this->unmapEdgeId(edge);
+		this->journalRemoval(edge);
 		delete edge;
 	}
 
@@ -322,20 +377,26 @@ public:
 		std::unordered_set<GraphEdge*> toRemove;
 		for (auto& edge : node->outEdges) 
 		{
+			this->touchNode(edge->nodeRight);
 			vecRemove(edge->nodeRight->inEdges, edge);
 			toRemove.insert(edge);
 		}
 		for (auto& edge : node->inEdges) 
 		{
+			this->touchNode(edge->nodeLeft);
 			vecRemove(edge->nodeLeft->outEdges, edge);
 			toRemove.insert(edge);
 		}
 		for (auto& edge : toRemove)
 		{
 			_graphEdges.erase(edge);
+			_edgesById.erase(edge->edgeId);
+			this->unmapEdgeId(edge);
+			this->journalRemoval(edge);
 			delete edge;
 		}
 		_graphNodes.erase(node);
+		_nodesById.erase(node->nodeId);
 		delete node;
 	}
 
@@ -348,27 +409,120 @@ public:
 	}
 
 	const SequenceContainer& edgeSequences() {return *_edgeSeqsContainer;}
+	//should be called before indexing the newly added edge sequences
+	void updateEdgeSeqsPositions() {_edgeSeqsContainer->buildPositionIndex();}
+
+	//returns the edits since the previous call and starts a new journal
+	EditJournal takeEditJournal()
+	{
+		EditJournal journal;
+		std::swap(journal, _journal);
+		return journal;
+	}
 
 	EdgeSequence addEdgeSequence(const DnaSequence& sequence, 
 							 	 int32_t start, int32_t length,
 							 	 const std::string& description);
 
-	void disconnectRight(GraphEdge* edge)
+	//moves the end (start) of the edge to the given node
+	void reattachRight(GraphEdge* edge, GraphNode* node)
 	{
-		GraphNode* newNode = this->addNode();
+		this->touchNode(edge->nodeRight);
+		this->touchNode(node);
 		vecRemove(edge->nodeRight->inEdges, edge);
-		edge->nodeRight = newNode;
-		edge->nodeRight->inEdges.push_back(edge);
+		edge->nodeRight = node;
+		node->inEdges.push_back(edge);
+	}
+
+	void reattachLeft(GraphEdge* edge, GraphNode* node)
+	{
+		this->touchNode(edge->nodeLeft);
+		this->touchNode(node);
+		vecRemove(edge->nodeLeft->outEdges, edge);
+		edge->nodeLeft = node;
+		node->outEdges.push_back(edge);
+	}
+
+	void disconnectRight(GraphEdge* edge)
+	{
+		this->reattachRight(edge, this->addNode());
 	};
 
 	void disconnectLeft(GraphEdge* edge)
 	{
-		GraphNode* newNode = this->addNode();
-		vecRemove(edge->nodeLeft->outEdges, edge);
-		edge->nodeLeft = newNode;
-		edge->nodeLeft->outEdges.push_back(edge);
+		this->reattachLeft(edge, this->addNode());
 	};
 
+	//Log of the nodes affected by the graph edits (or by the changes
+	//of the read support, reported by the aligner). Simplification
+	//passes keep a checkpoint (a position in the log), and on the 
+	//next run only revisit the nodes that were touched since then.
+	//A node is logged at most once after the latest checkpoint, and 
+	//the entries that all the checkpoints have passed are dropped, so
+	//the log is bounded by the number of nodes times the number of 
+	//checkpoints. The returned nodes might be already removed
+	static const size_t NO_CHECKPOINT = (size_t)-1;
+	void touchNode(GraphNode* node) 
+	{
+		if (_touchCheckpoints.empty() || 
+			node->touchStamp > _lastTouchCheckpoint) return;
+		_touchedNodes.push_back(node);
+		node->touchStamp = this->touchLogEnd();
+	}
+	//a single marker (all the nodes are reported to the 
+	//checkpoints before it), the older entries are not needed
+	void touchAllNodes()
+	{
+		_touchLogBegin = this->touchLogEnd() + 1;
+		_touchedAllEnd = _touchLogBegin;
+		_touchedNodes.clear();
+	}
+	//moves the previous checkpoint of the caller (if any) to the current
+	//end of the log. The checkpoint should be released when not needed
+	size_t touchCheckpoint(size_t previous)
+	{
+		this->releaseTouchCheckpoint(previous);
+		size_t checkpoint = this->touchLogEnd();
+		_touchCheckpoints.insert(checkpoint);
+		_lastTouchCheckpoint = checkpoint;
+
+		//amortized removal of the passed entries
+		size_t oldest = *_touchCheckpoints.begin();
+		if (oldest > _touchLogBegin &&
+			2 * (oldest - _touchLogBegin) >= _touchedNodes.size())
+		{
+			_touchedNodes.erase(_touchedNodes.begin(), _touchedNodes.begin() + 
+								(oldest - _touchLogBegin));
+			_touchLogBegin = oldest;
+		}
+		return checkpoint;
+	}
+	void releaseTouchCheckpoint(size_t checkpoint)
+	{
+		if (checkpoint == NO_CHECKPOINT) return;
+		auto itCheckpoint = _touchCheckpoints.find(checkpoint);
+		if (itCheckpoint != _touchCheckpoints.end()) 
+		{
+			_touchCheckpoints.erase(itCheckpoint);
+		}
+	}
+	std::unordered_set<GraphNode*> getTouchedNodes(size_t checkpoint) const
+	{
+		if (checkpoint < _touchedAllEnd) return _graphNodes;
+
+		assert(checkpoint >= _touchLogBegin);
+		std::unordered_set<GraphNode*> nodes;
+		for (size_t i = checkpoint - _touchLogBegin; 
+			 i < _touchedNodes.size(); ++i)
+		{
+			if (_graphNodes.count(_touchedNodes[i])) 
+			{
+				nodes.insert(_touchedNodes[i]);
+			}
+		}
+		return nodes;
+	}
+
 	void linkEdges(GraphEdge* leftEdge, GraphEdge* rightEdge)
 	{
 		if (leftEdge->rightLink || rightEdge->leftLink)
@@ -385,6 +539,7 @@ public:
 
 private:
 	size_t _nextEdgeId;
+	size_t _nextNodeId;
 
 	struct GluePoint
 	{
@@ -416,6 +571,18 @@ private:
 	void logEdges();
 	void checkGluepointProjections(const OverlapContainer& asmOverlaps);
 	void updateEdgeSequences();
+
+	//getEdge() should not return the deleted edges
+	void unmapEdgeId(GraphEdge* edge)
+	{
+		_idToEdge.erase(edge->edgeId);
+		if (edge->selfComplement) _idToEdge.erase(edge->edgeId.rc());
+	}
+
+	void journalRemoval(GraphEdge* edge)
+	{
+		_journal.removedEdges.insert(edge->edgeId);
+	}
 	
 	const SequenceContainer& _asmSeqs;
 	SequenceContainer* 		 _edgeSeqsContainer;
@@ -424,7 +591,22 @@ private:
 	std::unordered_map<FastaRecord::Id, 
 					   std::vector<GluePoint>> _gluePoints;
 
+	//the sets are for the membership tests (the pointers might
+	//be already deleted), the maps define the iteration order
 	std::unordered_set<GraphNode*> _graphNodes;
 	std::unordered_set<GraphEdge*> _graphEdges;
+	std::map<size_t, GraphNode*> _nodesById;
+	std::map<FastaRecord::Id, GraphEdge*> _edgesById;
 	std::unordered_map<FastaRecord::Id, GraphEdge*> _idToEdge;
+	EditJournal _journal;
+
+	//positions in the touched nodes log do not change when
+	//the log is truncated: _touchedNodes[0] is at _touchLogBegin
+	size_t touchLogEnd() const 
+		{return _touchLogBegin + _touchedNodes.size();}
+	std::vector<GraphNode*> _touchedNodes;
+	size_t 					_touchLogBegin;
+	size_t 					_touchedAllEnd;
+	size_t 					_lastTouchCheckpoint;
+	std::multiset<size_t> 	_touchCheckpoints;
 };
@@ -11,6 +11,7 @@
 #include "../common/utils.h"
 #include "../common/parallel.h"
 #include "../common/disjoint_set.h"
+#include "../common/profiler.h"
 
 #include <lemon/list_graph.h>
 #include <lemon/matching.h>
@@ -170,12 +171,13 @@ int RepeatResolver::resolveConnections(const std::vector<Connection>& connection
 }
 
 bool RepeatResolver::checkForTandemCopies(const GraphEdge* checkEdge,
-										  const std::vector<GraphAlignment>& alignments)
+										  const std::vector<size_t>& alignmentIds)
 {
 	const int NEEDED_READS = 5;
 	int readEvidence = 0;
-	for (const auto& aln: alignments)
+	for (size_t alnId : alignmentIds)
 	{
+		const auto& aln = _aligner.getAlignments()[alnId];
 		int numCopies = 0;
 		//only copies fully covered by reads
 		for (size_t i = 1; i < aln.size() - 1; ++i)
@@ -188,13 +190,14 @@ bool RepeatResolver::checkForTandemCopies(const GraphEdge* checkEdge,
 }
 
 bool RepeatResolver::checkByReadExtension(const GraphEdge* checkEdge,
-										  const std::vector<GraphAlignment>& alignments)
+										  const std::vector<size_t>& alignmentIds)
 {
 	std::unordered_map<GraphEdge*, std::vector<int>> outFlanks;
 	std::unordered_map<GraphEdge*, std::vector<int>> outSpans;
 	int lowerBound = 0;
-	for (auto& aln : alignments)
+	for (size_t alnId : alignmentIds)
 	{ 
+		const auto& aln = _aligner.getAlignments()[alnId];
 		bool passedStart = false;
 		int leftFlank = 0;
 		int leftCoord = 0;
@@ -260,7 +263,7 @@ bool RepeatResolver::checkByReadExtension(const GraphEdge* checkEdge,
 	if (uniqueMult > 1) 
 	{
 		Logger::get().debug() << "Starting " 
-			<< checkEdge->edgeId.signedId() << " aln:" << alignments.size()
+			<< checkEdge->edgeId.signedId() << " aln:" << alignmentIds.size()
 			<< " minSpan:" << lowerBound;
 		for (auto& outEdgeCount : outFlanks)
 		{
@@ -333,10 +336,9 @@ int RepeatResolver::maskUnsupportedEdges()
 //alignment information - one of the key steps here.
 void RepeatResolver::findRepeats()
 {
+	ScopedTimer timer("repeat_detection");
 	Logger::get().debug() << "Finding repeats";
 
-	auto alnIndex = _aligner.makeAlignmentIndex();
-
 	//all edges are unique at the beginning
 	for (auto& edge : _graph.iterEdges())
 	{
@@ -429,7 +431,8 @@ void RepeatResolver::findRepeats()
 		//mask edges that appear multiple times within single reads
 		for (auto& edge : path.path)
 		{
-			if (!edge->repetitive && this->checkForTandemCopies(edge, alnIndex[edge]))
+			if (!edge->repetitive && this->checkForTandemCopies(edge, 
+									_aligner.getEdgeAlignments(edge)))
 			{
 				markRepetitive(&path);
 				markRepetitive(complPath(&path));
@@ -467,10 +470,10 @@ void RepeatResolver::findRepeats()
 
 			bool rightRepeat = 
 				this->checkByReadExtension(path->path.back(), 
-										   alnIndex[path->path.back()]);
+							_aligner.getEdgeAlignments(path->path.back()));
 			bool leftRepeat = 
 				this->checkByReadExtension(complPath(path)->path.back(), 
-										   alnIndex[complPath(path)->path.back()]);
+							_aligner.getEdgeAlignments(complPath(path)->path.back()));
 			if (rightRepeat || leftRepeat)
 			{
 				markRepetitive(path);
@@ -532,6 +535,7 @@ void RepeatResolver::findRepeats()
 
 void RepeatResolver::finalizeGraph()
 {
+	ScopedTimer timer("repeat_resolution");
 	GraphProcessor proc(_graph, _asmSeqs);
 	auto unbranchingPaths = proc.getUnbranchingPaths();
 	for (auto& path : unbranchingPaths)
@@ -595,6 +599,7 @@ void RepeatResolver::finalizeGraph()
 
 int RepeatResolver::resolveRepeats()
 {
+	ScopedTimer timer("repeat_resolution");
 	const float MIN_SUPPORT = Config::get("min_repeat_res_support");
 
 	auto connections = this->getConnections();
@@ -800,10 +805,9 @@ void RepeatResolver::clearResolvedRepeats()
 
 int RepeatResolver::resolveSimpleRepeats()
 {
+	ScopedTimer timer("repeat_resolution");
 	static const int MIN_JCT_SUPPORT = 2;
 
-	auto alnIndex = _aligner.makeAlignmentIndex();
-
 	GraphProcessor proc(_graph, _asmSeqs);
 	auto unbranchingPaths = proc.getUnbranchingPaths();
 
@@ -828,8 +832,9 @@ int RepeatResolver::resolveSimpleRepeats()
 					   	   std::unordered_map<GraphEdge*, ReadSequence>> bridgingReads;
 		for (GraphEdge* inEdge : inputs)
 		{
-			for (auto& aln : alnIndex[inEdge])
+			for (size_t alnId : _aligner.getEdgeAlignments(inEdge))
 			{
+				const auto& aln = _aligner.getAlignments()[alnId];
 				for (size_t i = 0; i < aln.size(); ++i)
 				{
 					if (aln[i].edge != inEdge) continue;
@@ -858,12 +863,14 @@ int RepeatResolver::resolveSimpleRepeats()
 		SetVec<EdgeDir> allElements;
 		std::unordered_map<GraphEdge*, SetElement*> inputElements;
 		std::unordered_map<GraphEdge*, SetElement*> outputElements;
-		for (GraphEdge* edge : inputs) 
+		//in the order of the node edges, so the clusters do not 
+		//depend on the pointer hashes
+		for (GraphEdge* edge : pathToResolve.nodeLeft()->inEdges) 
 		{
 			allElements.push_back(new SetElement({edge, true}));
 			inputElements[edge] = allElements.back();
 		}
-		for (GraphEdge* edge : outputs) 
+		for (GraphEdge* edge : pathToResolve.nodeRight()->outEdges) 
 		{
 			allElements.push_back(new SetElement({edge, false}));
 			outputElements[edge] = allElements.back();
@@ -966,9 +973,7 @@ void RepeatResolver::separatePath(const GraphPath& graphPath,
 {
 	//first edge
 	GraphNode* leftNode = _graph.addNode();
-	vecRemove(graphPath.front()->nodeRight->inEdges, graphPath.front());
-	graphPath.front()->nodeRight = leftNode;
-	leftNode->inEdges.push_back(graphPath.front());
+	_graph.reattachRight(graphPath.front(), leftNode);
 	int32_t pathCoverage = (graphPath.front()->meanCoverage +
 						    graphPath.back()->meanCoverage) / 2;
 
@@ -991,8 +996,6 @@ void RepeatResolver::separatePath(const GraphPath& graphPath,
 	}
 
 	//last edge
-	vecRemove(graphPath.back()->nodeLeft->outEdges, graphPath.back());
-	graphPath.back()->nodeLeft = rightNode;
-	rightNode->outEdges.push_back(graphPath.back());
+	_graph.reattachLeft(graphPath.back(), rightNode);
 }
 
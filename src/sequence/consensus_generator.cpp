@@ -5,118 +5,153 @@
 #include <cassert>
 #include <algorithm>
 #include <fstream>
+#include <limits>
 
 #include "consensus_generator.h"
 
 #include "../common/config.h"
 #include "../common/logger.h"
 #include "../common/parallel.h"
-#include "../common/matrix.h"
+#include "../common/profiler.h"
 
 
 namespace
 {
-	//banded glocal alignment
-	void pairwiseAlignment(const std::string& seqOne, const std::string& seqTwo,
+	//Banded glocal alignment. The band is |i - j| <= bandWidth, where
+	//i and j are the positions in the first and the second sequence.
+	//The DP matrix is filled along the anti-diagonals (i + j = const):
+	//cells of one anti-diagonal do not depend on each other, so the inner
+	//loop is branchless and is vectorized by the compiler. Sequences are
+	//given as nucleotide ids, and the backtrack takes 2 bits per cell
+	void pairwiseAlignment(const std::vector<uint8_t>& seqOne, 
+						   const std::vector<uint8_t>& seqTwo,
 						   std::string& outOne, std::string& outTwo, 
 						   int bandWidth)
 	{
 		static const int32_t MATCH = 5;
 		static const int32_t SUBST = -5;
 		static const int32_t INDEL = -3;
+		static const int32_t NEG_INF = std::numeric_limits<int32_t>::min() / 2;
 
-		static const int32_t matchScore[] = {SUBST, MATCH};
-		static const int32_t indelScore[] = {INDEL, 0};
+		static const uint8_t STEP_LEFT = 0;
+		static const uint8_t STEP_UP = 1;
+		static const uint8_t STEP_CROSS = 2;
 
-		const size_t numRows = seqOne.length() + 1;
-		const size_t numCols = 2 * bandWidth + 1;
-
-		Matrix<char> backtrackMatrix(numRows, numCols);
-		std::vector<int32_t> scoreRowOne(numCols, 0);
-		std::vector<int32_t> scoreRowTwo(numCols, 0);
-
-
-		for (size_t i = 0; i < numRows; ++i) 
+		const int32_t lenOne = seqOne.size();
+		const int32_t lenTwo = seqTwo.size();
+		const int32_t numDiags = lenOne + lenTwo + 1;
+		//otherwise, some anti-diagonals are outside of the band
+		if (bandWidth < 1 || abs(lenOne - lenTwo) > bandWidth)
 		{
-			size_t j = std::max(0, bandWidth - (int)i);
-			backtrackMatrix.at(i, j) = 1;
+			throw std::runtime_error("Alignment band is too narrow");
 		}
-		for (size_t i = 0; i < numCols; ++i) 
+
+		//ranges of i for each anti-diagonal, and the positions
+		//of their first cells in the backtrack array
+		std::vector<int32_t> diagBegin(numDiags);
+		std::vector<int32_t> diagEnd(numDiags);
+		std::vector<size_t> diagOffset(numDiags + 1, 0);
+		for (int32_t d = 0; d < numDiags; ++d)
 		{
-			backtrackMatrix.at(0, i) = 0;
+			diagBegin[d] = std::max(std::max(0, d - lenTwo), 
+									std::max(0, d - bandWidth + 1) / 2);
+			diagEnd[d] = std::min(std::min(lenOne, d), (d + bandWidth) / 2) + 1;
+			diagOffset[d + 1] = diagOffset[d] + 
+								std::max(0, diagEnd[d] - diagBegin[d]);
 		}
+		std::vector<uint8_t> backtrack(diagOffset.back() / 4 + 1, 0);
+
+		//with the second sequence reversed, both sequences are
+		//read forward along an anti-diagonal
+		std::vector<uint8_t> revTwo(seqTwo.rbegin(), seqTwo.rend());
+
+		//scores of the current and the two previous anti-diagonals,
+		//indexed by i + 1. Cells right outside of the computed range
+		//are set to NEG_INF, so the out-of-band steps are never taken
+		std::vector<int32_t> diagCur(lenOne + 3, NEG_INF);
+		std::vector<int32_t> diagPrev(lenOne + 3, NEG_INF);
+		std::vector<int32_t> diagPrevTwo(lenOne + 3, NEG_INF);
+		std::vector<uint8_t> diagSteps(lenOne + 1);
 
-		//filling DP matrices
-		for (size_t i = 1; i < numRows; ++i)
+		for (int32_t d = 0; d < numDiags; ++d)
 		{
-			int leftOverhang = bandWidth - (int)i + 1;
-			int rightOverhand = (int)i + bandWidth - (int)seqTwo.length();
-			size_t colLeft = std::max(0, leftOverhang);
-			size_t colRight = std::min((int)numCols, (int)numCols - rightOverhand);
+			const int32_t begin = diagBegin[d];
+			const int32_t end = diagEnd[d];
+
+			//the first row and the first column have zero scores 
+			//(free leading gaps)
+			if (begin == 0)
+			{
+				diagCur[1] = 0;
+				diagSteps[0] = STEP_LEFT;
+			}
+			if (end == d + 1)
+			{
+				diagCur[d + 1] = 0;
+				diagSteps[d - begin] = STEP_UP;
+			}
 
-			for (int j = colLeft; j < (int)colRight; ++j)
+			const int32_t inBegin = std::max(begin, 1);
+			const int32_t inEnd = std::min(end, d);
+			const int32_t shiftTwo = lenTwo - d;
+			for (int32_t i = inBegin; i < inEnd; ++i)
 			{
-				size_t twoCoord = j + i - bandWidth;
-				int32_t cross = scoreRowOne[j] + 
-								matchScore[seqOne[i - 1] == seqTwo[twoCoord - 1]];
-				char maxStep = 2;
-				int32_t maxScore = cross;
-
-				if (j < (int)numCols - 1) //up
-				{
-					int32_t up = scoreRowOne[j + 1] +
-								 indelScore[twoCoord == seqTwo.length()];
-					if (up > maxScore)
-					{
-						maxStep = 1;
-						maxScore = up;
-					}
-				}
-
-				if (j > 0) //left
-				{
-					int32_t left = scoreRowTwo[j - 1] + 
-								   indelScore[i == seqOne.length()];
-					if (left > maxScore)
-					{
-						maxStep = 0;
-						maxScore = left;
-					}
-				}
-
-				scoreRowTwo[j] = maxScore;
-				backtrackMatrix.at(i, j) = maxStep;
+				//trailing gaps are free
+				int32_t cross = diagPrevTwo[i] + 
+					(seqOne[i - 1] == revTwo[shiftTwo + i] ? MATCH : SUBST);
+				int32_t up = diagPrev[i] + (d - i == lenTwo ? 0 : INDEL);
+				int32_t left = diagPrev[i + 1] + (i == lenOne ? 0 : INDEL);
+
+				//ties are resolved in favor of cross, then up
+				int32_t maxScore = up > cross ? up : cross;
+				uint8_t maxStep = up > cross ? STEP_UP : STEP_CROSS;
+				maxStep = left > maxScore ? STEP_LEFT : maxStep;
+				maxScore = left > maxScore ? left : maxScore;
+
+				diagCur[i + 1] = maxScore;
+				diagSteps[i - begin] = maxStep;
 			}
-			scoreRowOne.swap(scoreRowTwo);
+			diagCur[begin] = NEG_INF;
+			diagCur[end + 1] = NEG_INF;
+
+			for (int32_t i = 0; i < end - begin; ++i)
+			{
+				size_t pos = diagOffset[d] + i;
+				backtrack[pos / 4] |= diagSteps[i] << (pos % 4 * 2);
+			}
+
+			diagPrevTwo.swap(diagPrev);
+			diagPrev.swap(diagCur);
 		}
 
 		//backtrack
-		outOne.reserve(seqOne.length() * 3 / 2);
-		outTwo.reserve(seqTwo.length() * 3 / 2);
+		outOne.reserve(seqOne.size() * 3 / 2);
+		outTwo.reserve(seqTwo.size() * 3 / 2);
 
-		int i = numRows - 1;
-		int j = bandWidth - (int)numRows + (int)seqTwo.length() + 1;
-		while (i != 0 || j != bandWidth) 
+		int32_t i = lenOne;
+		int32_t j = lenTwo;
+		while (i != 0 || j != 0) 
 		{
-			size_t twoCoord = j + i - bandWidth;
-			if(backtrackMatrix.at(i, j) == 1) //up
+			size_t pos = diagOffset[i + j] + i - diagBegin[i + j];
+			uint8_t step = (backtrack[pos / 4] >> (pos % 4 * 2)) & 3;
+			if (step == STEP_UP)
 			{
-				outOne += seqOne[i - 1];
+				outOne += DnaSequence::idToDna(seqOne[i - 1]);
 				outTwo += '-';
 				i -= 1;
-				j += 1;
 			}
-			else if (backtrackMatrix.at(i, j) == 0) //left
+			else if (step == STEP_LEFT)
 			{
 				outOne += '-';
-				outTwo += seqTwo[twoCoord - 1];
+				outTwo += DnaSequence::idToDna(seqTwo[j - 1]);
 				j -= 1;
 			}
-			else	//cross
+			else
 			{
-				outOne += seqOne[i - 1];
-				outTwo += seqTwo[twoCoord - 1];
+				outOne += DnaSequence::idToDna(seqOne[i - 1]);
+				outTwo += DnaSequence::idToDna(seqTwo[j - 1]);
 				i -= 1;
+				j -= 1;
 			}
 		}
 		std::reverse(outOne.begin(), outOne.end());
@@ -124,11 +159,20 @@ namespace
 	}
 }
 
+void ConsensusGenerator::pairwiseAlignment(const std::vector<uint8_t>& seqOne,
+										   const std::vector<uint8_t>& seqTwo,
+										   std::string& outOne,
+										   std::string& outTwo, int bandWidth)
+{
+	::pairwiseAlignment(seqOne, seqTwo, outOne, outTwo, bandWidth);
+}
+
 
 std::vector<FastaRecord> 
 	ConsensusGenerator::generateConsensuses(const std::vector<ContigPath>& contigs, 
 											bool verbose)
 {
+	ScopedTimer timer("consensus");
 	if (verbose) Logger::get().info() << "Generating sequence";
 	std::vector<std::vector<AlignmentInfo>> allAlignments;
 	std::vector<FastaRecord> consensuses;
@@ -194,55 +238,53 @@ ConsensusGenerator::AlignmentsMap
 {
 	typedef std::pair<const ContigPath*, size_t> AlnTask;
 
-	AlignmentsMap alnMap;
-	std::mutex mapMutex;
-	std::function<void(const AlnTask&)> alnFunc =
-	[this, &alnMap, &mapMutex](const AlnTask& task)
+	std::vector<AlnTask> tasks;
+	for (auto& path : contigs)
 	{
-		const ContigPath* path = task.first;
-		size_t i = task.second;
+		for (size_t i = 0; i < path.sequences.size() - 1; ++i)
+		{
+			tasks.emplace_back(&path, i);
+		}
+	}
+
+	//each task writes into its own slot, so no locking is needed
+	std::vector<AlignmentInfo> alignments(tasks.size());
+	std::vector<size_t> taskIds(tasks.size());
+	for (size_t i = 0; i < taskIds.size(); ++i) taskIds[i] = i;
+
+	std::function<void(const size_t&)> alnFunc =
+	[&tasks, &alignments](const size_t& taskId)
+	{
+		const ContigPath* path = tasks[taskId].first;
+		size_t i = tasks[taskId].second;
 
 		int32_t leftStart = path->overlaps[i].curBegin;
 		int32_t leftLen = path->overlaps[i].curRange();
-		std::string leftSeq = path->sequences[i].substr(leftStart, leftLen).str();
+		std::vector<uint8_t> leftSeq(leftLen);
+		path->sequences[i].copyRaw(leftStart, leftLen, leftSeq.data());
 
 		int32_t rightStart = path->overlaps[i].extBegin;
 		int32_t rightLen = path->overlaps[i].extRange();
-		std::string rightSeq = path->sequences[i + 1].substr(rightStart, 
-															 rightLen).str();
+		std::vector<uint8_t> rightSeq(rightLen);
+		path->sequences[i + 1].copyRaw(rightStart, rightLen, rightSeq.data());
 		
-		const int bandWidth = abs((int)leftSeq.length() - 
-								  (int)rightSeq.length()) + 
-								  		Config::get("maximum_jump");
-		/*if (abs((int)leftSeq.length() - (int)rightSeq.length()) >
-			std::min((int)leftSeq.length(), (int)rightSeq.length()))
-		{
-			Logger::get().warning() << "Aligning sequence that are too "
-				<< " different - something is terribly wrong!";
-		}*/
-
-		std::string alignedLeft;
-		std::string alignedRight;
-		pairwiseAlignment(leftSeq, rightSeq, alignedLeft, 
-						  alignedRight, bandWidth);
-
-		{
-			std::lock_guard<std::mutex> lock(mapMutex);
-			alnMap[&path->overlaps[i]] = {alignedLeft, alignedRight, 
-						 				  leftStart, rightStart};
-		}
+		const int bandWidth = abs(leftLen - rightLen) + 
+							  (int)Config::get("maximum_jump");
+
+		auto& aln = alignments[taskId];
+		pairwiseAlignment(leftSeq, rightSeq, aln.alnOne, 
+						  aln.alnTwo, bandWidth);
+		aln.startOne = leftStart;
+		aln.startTwo = rightStart;
 	};
+	processInParallel(taskIds, alnFunc, Parameters::get().numThreads, verbose);
 
-	std::vector<AlnTask> tasks;
-	for (auto& path : contigs)
+	AlignmentsMap alnMap;
+	for (size_t i = 0; i < tasks.size(); ++i)
 	{
-		for (size_t i = 0; i < path.sequences.size() - 1; ++i)
-		{
-			tasks.emplace_back(&path, i);
-		}
+		const ContigPath* path = tasks[i].first;
+		alnMap[&path->overlaps[tasks[i].second]] = std::move(alignments[i]);
 	}
-	processInParallel(tasks, alnFunc, Parameters::get().numThreads, verbose);
-
 	return alnMap;
 }
 
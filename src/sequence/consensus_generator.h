@@ -29,7 +29,13 @@ public:
 	std::vector<FastaRecord> 
 		generateConsensuses(const std::vector<ContigPath>& contigs, 
 							bool verbose = true);
-	
+
+	//banded alignment of the two sequences, given as nucleotide ids
+	static void pairwiseAlignment(const std::vector<uint8_t>& seqOne,
+								  const std::vector<uint8_t>& seqTwo,
+								  std::string& outOne, std::string& outTwo,
+								  int bandWidth);
+
 private:
 	struct AlignmentInfo
 	{
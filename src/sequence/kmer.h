@@ -12,6 +12,16 @@
 
 static_assert(sizeof(size_t) == 8, "32-bit architectures are not supported");
 
+//The k-mer operations are templated by the k-mer size, so that the hot
+//loops could be compiled with the constant masks and shifts. K = 0 is
+//the generic version, that reads the size from Parameters. The common
+//sizes are instantiated by the callers (see KMER_SIZE_DISPATCH)
+template <size_t K>
+inline size_t kmerSize() {return K;}
+
+template <>
+inline size_t kmerSize<0>() {return Parameters::get().kmerSize;}
+
 class Kmer
 {
 public:
@@ -33,24 +43,27 @@ public:
 		}
 	}
 
-	Kmer reverseComplement()
+	//complements the bases and reverses the order of the 2-bit
+	//groups in the whole word, then shifts the k-mer down
+	template <size_t K = 0>
+	Kmer reverseComplement() const
 	{
-		KmerRepr tmpRepr = _representation;
-		Kmer newKmer;
-
-		for (unsigned int i = 0; i < Parameters::get().kmerSize; ++i)
-		{
-			newKmer._representation <<= 2;
-			newKmer._representation += ~tmpRepr & 3;
-			tmpRepr >>= 2;
-		}
+		KmerRepr x = ~_representation;
+		x = ((x >> 2) & 0x3333333333333333ULL) | 
+			((x & 0x3333333333333333ULL) << 2);
+		x = ((x >> 4) & 0x0F0F0F0F0F0F0F0FULL) | 
+			((x & 0x0F0F0F0F0F0F0F0FULL) << 4);
+		x = __builtin_bswap64(x);
 
+		Kmer newKmer;
+		newKmer._representation = x >> (64 - kmerSize<K>() * 2);
 		return newKmer;
 	}
 
+	template <size_t K = 0>
 	bool standardForm()
 	{
-		Kmer complKmer = this->reverseComplement();
+		Kmer complKmer = this->reverseComplement<K>();
 		if (complKmer._representation < _representation)
 		{
 			_representation = complKmer._representation;
@@ -59,23 +72,23 @@ public:
 		return false;
 	}
 
+	template <size_t K = 0>
 	void appendRight(DnaSequence::NuclType dnaSymbol)
 	{
 		_representation <<= 2;
 		_representation += dnaSymbol;
 
-		KmerRepr kmerSize = Parameters::get().kmerSize;
-		KmerRepr kmerMask = ((KmerRepr)1 << kmerSize * 2) - 1;
+		KmerRepr kmerMask = ((KmerRepr)1 << kmerSize<K>() * 2) - 1;
 		_representation &= kmerMask;
 	}
 
+	template <size_t K = 0>
 	void appendLeft(DnaSequence::NuclType dnaSymbol)
 	{
 		_representation >>= 2;
 
-		KmerRepr kmerSize = Parameters::get().kmerSize;
-		KmerRepr shift = kmerSize * 2 - 2;
-		_representation += dnaSymbol << shift;
+		KmerRepr shift = kmerSize<K>() * 2 - 2;
+		_representation += (KmerRepr)dnaSymbol << shift;
 	}
 
 	typedef size_t KmerRepr;
@@ -121,28 +134,29 @@ struct KmerPosition
 	int32_t position;
 };
 
-class KmerIterator
+template <size_t K>
+class SizedKmerIterator
 {
 public:
     typedef std::forward_iterator_tag iterator_category;
 
-	KmerIterator(const DnaSequence* readSeq, size_t position):
+	SizedKmerIterator(const DnaSequence* readSeq, size_t position):
 		_readSeq(readSeq),
 		_position(position)
 	{
-		if (position != readSeq->length() - Parameters::get().kmerSize)
+		if (position != readSeq->length() - kmerSize<K>())
 		{
 			//_kmer = Kmer(readSeq->substr(0, Parameters::get().kmerSize));
-			_kmer = Kmer(*readSeq, 0, Parameters::get().kmerSize);
+			_kmer = Kmer(*readSeq, 0, kmerSize<K>());
 		}
 	}
 
-	bool operator==(const KmerIterator& other) const
+	bool operator==(const SizedKmerIterator& other) const
 	{
 		return _readSeq == other._readSeq && _position == other._position;
 	}
 
-	bool operator!=(const KmerIterator& other) const
+	bool operator!=(const SizedKmerIterator& other) const
 	{
 		return !(*this == other);
 	}
@@ -152,10 +166,10 @@ public:
 		return KmerPosition(_kmer, _position);
 	}
 
-	KmerIterator& operator++()
+	SizedKmerIterator& operator++()
 	{
-		size_t appendPos = _position + Parameters::get().kmerSize;
-		_kmer.appendRight(_readSeq->atRaw(appendPos));
+		size_t appendPos = _position + kmerSize<K>();
+		_kmer.appendRight<K>(_readSeq->atRaw(appendPos));
 		++_position;
 		return *this;
 	}
@@ -167,27 +181,28 @@ protected:
 };
 
 
-class IterKmers
+template <size_t K>
+class SizedIterKmers
 {
 public:
-	IterKmers(const DnaSequence& sequence, size_t start = 0,
-			  size_t length = std::string::npos):
+	SizedIterKmers(const DnaSequence& sequence, size_t start = 0,
+				   size_t length = std::string::npos):
 		_sequence(sequence), _start(start), _length(length)
 	{}
 
-	KmerIterator begin()
+	SizedKmerIterator<K> begin()
 	{
-		if (_sequence.length() < Parameters::get().kmerSize + _start)
+		if (_sequence.length() < kmerSize<K>() + _start)
 			return this->end();
 
-		return KmerIterator(&_sequence, _start);
+		return SizedKmerIterator<K>(&_sequence, _start);
 	}
 
-	KmerIterator end()
+	SizedKmerIterator<K> end()
 	{
 		size_t end = _length == std::string::npos ?
 						_sequence.length() : _length + _start;
-		return KmerIterator(&_sequence, end - Parameters::get().kmerSize);
+		return SizedKmerIterator<K>(&_sequence, end - kmerSize<K>());
 	}
 
 private:
@@ -195,3 +210,19 @@ private:
 	const size_t _start;
 	const size_t _length;
 };
+
+typedef SizedKmerIterator<0> KmerIterator;
+typedef SizedIterKmers<0> IterKmers;
+
+//Calls IMPL<K>(args) with the compile-time k-mer size, if the current
+//size is one of the common ones, and the generic IMPL<0>(args) otherwise
+#define KMER_SIZE_DISPATCH(IMPL, ...) \
+	switch (Parameters::get().kmerSize) \
+	{ \
+		case 15: return IMPL<15>(__VA_ARGS__); \
+		case 17: return IMPL<17>(__VA_ARGS__); \
+		case 19: return IMPL<19>(__VA_ARGS__); \
+		case 21: return IMPL<21>(__VA_ARGS__); \
+		case 31: return IMPL<31>(__VA_ARGS__); \
+		default: return IMPL<0>(__VA_ARGS__); \
+	}
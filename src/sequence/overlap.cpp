@@ -21,11 +21,30 @@
 #undef HAVE_KALLOC
 
 #include "overlap.h"
+#include "wfa_align.h"
 #include "../common/config.h"
 #include "../common/utils.h"
 #include "../common/parallel.h"
 #include "../common/disjoint_set.h"
 #include "../common/bfcontainer.h"
+#include "../common/profiler.h"
+
+
+float cigarDivergence(const std::vector<CigOp>& cigar)
+{
+	const int KMER_SIZE = Parameters::get().kmerSize;
+
+	int numMatches = 0;
+	int numMiss = 0;
+	int numIndels = 0;
+	for (const auto& op : cigar)
+	{
+		if (op.op == '=') numMatches += op.len;
+		else if (op.op == 'X') numMiss += op.len;
+		else numIndels += std::min(op.len, KMER_SIZE);
+	}
+	return 1 - float(numMatches) / (numMatches + numMiss + numIndels);
+}
 
 
 namespace
@@ -56,18 +75,12 @@ namespace
 		void* memPool;
     };
 
-	struct CigOp
-	{
-		char op;
-		int len;
-	};
 	float kswAlign(const DnaSequence& trgSeq, size_t trgBegin, size_t trgLen,
 				   const DnaSequence& qrySeq, size_t qryBegin, size_t qryLen,
 				   int matchScore, int misScore, int gapOpen, int gapExtend,
 				   std::vector<CigOp>& cigarOut)
 	{
 		static const int32_t MAX_JUMP = Config::get("maximum_jump");
-		const int KMER_SIZE = Parameters::get().kmerSize;
 
 		thread_local ThreadMemPool buf;
 		thread_local std::vector<uint8_t> trgByte;
@@ -76,14 +89,8 @@ namespace
 		trgByte.assign(trgLen, 0);
 		qryByte.assign(qryLen, 0);
 
-		for (size_t i = 0; i < trgLen; ++i)
-		{
-			trgByte[i] = trgSeq.atRaw(i + trgBegin);
-		}
-		for (size_t i = 0; i < qryLen; ++i)
-		{
-			qryByte[i] = qrySeq.atRaw(i + qryBegin);
-		}
+		trgSeq.copyRaw(trgBegin, trgLen, trgByte.data());
+		qrySeq.copyRaw(qryBegin, qryLen, qryByte.data());
 
 		int seqDiff = abs((int)trgByte.size() - (int)qryByte.size());
 		int bandWidth = seqDiff + MAX_JUMP;
@@ -109,10 +116,6 @@ namespace
 					  trgByte.size(), &trgByte[0], NUM_NUCL,
 				 	  subsMat, gapOpen, gapExtend, bandWidth, Z_DROP, 
 					  END_BONUS, FLAG, &ez);
-		
-        int numMatches = 0;
-		int numMiss = 0;
-		int numIndels = 0;
 
 		cigarOut.clear();
 		cigarOut.reserve((size_t)ez.n_cigar);
@@ -140,8 +143,6 @@ namespace
 					{
 						++cigarOut.back().len;
 					}
-					numMatches += int(match == '=');
-					numMiss += int(match == 'X');
 				}
 				posQry += size;
 				posTrg += size;
@@ -150,31 +151,51 @@ namespace
 			{
 				cigarOut.push_back({'I', size});
                 posQry += size;
-				numIndels += std::min(size, KMER_SIZE);
 			}
             else //D
 			{
 				cigarOut.push_back({'D', size});
 				posTrg += size;
-				numIndels += std::min(size, KMER_SIZE);
 			}
 		}
-        float errRate = 1 - float(numMatches) / (numMatches + numMiss + numIndels);
+		float errRate = cigarDivergence(cigarOut);
 
 		kfree(buf.memPool, ez.cigar);
 		return errRate;
 	}
 
+	//nucleotide alignment of the overlap. The wavefront aligner is used
+	//first (if enabled for the platform), and the alignments that are
+	//too divergent for it are computed with ksw2
+	float alignOverlap(const OverlapRange& ovlp, const DnaSequence& trgSeq,
+					   const DnaSequence& qrySeq, std::vector<CigOp>& cigarOut)
+	{
+		static const float WFA_MAX_DIV = Config::get("wfa_max_divergence");
+
+		if (WFA_MAX_DIV > 0)
+		{
+			float errRate = 0;
+			if (wfaAlign(trgSeq, ovlp.curBegin, ovlp.curRange(),
+						 qrySeq, ovlp.extBegin, ovlp.extRange(),
+						 /*match*/ 1, /*mm*/ -2, /*gap open*/ 2, 
+						 /*gap ext*/ 1, WFA_MAX_DIV, cigarOut, errRate))
+			{
+				return errRate;
+			}
+		}
+		return kswAlign(trgSeq, ovlp.curBegin, ovlp.curRange(),
+						qrySeq, ovlp.extBegin, ovlp.extRange(),
+						/*match*/ 1, /*mm*/ -2, /*gap open*/ 2, 
+						/*gap ext*/ 1, cigarOut);
+	}
+
 	float getAlignmentIdy(const OverlapRange& ovlp,
 						  const DnaSequence& trgSeq,
 						  const DnaSequence& qrySeq,
 						  bool showAlignment)
 	{
 		std::vector<CigOp> decodedCigar;
-		float errRate = kswAlign(trgSeq, ovlp.curBegin, ovlp.curRange(),
-								 qrySeq, ovlp.extBegin, ovlp.extRange(),
-								 /*match*/ 1, /*mm*/ -2, /*gap open*/ 2, 
-								 /*gap ext*/ 1, decodedCigar);
+		float errRate = alignOverlap(ovlp, trgSeq, qrySeq, decodedCigar);
 
 		//visualize alignents if needed
 		if (showAlignment)
@@ -183,14 +204,8 @@ namespace
 			std::vector<uint8_t> qryByte;
 			trgByte.assign(ovlp.curRange(), 0);
 			qryByte.assign(ovlp.extRange(), 0);
-			for (size_t i = 0; i < (size_t)ovlp.curRange(); ++i)
-			{
-				trgByte[i] = trgSeq.atRaw(i + ovlp.curBegin);
-			}
-			for (size_t i = 0; i < (size_t)ovlp.extRange(); ++i)
-			{
-				qryByte[i] = qrySeq.atRaw(i + ovlp.extBegin);
-			}
+			trgSeq.copyRaw(ovlp.curBegin, ovlp.curRange(), trgByte.data());
+			qrySeq.copyRaw(ovlp.extBegin, ovlp.extRange(), qryByte.data());
 
 			std::string strQ;
 			std::string strT;
@@ -252,10 +267,7 @@ namespace
 						int32_t minOverlap, bool showAlignment)
 	{
 		std::vector<CigOp> decodedCigar;
-		float errRate = kswAlign(trgSeq, ovlp.curBegin, ovlp.curRange(),
-								 qrySeq, ovlp.extBegin, ovlp.extRange(),
-								 /*match*/ 1, /*mm*/ -2, /*gap open*/ 2, 
-								 /*gap ext*/ 1, decodedCigar);
+		float errRate = alignOverlap(ovlp, trgSeq, qrySeq, decodedCigar);
 		//the original alignment is already passing the threshold
 		ovlp.seqDivergence = errRate;
 		if (errRate < maxDivergence) 
@@ -263,104 +275,85 @@ namespace
 			return {ovlp};
 		}
 
-		//if not, then...
-
-		//precomputing some stuff
-		std::vector<int> sumMatches;
-		sumMatches.reserve(decodedCigar.size() + 1);
-		sumMatches.push_back(0);
-		std::vector<int> sumLength;
-		sumLength.reserve(decodedCigar.size() + 1);
-		sumLength.push_back(0);
-		for (auto op : decodedCigar)
-		{
-			sumLength.push_back(sumLength.back() + op.len);
-			int match = (op.op == '=') ? op.len : 0;
-			sumMatches.push_back(sumMatches.back() + match);
-		}
-
-		std::vector<std::pair<int, int>> goodIntervals;
+		//if not, find the high-identity segments of the alignment.
+		//Each CIGAR operation gets a score, so that a segment has positive
+		//score iff its divergence is below the threshold, and the
+		//maximal scoring segments are found in a single pass (Ruzzo & Tompa)
 		const float EPS = 0.005;
+		const double matchRate = 1.0 - (maxDivergence - EPS);
 
-		for (int intLen = (int)decodedCigar.size(); intLen > 0; --intLen)
+		//segment of operations [first, last]. Cumulative score before
+		//and after it, and the closest segment to the left with lower
+		//cumulative score before
+		struct Segment
+		{
+			int first;
+			int last;
+			double leftScore;
+			double rightScore;
+			int prev;
+		};
+		std::vector<Segment> segments;
+
+		//also precomputing the positions and the matches before each op
+		std::vector<int> sumMatches(decodedCigar.size() + 1, 0);
+		std::vector<int> sumLength(decodedCigar.size() + 1, 0);
+		std::vector<int> sumTrg(decodedCigar.size() + 1, 0);
+		std::vector<int> sumQry(decodedCigar.size() + 1, 0);
+		double cumScore = 0;
+		for (int i = 0; i < (int)decodedCigar.size(); ++i)
 		{
-			for (int intStart = 0; 
-				intStart < (int)decodedCigar.size() - intLen + 1; ++intStart)
+			const auto& op = decodedCigar[i];
+			bool isMatch = (op.op == '=');
+			sumLength[i + 1] = sumLength[i] + op.len;
+			sumMatches[i + 1] = sumMatches[i] + (isMatch ? op.len : 0);
+			sumTrg[i + 1] = sumTrg[i] + (op.op != 'I' ? op.len : 0);
+			sumQry[i + 1] = sumQry[i] + (op.op != 'D' ? op.len : 0);
+
+			double opScore = isMatch ? op.len * (1 - matchRate) : 
+									   -op.len * matchRate;
+			if (!isMatch)
 			{
-				int i = intStart;
-				int j = intStart + intLen - 1;
-				int rangeLen = sumLength[j + 1] - sumLength[i];
-				int rangeMatch = sumMatches[j + 1] - sumMatches[i];
-				if (1.0f - float(rangeMatch) / rangeLen < maxDivergence - EPS)
-				{
-					if (j - i >= 1) goodIntervals.emplace_back(i, j);
-				}
+				cumScore += opScore;
+				continue;
 			}
-		}
 
-		//select non-intersecting set
-		std::vector<std::pair<int, int>> nonIntersecting;
-		for (auto& interval : goodIntervals)
-		{
-			bool intersects = false;
-			for (auto& otherInt : nonIntersecting)
+			Segment newSeg = {i, i, cumScore, cumScore + opScore, -1};
+			cumScore += opScore;
+			while (true)
 			{
-				int ovl = std::min(interval.second, otherInt.second) - 
-						std::max(interval.first, otherInt.first);
-				if (ovl > 0) 
+				//the rightmost segment with lower score before it
+				int j = (int)segments.size() - 1;
+				while (j >= 0 && segments[j].leftScore >= newSeg.leftScore)
 				{
-					intersects = true;
+					j = segments[j].prev;
+				}
+				if (j < 0 || segments[j].rightScore >= newSeg.rightScore)
+				{
+					newSeg.prev = j;
+					segments.push_back(newSeg);
 					break;
 				}
+				//otherwise, merge with everything from j
+				newSeg.first = segments[j].first;
+				newSeg.leftScore = segments[j].leftScore;
+				segments.resize(j);
 			}
-			if (!intersects) nonIntersecting.push_back(interval);
 		}
 
-		//now, for each interesting interval ajust boundaries and check the
-		//actual sequence length
 		std::vector<OverlapRange> trimmedAlignments;
-		for (auto intCand : nonIntersecting)
+		for (const auto& seg : segments)
 		{
-			while (intCand.first < (int)decodedCigar.size() && 
-				   decodedCigar[intCand.first].op != '=') ++intCand.first;
-			while (intCand.second > 0 && 
-				   decodedCigar[intCand.second].op != '=') ++intCand.second;
-			if (intCand.second - intCand.first < 1) continue;
-
-			int rangeLen = sumLength[intCand.second + 1] - sumLength[intCand.first];
-			int rangeMatch = sumMatches[intCand.second + 1] - sumMatches[intCand.first];
+			int rangeLen = sumLength[seg.last + 1] - sumLength[seg.first];
+			int rangeMatch = sumMatches[seg.last + 1] - sumMatches[seg.first];
 			float newDivergence = 1.0f - float(rangeMatch) / rangeLen;
 
 			OverlapRange newOvlp = ovlp;
 			newOvlp.seqDivergence = newDivergence;
-			size_t posQry = 0;
-			size_t posTrg = 0;
-			for (int i = 0; i < (int)decodedCigar.size(); ++i)
-			{
-				if (decodedCigar[i].op == '=' || decodedCigar[i].op == 'X')
-				{
-					posQry += decodedCigar[i].len;
-					posTrg += decodedCigar[i].len;
-				}
-				else if (decodedCigar[i].op == 'I')
-				{
-					posQry += decodedCigar[i].len;
-				}
-				else
-				{
-					posTrg += decodedCigar[i].len;
-				}
-				if (i == intCand.first)
-				{
-					newOvlp.curBegin += posTrg;
-					newOvlp.extBegin += posQry;
-				}
-				if (i == intCand.second)
-				{
-					newOvlp.curEnd = ovlp.curBegin + posTrg;
-					newOvlp.extEnd = ovlp.extBegin + posQry;
-				}
-			}
+			newOvlp.curBegin = ovlp.curBegin + sumTrg[seg.first];
+			newOvlp.extBegin = ovlp.extBegin + sumQry[seg.first];
+			newOvlp.curEnd = ovlp.curBegin + sumTrg[seg.last + 1];
+			newOvlp.extEnd = ovlp.extBegin + sumQry[seg.last + 1];
 			//TODO: updating score and k-mer matches?
 			
 			if (newOvlp.curRange() > minOverlap &&
@@ -391,6 +384,16 @@ namespace
 	}
 }
 
+float OverlapDetector::kswAlign(const DnaSequence& trgSeq, size_t trgBegin,
+							   size_t trgLen, const DnaSequence& qrySeq,
+							   size_t qryBegin, size_t qryLen, int matchScore,
+							   int misScore, int gapOpen, int gapExtend,
+							   std::vector<CigOp>& cigarOut)
+{
+	return ::kswAlign(trgSeq, trgBegin, trgLen, qrySeq, qryBegin, qryLen,
+					  matchScore, misScore, gapOpen, gapExtend, cigarOut);
+}
+
 //Check if it is a proper overlap
 bool OverlapDetector::overlapTest(const OverlapRange& ovlp,
 								  bool& outSuggestChimeric) const
@@ -474,16 +477,17 @@ namespace
 
 //This implementation was inspired by Heng Li's minimap2 paper
 //might be used in parallel
+template <size_t K>
 std::vector<OverlapRange> 
-OverlapDetector::getSeqOverlaps(const FastaRecord& fastaRec, 
-								bool& outSuggestChimeric,
-								OvlpDivStats& divStats,
-								int maxOverlaps) const
+OverlapDetector::getSeqOverlapsImpl(const FastaRecord& fastaRec, 
+									bool& outSuggestChimeric,
+									OvlpDivStats& divStats,
+									int maxOverlaps) const
 {
 	//static std::ofstream fout("../kmers.txt");
 	
 	//const int MAX_LOOK_BACK = 50;
-	const int kmerSize = Parameters::get().kmerSize;
+	const int kmerSize = ::kmerSize<K>();
 	//const float minKmerSruvivalRate = std::exp(-_maxDivergence * kmerSize);
 	const float minKmerSruvivalRate = 0.01;
 	const float LG_GAP = 2;
@@ -503,38 +507,27 @@ OverlapDetector::getSeqOverlaps(const FastaRecord& fastaRec,
 	static ChunkPool<KmerMatch> sharedChunkPool;	//shared accoress threads
 	BFContainer<KmerMatch> vecMatches(sharedChunkPool);
 
-	//speed benchmarks
-	thread_local float timeMemory = 0;
-	thread_local float timeKmerIndexFirst = 0;
-	thread_local float timeKmerIndexSecond = 0;
-	thread_local float timeDp = 0;
-	auto timeStart = std::chrono::system_clock::now();
-
-	/*static std::mutex reportMutex;
-	thread_local int threadId = rand() % 1000; 
-	thread_local int numTicks = 0;
-	++numTicks;
-	thread_local auto prevReport = std::chrono::system_clock::now();
-	if ((std::chrono::system_clock::now() - prevReport) > 
-		std::chrono::seconds(60))
+	//per-thread time of the overlap stages, reported by the profiler
+	static const size_t CNT_CALLS = 
+		Profiler::get().registerCounter("overlap_calls");
+	static const size_t CNT_MEMORY = 
+		Profiler::get().registerCounter("overlap_memory_sec");
+	static const size_t CNT_KMER_FIRST = 
+		Profiler::get().registerCounter("overlap_kmer_index_first_sec");
+	static const size_t CNT_KMER_SECOND = 
+		Profiler::get().registerCounter("overlap_kmer_index_second_sec");
+	static const size_t CNT_DP = 
+		Profiler::get().registerCounter("overlap_dp_sec");
+	Profiler::get().addCounter(CNT_CALLS, 1);
+	auto timeStart = std::chrono::steady_clock::now();
+	auto addTime = [&timeStart](size_t counterId)
 	{
-		std::lock_guard<std::mutex> lock(reportMutex);
-		prevReport = std::chrono::system_clock::now();
-		Logger::get().debug() << ">Perf " << threadId
-			<< " mem:" << timeMemory
-			<< " kmFst:" << timeKmerIndexFirst 
-			<< " kmSnd:" << timeKmerIndexSecond 
-			<< " dp:" << timeDp << " ticks: " << numTicks; 
-		Logger::get().debug() << ">Mem  " << threadId 
-			<< " chunks:" << sharedChunkPool.numberChunks();
-
-		timeMemory = 0;
-		timeKmerIndexFirst = 0;
-		timeKmerIndexSecond = 0;
-		timeDp = 0;
-		numTicks = 0;
-	}*/
-	timeStart = std::chrono::system_clock::now();
+		auto timeNow = std::chrono::steady_clock::now();
+		Profiler::get().addCounter(counterId, 
+			std::chrono::duration_cast<std::chrono::duration<double>>
+				(timeNow - timeStart).count());
+		timeStart = timeNow;
+	};
 
 	//although once in a while shrink allocated memory size
 	//thread_local auto prevCleanup = 
@@ -547,11 +540,9 @@ OverlapDetector::getSeqOverlaps(const FastaRecord& fastaRec,
 		shrinkAndClear(scoreTable, 2);
 		shrinkAndClear(backtrackTable, 2);
 	}
-	timeMemory += std::chrono::duration_cast<std::chrono::duration<float>>
-						(std::chrono::system_clock::now() - timeStart).count();
-	timeStart = std::chrono::system_clock::now();
+	addTime(CNT_MEMORY);
 
-	for (const auto& curKmerPos : IterKmers(fastaRec.sequence))
+	for (const auto& curKmerPos : SizedIterKmers<K>(fastaRec.sequence))
 	{
 		if (_vertexIndex.isRepetitive(curKmerPos.kmer))
 		{
@@ -571,18 +562,14 @@ OverlapDetector::getSeqOverlaps(const FastaRecord& fastaRec,
 									extReadPos.readId);
 		}
 	}
-	timeKmerIndexFirst += std::chrono::duration_cast<std::chrono::duration<float>>
-							(std::chrono::system_clock::now() - timeStart).count();
-	timeStart = std::chrono::system_clock::now();
+	addTime(CNT_KMER_FIRST);
 
 	std::sort(vecMatches.begin(), vecMatches.end(),
 			  [](const KmerMatch& k1, const KmerMatch& k2)
 			  {return k1.extId != k2.extId ? k1.extId < k2.extId : 
 			  								 k1.curPos < k2.curPos;});
 
-	timeKmerIndexSecond += std::chrono::duration_cast<std::chrono::duration<float>>
-								(std::chrono::system_clock::now() - timeStart).count();
-	timeStart = std::chrono::system_clock::now();
+	addTime(CNT_KMER_SECOND);
 
 	const int STAT_WND = 10000;
 	std::vector<OverlapRange> divStatWindows(curLen / STAT_WND + 1);
@@ -897,9 +884,7 @@ OverlapDetector::getSeqOverlaps(const FastaRecord& fastaRec,
 		}
 	}
 
-	timeDp += std::chrono::duration_cast<std::chrono::duration<float>>
-				(std::chrono::system_clock::now() - timeStart).count();
-	timeStart = std::chrono::system_clock::now();
+	addTime(CNT_DP);
 
 	for (const auto& ovlp : divStatWindows)
 	{
@@ -911,11 +896,20 @@ OverlapDetector::getSeqOverlaps(const FastaRecord& fastaRec,
 	return detectedOverlaps;
 }
 
+std::vector<OverlapRange> 
+OverlapDetector::getSeqOverlaps(const FastaRecord& fastaRec, 
+								bool& outSuggestChimeric,
+								OvlpDivStats& divStats,
+								int maxOverlaps) const
+{
+	KMER_SIZE_DISPATCH(this->getSeqOverlapsImpl, fastaRec, outSuggestChimeric,
+					   divStats, maxOverlaps);
+}
+
 bool OverlapContainer::hasSelfOverlaps(FastaRecord::Id readId)
 {
-	this->lazySeqOverlaps(readId);
 	if (!readId.strand()) readId = readId.rc();
-	return _overlapIndex.find(readId).suggestChimeric;
+	return this->cachedSeqOverlaps(readId).suggestChimeric;
 }
 
 
@@ -930,18 +924,29 @@ std::vector<OverlapRange>
 
 const std::vector<OverlapRange>&
 	OverlapContainer::lazySeqOverlaps(FastaRecord::Id readId)
+{
+	return *this->sharedSeqOverlaps(readId);
+}
+
+OverlapContainer::OverlapsPtr
+	OverlapContainer::sharedSeqOverlaps(FastaRecord::Id readId)
 {
 	bool flipped = !readId.strand();
 	if (flipped) readId = readId.rc();
-	IndexVecWrapper wrapper;
+	IndexVecWrapper wrapper = this->cachedSeqOverlaps(readId);
+	if (!flipped) return wrapper.fwdOverlaps;
+	return wrapper.revOverlaps;
+}
 
-	//upsert creates default value if it does not exist
-	_overlapIndex.upsert(readId, 	
-		[&wrapper](IndexVecWrapper& val)
-			{wrapper = val;});
-	if (wrapper.cached)
+//returns the stored overlaps of the read (forward strand),
+//computes and stores them if necessary
+OverlapContainer::IndexVecWrapper 
+	OverlapContainer::cachedSeqOverlaps(FastaRecord::Id readId)
+{
+	IndexVecWrapper wrapper;
+	if (_overlapIndex.find(readId, wrapper) && wrapper.cached)
 	{
-		return !flipped ? *wrapper.fwdOverlaps : *wrapper.revOverlaps;
+		return wrapper;
 	}
 
 	//otherwise, need to compute overlaps.
@@ -953,26 +958,55 @@ const std::vector<OverlapRange>&
 											   _ovlpDetect._maxCurOverlaps);
 	overlaps.shrink_to_fit();
 
-	std::vector<OverlapRange> revOverlaps;
-	revOverlaps.reserve(overlaps.size());
-	for (const auto& ovlp : overlaps) revOverlaps.push_back(ovlp.complement());
+	IndexVecWrapper computed;
+	computed.revOverlaps->reserve(overlaps.size());
+	for (const auto& ovlp : overlaps) 
+	{
+		computed.revOverlaps->push_back(ovlp.complement());
+	}
+	*computed.fwdOverlaps = std::move(overlaps);
+	computed.suggestChimeric = suggestChimeric;
+	computed.cached = true;
 
-	_overlapIndex.update_fn(readId,
-		[&wrapper, &overlaps, &revOverlaps, &suggestChimeric, &flipped, this]
-		(IndexVecWrapper& val)
+	//another thread might have stored the same overlaps meanwhile
+	bool inserted = _overlapIndex.upsert(readId, 	
+		[&wrapper, &computed, this] (IndexVecWrapper& val)
 		{
 			if (!val.cached)
 			{
-				_indexSize += overlaps.size();
-				*val.fwdOverlaps = std::move(overlaps);
-				*val.revOverlaps = std::move(revOverlaps);
-				val.suggestChimeric = suggestChimeric;
-				val.cached = true;
+				_indexSize += computed.fwdOverlaps->size();
+				val = computed;
 			}
 			wrapper = val;
-		});
+		}, computed);
+	if (inserted)
+	{
+		_indexSize += computed.fwdOverlaps->size();
+		wrapper = computed;
+	}
+
+	return wrapper;
+}
 
-	return !flipped ? *wrapper.fwdOverlaps : *wrapper.revOverlaps;
+size_t OverlapContainer::evictOverlaps(std::function<bool(FastaRecord::Id)> 
+									   canEvict)
+{
+	auto lockedIndex = _overlapIndex.lock_table();
+	std::vector<FastaRecord::Id> evicted;
+	size_t targetSize = _cacheCapacity / 2;
+	size_t evictedSize = 0;
+	for (const auto& seqIt : lockedIndex)
+	{
+		if (_indexSize - evictedSize <= targetSize) break;
+		if (!seqIt.second.cached || !canEvict(seqIt.first)) continue;
+
+		evicted.push_back(seqIt.first);
+		evictedSize += seqIt.second.fwdOverlaps->size();
+	}
+	//the vectors are not freed while someone still holds them
+	for (auto& readId : evicted) lockedIndex.erase(readId);
+	_indexSize -= evictedSize;
+	return evicted.size();
 }
 
 void OverlapContainer::ensureTransitivity(bool onlyMaxExt)
@@ -1031,6 +1065,7 @@ void OverlapContainer::ensureTransitivity(bool onlyMaxExt)
 
 void OverlapContainer::findAllOverlaps()
 {
+	ScopedTimer timer("overlap");
 	//Logger::get().info() << "Finding overlaps:";
 	std::vector<FastaRecord::Id> allQueries;
 	for (const auto& seq : _queryContainer.iterSeqs())
@@ -1184,7 +1219,7 @@ void OverlapContainer::estimateOverlaperParameters()
 
 		//set the parameters and reset statistics
 		_ovlpDetect._estimatorBias = _kmerIdyEstimateBias;
-		_divergenceStats.vecSize = 0;
+		_divergenceStats.clear();
 	}
 	else
 	{
@@ -1214,24 +1249,24 @@ void OverlapContainer::overlapDivergenceStats()
 void OverlapContainer::overlapDivergenceStats(const OvlpDivStats& stats,
 											  float divCutoff)
 {
-	std::vector<float> ovlpDivergence(stats.divVec.begin(),
-									  stats.divVec.begin() + stats.vecSize);
+	QuantileSketch ovlpDivergence = stats.merged();
 	const int HIST_LENGTH = 100;
 	const int HIST_HEIGHT = 20;
 	const float HIST_MIN = 0;
 	const float HIST_MAX = 0.5;
 	const float mult = HIST_LENGTH / (HIST_MAX * 100);
-	std::vector<int> histogram(HIST_LENGTH, 0);
-	for (float d : ovlpDivergence)
+	std::vector<uint64_t> histogram(HIST_LENGTH, 0);
+	ovlpDivergence.forEachBin([&histogram, mult, HIST_MIN, HIST_MAX]
+							  (double d, uint64_t count)
 	{
 		if (HIST_MIN <= d && d < HIST_MAX) 
 		{
-			++histogram[int(d * mult * 100)];
+			histogram[int(d * mult * 100)] += count;
 		}
-	}
-	int histMax = 1;
+	});
+	uint64_t histMax = 1;
 	int threshold = divCutoff * mult * 100;
-	for (int freq : histogram) histMax = std::max(histMax, freq);
+	for (uint64_t freq : histogram) histMax = std::max(histMax, freq);
 
 	std::string histString = "\n";
 	for (int height = HIST_HEIGHT - 1; height >= 0; --height)
@@ -1265,12 +1300,12 @@ void OverlapContainer::overlapDivergenceStats(const OvlpDivStats& stats,
 	histString += "    " + footer + "\n";
 
 	Logger::get().info() << "Median overlap divergence: " 
-		<< quantile(ovlpDivergence, 50); 
+		<< ovlpDivergence.median(); 
 	Logger::get().debug() << "Sequence divergence distribution: \n" << histString
 		<< "\n    Q25 = " << std::setprecision(2)
-		<< quantile(ovlpDivergence, 25) << ", Q50 = " 
-		<< quantile(ovlpDivergence, 50)
-		<< ", Q75 = " << quantile(ovlpDivergence, 75) << "\n"
+		<< ovlpDivergence.quantile(25) << ", Q50 = " 
+		<< ovlpDivergence.median()
+		<< ", Q75 = " << ovlpDivergence.quantile(75) << "\n"
 		<< std::setprecision(6);
 }
 
@@ -7,6 +7,7 @@
 #include <unordered_set>
 #include <mutex>
 #include <sstream>
+#include <functional>
 
 #include <cuckoohash_map.hh>
 #include "IntervalTree.h"
@@ -15,6 +16,7 @@
 #include "sequence_container.h"
 #include "../common/logger.h"
 #include "../common/progress_bar.h"
+#include "../common/quantile_sketch.h"
 
 
 struct OverlapRange
@@ -194,34 +196,18 @@ struct OverlapRange
 
 
 
-struct OvlpDivStats
-{
-	static const size_t MAX_STATS = 1000000;
-	OvlpDivStats(): divVec(MAX_STATS), vecSize(0) {}
-	
-	void add(float val)
-	{
-		size_t expected = 0;
-		while(true)
-		{
-			expected = vecSize;
-			if (expected == MAX_STATS) 
-			{
-				return;
-			}
-			if (vecSize.compare_exchange_weak(expected, expected + 1))
-			{
-				break;
-			}
-		}
-		assert(expected < divVec.size());
-		divVec[expected] = val;
-	}
+//divergence of the detected overlaps, updated from multiple threads
+typedef ConcurrentQuantileSketch OvlpDivStats;
 
-	std::vector<float>  divVec;
-	std::atomic<size_t> vecSize;
+struct CigOp
+{
+	char op;
+	int len;
 };
 
+//Alignment divergence, where indels are counted up to the k-mer size
+float cigarDivergence(const std::vector<CigOp>& cigar);
+
 class OverlapDetector
 {
 public:
@@ -248,6 +234,15 @@ public:
 	{
 	}
 
+	//Nucleotide-level alignment of the two sequence ranges (ksw2, banded
+	//extension mode). Returns the divergence estimate (indels are counted
+	//up to the k-mer size), the decoded CIGAR is written to cigarOut
+	static float kswAlign(const DnaSequence& trgSeq, size_t trgBegin,
+						  size_t trgLen, const DnaSequence& qrySeq,
+						  size_t qryBegin, size_t qryLen, int matchScore,
+						  int misScore, int gapOpen, int gapExtend,
+						  std::vector<CigOp>& cigarOut);
+
 	friend class OverlapContainer;
 
 private:
@@ -256,6 +251,13 @@ private:
 				   bool& outSuggestChiemeric,
 				   OvlpDivStats& divergenceStats,
 				   int maxOverlaps) const;
+	//specialized by the k-mer size (see kmer.h)
+	template <size_t K>
+	std::vector<OverlapRange> 
+	getSeqOverlapsImpl(const FastaRecord& fastaRec, 
+					   bool& outSuggestChiemeric,
+					   OvlpDivStats& divergenceStats,
+					   int maxOverlaps) const;
 
 	bool    overlapTest(const OverlapRange& ovlp, bool& outSuggestChimeric) const;
 	
@@ -288,6 +290,7 @@ public:
 		_ovlpDetect(ovlpDetect),
 		_queryContainer(queryContainer),
 		_indexSize(0),
+		_cacheCapacity(0),
 		_kmerIdyEstimateBias(0),
 		_meanTrueOvlpDiv(0)
 	{}
@@ -307,6 +310,7 @@ public:
 		bool suggestChimeric;
 	};
 	typedef cuckoohash_map<FastaRecord::Id, IndexVecWrapper> OverlapIndex;
+	typedef std::shared_ptr<const std::vector<OverlapRange>> OverlapsPtr;
 
 	//This conteiner is designed to find overlaps in parallel
 	//and store them dynamically. The first two functions
@@ -316,6 +320,11 @@ public:
 	//readId is simply referencing to the computed overlaps.
 	const std::vector<OverlapRange>& lazySeqOverlaps(FastaRecord::Id readId);
 
+	//Same as above, but the returned overlaps remain valid after
+	//they are evicted from the container. Should be used instead of
+	//lazySeqOverlaps() if the cache capacity is set
+	OverlapsPtr sharedSeqOverlaps(FastaRecord::Id readId);
+
 	//Checks if read has self-overlaps (for chimera detection)
 	bool hasSelfOverlaps(FastaRecord::Id seqId);
 
@@ -325,6 +334,20 @@ public:
 
 	size_t indexSize() {return _indexSize;}
 
+	//Bounds the number of stored overlaps (0 - no bound, default).
+	//The bound is not enforced automatically: once it is exceeded,
+	//the owner calls evictOverlaps() at the point where it knows
+	//which reads are no longer needed
+	void setCacheCapacity(size_t numOverlaps) {_cacheCapacity = numOverlaps;}
+	bool cacheOverflow() const 
+		{return _cacheCapacity > 0 && _indexSize > _cacheCapacity;}
+
+	//Removes stored overlaps of the reads (given by the forward strand)
+	//accepted by the predicate, until the index size drops to the half
+	//of the capacity. Evicted overlaps are recomputed on the next request.
+	//Returns the number of evicted reads
+	size_t evictOverlaps(std::function<bool(FastaRecord::Id)> canEvict);
+
 	void estimateOverlaperParameters();
 
 	void setRelativeDivergenceThreshold(float relThreshold);
@@ -349,6 +372,7 @@ public:
 
 private:
 	std::vector<OverlapRange>& unsafeSeqOverlaps(FastaRecord::Id);
+	IndexVecWrapper cachedSeqOverlaps(FastaRecord::Id readId);
 	//std::vector<OverlapRange>  seqOverlaps(FastaRecord::Id readId,
 	//									   bool& outSuggestChimeric) const;
 	void filterOverlaps();
@@ -359,6 +383,7 @@ private:
 	OvlpDivStats _divergenceStats;
 	OverlapIndex _overlapIndex;
 	std::atomic<size_t> _indexSize;
+	size_t _cacheCapacity;
 	std::unordered_map<FastaRecord::Id, 
 					   IntervalTree<const OverlapRange*>> _ovlpTree;
 
@@ -1,4 +1,6 @@
 #include "sequence.h"
 
 std::vector<size_t> DnaSequence::_dnaTable;
+DnaSequence::DecodeTable DnaSequence::_charTable;
+DnaSequence::DecodeTable DnaSequence::_idTable;
 DnaSequence::TableFiller DnaSequence::_filler;
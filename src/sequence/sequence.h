@@ -10,8 +10,21 @@
 #include <iostream>
 #include <algorithm>
 #include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
 
-//Immutable dna sequence class
+class SequenceArena;
+
+//Immutable dna sequence class. Sequences are 2-bit packed into a 
+//shared buffer, and each object is a view (offset, length, strand) over 
+//it, so copying, complementing and taking substrings do not copy the data.
+//Buffers are either reference counted (atomically, so sequences could be
+//copied from different threads), or owned by a SequenceArena. In the
+//latter case the object is a handle: copying it does not touch the buffer
+//at all. Handles do not own their buffer: a handle, and every copy,
+//complement or substring of it, is only valid as long as the arena 
+//(or the SequenceContainer that owns the arena) exists.
 class DnaSequence
 {
 public:
@@ -20,126 +33,135 @@ public:
 private:
 	static const int NUCL_BITS = 2;
 	static const int NUCL_IN_CHUNK = sizeof(NuclType) * 8 / NUCL_BITS;
+	//substrings shorter than 1 / COPY_RATE of the parent buffer 
+	//of at least MIN_COPY_PARENT nucleotides are copied (see substr)
+	static const size_t MIN_COPY_PARENT = 1024 * 1024;
+	static const size_t COPY_RATE = 4;
 
 	struct SharedBuffer
 	{
 		SharedBuffer(): useCount(0), length(0) {}
-		size_t useCount;
+		std::atomic<size_t> useCount;
 		size_t length;
 		std::vector<size_t> chunks;
 	};
 
 public:
 	DnaSequence():
-		_complement(false)
+		_data(emptyBuffer()), _offset(0), _length(0), 
+		_complement(false), _handle(true)
 	{
-		_data = new SharedBuffer;
-		++_data->useCount;
 	}
 
 	~DnaSequence()
 	{
-		if (_data != nullptr)
-		{
-			//std::cout << "Destructor!\n";
-			--_data->useCount;
-			if (_data->useCount == 0) 
-			{
-				//std::cout << "Deleting\n";
-				delete _data;
-			}
-		}
+		this->release();
 	}
 
 	explicit DnaSequence(const std::string& string):
-		_complement(false)
+		_offset(0), _length(string.length()), _complement(false),
+		_handle(false)
 	{
 		_data = new SharedBuffer;
-		++_data->useCount;
+		this->acquire();
 
 		if (string.empty()) return;
 
 		_data->length = string.length();
 		_data->chunks.assign((_data->length - 1) / NUCL_IN_CHUNK + 1, 0);
-		for (size_t i = 0; i < string.length(); ++i)
+		size_t pos = 0;
+		for (auto& chunk : _data->chunks)
 		{
-			size_t chunkId = i / NUCL_IN_CHUNK;
-			_data->chunks[chunkId] |= dnaToId(string[i]) << (i % NUCL_IN_CHUNK) * 2;
+			size_t chunkEnd = std::min(pos + NUCL_IN_CHUNK, string.length());
+			NuclType word = 0;
+			for (size_t i = chunkEnd; i > pos; --i)
+			{
+				word = (word << NUCL_BITS) | dnaToId(string[i - 1]);
+			}
+			chunk = word;
+			pos = chunkEnd;
 		}
 	}
 
 	DnaSequence(const DnaSequence& other):
 		_data(other._data),
-		_complement(other._complement)
+		_offset(other._offset),
+		_length(other._length),
+		_complement(other._complement),
+		_handle(other._handle)
 	{
-		++_data->useCount;
+		this->acquire();
 	}
 
 	DnaSequence(DnaSequence&& other):
 		_data(other._data),
-		_complement(other._complement)
+		_offset(other._offset),
+		_length(other._length),
+		_complement(other._complement),
+		_handle(other._handle)
 	{
-		other._data = nullptr;
+		other.reset();
 	}
 
 	DnaSequence& operator=(const DnaSequence& other)
 	{
-		--_data->useCount;
-		if (_data->useCount == 0) delete _data;
-
-		_complement = other._complement;
-		_data = other._data;
-		++_data->useCount;
-		return *this;
+		DnaSequence copy(other);
+		return *this = std::move(copy);
 	}
 
 	DnaSequence& operator=(DnaSequence&& other)
 	{
-		--_data->useCount;
-		if (_data->useCount == 0) delete _data;
+		if (this == &other) return *this;
+		this->release();
 
 		_data = other._data;
+		_offset = other._offset;
+		_length = other._length;
 		_complement = other._complement;
-		other._data = nullptr;
+		_handle = other._handle;
+		other.reset();
 		return *this;
 	}
 
-	size_t length() const {return _data->length;}
+	size_t length() const {return _length;}
 
 	char at(size_t index) const 
 	{
-		if (_complement)
-		{
-			index = _data->length - index - 1;
-		}
-		size_t id = (_data->chunks[index / NUCL_IN_CHUNK] >> 
-					 (index % NUCL_IN_CHUNK) * 2 ) & 3;
-		return idToDna(!_complement ? id : ~id & 3);
+		return idToDna(this->atRaw(index));
 	}
 
 	NuclType atRaw(size_t index) const 
 	{
-		if (_complement)
-		{
-			index = _data->length - index - 1;
-		}
-		size_t id = (_data->chunks[index / NUCL_IN_CHUNK] >> 
-					 (index % NUCL_IN_CHUNK) * 2 ) & 3;
+		size_t id = this->bufferId(this->bufferPos(index));
 		return !_complement ? id : ~id & 3;
 	}
 	
-	//TODO: use the same shared buffer
-	
 	DnaSequence complement() const
 	{
 		DnaSequence complSequence(*this);
-		complSequence._complement = true;
+		complSequence._complement = !_complement;
 		return complSequence;
 	}
 
+	//returns a view over the same buffer, without copying. The view 
+	//keeps the buffer alive, so a short substring of a large 
+	//reference-counted sequence is copied into its own buffer
 	DnaSequence substr(size_t start, size_t length) const;
 	std::string str() const;	
 
+	//decodes a part of the sequence into the nucleotide ids 
+	//(0-3, one byte per nucleotide)
+	void copyRaw(size_t start, size_t length, uint8_t* out) const
+	{
+		this->decode(start, length, out, _idTable);
+	}
+
+	//2-bit packed representation, used for the binary dumps: 
+	//4 nucleotides per byte, the first one in the lowest bits. 
+	//Takes (length + 3) / 4 bytes
+	void copyPacked(uint8_t* out) const;
+	static DnaSequence fromPacked(const uint8_t* data, size_t length);
+
 	static size_t dnaToId(char c)
 	{
 		return _dnaTable[(size_t)c];
@@ -152,7 +174,94 @@ public:
 	}
 
 private:
+	//4-nucleotide lookup tables for the bulk decoding: the packed byte 
+	//is converted into 4 output bytes at once, in the forward or
+	//in the reverse-complement orientation
+	struct DecodeTable
+	{
+		uint8_t single[4];
+		uint8_t forward[256][4];
+		uint8_t revComplement[256][4];
+
+		void fill(const uint8_t* symbols)
+		{
+			for (size_t i = 0; i < 4; ++i) single[i] = symbols[i];
+			for (size_t byte = 0; byte < 256; ++byte)
+			{
+				for (size_t i = 0; i < 4; ++i)
+				{
+					forward[byte][i] = symbols[(byte >> i * NUCL_BITS) & 3];
+					revComplement[byte][i] = 
+						symbols[~(byte >> (3 - i) * NUCL_BITS) & 3];
+				}
+			}
+		}
+	};
+
+	friend class SequenceArena;
+
+	DnaSequence(SharedBuffer* data, size_t length):
+		_data(data), _offset(0), _length(length), 
+		_complement(false), _handle(true)
+	{
+	}
+
+	SharedBuffer* copyBuffer() const;
+
+	void acquire()
+	{
+		if (!_handle) _data->useCount.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void release()
+	{
+		if (_data && !_handle && 
+			_data->useCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			delete _data;
+		}
+		_data = nullptr;
+	}
+
+	//moved-from objects are left as valid empty sequences
+	void reset()
+	{
+		_data = emptyBuffer();
+		_offset = 0;
+		_length = 0;
+		_complement = false;
+		_handle = true;
+	}
+
+	static SharedBuffer* emptyBuffer()
+	{
+		static SharedBuffer buffer;
+		return &buffer;
+	}
+
+	size_t bufferPos(size_t index) const
+	{
+		return !_complement ? _offset + index : _offset + _length - index - 1;
+	}
+
+	size_t bufferId(size_t bufPos) const
+	{
+		return (_data->chunks[bufPos / NUCL_IN_CHUNK] >> 
+				(bufPos % NUCL_IN_CHUNK) * NUCL_BITS) & 3;
+	}
+
+	uint8_t bufferByte(size_t bufPos) const
+	{
+		return (_data->chunks[bufPos / NUCL_IN_CHUNK] >> 
+				(bufPos % NUCL_IN_CHUNK) * NUCL_BITS) & 0xFF;
+	}
+
+	void decode(size_t start, size_t length, uint8_t* out,
+				const DecodeTable& table) const;
+
 	static std::vector<size_t> _dnaTable;
+	static DecodeTable _charTable;
+	static DecodeTable _idTable;
 
 	struct TableFiller
 	{
@@ -171,22 +280,106 @@ private:
 				_dnaTable[(size_t)'g'] = 2;
 				_dnaTable[(size_t)'T'] = 3;
 				_dnaTable[(size_t)'t'] = 3;
+
+				const uint8_t chars[] = {'A', 'C', 'G', 'T'};
+				const uint8_t ids[] = {0, 1, 2, 3};
+				_charTable.fill(chars);
+				_idTable.fill(ids);
 			}
 		}
 	};
 	static TableFiller _filler;
 
 	SharedBuffer* _data;
+	size_t _offset;
+	size_t _length;
 	bool _complement;
+	bool _handle;
+};
+
+//Owns immutable sequence buffers and gives out handles to them
+//(see DnaSequence). Sequences are copied into the arena, so the
+//handles do not keep any other buffer alive.
+class SequenceArena
+{
+public:
+	SequenceArena() {}
+	SequenceArena(const SequenceArena&) = delete;
+	SequenceArena& operator=(const SequenceArena&) = delete;
+
+	~SequenceArena()
+	{
+		for (auto buffer : _buffers) delete buffer;
+	}
+
+	DnaSequence store(const DnaSequence& sequence);
+
+private:
+	std::vector<DnaSequence::SharedBuffer*> _buffers;
 };
 
+//Decodes the view positions [start, start + length). Unaligned ends are
+//decoded one nucleotide at a time, and the rest - a packed byte 
+//(4 nucleotides) at a time. For the complement strand, the buffer
+//is traversed backwards and bytes are reverse-complemented by the table
+inline void DnaSequence::decode(size_t start, size_t length, uint8_t* out,
+								const DecodeTable& table) const
+{
+	const size_t NUCL_IN_BYTE = 8 / NUCL_BITS;
+	if (length == 0) return;
+	if (start + length > _length) 
+	{
+		throw std::runtime_error("Incorrect sequence range");
+	}
+
+	if (!_complement)
+	{
+		size_t pos = _offset + start;
+		size_t end = pos + length;
+		while (pos < end && pos % NUCL_IN_BYTE != 0)
+		{
+			*out++ = table.single[this->bufferId(pos++)];
+		}
+		while (pos + NUCL_IN_BYTE <= end)
+		{
+			memcpy(out, table.forward[this->bufferByte(pos)], NUCL_IN_BYTE);
+			out += NUCL_IN_BYTE;
+			pos += NUCL_IN_BYTE;
+		}
+		while (pos < end)
+		{
+			*out++ = table.single[this->bufferId(pos++)];
+		}
+	}
+	else
+	{
+		//buffer range [begin, pos) is traversed from right to left
+		size_t pos = this->bufferPos(start) + 1;
+		size_t begin = pos - length;
+		while (pos > begin && pos % NUCL_IN_BYTE != 0)
+		{
+			*out++ = table.single[~this->bufferId(--pos) & 3];
+		}
+		while (pos >= begin + NUCL_IN_BYTE)
+		{
+			pos -= NUCL_IN_BYTE;
+			memcpy(out, table.revComplement[this->bufferByte(pos)], 
+				   NUCL_IN_BYTE);
+			out += NUCL_IN_BYTE;
+		}
+		while (pos > begin)
+		{
+			*out++ = table.single[~this->bufferId(--pos) & 3];
+		}
+	}
+}
+
 inline std::string DnaSequence::str() const 
 {
-	std::string result;
-	result.reserve(this->length());
-	for (size_t i = 0; i < this->length(); ++i)
+	std::string result(_length, 0);
+	if (_length > 0)
 	{
-		result.push_back(this->at(i));
+		this->decode(0, _length, (uint8_t*)&result[0], _charTable);
 	}
 	return result;
 }
@@ -194,23 +387,119 @@ inline std::string DnaSequence::str() const
 inline DnaSequence DnaSequence::substr(size_t start, size_t length) const 
 {
 	if (length == 0) throw std::runtime_error("Zero length subtring");
-	if (start >= _data->length) throw std::runtime_error("Incorrect substring start");
+	if (start >= _length) throw std::runtime_error("Incorrect substring start");
 
-	if (start + length > _data->length)
+	if (start + length > _length)
 	{
-		length = _data->length - start;
+		length = _length - start;
 	}
 
-	DnaSequence newSequence;
-	newSequence._data->length = length;
-	newSequence._data->chunks.assign((length - 1) / NUCL_IN_CHUNK + 1, 0);
+	DnaSequence newSequence(*this);
+	newSequence._length = length;
+	newSequence._offset = !_complement ? _offset + start : 
+						  _offset + _length - start - length;
 
-	for (size_t i = 0; i < length; ++i)
+	//a view keeps the whole parent buffer alive, so short pieces of
+	//large buffers are copied instead. Arena buffers live as long as
+	//the arena anyway, so handles are always views
+	if (!_handle && _data->length >= MIN_COPY_PARENT &&
+		length < _data->length / COPY_RATE)
 	{
-		size_t nucId = this->atRaw(start + i);
-		size_t newChunkId = i / NUCL_IN_CHUNK;
-		newSequence._data->chunks[newChunkId] |= nucId << (i % NUCL_IN_CHUNK) * 2;
+		DnaSequence copy(newSequence.copyBuffer(), length);
+		copy._handle = false;
+		copy._complement = _complement;
+		copy.acquire();
+		return copy;
 	}
-
 	return newSequence;
 }
+
+inline void DnaSequence::copyPacked(uint8_t* out) const
+{
+	const size_t NUCL_IN_BYTE = 8 / NUCL_BITS;
+	const size_t BLOCK_SIZE = 1024;
+	uint8_t block[BLOCK_SIZE];
+
+	memset(out, 0, (_length + NUCL_IN_BYTE - 1) / NUCL_IN_BYTE);
+	for (size_t start = 0; start < _length; start += BLOCK_SIZE)
+	{
+		size_t blockLen = std::min(BLOCK_SIZE, _length - start);
+		this->decode(start, blockLen, block, _idTable);
+		for (size_t i = 0; i < blockLen; ++i)
+		{
+			size_t pos = start + i;
+			out[pos / NUCL_IN_BYTE] |= 
+				block[i] << (pos % NUCL_IN_BYTE * NUCL_BITS);
+		}
+	}
+}
+
+inline DnaSequence DnaSequence::fromPacked(const uint8_t* data, size_t length)
+{
+	const size_t NUCL_IN_BYTE = 8 / NUCL_BITS;
+	const size_t BYTES_IN_CHUNK = sizeof(NuclType);
+
+	DnaSequence sequence((std::string()));
+	if (length == 0) return sequence;
+
+	sequence._length = length;
+	sequence._data->length = length;
+	sequence._data->chunks.assign((length - 1) / NUCL_IN_CHUNK + 1, 0);
+	size_t numBytes = (length - 1) / NUCL_IN_BYTE + 1;
+	for (size_t i = 0; i < numBytes; ++i)
+	{
+		sequence._data->chunks[i / BYTES_IN_CHUNK] |= 
+			(NuclType)data[i] << (i % BYTES_IN_CHUNK * 8);
+	}
+	size_t tailNucl = length % NUCL_IN_CHUNK;
+	if (tailNucl > 0)
+	{
+		sequence._data->chunks.back() &= 
+			((NuclType)1 << tailNucl * NUCL_BITS) - 1;
+	}
+	return sequence;
+}
+
+//Copies the data of the view into a new (unowned) buffer, a word at 
+//a time: each output word is combined from the two overlapping input words.
+//The data itself is not complemented, so the copy has the same strand.
+inline DnaSequence::SharedBuffer* DnaSequence::copyBuffer() const
+{
+	const size_t WORD_BITS = sizeof(NuclType) * 8;
+
+	auto buffer = new SharedBuffer;
+	if (_length == 0) return buffer;
+
+	const auto& srcChunks = _data->chunks;
+	size_t firstChunk = _offset / NUCL_IN_CHUNK;
+	size_t shift = (_offset % NUCL_IN_CHUNK) * NUCL_BITS;
+
+	buffer->length = _length;
+	buffer->chunks.assign((buffer->length - 1) / NUCL_IN_CHUNK + 1, 0);
+	for (size_t i = 0; i < buffer->chunks.size(); ++i)
+	{
+		NuclType word = srcChunks[firstChunk + i] >> shift;
+		if (shift > 0 && firstChunk + i + 1 < srcChunks.size())
+		{
+			word |= srcChunks[firstChunk + i + 1] << (WORD_BITS - shift);
+		}
+		buffer->chunks[i] = word;
+	}
+	size_t tailNucl = buffer->length % NUCL_IN_CHUNK;
+	if (tailNucl > 0)
+	{
+		buffer->chunks.back() &= ((NuclType)1 << tailNucl * NUCL_BITS) - 1;
+	}
+	return buffer;
+}
+
+//Copies the sequence view into a new arena buffer. The strand of
+//the view is kept
+inline DnaSequence SequenceArena::store(const DnaSequence& sequence)
+{
+	auto buffer = sequence.copyBuffer();
+	_buffers.push_back(buffer);
+	DnaSequence handle(buffer, sequence.length());
+	handle._complement = sequence._complement;
+	return handle;
+}
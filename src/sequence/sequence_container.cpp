@@ -12,6 +12,7 @@
 
 #include "sequence_container.h"
 #include "../common/logger.h"
+#include "../common/profiler.h"
 
 size_t SequenceContainer::g_nextSeqId = 0;
 
@@ -59,8 +60,8 @@ FastaRecord::Id SequenceContainer::addSequence(const FastaRecord& seqRec)
 	}
 	g_nextSeqId += 2;
 
-	_seqIndex.emplace_back(seqRec.sequence, "+" + seqRec.description, 
-						   newId);
+	DnaSequence storedSeq = _arena.store(seqRec.sequence);
+	_seqIndex.emplace_back(storedSeq, "+" + seqRec.description, newId);
 
 	if (_nameIndex.count(_seqIndex.back().description))
 	{
@@ -71,7 +72,7 @@ FastaRecord::Id SequenceContainer::addSequence(const FastaRecord& seqRec)
 	}
 	_nameIndex[_seqIndex.back().description] = _seqIndex.back().id;
 
-	_seqIndex.emplace_back(seqRec.sequence.complement(), 
+	_seqIndex.emplace_back(storedSeq.complement(), 
 						   "-" + seqRec.description, newId.rc());
 	_nameIndex[_seqIndex.back().description] = _seqIndex.back().id;
 
@@ -81,6 +82,7 @@ FastaRecord::Id SequenceContainer::addSequence(const FastaRecord& seqRec)
 void SequenceContainer::loadFromFile(const std::string& fileName, 
 									 int minReadLength)
 {
+	ScopedTimer timer("sequence_loading");
 	std::vector<FastaRecord> records;
 	if (this->isFasta(fileName))
 	{
@@ -103,6 +105,7 @@ void SequenceContainer::loadFromFile(const std::string& fileName,
 		{
 			this->addSequence(records[i]);
 		}
+		records[i].sequence = DnaSequence();	//the copy is in the arena now
 	}
 }
 
@@ -360,6 +363,8 @@ void SequenceContainer::buildPositionIndex()
 {
 	Logger::get().debug() << "Building positional index";
 	size_t offset = 0;
+	_sequenceOffsets.clear();
+	_offsetsHint.clear();
 	_sequenceOffsets.reserve(_seqIndex.size());
 	for (const auto& seq : _seqIndex)
 	{
@@ -44,6 +44,10 @@ struct FastaRecord
 		int signedId() const
 			{return (_id % 2) ? -((int)_id + 1) / 2 : (int)_id / 2 + 1;}
 
+		//non-negative index, suitable for dense arrays
+		size_t index() const
+			{return _id;}
+
 		friend std::ostream& operator << (std::ostream& stream, const Id& id)
 		{
 			stream << std::to_string(id._id);
@@ -256,6 +260,10 @@ private:
 
 	void   validateHeader(std::string& header);
 
+	//record sequences are handles to the arena-owned buffers, so
+	//the records could be freely copied between threads. They (and their
+	//substrings) must not outlive the container
+	SequenceArena	_arena;
 	SequenceIndex 	_seqIndex;
 	size_t 			_seqIdOffest;
 	bool   			_offsetInitialized;
@@ -12,10 +12,14 @@
 #include "../common/logger.h"
 #include "../common/parallel.h"
 #include "../common/config.h"
+#include "../common/profiler.h"
+#include "../common/memory_budget.h"
 
 
-void VertexIndex::countKmers(size_t hardThreshold, int genomeSize)
+template <size_t K>
+void VertexIndex::countKmersImpl(size_t hardThreshold, int genomeSize)
 {
+	ScopedTimer timer("kmer_counting");
 	if (Parameters::get().kmerSize > 31)
 	{
 		throw std::runtime_error("Maximum k-mer size is 31");
@@ -34,7 +38,16 @@ void VertexIndex::countKmers(size_t hardThreshold, int genomeSize)
 	{
 		preCountSize *= 4 * 4;					//16G in case of larger genomes
 	}
+	//under the memory limit, the filter is made smaller. This only
+	//increases the number of false positive k-mers that are
+	//passed to the exact counting
+	const size_t MIN_PRECOUNT = 64 * 1024 * 1024;
+	preCountSize = MemoryBudget::get().share(preCountSize, /*fraction*/ 0.5,
+											 MIN_PRECOUNT);
+	Logger::get().debug() << "K-mer filter size: " 
+		<< preCountSize / 1024 / 1024 << " Mb";
 	auto preCounters = new std::atomic<unsigned char>[preCountSize];
+	MemoryBudget::get().reserve(preCountSize);
 	for (size_t i = 0; i < preCountSize; ++i) preCounters[i] = 0;
 
 	std::vector<FastaRecord::Id> allReads;
@@ -52,7 +65,7 @@ void VertexIndex::countKmers(size_t hardThreshold, int genomeSize)
 		if (!readId.strand()) return;
 		
 		int32_t nextKmerPos = _sampleRate;
-		for (auto kmerPos : IterKmers(_seqContainer.getSeq(readId)))
+		for (auto kmerPos : SizedIterKmers<K>(_seqContainer.getSeq(readId)))
 		{
 			if (_sampleRate > 1) //subsampling
 			{
@@ -61,12 +74,12 @@ void VertexIndex::countKmers(size_t hardThreshold, int genomeSize)
 					(int32_t)((kmerPos.kmer.hash() ^ readId.hash()) % 3) - 1;
 			}
 
-			bool revCmp = kmerPos.kmer.standardForm();
+			bool revCmp = kmerPos.kmer.template standardForm<K>();
 			if (revCmp)
 			{
 				kmerPos.position = _seqContainer.seqLen(readId) - 
 										kmerPos.position -
-										Parameters::get().kmerSize;
+										kmerSize<K>();
 			}
 			size_t kmerBucket = kmerPos.kmer.hash() % preCountSize;
 
@@ -99,7 +112,7 @@ void VertexIndex::countKmers(size_t hardThreshold, int genomeSize)
 		if (!readId.strand()) return;
 
 		int32_t nextKmerPos = _sampleRate;
-		for (auto kmerPos : IterKmers(_seqContainer.getSeq(readId)))
+		for (auto kmerPos : SizedIterKmers<K>(_seqContainer.getSeq(readId)))
 		{
 			if (_sampleRate > 1) //subsampling
 			{
@@ -108,7 +121,7 @@ void VertexIndex::countKmers(size_t hardThreshold, int genomeSize)
 					(int32_t)((kmerPos.kmer.hash() ^ readId.hash()) % 3) - 1;
 			}
 
-			kmerPos.kmer.standardForm();
+			kmerPos.kmer.template standardForm<K>();
 			/*if (revCmp)
 			{
 				kmerPos.position = _seqContainer.seqLen(readId) - 
@@ -132,6 +145,12 @@ void VertexIndex::countKmers(size_t hardThreshold, int genomeSize)
 		_repetitiveFrequency = std::max(_repetitiveFrequency, kmer.second);
 	}
 	delete[] preCounters;
+	MemoryBudget::get().release(preCountSize);
+}
+
+void VertexIndex::countKmers(size_t hardThreshold, int genomeSize)
+{
+	KMER_SIZE_DISPATCH(this->countKmersImpl, hardThreshold, genomeSize);
 }
 
 namespace
@@ -144,9 +163,12 @@ namespace
 	};
 }
 
-void VertexIndex::buildIndexUnevenCoverage(int minCoverage, float selectRate,
-										   int tandemFreq)
+template <size_t K>
+void VertexIndex::buildIndexUnevenCoverageImpl(int minCoverage, 
+											   float selectRate,
+											   int tandemFreq)
 {
+	ScopedTimer timer("index_fill");
 	//_solidMultiplier = 2;
 	_solidMultiplier = 1;
 
@@ -169,9 +191,9 @@ void VertexIndex::buildIndexUnevenCoverage(int minCoverage, float selectRate,
 		std::vector<KmerFreq> topKmers;
 		topKmers.reserve(_seqContainer.seqLen(readId));
 
-		for (auto kmerPos : IterKmers(_seqContainer.getSeq(readId)))
+		for (auto kmerPos : SizedIterKmers<K>(_seqContainer.getSeq(readId)))
 		{
-			kmerPos.kmer.standardForm();
+			kmerPos.kmer.template standardForm<K>();
 			size_t freq = 1;
 			_kmerCounts.find(kmerPos.kmer, freq);
 
@@ -200,7 +222,7 @@ void VertexIndex::buildIndexUnevenCoverage(int minCoverage, float selectRate,
 	processInParallel(allReads, initializeIndex, 
 					  Parameters::get().numThreads, _outputProgress);
 	
-	_memoryChunks.push_back(new IndexChunk[MEM_CHUNK]);
+	this->addMemoryChunk();
 	size_t chunkOffset = 0;
 	//Important: since packed structures are apparently not thread-safe,
 	//make sure that adjacent k-mer index arrays (that are accessed in parallel)
@@ -214,12 +236,17 @@ void VertexIndex::buildIndexUnevenCoverage(int minCoverage, float selectRate,
 		}
 		if (MEM_CHUNK - chunkOffset < kmer.second.capacity + PADDING)
 		{
-			_memoryChunks.push_back(new IndexChunk[MEM_CHUNK]);
+			this->addMemoryChunk();
 			chunkOffset = 0;
 		}
 		kmer.second.data = _memoryChunks.back() + chunkOffset;
 		chunkOffset += kmer.second.capacity + PADDING;
 	}
+	//the index can not be spilled, so only report it
+	if (MemoryBudget::get().underPressure())
+	{
+		Logger::get().warning() << "K-mer index does not fit into the memory limit";
+	}
 
 	if (_outputProgress) Logger::get().info() << "Filling index table (2/2)";
 	std::function<void(const FastaRecord::Id&)> indexUpdate = 
@@ -232,10 +259,10 @@ void VertexIndex::buildIndexUnevenCoverage(int minCoverage, float selectRate,
 		std::vector<KmerFreq> topKmers;
 		topKmers.reserve(_seqContainer.seqLen(readId));
 
-		for (const auto& kmerPos : IterKmers(_seqContainer.getSeq(readId)))
+		for (const auto& kmerPos : SizedIterKmers<K>(_seqContainer.getSeq(readId)))
 		{
 			auto stdKmer = kmerPos.kmer;
-			stdKmer.standardForm();
+			stdKmer.template standardForm<K>();
 			size_t freq = 1;
 			_kmerCounts.find(stdKmer, freq);
 
@@ -256,12 +283,12 @@ void VertexIndex::buildIndexUnevenCoverage(int minCoverage, float selectRate,
 
 			KmerPosition kmerPos(kmerFreq.kmer, kmerFreq.position);
 			FastaRecord::Id targetRead = readId;
-			bool revCmp = kmerPos.kmer.standardForm();
+			bool revCmp = kmerPos.kmer.template standardForm<K>();
 			if (revCmp)
 			{
 				kmerPos.position = _seqContainer.seqLen(readId) - 
 										kmerPos.position -
-										Parameters::get().kmerSize;
+										kmerSize<K>();
 				targetRead = targetRead.rc();
 			}
 
@@ -308,6 +335,13 @@ void VertexIndex::buildIndexUnevenCoverage(int minCoverage, float selectRate,
 	Logger::get().debug() << "Index size: " << totalEntries;
 }
 
+void VertexIndex::buildIndexUnevenCoverage(int minCoverage, float selectRate,
+										   int tandemFreq)
+{
+	KMER_SIZE_DISPATCH(this->buildIndexUnevenCoverageImpl, 
+					   minCoverage, selectRate, tandemFreq);
+}
+
 namespace
 {
 	template <class T>
@@ -353,8 +387,10 @@ void VertexIndex::setRepeatCutoff(int minCoverage)
 						  filteredRate << ")";
 }
 
-void VertexIndex::buildIndex(int minCoverage)
+template <size_t K>
+void VertexIndex::buildIndexImpl(int minCoverage)
 {
+	ScopedTimer timer("index_fill");
 	if (_outputProgress) Logger::get().info() << "Filling index table";
 	_solidMultiplier = 1;
 	
@@ -396,7 +432,7 @@ void VertexIndex::buildIndex(int minCoverage)
 	_kmerCounts.clear();
 	_kmerCounts.reserve(0);
 
-	_memoryChunks.push_back(new IndexChunk[MEM_CHUNK]);
+	this->addMemoryChunk();
 	size_t chunkOffset = 0;
 	//Important: since packed structures are apparently not thread-safe,
 	//make sure that adjacent k-mer index arrays (that are accessed in parallel)
@@ -410,12 +446,17 @@ void VertexIndex::buildIndex(int minCoverage)
 		}
 		if (MEM_CHUNK - chunkOffset < kmer.second.capacity + PADDING)
 		{
-			_memoryChunks.push_back(new IndexChunk[MEM_CHUNK]);
+			this->addMemoryChunk();
 			chunkOffset = 0;
 		}
 		kmer.second.data = _memoryChunks.back() + chunkOffset;
 		chunkOffset += kmer.second.capacity + PADDING;
 	}
+	//the index can not be spilled, so only report it
+	if (MemoryBudget::get().underPressure())
+	{
+		Logger::get().warning() << "K-mer index does not fit into the memory limit";
+	}
 	//Logger::get().debug() << "Total chunks " << _memoryChunks.size()
 	//	<< " wasted space: " << wasted;
 
@@ -426,7 +467,7 @@ void VertexIndex::buildIndex(int minCoverage)
 
 		int32_t nextKmerPos = _sampleRate;
 		//int32_t seqLen = _seqContainer.seqLen(readId);
-		for (auto kmerPos : IterKmers(_seqContainer.getSeq(readId)))
+		for (auto kmerPos : SizedIterKmers<K>(_seqContainer.getSeq(readId)))
 		{
 			if (_sampleRate > 1) //subsampling
 			{
@@ -436,12 +477,12 @@ void VertexIndex::buildIndex(int minCoverage)
 			}
 
 			FastaRecord::Id targetRead = readId;
-			bool revCmp = kmerPos.kmer.standardForm();
+			bool revCmp = kmerPos.kmer.template standardForm<K>();
 			if (revCmp)
 			{
 				kmerPos.position = _seqContainer.seqLen(readId) - 
 										kmerPos.position -
-										Parameters::get().kmerSize;
+										kmerSize<K>();
 				targetRead = targetRead.rc();
 			}
 			
@@ -475,10 +516,23 @@ void VertexIndex::buildIndex(int minCoverage)
 	}
 }
 
+void VertexIndex::buildIndex(int minCoverage)
+{
+	KMER_SIZE_DISPATCH(this->buildIndexImpl, minCoverage);
+}
+
+
+void VertexIndex::addMemoryChunk()
+{
+	_memoryChunks.push_back(new IndexChunk[MEM_CHUNK]);
+	MemoryBudget::get().reserve(MEM_CHUNK * sizeof(IndexChunk));
+}
 
 void VertexIndex::clear()
 {
 	for (auto& chunk : _memoryChunks) delete[] chunk;
+	MemoryBudget::get().release(_memoryChunks.size() * MEM_CHUNK * 
+								sizeof(IndexChunk));
 	_memoryChunks.clear();
 
 	_kmerIndex.clear();
@@ -214,6 +214,16 @@ public:
 
 private:
 	void addFastaSequence(const FastaRecord& fastaRecord);
+	void addMemoryChunk();
+
+	//implementations, specialized by the k-mer size (see kmer.h)
+	template <size_t K> 
+	void countKmersImpl(size_t hardThreshold, int genomeSize);
+	template <size_t K> 
+	void buildIndexImpl(int minCoverage);
+	template <size_t K> 
+	void buildIndexUnevenCoverageImpl(int minCoverage, float selectRate, 
+									  int tandemFreq);
 
 	const SequenceContainer& _seqContainer;
 	KmerDistribution 		 _kmerDistribution;
@@ -0,0 +1,383 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+#include <limits>
+#include <algorithm>
+#include <cstring>
+
+#include "wfa_align.h"
+
+
+namespace
+{
+	const int32_t NULL_OFFSET = std::numeric_limits<int32_t>::min() / 4;
+
+	//adaptive wavefront reduction: the diagonals that are lagging
+	//behind the best one by more than the threshold are dropped
+	const int32_t MIN_WAVEFRONT_LENGTH = 10;
+	const int32_t MAX_DISTANCE_THRESHOLD = 50;
+
+	//furthest reaching offsets on diagonals [lo, hi]. The offset
+	//is the target position, the diagonal is (target pos - query pos).
+	//Offsets are stored in the aligner's arena, starting from
+	//the diagonal "base" (lo / hi might be shrinked by the reduction)
+	struct Wavefront
+	{
+		Wavefront(): lo(0), hi(-1), base(0), start(0) {}
+		bool empty() const {return hi < lo;}
+
+		int32_t lo;
+		int32_t hi;
+		int32_t base;
+		size_t  start;
+	};
+
+	struct WavefrontSet
+	{
+		Wavefront mat;	//ending with a match / mismatch
+		Wavefront ins;	//ending with an insertion (query only)
+		Wavefront del;	//ending with a deletion (target only)
+	};
+
+	class WavefrontAligner
+	{
+	public:
+		WavefrontAligner(const std::vector<uint8_t>& trg,
+						 const std::vector<uint8_t>& qry,
+						 int mismatch, int gapOpen, int gapExtend,
+						 std::vector<int32_t>& arena,
+						 std::vector<WavefrontSet>& wavefronts):
+			_trg(trg), _qry(qry), _trgLen(trg.size()), _qryLen(qry.size()),
+			_endDiag(_trgLen - _qryLen), _mismatch(mismatch),
+			_gapOpen(gapOpen), _gapExtend(gapExtend), _finalScore(-1),
+			_arena(arena), _wavefronts(wavefronts)
+		{
+			_arena.clear();
+			_wavefronts.clear();
+		}
+
+		bool align(int32_t maxScore)
+		{
+			WavefrontSet first;
+			first.mat = this->allocate(0, 0);
+			_arena[first.mat.start] = 0;
+			_wavefronts.push_back(first);
+
+			for (int32_t score = 0; score <= maxScore; ++score)
+			{
+				if (score > 0) this->computeNext(score);
+				WavefrontSet& cur = _wavefronts[score];
+				if (cur.mat.empty()) continue;
+
+				this->extend(cur.mat);
+				if (this->get(cur.mat, _endDiag) == _trgLen)
+				{
+					_finalScore = score;
+					return true;
+				}
+				this->reduce(cur);
+			}
+			return false;
+		}
+
+		//run-length encoded CIGAR of the computed alignment
+		void traceback(std::vector<CigOp>& cigarOut) const
+		{
+			cigarOut.clear();
+			auto emit = [&cigarOut](char op, int len)
+			{
+				if (len <= 0) return;
+				if (!cigarOut.empty() && cigarOut.back().op == op)
+				{
+					cigarOut.back().len += len;
+				}
+				else
+				{
+					cigarOut.push_back({op, len});
+				}
+			};
+
+			//going backwards from the end of the alignment
+			int32_t score = _finalScore;
+			int32_t diag = _endDiag;
+			int32_t offset = _trgLen;
+			char state = 'M';
+			while (true)
+			{
+				if (state == 'M')
+				{
+					if (score == 0)
+					{
+						emit('=', offset);
+						break;
+					}
+					const WavefrontSet& cur = _wavefronts[score];
+					int32_t mis = this->checked(this->get(this->at(score - _mismatch)
+														  .mat, diag) + 1, diag);
+					int32_t ins = this->get(cur.ins, diag);
+					int32_t del = this->get(cur.del, diag);
+					int32_t best = std::max(mis, std::max(ins, del));
+
+					emit('=', offset - best);
+					offset = best;
+					if (best == mis)
+					{
+						emit('X', 1);
+						--offset;
+						score -= _mismatch;
+					}
+					else if (best == del)
+					{
+						state = 'D';
+					}
+					else
+					{
+						state = 'I';
+					}
+				}
+				else if (state == 'D')
+				{
+					emit('D', 1);
+					int32_t fromMat = this->checked(this->get(this->at(score - _gapOpen -
+											_gapExtend).mat, diag - 1) + 1, diag);
+					if (fromMat == offset)
+					{
+						score -= _gapOpen + _gapExtend;
+						state = 'M';
+					}
+					else
+					{
+						score -= _gapExtend;
+					}
+					--offset;
+					--diag;
+				}
+				else
+				{
+					emit('I', 1);
+					int32_t fromMat = this->checked(this->get(this->at(score - _gapOpen -
+											_gapExtend).mat, diag + 1), diag);
+					if (fromMat == offset)
+					{
+						score -= _gapOpen + _gapExtend;
+						state = 'M';
+					}
+					else
+					{
+						score -= _gapExtend;
+					}
+					++diag;
+				}
+			}
+			std::reverse(cigarOut.begin(), cigarOut.end());
+		}
+
+	private:
+		const WavefrontSet& at(int32_t score) const
+		{
+			static const WavefrontSet EMPTY;
+			if (score < 0) return EMPTY;
+			return _wavefronts[score];
+		}
+
+		int32_t get(const Wavefront& wf, int32_t diag) const
+		{
+			if (diag < wf.lo || diag > wf.hi) return NULL_OFFSET;
+			return _arena[wf.start + diag - wf.base];
+		}
+
+		//the offset if it is within both sequences, NULL_OFFSET otherwise
+		int32_t checked(int32_t offset, int32_t diag) const
+		{
+			int32_t qryPos = offset - diag;
+			if (offset < 0 || offset > _trgLen ||
+				qryPos < 0 || qryPos > _qryLen) return NULL_OFFSET;
+			return offset;
+		}
+
+		Wavefront allocate(int32_t lo, int32_t hi)
+		{
+			Wavefront wf;
+			wf.lo = lo;
+			wf.hi = hi;
+			wf.base = lo;
+			wf.start = _arena.size();
+			_arena.resize(_arena.size() + hi - lo + 1, NULL_OFFSET);
+			return wf;
+		}
+
+		void computeNext(int32_t score)
+		{
+			const WavefrontSet& sub = this->at(score - _mismatch);
+			const WavefrontSet& open = this->at(score - _gapOpen - _gapExtend);
+			const WavefrontSet& ext = this->at(score - _gapExtend);
+
+			int32_t lo = std::numeric_limits<int32_t>::max();
+			int32_t hi = std::numeric_limits<int32_t>::min();
+			auto widen = [&lo, &hi](const Wavefront& wf, int32_t shift)
+			{
+				if (wf.empty()) return;
+				lo = std::min(lo, wf.lo + shift);
+				hi = std::max(hi, wf.hi + shift);
+			};
+			widen(sub.mat, 0);
+			widen(open.mat, -1);
+			widen(open.mat, 1);
+			widen(ext.ins, -1);
+			widen(ext.del, 1);
+
+			WavefrontSet next;
+			if (lo <= hi)
+			{
+				next.mat = this->allocate(lo, hi);
+				next.ins = this->allocate(lo, hi);
+				next.del = this->allocate(lo, hi);
+				for (int32_t diag = lo; diag <= hi; ++diag)
+				{
+					int32_t ins = std::max(
+						this->checked(this->get(open.mat, diag + 1), diag),
+						this->checked(this->get(ext.ins, diag + 1), diag));
+					int32_t del = std::max(
+						this->checked(this->get(open.mat, diag - 1) + 1, diag),
+						this->checked(this->get(ext.del, diag - 1) + 1, diag));
+					int32_t mis =
+						this->checked(this->get(sub.mat, diag) + 1, diag);
+
+					size_t idx = diag - lo;
+					_arena[next.ins.start + idx] = ins;
+					_arena[next.del.start + idx] = del;
+					_arena[next.mat.start + idx] = std::max(mis, std::max(ins, del));
+				}
+			}
+			_wavefronts.push_back(next);
+		}
+
+		//slides along the diagonals over the exact matches,
+		//comparing 8 bases at a time
+		void extend(Wavefront& wf)
+		{
+			for (int32_t diag = wf.lo; diag <= wf.hi; ++diag)
+			{
+				int32_t& offset = _arena[wf.start + diag - wf.base];
+				if (offset < 0) continue;
+
+				int32_t trgPos = offset;
+				int32_t qryPos = offset - diag;
+				while (trgPos < _trgLen && qryPos < _qryLen)
+				{
+					if (trgPos + 8 <= _trgLen && qryPos + 8 <= _qryLen)
+					{
+						uint64_t trgWord = 0;
+						uint64_t qryWord = 0;
+						memcpy(&trgWord, &_trg[trgPos], sizeof(uint64_t));
+						memcpy(&qryWord, &_qry[qryPos], sizeof(uint64_t));
+						uint64_t diff = trgWord ^ qryWord;
+						if (diff == 0)
+						{
+							trgPos += 8;
+							qryPos += 8;
+							continue;
+						}
+						int32_t matched = __builtin_ctzll(diff) / 8;
+						trgPos += matched;
+						qryPos += matched;
+						break;
+					}
+					if (_trg[trgPos] != _qry[qryPos]) break;
+					++trgPos;
+					++qryPos;
+				}
+				offset = trgPos;
+			}
+		}
+
+		void reduce(WavefrontSet& wfSet)
+		{
+			Wavefront& mat = wfSet.mat;
+			if (mat.hi - mat.lo + 1 < MIN_WAVEFRONT_LENGTH) return;
+
+			auto distance = [this, &mat](int32_t diag)
+			{
+				int32_t offset = this->get(mat, diag);
+				if (offset < 0) return std::numeric_limits<int32_t>::max();
+				return std::max(_trgLen - offset, _qryLen - (offset - diag));
+			};
+			int32_t minDist = std::numeric_limits<int32_t>::max();
+			for (int32_t diag = mat.lo; diag <= mat.hi; ++diag)
+			{
+				minDist = std::min(minDist, distance(diag));
+			}
+			auto lagging = [minDist, &distance](int32_t diag)
+			{
+				return distance(diag) - minDist > MAX_DISTANCE_THRESHOLD;
+			};
+
+			int32_t newLo = mat.lo;
+			while (newLo < mat.hi && lagging(newLo)) ++newLo;
+			int32_t newHi = mat.hi;
+			while (newHi > newLo && lagging(newHi)) --newHi;
+			for (Wavefront* wf : {&wfSet.mat, &wfSet.ins, &wfSet.del})
+			{
+				wf->lo = std::max(wf->lo, newLo);
+				wf->hi = std::min(wf->hi, newHi);
+			}
+		}
+
+		const std::vector<uint8_t>& _trg;
+		const std::vector<uint8_t>& _qry;
+		const int32_t _trgLen;
+		const int32_t _qryLen;
+		const int32_t _endDiag;
+		const int32_t _mismatch;
+		const int32_t _gapOpen;
+		const int32_t _gapExtend;
+		int32_t 	  _finalScore;
+
+		std::vector<int32_t>& 	   _arena;
+		std::vector<WavefrontSet>& _wavefronts;
+	};
+}
+
+bool wfaAlign(const DnaSequence& trgSeq, size_t trgBegin, size_t trgLen,
+			  const DnaSequence& qrySeq, size_t qryBegin, size_t qryLen,
+			  int matchScore, int misScore, int gapOpen, int gapExtend,
+			  float maxDivergence, std::vector<CigOp>& cigarOut,
+			  float& errRate)
+{
+	thread_local std::vector<uint8_t> trgByte;
+	thread_local std::vector<uint8_t> qryByte;
+	thread_local std::vector<int32_t> arena;
+	thread_local std::vector<WavefrontSet> wavefronts;
+	trgByte.assign(trgLen, 0);
+	qryByte.assign(qryLen, 0);
+	trgSeq.copyRaw(trgBegin, trgLen, trgByte.data());
+	qrySeq.copyRaw(qryBegin, qryLen, qryByte.data());
+
+	//converting the match score into penalties: for a global
+	//alignment, maximizing the score is equivalent to minimizing
+	//the doubled penalties below (Eizenga & Paten)
+	int mismatch = 2 * (matchScore + std::abs(misScore));
+	int open = 2 * gapOpen;
+	int extend = 2 * gapExtend + matchScore;
+
+	int32_t maxScore = maxDivergence * std::max(trgLen, qryLen) *
+					   std::max(mismatch, open + extend);
+	WavefrontAligner aligner(trgByte, qryByte, mismatch, open, extend,
+							 arena, wavefronts);
+	bool aligned = aligner.align(maxScore);
+	if (aligned)
+	{
+		aligner.traceback(cigarOut);
+		errRate = cigarDivergence(cigarOut);
+	}
+
+	//do not keep the memory after the large alignments
+	const size_t MAX_ARENA = 1 << 24;
+	if (arena.capacity() > MAX_ARENA)
+	{
+		std::vector<int32_t>().swap(arena);
+		std::vector<WavefrontSet>().swap(wavefronts);
+	}
+	return aligned;
+}
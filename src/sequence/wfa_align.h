@@ -0,0 +1,29 @@
+//(c) 2019 by Authors
+//This file is a part of the Flye program.
+//Released under the BSD license (see LICENSE file)
+
+//Gap-affine wavefront alignment (WFA). Instead of filling a band of the
+//DP matrix, the aligner keeps for each score only the furthest reaching
+//point on every diagonal and jumps over the exact matches, so the
+//time is O(n s), where s is the alignment score. This makes it much faster
+//than the banded ksw2 alignment for the similar sequences (HiFi/corrected
+//reads, assembled contigs), but slower for the noisy ones
+
+#pragma once
+
+#include <vector>
+
+#include "overlap.h"
+
+//Global alignment of the two sequence ranges, with the same scoring
+//scheme as kswAlign (gap of length l costs gapOpen + l * gapExtend).
+//Long-lagging diagonals are dropped (adaptive wavefront reduction),
+//so the alignment might be slightly suboptimal in rare cases.
+//Returns false if the sequences are more divergent than maxDivergence
+//(the alignment is not computed then). Otherwise, the CIGAR is written
+//to cigarOut, and the divergence estimate (same as in kswAlign) to errRate
+bool wfaAlign(const DnaSequence& trgSeq, size_t trgBegin, size_t trgLen,
+			  const DnaSequence& qrySeq, size_t qryBegin, size_t qryLen,
+			  int matchScore, int misScore, int gapOpen, int gapExtend,
+			  float maxDivergence, std::vector<CigOp>& cigarOut,
+			  float& errRate);